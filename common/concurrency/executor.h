@@ -26,6 +26,7 @@
 #include "../utility/string.h"
 #include "../utility/move_on_copy.h"
 #include "../log/log.h"
+#include "thread_info.h"
 
 #include <tbb/atomic.h>
 #include <tbb/concurrent_queue.h>
@@ -58,6 +59,7 @@ class executor : boost::noncopyable
 	const std::string name_;
 	boost::thread thread_;
 	tbb::atomic<bool> is_running_;
+	tbb::atomic<unsigned int> task_count_;
 	
 	typedef tbb::concurrent_bounded_queue<std::function<void()>> function_queue;
 	function_queue execution_queue_[priority_count];
@@ -87,6 +89,7 @@ public:
 	explicit executor(const std::wstring& name) : name_(narrow(name)) // noexcept
 	{
 		is_running_ = true;
+		task_count_ = 0;
 		thread_ = boost::thread([this]{run();});
 	}
 	
@@ -151,10 +154,14 @@ public:
 
 		auto future = task_adaptor.value.get_future();
 
+		auto sample_rate = get_task_sample_rate();
+		auto queued		 = sample_rate > 0 && task_count_.fetch_and_increment() % sample_rate == 0 ? get_task_timestamp() : 0;
+
 		execution_queue_[priority].push([=]
 		{
 			try
 			{
+				task_timer timer(queued, queued != 0 ? static_cast<size_t>(std::max<std::ptrdiff_t>(0, size())) : 0);
 				task_adaptor.value();
 			}
 			catch(boost::task_already_started&)
@@ -198,6 +205,7 @@ public:
 	function_queue::size_type size() const /*noexcept*/ { return execution_queue_[normal_priority].size();	}
 	bool empty() const /*noexcept*/	{ return execution_queue_[normal_priority].empty();	}
 	bool is_running() const /*noexcept*/ { return is_running_; }	
+	bool is_current() const /*noexcept*/ { return boost::this_thread::get_id() == thread_.get_id(); }
 	const std::string& name() const { return name_; }
 		
 private:
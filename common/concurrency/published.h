@@ -0,0 +1,62 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <tbb/spin_mutex.h>
+
+#include <memory>
+
+namespace caspar {
+
+// Latest immutable snapshot of some state, published by the thread owning the
+// state and read by any thread without going through the owner's executor.
+// Readers only hold the spin lock for the duration of a reference count 
+// increment; superseded snapshots are released outside of it.
+template<typename T>
+class published : boost::noncopyable
+{
+	mutable tbb::spin_mutex		mutex_;
+	std::shared_ptr<const T>	value_;
+public:
+	published()
+		: value_(std::make_shared<T>())
+	{
+	}
+
+	void publish(T&& value)
+	{
+		std::shared_ptr<const T> new_value = std::make_shared<T>(std::move(value));
+		{
+			tbb::spin_mutex::scoped_lock lock(mutex_);
+			value_.swap(new_value);
+		}
+	}
+
+	std::shared_ptr<const T> get() const
+	{
+		tbb::spin_mutex::scoped_lock lock(mutex_);
+		return value_;
+	}
+};
+
+}
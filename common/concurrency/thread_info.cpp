@@ -23,14 +23,35 @@
 
 #include "thread_info.h"
 
+#include "../utility/string.h"
+
 #include <map>
 
 #include <boost/thread/tss.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 namespace caspar {
 
+namespace {
+
+int64_t query_frequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+}
+
+const double					g_seconds_per_tick = 1.0 / static_cast<double>(query_frequency());
+tbb::atomic<unsigned int>		g_task_sample_rate;
+
+// Upper bounds of the execution time histogram buckets in milliseconds. The last bucket takes the rest.
+const double					HISTOGRAM_BUCKETS[task_statistics::histogram_size - 1] = {0.1, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0, 40.0};
+
+}
+
 class enumerable_thread_infos
 {
 	boost::mutex												mutex_;
@@ -94,9 +115,121 @@ public:
 	}
 };
 
+task_statistics::task_statistics()
+	: samples(0)
+	, queue_depth(0)
+	, total_wait_time(0.0)
+	, max_wait_time(0.0)
+	, total_execution_time(0.0)
+	, max_execution_time(0.0)
+{
+	execution_histogram.fill(0);
+}
+
+std::wstring task_statistics::histogram_bucket_name(size_t bucket)
+{
+	return bucket < histogram_size - 1 
+		? L"under-" + boost::lexical_cast<std::wstring>(HISTOGRAM_BUCKETS[bucket]) + L"ms"
+		: L"over-" + boost::lexical_cast<std::wstring>(HISTOGRAM_BUCKETS[histogram_size - 2]) + L"ms";
+}
+
+thread_window::thread_window()
+	: duration(0.0)
+	, cpu_load(0.0)
+	, samples(0)
+	, queue_depth(0)
+	, average_wait_time(0.0)
+	, average_execution_time(0.0)
+	, max_execution_time(0.0)
+{
+}
+
 thread_info::thread_info()
 	: native_id(GetCurrentThreadId())
+	, window_start_(get_task_timestamp())
+	, window_start_cpu_time_(0.0)
+	, window_max_execution_time_(0.0)
+{
+	// The first window starts now rather than at the first sample.
+	window_start_cpu_time_ = cpu_time();
+}
+
+void thread_info::record_task(double wait_time, double execution_time, size_t queue_depth)
+{
+	size_t bucket = 0;
+	while(bucket < task_statistics::histogram_size - 1 && execution_time * 1000.0 >= HISTOGRAM_BUCKETS[bucket])
+		++bucket;
+
+	tbb::spin_mutex::scoped_lock lock(mutex_);
+
+	++stats_.samples;
+	stats_.queue_depth			 = queue_depth;
+	stats_.total_wait_time		+= wait_time;
+	stats_.max_wait_time		 = std::max(stats_.max_wait_time, wait_time);
+	stats_.total_execution_time += execution_time;
+	stats_.max_execution_time	 = std::max(stats_.max_execution_time, execution_time);
+	++stats_.execution_histogram[bucket];
+	window_max_execution_time_	 = std::max(window_max_execution_time_, execution_time);
+}
+
+task_statistics thread_info::task_stats() const
 {
+	tbb::spin_mutex::scoped_lock lock(mutex_);
+	return stats_;
+}
+
+double thread_info::cpu_time() const
+{
+	auto handle = OpenThread(THREAD_QUERY_INFORMATION, FALSE, static_cast<DWORD>(native_id));
+	if(!handle)
+		return 0.0;
+
+	FILETIME creation, exit, kernel, user;
+	auto result = GetThreadTimes(handle, &creation, &exit, &kernel, &user);
+	CloseHandle(handle);
+
+	if(!result)
+		return 0.0;
+
+	auto to_seconds = [](const FILETIME& time)
+	{
+		return static_cast<double>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100.0e-9;
+	};
+
+	return to_seconds(kernel) + to_seconds(user);
+}
+
+thread_window thread_info::last_window() const
+{
+	tbb::spin_mutex::scoped_lock lock(mutex_);
+	return window_;
+}
+
+void thread_info::close_window()
+{
+	auto cpu = cpu_time();
+	auto now = get_task_timestamp();
+
+	tbb::spin_mutex::scoped_lock lock(mutex_);
+
+	thread_window window;
+	window.duration		= task_timestamp_to_seconds(now - window_start_);
+	window.cpu_load		= window.duration > 0.0 ? (cpu - window_start_cpu_time_) / window.duration : 0.0;
+	window.samples		= stats_.samples - window_start_stats_.samples;
+	window.queue_depth	= stats_.queue_depth;
+
+	if(window.samples > 0)
+	{
+		window.average_wait_time		= (stats_.total_wait_time - window_start_stats_.total_wait_time) / window.samples;
+		window.average_execution_time	= (stats_.total_execution_time - window_start_stats_.total_execution_time) / window.samples;
+		window.max_execution_time		= window_max_execution_time_;
+	}
+
+	window_						= window;
+	window_start_				= now;
+	window_start_cpu_time_		= cpu;
+	window_start_stats_			= stats_;
+	window_max_execution_time_	= 0.0;
 }
 
 thread_info& get_thread_info()
@@ -109,4 +242,73 @@ std::vector<safe_ptr<thread_info>> get_thread_infos()
 	return enumerable_thread_infos::get_instance().get_thread_infos();
 }
 
+void sample_thread_infos()
+{
+	BOOST_FOREACH(auto& thread, get_thread_infos())
+		thread->close_window();
+}
+
+void set_task_sample_rate(unsigned int rate)
+{
+	g_task_sample_rate = rate;
+}
+
+unsigned int get_task_sample_rate()
+{
+	return g_task_sample_rate;
+}
+
+int64_t get_task_timestamp()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+double task_timestamp_to_seconds(int64_t timestamp)
+{
+	return static_cast<double>(timestamp) * g_seconds_per_tick;
+}
+
+boost::property_tree::wptree get_thread_profile_info()
+{
+	boost::property_tree::wptree info;
+	info.add(L"sample-rate", get_task_sample_rate());
+
+	BOOST_FOREACH(auto& thread, get_thread_infos())
+	{
+		auto stats	= thread->task_stats();
+		auto window	= thread->last_window();
+
+		boost::property_tree::wptree thread_info;
+		thread_info.add(L"id",				thread->native_id);
+		thread_info.add(L"name",			widen(thread->name));
+		thread_info.add(L"cpu-time",		thread->cpu_time());
+		thread_info.add(L"cpu-load",		window.cpu_load);
+
+		thread_info.add(L"window.duration",					window.duration);
+		thread_info.add(L"window.samples",					window.samples);
+		thread_info.add(L"window.average-wait-time",		window.average_wait_time);
+		thread_info.add(L"window.average-execution-time",	window.average_execution_time);
+		thread_info.add(L"window.max-execution-time",		window.max_execution_time);
+
+		if(stats.samples > 0)
+		{
+			thread_info.add(L"tasks.samples",				stats.samples);
+			thread_info.add(L"tasks.queue-depth",			stats.queue_depth);
+			thread_info.add(L"tasks.average-wait-time",		stats.total_wait_time / stats.samples);
+			thread_info.add(L"tasks.max-wait-time",			stats.max_wait_time);
+			thread_info.add(L"tasks.average-execution-time",stats.total_execution_time / stats.samples);
+			thread_info.add(L"tasks.max-execution-time",	stats.max_execution_time);
+
+			for(size_t n = 0; n < task_statistics::histogram_size; ++n)
+				thread_info.add(L"tasks.execution-histogram." + task_statistics::histogram_bucket_name(n), stats.execution_histogram[n]);
+		}
+
+		info.add_child(L"threads.thread", thread_info);
+	}
+
+	return info;
+}
+
 }
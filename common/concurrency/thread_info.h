@@ -21,25 +21,121 @@
 
 #pragma once
 
+#include <array>
 #include <string>
 #include <cstdint>
 #include <vector>
 
 #include "../memory/safe_ptr.h"
 
+#include <boost/property_tree/ptree_fwd.hpp>
+
 #include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
 
 namespace caspar {
 
+struct task_statistics
+{
+	static const size_t histogram_size = 9;
+
+	uint64_t								samples;
+	uint64_t								queue_depth;	// At the last sample.
+	double									total_wait_time;
+	double									max_wait_time;
+	double									total_execution_time;
+	double									max_execution_time;
+	std::array<uint64_t, histogram_size>	execution_histogram;
+
+	task_statistics();
+
+	static std::wstring histogram_bucket_name(size_t bucket);
+};
+
+// The figures of one sampling window, see sample_thread_infos.
+struct thread_window
+{
+	double		duration;				// Seconds, 0 until the first window has been closed.
+	double		cpu_load;				// Fraction of a core.
+	uint64_t	samples;
+	uint64_t	queue_depth;			// At the last sample.
+	double		average_wait_time;
+	double		average_execution_time;
+	double		max_execution_time;
+
+	thread_window();
+};
+
 struct thread_info
 {
 	std::string		name;
 	std::int64_t	native_id;
 
 	thread_info();
+
+	void			record_task(double wait_time, double execution_time, size_t queue_depth);
+	task_statistics	task_stats() const;		// Since the thread started.
+	thread_window	last_window() const;	// The last closed window, not changed by reading it.
+
+	double			cpu_time() const;		// User and kernel time in seconds.
+
+	void			close_window();			// Only called by sample_thread_infos.
+private:
+	mutable tbb::spin_mutex	mutex_;
+	task_statistics			stats_;
+	thread_window			window_;
+
+	int64_t					window_start_;
+	double					window_start_cpu_time_;
+	task_statistics			window_start_stats_;
+	double					window_max_execution_time_;
 };
 
 thread_info& get_thread_info();
 std::vector<safe_ptr<thread_info>> get_thread_infos();
 
+// Closes the current window of every thread. Called periodically from one
+// place only (the server's profiler timer), so that every reader sees the 
+// same windows.
+void sample_thread_infos();
+
+// Executor tasks are profiled one in every rate tasks, 1 profiles every task and 0 turns profiling off.
+void set_task_sample_rate(unsigned int rate);
+unsigned int get_task_sample_rate();
+
+int64_t get_task_timestamp();
+double task_timestamp_to_seconds(int64_t timestamp);
+
+// Records the queue wait and execution time of an executor task on the executing thread.
+class task_timer
+{
+	const int64_t	queued_;
+	const int64_t	started_;
+	const size_t	queue_depth_;
+
+	task_timer(const task_timer&);
+	task_timer& operator=(const task_timer&);
+public:
+	// queued is 0 for tasks which are not sampled.
+	task_timer(int64_t queued, size_t queue_depth)
+		: queued_(queued)
+		, started_(queued != 0 ? get_task_timestamp() : 0)
+		, queue_depth_(queue_depth)
+	{
+	}
+
+	~task_timer()
+	{
+		if(queued_ != 0)
+		{
+			get_thread_info().record_task(
+					task_timestamp_to_seconds(started_ - queued_), 
+					task_timestamp_to_seconds(get_task_timestamp() - started_), 
+					queue_depth_);
+		}
+	}
+};
+
+boost::property_tree::wptree get_thread_profile_info();
+
 }
@@ -21,46 +21,19 @@
 
 #pragma once
 
-#include <assert.h>
-
-#include <cstring>
+#include <cstddef>
 
 namespace caspar {
 
-static void* fast_memclr(void* dest, size_t count)
-{
-	if(count < 2048)
-		return memset(dest, 0, count);
-
-	assert(dest != nullptr);
-	
-	size_t rest = count % 128;
-	count -= rest;
-
-	__asm   
-	{              
-		mov edi, dest;    
-		mov ebx, count;     
-		shr ebx, 7;
-		pxor xmm0, xmm0; 
+namespace detail {
 
-		clr:             
-			movntdq [edi+00h], xmm0;
-			movntdq [edi+10h], xmm0;
-			movntdq [edi+20h], xmm0;    
-			movntdq [edi+30h], xmm0;
-			
-			movntdq [edi+40h], xmm0; 
-			movntdq [edi+50h], xmm0;      
-			movntdq [edi+60h], xmm0;    
-			movntdq [edi+70h], xmm0;    
+void* fast_memclr(void* dest, size_t count, int max_concurrency);
 
-			lea edi, [edi+80h];         
+}
 
-			dec ebx;      
-		jnz clr;  
-	}   
-	return memset(reinterpret_cast<char*>(dest)+count, 0, rest);
+inline void* fast_memclr(void* dest, size_t count)
+{
+	return detail::fast_memclr(dest, count, 0);
 }
 
-}
\ No newline at end of file
+}
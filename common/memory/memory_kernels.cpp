@@ -0,0 +1,554 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../stdafx.h"
+
+#include "memory_kernels.h"
+
+#include "memclr.h"
+#include "memcpy.h"
+#include "memshfl.h"
+
+#include "../exception/exceptions.h"
+#include "../os/windows/system_info.h"
+#include "../utility/assert.h"
+
+#include <boost/foreach.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_scheduler_init.h>
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Which kernels are built depends on the intrinsics the toolset knows. VS2010
+// SP1 has AVX, AVX2 came with VS2012 and AVX-512 with VS2017 15.3.
+#if defined(_MSC_VER) && _MSC_FULL_VER >= 160040219
+#define CASPAR_HAS_AVX_INTRINSICS
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define CASPAR_HAS_AVX2_INTRINSICS
+#endif
+
+#if defined(_MSC_VER) && _MSC_VER >= 1911
+#define CASPAR_HAS_AVX512_INTRINSICS
+#endif
+
+namespace caspar {
+
+namespace {
+
+// Temporal copies and clears go straight to the CRT, which is already optimal
+// for them. Only the non-temporal paths and the shuffle need own kernels.
+
+typedef void (*stream_copy_kernel)(uint8_t* dest, const uint8_t* source, size_t count);
+typedef void (*stream_clear_kernel)(uint8_t* dest, size_t count);
+typedef void (*shuffle_kernel)(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask, bool stream);
+
+size_t align_head(const uint8_t* dest, size_t alignment, size_t count)
+{
+	return std::min(count, (alignment - (reinterpret_cast<uintptr_t>(dest) & (alignment-1))) & (alignment-1));
+}
+
+// Handles partial blocks (and aliasing source and dest) through a zero padded copy.
+void shuffle_block_c(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask)
+{
+	uint8_t in[16] = {0};
+	uint8_t out[16];
+
+	memcpy(in, source, count);
+	for(int n = 0; n < 16; ++n)
+		out[n] = (mask[n] & 0x80) ? 0 : in[mask[n] & 0x0F];
+	memcpy(dest, out, count);
+}
+
+void shuffle_c(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask, bool)
+{
+	for(size_t n = 0; n < count; n += 16)
+		shuffle_block_c(dest + n, source + n, std::min<size_t>(16, count - n), mask);
+}
+
+void stream_copy_c(uint8_t* dest, const uint8_t* source, size_t count)
+{
+	memcpy(dest, source, count);
+}
+
+void stream_clear_c(uint8_t* dest, size_t count)
+{
+	memset(dest, 0, count);
+}
+
+// SSE2 / SSSE3
+
+void stream_copy_sse2(uint8_t* dest, const uint8_t* source, size_t count)
+{
+	auto head = align_head(dest, 16, count);
+	memcpy(dest, source, head);
+	dest += head, source += head, count -= head;
+
+	for(; count >= 64; count -= 64, dest += 64, source += 64)
+	{
+		auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source) + 0);
+		auto xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source) + 1);
+		auto xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source) + 2);
+		auto xmm3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source) + 3);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 0, xmm0);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 1, xmm1);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 2, xmm2);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 3, xmm3);
+	}
+	_mm_sfence();
+
+	memcpy(dest, source, count);
+}
+
+void stream_clear_sse2(uint8_t* dest, size_t count)
+{
+	auto head = align_head(dest, 16, count);
+	memset(dest, 0, head);
+	dest += head, count -= head;
+
+	auto zero = _mm_setzero_si128();
+	for(; count >= 64; count -= 64, dest += 64)
+	{
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 0, zero);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 1, zero);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 2, zero);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest) + 3, zero);
+	}
+	_mm_sfence();
+
+	memset(dest, 0, count);
+}
+
+// Shuffles must stay in phase with the 16 byte blocks of the source, so an
+// unaligned destination is written with unaligned stores instead of being aligned first.
+void shuffle_ssse3(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask, bool stream)
+{
+	auto mask128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+
+	size_t n = 0;
+	if(stream && (reinterpret_cast<uintptr_t>(dest) & 15) == 0)
+	{
+		for(; n + 64 <= count; n += 64)
+		{
+			auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n) + 0);
+			auto xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n) + 1);
+			auto xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n) + 2);
+			auto xmm3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n) + 3);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n) + 0, _mm_shuffle_epi8(xmm0, mask128));
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n) + 1, _mm_shuffle_epi8(xmm1, mask128));
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n) + 2, _mm_shuffle_epi8(xmm2, mask128));
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n) + 3, _mm_shuffle_epi8(xmm3, mask128));
+		}
+		_mm_sfence();
+	}
+
+	for(; n + 16 <= count; n += 16)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n)), mask128));
+
+	if(n < count)
+		shuffle_block_c(dest + n, source + n, count - n, mask);
+}
+
+#ifdef CASPAR_HAS_AVX_INTRINSICS
+
+// AVX, 256 bit loads and stores do not need AVX2.
+
+void stream_copy_avx(uint8_t* dest, const uint8_t* source, size_t count)
+{
+	auto head = align_head(dest, 32, count);
+	memcpy(dest, source, head);
+	dest += head, source += head, count -= head;
+
+	for(; count >= 128; count -= 128, dest += 128, source += 128)
+	{
+		auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source) + 0);
+		auto ymm1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source) + 1);
+		auto ymm2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source) + 2);
+		auto ymm3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source) + 3);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 0, ymm0);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 1, ymm1);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 2, ymm2);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 3, ymm3);
+	}
+	_mm_sfence();
+	_mm256_zeroupper();
+
+	memcpy(dest, source, count);
+}
+
+void stream_clear_avx(uint8_t* dest, size_t count)
+{
+	auto head = align_head(dest, 32, count);
+	memset(dest, 0, head);
+	dest += head, count -= head;
+
+	auto zero = _mm256_setzero_si256();
+	for(; count >= 128; count -= 128, dest += 128)
+	{
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 0, zero);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 1, zero);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 2, zero);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest) + 3, zero);
+	}
+	_mm_sfence();
+	_mm256_zeroupper();
+
+	memset(dest, 0, count);
+}
+
+#endif
+
+#ifdef CASPAR_HAS_AVX2_INTRINSICS
+
+// AVX2
+
+void shuffle_avx2(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask, bool stream)
+{
+	auto mask128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+	auto mask256 = _mm256_inserti128_si256(_mm256_castsi128_si256(mask128), mask128, 1);
+
+	size_t n = 0;
+	if(stream && (reinterpret_cast<uintptr_t>(dest) & 31) == 0)
+	{
+		for(; n + 128 <= count; n += 128)
+		{
+			auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n) + 0);
+			auto ymm1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n) + 1);
+			auto ymm2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n) + 2);
+			auto ymm3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n) + 3);
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n) + 0, _mm256_shuffle_epi8(ymm0, mask256));
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n) + 1, _mm256_shuffle_epi8(ymm1, mask256));
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n) + 2, _mm256_shuffle_epi8(ymm2, mask256));
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n) + 3, _mm256_shuffle_epi8(ymm3, mask256));
+		}
+		_mm_sfence();
+	}
+
+	for(; n + 32 <= count; n += 32)
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n), _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n)), mask256));
+
+	_mm256_zeroupper();
+
+	shuffle_ssse3(dest + n, source + n, count - n, mask, false);
+}
+
+#endif
+
+#ifdef CASPAR_HAS_AVX512_INTRINSICS
+
+// AVX-512 (F for copies and clears, BW for shuffles)
+
+void stream_copy_avx512(uint8_t* dest, const uint8_t* source, size_t count)
+{
+	auto head = align_head(dest, 64, count);
+	memcpy(dest, source, head);
+	dest += head, source += head, count -= head;
+
+	for(; count >= 256; count -= 256, dest += 256, source += 256)
+	{
+		auto zmm0 = _mm512_loadu_si512(source + 0);
+		auto zmm1 = _mm512_loadu_si512(source + 64);
+		auto zmm2 = _mm512_loadu_si512(source + 128);
+		auto zmm3 = _mm512_loadu_si512(source + 192);
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 0),	zmm0);
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 64),	zmm1);
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 128), zmm2);
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 192), zmm3);
+	}
+	_mm_sfence();
+	_mm256_zeroupper();
+
+	memcpy(dest, source, count);
+}
+
+void stream_clear_avx512(uint8_t* dest, size_t count)
+{
+	auto head = align_head(dest, 64, count);
+	memset(dest, 0, head);
+	dest += head, count -= head;
+
+	auto zero = _mm512_setzero_si512();
+	for(; count >= 256; count -= 256, dest += 256)
+	{
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 0),	zero);
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 64),	zero);
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 128), zero);
+		_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 192), zero);
+	}
+	_mm_sfence();
+	_mm256_zeroupper();
+
+	memset(dest, 0, count);
+}
+
+void shuffle_avx512(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask, bool stream)
+{
+	auto mask512 = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)));
+
+	size_t n = 0;
+	if(stream && (reinterpret_cast<uintptr_t>(dest) & 63) == 0)
+	{
+		for(; n + 256 <= count; n += 256)
+		{
+			auto zmm0 = _mm512_loadu_si512(source + n + 0);
+			auto zmm1 = _mm512_loadu_si512(source + n + 64);
+			auto zmm2 = _mm512_loadu_si512(source + n + 128);
+			auto zmm3 = _mm512_loadu_si512(source + n + 192);
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 0),	_mm512_shuffle_epi8(zmm0, mask512));
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 64),	_mm512_shuffle_epi8(zmm1, mask512));
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 128), _mm512_shuffle_epi8(zmm2, mask512));
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 192), _mm512_shuffle_epi8(zmm3, mask512));
+		}
+		_mm_sfence();
+	}
+
+	for(; n + 64 <= count; n += 64)
+		_mm512_storeu_si512(dest + n, _mm512_shuffle_epi8(_mm512_loadu_si512(source + n), mask512));
+
+	_mm256_zeroupper();
+
+	shuffle_ssse3(dest + n, source + n, count - n, mask, false);
+}
+
+#endif
+
+detail::memory_kernel_level make_level(const std::wstring& name, stream_copy_kernel stream_copy, stream_clear_kernel stream_clear, shuffle_kernel shuffle)
+{
+	detail::memory_kernel_level level;
+	level.name			= name;
+	level.stream_copy	= stream_copy;
+	level.stream_clear	= stream_clear;
+	level.shuffle		= shuffle;
+	return level;
+}
+
+std::vector<detail::memory_kernel_level> get_supported_levels()
+{
+	auto features = get_cpu_features();
+
+	std::vector<detail::memory_kernel_level> levels;
+	levels.push_back(make_level(L"C", stream_copy_c, stream_clear_c, shuffle_c));
+
+	if(features.sse2)
+		levels.push_back(make_level(L"SSE2", stream_copy_sse2, stream_clear_sse2, nullptr));
+
+	if(features.ssse3)
+		levels.push_back(make_level(L"SSSE3", nullptr, nullptr, shuffle_ssse3));
+
+#ifdef CASPAR_HAS_AVX_INTRINSICS
+	if(features.avx)
+		levels.push_back(make_level(L"AVX", stream_copy_avx, stream_clear_avx, nullptr));
+#endif
+
+#ifdef CASPAR_HAS_AVX2_INTRINSICS
+	if(features.avx2)
+		levels.push_back(make_level(L"AVX2", nullptr, nullptr, shuffle_avx2));
+#endif
+
+#ifdef CASPAR_HAS_AVX512_INTRINSICS
+	if(features.avx512f)
+		levels.push_back(make_level(L"AVX-512F", stream_copy_avx512, stream_clear_avx512, nullptr));
+
+	if(features.avx512bw)
+		levels.push_back(make_level(L"AVX-512BW", nullptr, nullptr, shuffle_avx512));
+#endif
+
+	return levels;
+}
+
+struct memory_kernels
+{
+	stream_copy_kernel	stream_copy;
+	stream_clear_kernel	stream_clear;
+	shuffle_kernel		shuffle;
+	std::wstring		name;
+
+	memory_kernels()
+		: stream_copy(stream_copy_c)
+		, stream_clear(stream_clear_c)
+		, shuffle(shuffle_c)
+	{
+		std::wstring copy_level		= L"C";
+		std::wstring shuffle_level	= L"C";
+
+		BOOST_FOREACH(auto& level, get_supported_levels())
+		{
+			if(level.stream_copy)
+			{
+				stream_copy		= level.stream_copy;
+				stream_clear	= level.stream_clear;
+				copy_level		= level.name;
+			}
+
+			if(level.shuffle)
+			{
+				shuffle			= level.shuffle;
+				shuffle_level	= level.name;
+			}
+		}
+
+		name = copy_level + L" copy, " + shuffle_level + L" shuffle";
+	}
+};
+
+// Constructed on first use, so that fast_memcpy works from static initializers 
+// in other translation units.
+const memory_kernels& get_memory_kernels()
+{
+	static const memory_kernels kernels;
+	return kernels;
+}
+
+// Function local statics are not initialized thread safely before VS2015,
+// construct the kernels during static initialization, before any threads exist.
+const memory_kernels& g_init_memory_kernels = get_memory_kernels();
+
+template<typename Func>
+void for_each_chunk(size_t count, int max_concurrency, const Func& func)
+{
+	typedef memory_kernel_thresholds thresholds;
+
+	bool stream		= count >= thresholds::non_temporal_threshold;
+	int concurrency = max_concurrency > 0 ? max_concurrency : tbb::task_scheduler_init::default_num_threads();
+	
+	if(count < thresholds::parallel_threshold || concurrency < 2)
+	{
+		func(0, count, stream);
+		return;
+	}
+
+	// One chunk per thread. Chunks are multiples of 64 bytes which keeps both
+	// vector alignment and shuffle blocks in phase between chunks.
+	auto chunks = std::max<size_t>(1, std::min<size_t>(count / thresholds::min_parallel_chunk, concurrency));
+	auto chunk	= ((count + chunks - 1) / chunks + 63) & ~static_cast<size_t>(63);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks, 1), [&](const tbb::blocked_range<size_t>& r)
+	{
+		for(auto n = r.begin(); n < r.end(); ++n)
+		{
+			auto begin	= n * chunk;
+			auto end	= std::min(count, begin + chunk);
+			if(begin < end)
+				func(begin, end, stream);
+		}
+	}, tbb::simple_partitioner());
+}
+
+// The kernels run in place, but chunks and blocks of partly overlapping buffers 
+// would read what other ones have already written.
+void check_overlap(const void* dest, const void* source, size_t count)
+{
+	auto dest8		= reinterpret_cast<const uint8_t*>(dest);
+	auto source8	= reinterpret_cast<const uint8_t*>(source);
+
+	if(dest8 != source8 && dest8 < source8 + count && source8 < dest8 + count)
+		BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Source and destination overlap."));
+}
+
+void to_shuffle_mask(int m1, int m2, int m3, int m4, uint8_t* mask)
+{
+	const int words[] = {m4, m3, m2, m1}; // _mm_set_epi32 order.
+	for(int n = 0; n < 16; ++n)
+		mask[n] = static_cast<uint8_t>(words[n / 4] >> ((n % 4) * 8));
+}
+
+}
+
+namespace detail {
+
+void* fast_memcpy(void* dest, const void* source, size_t count, int max_concurrency)
+{
+	CASPAR_ASSERT(count == 0 || (dest != nullptr && source != nullptr));
+	check_overlap(dest, source, count);
+
+	auto dest8		= reinterpret_cast<uint8_t*>(dest);
+	auto source8	= reinterpret_cast<const uint8_t*>(source);
+
+	for_each_chunk(count, max_concurrency, [&](size_t begin, size_t end, bool stream)
+	{
+		if(stream)
+			get_memory_kernels().stream_copy(dest8 + begin, source8 + begin, end - begin);
+		else
+			memcpy(dest8 + begin, source8 + begin, end - begin);
+	});
+
+	return dest;
+}
+
+void* fast_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4, int max_concurrency)
+{
+	CASPAR_ASSERT(count == 0 || (dest != nullptr && source != nullptr));
+	check_overlap(dest, source, count);
+
+	uint8_t mask[16];
+	to_shuffle_mask(m1, m2, m3, m4, mask);
+
+	auto dest8		= reinterpret_cast<uint8_t*>(dest);
+	auto source8	= reinterpret_cast<const uint8_t*>(source);
+
+	for_each_chunk(count, max_concurrency, [&](size_t begin, size_t end, bool stream)
+	{
+		get_memory_kernels().shuffle(dest8 + begin, source8 + begin, end - begin, mask, stream);
+	});
+
+	return dest;
+}
+
+void* fast_memclr(void* dest, size_t count, int max_concurrency)
+{
+	CASPAR_ASSERT(count == 0 || dest != nullptr);
+
+	auto dest8 = reinterpret_cast<uint8_t*>(dest);
+
+	for_each_chunk(count, max_concurrency, [&](size_t begin, size_t end, bool stream)
+	{
+		if(stream)
+			get_memory_kernels().stream_clear(dest8 + begin, end - begin);
+		else
+			memset(dest8 + begin, 0, end - begin);
+	});
+
+	return dest;
+}
+
+std::vector<memory_kernel_level> get_memory_kernel_levels()
+{
+	return get_supported_levels();
+}
+
+}
+
+std::wstring get_memory_kernels_simd_level()
+{
+	return get_memory_kernels().name;
+}
+
+}
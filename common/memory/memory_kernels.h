@@ -0,0 +1,72 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+// Kernels behind fast_memcpy, fast_memshfl and fast_memclr. The widest kernel
+// that both the cpu and the toolset support is selected once, on first use.
+// Copies and clears use SSE2, AVX (VS2010 SP1) or AVX-512F (VS2017 15.3), 
+// shuffles SSSE3, AVX2 (VS2012) or AVX-512BW (VS2017 15.3). With the VS2010 
+// toolset the server is built with, that is AVX copies and SSSE3 shuffles.
+//
+// Below parallel_threshold the operation runs on the calling thread, above it
+// it is split into chunks of at least min_parallel_chunk bytes over the tbb
+// pool. From non_temporal_threshold on, stores bypass the cache since the 
+// destination (a frame) is not read back by the same core any time soon.
+//
+// Source and destination may be the same buffer but must not otherwise 
+// overlap, invalid_argument is thrown if they do.
+struct memory_kernel_thresholds
+{
+	static const size_t parallel_threshold		= 1024*1024;
+	static const size_t min_parallel_chunk		= 256*1024;
+	static const size_t non_temporal_threshold	= 512*1024;
+};
+
+// E.g. "AVX copy, SSSE3 shuffle".
+std::wstring get_memory_kernels_simd_level();
+
+namespace detail {
+
+// The kernels of one SIMD level, those it does not provide are null. The 
+// plain C level comes first and the widest last, the widest non null kernel 
+// is the one dispatched to.
+struct memory_kernel_level
+{
+	std::wstring	name;
+	void			(*stream_copy)(uint8_t* dest, const uint8_t* source, size_t count);
+	void			(*stream_clear)(uint8_t* dest, size_t count);
+	void			(*shuffle)(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask, bool stream);
+};
+
+// The levels both the cpu and the toolset support.
+std::vector<memory_kernel_level> get_memory_kernel_levels();
+
+}
+
+}
@@ -26,6 +26,9 @@
 
 #include <windows.h>
 
+#include <intrin.h>
+#include <immintrin.h>
+
 #include <string>
 #include <sstream>
 
@@ -81,5 +84,69 @@ static std::wstring get_system_product_name()
 	return system_product_name;
 }
 
+struct cpu_features
+{
+	bool sse2;
+	bool ssse3;
+	bool sse41;
+	bool avx;
+	bool avx2;
+	bool avx512f;
+	bool avx512bw;
+};
+
+// Instruction sets usable by this process, i.e. supported by the cpu and
+// with their register state enabled by the os (XGETBV).
+static cpu_features get_cpu_features()
+{
+	cpu_features features = {};
+
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	if(max_leaf < 1)
+		return features;
+
+	__cpuid(info, 1);
+	features.sse2	= (info[3] & (1 << 26)) != 0;
+	features.ssse3	= (info[2] & (1 << 9))  != 0;
+	features.sse41	= (info[2] & (1 << 19)) != 0;
+
+	bool osxsave	= (info[2] & (1 << 27)) != 0;
+	bool avx		= (info[2] & (1 << 28)) != 0;
+
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymm_state	= (xcr0 & 0x06) == 0x06;
+	bool zmm_state	= (xcr0 & 0xE6) == 0xE6;
+
+	features.avx	= avx && ymm_state;
+
+	if(max_leaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		features.avx2		= features.avx && (info[1] & (1 << 5))  != 0;
+		features.avx512f	= features.avx && zmm_state && (info[1] & (1 << 16)) != 0;
+		features.avx512bw	= features.avx512f && (info[1] & (1 << 30)) != 0;
+	}
+
+	return features;
+}
+
+static std::wstring get_cpu_features_info()
+{
+	auto features = get_cpu_features();
+
+	std::wstringstream s;
+
+	s << (features.avx512f ? L"AVX-512 " : L"")
+	  << (features.avx2 ? L"AVX2 " : L"")
+	  << (features.avx ? L"AVX " : L"")
+	  << (features.sse41 ? L"SSE4.1 " : L"")
+	  << (features.ssse3 ? L"SSSE3 " : L"")
+	  << (features.sse2 ? L"SSE2" : L"");
+
+	return s.str();
+}
 
 }
\ No newline at end of file
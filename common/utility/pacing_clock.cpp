@@ -0,0 +1,243 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../stdafx.h"
+
+#include "pacing_clock.h"
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+
+#include <intrin.h>
+
+// Windows 10 1803 and later, not in the VS2010 SDK.
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+namespace caspar {
+
+namespace {
+
+int64_t query_counter()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+int64_t query_frequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+}
+
+std::shared_ptr<void> create_timer(bool& high_resolution)
+{
+	auto timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	high_resolution = timer != nullptr;
+	
+	// Older systems fall back to a normal timer, which fires on the system timer period (see shell/main.cpp).
+	if(!timer)
+		timer = CreateWaitableTimerW(nullptr, TRUE, nullptr);
+
+	if(!timer)
+		return nullptr;
+
+	return std::shared_ptr<void>(timer, CloseHandle);
+}
+
+// Upper bounds of the jitter histogram buckets, in microseconds. The last bucket takes the rest.
+const int64_t JITTER_BUCKETS[] = {50, 100, 250, 500, 1000, 2000, 5000};
+
+boost::mutex													g_master_clocks_mutex;
+std::map<std::pair<int, int>, std::weak_ptr<pacing_clock>>		g_master_clocks;
+
+}
+
+pacing_clock::pacing_clock(int time_scale, int duration)
+	: time_scale_(time_scale)
+	, duration_(duration)
+	, frequency_(query_frequency())
+	, epoch_(query_counter())
+{
+}
+
+int64_t pacing_clock::now() const
+{
+	return query_counter() - epoch_;
+}
+
+int64_t pacing_clock::frequency() const
+{
+	return frequency_;
+}
+
+int64_t pacing_clock::deadline(int64_t frame) const
+{
+	// Every time_scale frames take exactly duration seconds. Splitting the frame 
+	// number keeps the products within 64 bits for any realistic uptime.
+	auto seconds	= frame / time_scale_ * duration_;
+	auto remainder	= frame % time_scale_;
+
+	return seconds * frequency_ + remainder * duration_ * frequency_ / time_scale_;
+}
+
+int64_t pacing_clock::frame_at(int64_t ticks) const
+{
+	// The last frame whose deadline has passed. Deadlines are rounded down, so 
+	// this rounds up to stay the exact inverse of deadline(). time_scale frames 
+	// span exactly duration * frequency ticks.
+	auto period		= duration_ * frequency_;
+	auto periods	= (ticks + 1) / period;
+	auto remainder	= (ticks + 1) % period;
+
+	return periods * time_scale_ + (remainder * time_scale_ + period - 1) / period - 1;
+}
+
+int pacing_clock::time_scale() const
+{
+	return time_scale_;
+}
+
+int pacing_clock::duration() const
+{
+	return duration_;
+}
+
+safe_ptr<pacing_clock> get_master_pacing_clock(int time_scale, int duration)
+{
+	boost::lock_guard<boost::mutex> lock(g_master_clocks_mutex);
+
+	auto& weak_clock = g_master_clocks[std::make_pair(time_scale, duration)];
+	auto clock = weak_clock.lock();
+
+	if(!clock)
+	{
+		clock = std::make_shared<pacing_clock>(time_scale, duration);
+		weak_clock = clock;
+	}
+
+	return make_safe_ptr(clock);
+}
+
+frame_pacer::frame_pacer(const safe_ptr<pacing_clock>& clock)
+	: clock_(clock)
+	, spin_ticks_(0)
+	, next_frame_(-1)
+	, last_jitter_(0)
+	, max_jitter_(0)
+	, ticks_(0)
+	, skipped_frames_(0)
+{
+	jitter_histogram_.fill(0);
+
+	// The timer wakes up early by this much and the rest is spun.
+	bool high_resolution = false;
+	timer_		= create_timer(high_resolution);
+	spin_ticks_ = clock_->frequency() * (high_resolution ? 200 : 1200) / 1000000;
+}
+
+void frame_pacer::tick()
+{
+	auto now = clock_->now();
+
+	if(next_frame_ < 0)
+		next_frame_ = clock_->frame_at(now) + 1;
+	else if(now > clock_->deadline(next_frame_ + 1))
+	{
+		auto frame = clock_->frame_at(now) + 1;
+		skipped_frames_ += frame - next_frame_;
+		next_frame_		 = frame;
+	}
+
+	auto deadline = clock_->deadline(next_frame_);
+
+	wait_until(deadline);
+
+	last_jitter_ = clock_->now() - deadline;
+	max_jitter_	 = std::max(max_jitter_, last_jitter_);
+	
+	auto micros = last_jitter_ * 1000000 / clock_->frequency();
+	size_t bucket = 0;
+	while(bucket < _countof(JITTER_BUCKETS) && micros >= JITTER_BUCKETS[bucket])
+		++bucket;
+	++jitter_histogram_[bucket];
+
+	++ticks_;
+	++next_frame_;
+}
+
+void frame_pacer::wait_until(int64_t deadline) const
+{
+	auto left = deadline - clock_->now();
+
+	if(left > spin_ticks_)
+	{
+		// Relative due time in 100 ns units.
+		LARGE_INTEGER due_time;
+		due_time.QuadPart = -((left - spin_ticks_) * 10000000 / clock_->frequency());
+
+		if(timer_ && SetWaitableTimer(timer_.get(), &due_time, 0, nullptr, nullptr, FALSE))
+			WaitForSingleObject(timer_.get(), INFINITE);
+		else
+			Sleep(static_cast<DWORD>((left - spin_ticks_) * 1000 / clock_->frequency()));
+	}
+
+	while(clock_->now() < deadline)
+		_mm_pause();
+}
+
+const safe_ptr<pacing_clock>& frame_pacer::clock() const
+{
+	return clock_;
+}
+
+double frame_pacer::last_jitter() const
+{
+	return static_cast<double>(last_jitter_) / clock_->frequency();
+}
+
+boost::property_tree::wptree frame_pacer::info() const
+{
+	boost::property_tree::wptree info;
+	info.add(L"fps",			static_cast<double>(clock_->time_scale()) / clock_->duration());
+	info.add(L"ticks",			ticks_);
+	info.add(L"skipped-frames",	skipped_frames_);
+	info.add(L"max-jitter",		static_cast<double>(max_jitter_) / clock_->frequency());
+
+	for(size_t n = 0; n < jitter_histogram_.size(); ++n)
+	{
+		auto name = n < _countof(JITTER_BUCKETS) 
+				  ? L"under-" + boost::lexical_cast<std::wstring>(JITTER_BUCKETS[n]) + L"us"
+				  : L"over-" + boost::lexical_cast<std::wstring>(JITTER_BUCKETS[n - 1]) + L"us";
+		info.add(L"jitter-histogram." + name, jitter_histogram_[n]);
+	}
+
+	return info;
+}
+
+}
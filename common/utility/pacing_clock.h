@@ -0,0 +1,89 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include "../memory/safe_ptr.h"
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <array>
+#include <cstdint>
+
+namespace caspar {
+
+// Monotonic frame grid for a rational frame rate (time_scale/duration frames
+// per second). Deadlines are computed from a fixed epoch with integer math,
+// so 1001/60000 style durations never accumulate rounding errors.
+class pacing_clock : boost::noncopyable
+{
+public:
+	pacing_clock(int time_scale, int duration);
+
+	int64_t now() const;			// In ticks of frequency().
+	int64_t frequency() const;
+
+	int64_t deadline(int64_t frame) const;
+	int64_t frame_at(int64_t ticks) const;
+
+	int time_scale() const;
+	int duration() const;
+private:
+	const int		time_scale_;
+	const int		duration_;
+	const int64_t	frequency_;
+	const int64_t	epoch_;
+};
+
+// Channels running at the same frame rate share one clock and therefore tick in phase.
+safe_ptr<pacing_clock> get_master_pacing_clock(int time_scale, int duration);
+
+// Paces a single thread to the frame grid of a pacing_clock. Not thread-safe.
+class frame_pacer : boost::noncopyable
+{
+public:
+	explicit frame_pacer(const safe_ptr<pacing_clock>& clock);
+
+	// Blocks until the next frame deadline. If the caller has fallen more than
+	// one frame behind, the missed deadlines are skipped instead of bursting.
+	void tick();
+
+	const safe_ptr<pacing_clock>& clock() const;
+
+	double last_jitter() const;	// Seconds past the deadline of the last tick.
+	boost::property_tree::wptree info() const;
+private:
+	void wait_until(int64_t deadline) const;
+
+	safe_ptr<pacing_clock>		clock_;
+	std::shared_ptr<void>		timer_;
+	int64_t						spin_ticks_;
+	int64_t						next_frame_;
+
+	std::array<uint64_t, 8>		jitter_histogram_;
+	int64_t						last_jitter_;
+	int64_t						max_jitter_;
+	uint64_t					ticks_;
+	uint64_t					skipped_frames_;
+};
+
+}
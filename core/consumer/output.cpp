@@ -32,10 +32,13 @@
 #include "../mixer/read_frame.h"
 
 #include <common/concurrency/executor.h>
+#include <common/concurrency/future_util.h>
+#include <common/concurrency/published.h>
 #include <common/utility/assert.h>
-#include <common/utility/timer.h>
+#include <common/utility/pacing_clock.h>
 #include <common/memory/memshfl.h>
 #include <common/env.h>
+#include <common/scope_exit.h>
 
 #include <boost/circular_buffer.hpp>
 #include <boost/timer.hpp>
@@ -49,6 +52,12 @@ const long SEND_TIMEOUT_MILLIS = 10000L;
 	
 struct output::implementation
 {		
+	struct state
+	{
+		boost::property_tree::wptree					info;
+		boost::property_tree::wptree					delay_info;
+	};
+
 	const int										channel_index_;
 	const safe_ptr<diagnostics::graph>				graph_;
 	monitor::subject								monitor_subject_;
@@ -59,11 +68,13 @@ struct output::implementation
 
 	std::map<int, safe_ptr<frame_consumer>>			consumers_;
 	
-	high_prec_timer									sync_timer_;
+	std::unique_ptr<frame_pacer>					pacer_;
 
 	boost::circular_buffer<safe_ptr<read_frame>>	frames_;
 	std::map<int, int64_t>							send_to_consumers_delays_;
 
+	published<state>								state_;
+
 	executor										executor_;
 		
 public:
@@ -80,6 +91,9 @@ public:
 		, executor_(L"output " + boost::lexical_cast<std::wstring>(channel_index))
 	{
 		graph_->set_color("consume-time", diagnostics::color(1.0f, 0.4f, 0.0f, 0.8));
+		graph_->set_color("tick-jitter", diagnostics::color(0.4f, 0.8f, 1.0f));
+
+		reset_pacer();
 	}
 
 	void add(int index, safe_ptr<frame_consumer> consumer)
@@ -93,6 +107,7 @@ public:
 		{
 			consumers_.insert(std::make_pair(index, consumer));
 			CASPAR_LOG(info) << print() << L" " << consumer->print() << L" Added.";
+			publish_state();
 		}, high_priority);
 	}
 
@@ -114,6 +129,7 @@ public:
 				old_consumer = it->second;
 				send_to_consumers_delays_.erase(it->first);
 				consumers_.erase(it);
+				publish_state();
 			}
 		}, high_priority);
 
@@ -153,9 +169,21 @@ public:
 			
 			format_desc_ = format_desc;
 			frames_.clear();
+			reset_pacer();
 		});
 	}
 	
+	void reset_pacer()
+	{
+		pacer_.reset(new frame_pacer(get_master_pacing_clock(static_cast<int>(format_desc_.time_scale), static_cast<int>(format_desc_.duration))));
+	}
+
+	void tick()
+	{
+		pacer_->tick();
+		graph_->set_value("tick-jitter", pacer_->last_jitter()*format_desc_.fps*0.5);
+	}
+
 	std::map<int, int> buffer_depths_snapshot() const
 	{
 		std::map<int, int> result;
@@ -195,6 +223,11 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
+			CASPAR_SCOPE_EXIT
+			{
+				publish_state();
+			};
+
 			try
 			{
 				consume_timer_.restart();
@@ -202,11 +235,11 @@ public:
 				auto input_frame = packet.first;
 
 				if(!has_synchronization_clock())
-					sync_timer_.tick(1.0/format_desc_.fps);
+					tick();
 
 				if(input_frame->image_size() != format_desc_.size)
 				{
-					sync_timer_.tick(1.0/format_desc_.fps);
+					tick();
 					return;
 				}
 				
@@ -320,42 +353,65 @@ public:
 		return L"output[" + boost::lexical_cast<std::wstring>(channel_index_) + L"]";
 	}
 
+	void publish_state()
+	{
+		try
+		{
+			state new_state;
+			new_state.info			= create_info();
+			new_state.delay_info	= create_delay_info();
+			state_.publish(std::move(new_state));
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+	}
+
+	// The info functions read the state published by the last send and never enter the executor.
+
 	boost::unique_future<boost::property_tree::wptree> info()
 	{
-		return std::move(executor_.begin_invoke([&]() -> boost::property_tree::wptree
-		{			
-			boost::property_tree::wptree info;
-			BOOST_FOREACH(auto& consumer, consumers_)
-			{
-				info.add_child(L"consumers.consumer", consumer.second->info())
-					.add(L"index", consumer.first); 
-			}
-			return info;
-		}, high_priority));
+		return wrap_as_future(boost::property_tree::wptree(state_.get()->info));
 	}
 
 	boost::unique_future<boost::property_tree::wptree> delay_info()
 	{
-		return std::move(executor_.begin_invoke([&]() -> boost::property_tree::wptree
-		{			
-			boost::property_tree::wptree info;
-			BOOST_FOREACH(auto& consumer, consumers_)
-			{
-				auto total_age =
-						consumer.second->presentation_frame_age_millis();
-				auto sendoff_age = send_to_consumers_delays_[consumer.first];
-				auto presentation_time = total_age - sendoff_age;
-
-				boost::property_tree::wptree child;
-				child.add(L"name", consumer.second->print());
-				child.add(L"age-at-arrival", sendoff_age);
-				child.add(L"presentation-time", presentation_time);
-				child.add(L"age-at-presentation", total_age);
-
-				info.add_child(L"consumer", child);
-			}
-			return info;
-		}, high_priority));
+		return wrap_as_future(boost::property_tree::wptree(state_.get()->delay_info));
+	}
+
+	boost::property_tree::wptree create_info()
+	{
+		boost::property_tree::wptree info;
+		BOOST_FOREACH(auto& consumer, consumers_)
+		{
+			info.add_child(L"consumers.consumer", consumer.second->info())
+				.add(L"index", consumer.first); 
+		}
+		if(!has_synchronization_clock())
+			info.add_child(L"pacing", pacer_->info());
+		return info;
+	}
+
+	boost::property_tree::wptree create_delay_info()
+	{
+		boost::property_tree::wptree info;
+		BOOST_FOREACH(auto& consumer, consumers_)
+		{
+			auto total_age =
+					consumer.second->presentation_frame_age_millis();
+			auto sendoff_age = send_to_consumers_delays_[consumer.first];
+			auto presentation_time = total_age - sendoff_age;
+
+			boost::property_tree::wptree child;
+			child.add(L"name", consumer.second->print());
+			child.add(L"age-at-arrival", sendoff_age);
+			child.add(L"presentation-time", presentation_time);
+			child.add(L"age-at-presentation", total_age);
+
+			info.add_child(L"consumer", child);
+		}
+		return info;
 	}
 
 	bool empty()
@@ -0,0 +1,595 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../stdafx.h"
+
+#include "pixel_packing.h"
+
+#include <common/os/windows/system_info.h>
+#include <common/exception/exceptions.h>
+
+#include <tbb/parallel_for.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <emmintrin.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const int ROW_GRAIN = 16;
+
+// Fixed point (2^13) matrix producing 10-bit studio range Y'CbCr. Vectors are
+// laid out as one BGRA pixel pair (b, g, r, 0, b, g, r, 0) for _mm_madd_epi16.
+struct yuv_matrix
+{
+	int16_t y[3];
+	int16_t u[3];
+	int16_t v[3];
+
+	__m128i	y128;
+	__m128i	u128;
+	__m128i	v128;
+
+	yuv_matrix(double kr, double kb)
+	{
+		const double kg		= 1.0 - kr - kb;
+		const double yscale = 876.0/255.0*8192.0;
+		const double cscale = 896.0/255.0*8192.0;
+
+		y[0] = round(kb*yscale);
+		y[1] = round(kg*yscale);
+		y[2] = round(kr*yscale);
+
+		u[0] = round(0.5*cscale);
+		u[1] = round(-kg/(2.0*(1.0-kb))*cscale);
+		u[2] = round(-kr/(2.0*(1.0-kb))*cscale);
+
+		v[0] = round(-kb/(2.0*(1.0-kr))*cscale);
+		v[1] = round(-kg/(2.0*(1.0-kr))*cscale);
+		v[2] = round(0.5*cscale);
+
+		y128 = _mm_set_epi16(0, y[2], y[1], y[0], 0, y[2], y[1], y[0]);
+		u128 = _mm_set_epi16(0, u[2], u[1], u[0], 0, u[2], u[1], u[0]);
+		v128 = _mm_set_epi16(0, v[2], v[1], v[0], 0, v[2], v[1], v[0]);
+	}
+
+	static int16_t round(double value)
+	{
+		return static_cast<int16_t>(std::floor(value + 0.5));
+	}
+};
+
+const yuv_matrix g_bt601(0.299, 0.114);
+const yuv_matrix g_bt709(0.2126, 0.0722);
+
+const yuv_matrix& get_matrix(int height)
+{
+	return height >= 720 ? g_bt709 : g_bt601;
+}
+
+// Plain C kernels. These also handle the tails of the SIMD kernels.
+
+void key_bgra_c(const uint8_t* src, uint8_t* dest, int count)
+{
+	auto src32	= reinterpret_cast<const uint32_t*>(src);
+	auto dest32	= reinterpret_cast<uint32_t*>(dest);
+
+	for(int n = 0; n < count; ++n)
+		dest32[n] = (src32[n] >> 24) * 0x01010101;
+}
+
+void key_luma_c(const uint8_t* src, uint8_t* dest, int count)
+{
+	for(int n = 0; n < count; ++n)
+		dest[n] = src[n*4+3];
+}
+
+void premultiply_c(const uint8_t* src, uint8_t* dest, int count)
+{
+	for(int n = 0; n < count; ++n)
+	{
+		int a = src[n*4+3];
+		for(int c = 0; c < 3; ++c)
+		{
+			int t = src[n*4+c]*a + 128;
+			dest[n*4+c] = static_cast<uint8_t>((t + (t >> 8)) >> 8);
+		}
+		dest[n*4+3] = static_cast<uint8_t>(a);
+	}
+}
+
+struct reciprocal_table
+{
+	uint32_t values[256];
+
+	reciprocal_table()
+	{
+		values[0] = 0;
+		for(int a = 1; a < 256; ++a)
+			values[a] = (255*65536 + a/2)/a;
+	}
+};
+
+const reciprocal_table g_reciprocal;
+
+void unpremultiply_c(const uint8_t* src, uint8_t* dest, int count)
+{
+	for(int n = 0; n < count; ++n)
+	{
+		int a = src[n*4+3];
+		uint32_t r = g_reciprocal.values[a];
+		for(int c = 0; c < 3; ++c)
+			dest[n*4+c] = static_cast<uint8_t>(std::min<uint32_t>(255, (src[n*4+c]*r + 32768) >> 16));
+		dest[n*4+3] = static_cast<uint8_t>(a);
+	}
+}
+
+// Writes width luma and (width+1)/2 chroma samples, 10-bit.
+void bgra_to_yuv_c(const uint8_t* src, int first, int width, const yuv_matrix& m, int16_t* y, int16_t* u, int16_t* v)
+{
+	for(int x = first; x < width; ++x)
+	{
+		auto p = src + x*4;
+		y[x] = static_cast<int16_t>(64 + ((m.y[0]*p[0] + m.y[1]*p[1] + m.y[2]*p[2] + (1 << 12)) >> 13));
+	}
+
+	for(int x = first/2; x < (width+1)/2; ++x)
+	{
+		auto p0 = src + x*8;
+		auto p1 = src + std::min(x*2+1, width-1)*4;
+		int b = p0[0] + p1[0];
+		int g = p0[1] + p1[1];
+		int r = p0[2] + p1[2];
+		u[x] = static_cast<int16_t>(512 + ((m.u[0]*b + m.u[1]*g + m.u[2]*r + (1 << 13)) >> 14));
+		v[x] = static_cast<int16_t>(512 + ((m.v[0]*b + m.v[1]*g + m.v[2]*r + (1 << 13)) >> 14));
+	}
+}
+
+// SSE2 kernels.
+
+void key_bgra_sse2(const uint8_t* src, uint8_t* dest, int count)
+{
+	int n = 0;
+	for(; n + 4 <= count; n += 4)
+	{
+		__m128i a = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n*4)), 24);
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n*4), a);
+	}
+	key_bgra_c(src + n*4, dest + n*4, count - n);
+}
+
+void key_luma_sse2(const uint8_t* src, uint8_t* dest, int count)
+{
+	auto src128 = reinterpret_cast<const __m128i*>(src);
+
+	int n = 0;
+	for(; n + 16 <= count; n += 16, src128 += 4)
+	{
+		__m128i a0 = _mm_srli_epi32(_mm_loadu_si128(src128+0), 24);
+		__m128i a1 = _mm_srli_epi32(_mm_loadu_si128(src128+1), 24);
+		__m128i a2 = _mm_srli_epi32(_mm_loadu_si128(src128+2), 24);
+		__m128i a3 = _mm_srli_epi32(_mm_loadu_si128(src128+3), 24);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3)));
+	}
+	key_luma_c(src + n*4, dest + n, count - n);
+}
+
+void premultiply_sse2(const uint8_t* src, uint8_t* dest, int count)
+{
+	const __m128i zero			= _mm_setzero_si128();
+	const __m128i round			= _mm_set1_epi16(128);
+	const __m128i alpha_mask	= _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+	int n = 0;
+	for(; n + 4 <= count; n += 4)
+	{
+		__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n*4));
+		__m128i lo = _mm_unpacklo_epi8(px, zero);
+		__m128i hi = _mm_unpackhi_epi8(px, zero);
+
+		__m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+		__m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+
+		__m128i tlo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), round);
+		__m128i thi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), round);
+		tlo = _mm_srli_epi16(_mm_add_epi16(tlo, _mm_srli_epi16(tlo, 8)), 8);
+		thi = _mm_srli_epi16(_mm_add_epi16(thi, _mm_srli_epi16(thi, 8)), 8);
+
+		tlo = _mm_or_si128(_mm_andnot_si128(alpha_mask, tlo), _mm_and_si128(alpha_mask, lo));
+		thi = _mm_or_si128(_mm_andnot_si128(alpha_mask, thi), _mm_and_si128(alpha_mask, hi));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n*4), _mm_packus_epi16(tlo, thi));
+	}
+	premultiply_c(src + n*4, dest + n*4, count - n);
+}
+
+// Sums (b*kb + g*kg + r*kr) for the pixel pair in "px" into 32-bit lanes 0 and 2.
+inline __m128i dot_pair(__m128i px, __m128i k)
+{
+	__m128i t = _mm_madd_epi16(px, k);
+	return _mm_add_epi32(t, _mm_srli_epi64(t, 32));
+}
+
+void bgra_to_yuv_sse2(const uint8_t* src, int /*first*/, int width, const yuv_matrix& m, int16_t* y, int16_t* u, int16_t* v)
+{
+	const __m128i zero		= _mm_setzero_si128();
+	const __m128i y_round	= _mm_set1_epi32(1 << 12);
+	const __m128i c_round	= _mm_set1_epi32(1 << 13);
+	const __m128i y_offset	= _mm_set1_epi16(64);
+	const __m128i c_offset	= _mm_set1_epi16(512);
+
+	int x = 0;
+	for(; x + 8 <= width; x += 8)
+	{
+		__m128i px0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x*4));
+		__m128i px1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x*4 + 16));
+
+		__m128i p[4] = 
+		{
+			_mm_unpacklo_epi8(px0, zero), 
+			_mm_unpackhi_epi8(px0, zero), 
+			_mm_unpacklo_epi8(px1, zero), 
+			_mm_unpackhi_epi8(px1, zero)
+		};
+
+		// Luma
+
+		__m128i s[4];
+		for(int n = 0; n < 4; ++n)
+			s[n] = _mm_shuffle_epi32(dot_pair(p[n], m.y128), _MM_SHUFFLE(3,1,2,0));
+
+		__m128i y03 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi64(s[0], s[1]), y_round), 13);
+		__m128i y47 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi64(s[2], s[3]), y_round), 13);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y + x), _mm_add_epi16(_mm_packs_epi32(y03, y47), y_offset));
+
+		// Chroma, horizontally averaged pixel pairs
+
+		__m128i cu[4], cv[4];
+		for(int n = 0; n < 4; ++n)
+		{
+			__m128i pair = _mm_add_epi16(p[n], _mm_srli_si128(p[n], 8));
+			cu[n] = dot_pair(pair, m.u128);
+			cv[n] = dot_pair(pair, m.v128);
+		}
+
+		__m128i u4 = _mm_unpacklo_epi64(_mm_unpacklo_epi32(cu[0], cu[1]), _mm_unpacklo_epi32(cu[2], cu[3]));
+		__m128i v4 = _mm_unpacklo_epi64(_mm_unpacklo_epi32(cv[0], cv[1]), _mm_unpacklo_epi32(cv[2], cv[3]));
+		u4 = _mm_srai_epi32(_mm_add_epi32(u4, c_round), 14);
+		v4 = _mm_srai_epi32(_mm_add_epi32(v4, c_round), 14);
+
+		__m128i uv = _mm_add_epi16(_mm_packs_epi32(u4, v4), c_offset);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(u + x/2), uv);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(v + x/2), _mm_srli_si128(uv, 8));
+	}
+	bgra_to_yuv_c(src, x, width, m, y, u, v);
+}
+
+struct kernels
+{
+	typedef void (*row_fn)(const uint8_t* src, uint8_t* dest, int count);
+	typedef void (*yuv_fn)(const uint8_t* src, int first, int width, const yuv_matrix& m, int16_t* y, int16_t* u, int16_t* v);
+
+	row_fn			key_bgra;
+	row_fn			key_luma;
+	row_fn			premultiply;
+	row_fn			unpremultiply;
+	yuv_fn			bgra_to_yuv;
+	std::wstring	name;
+
+	kernels()
+		: key_bgra(key_bgra_c)
+		, key_luma(key_luma_c)
+		, premultiply(premultiply_c)
+		, unpremultiply(unpremultiply_c)
+		, bgra_to_yuv(bgra_to_yuv_c)
+		, name(L"C")
+	{
+		auto features = get_cpu_features();
+
+		if(features.sse2)
+		{
+			key_bgra	= key_bgra_sse2;
+			key_luma	= key_luma_sse2;
+			premultiply	= premultiply_sse2;
+			bgra_to_yuv	= bgra_to_yuv_sse2;
+			name		= L"SSE2";
+		}
+	}
+};
+
+const kernels g_kernels;
+
+inline uint8_t to_8bit(int16_t value)
+{
+	return static_cast<uint8_t>(std::min(255, (value + 2) >> 2));
+}
+
+// Y'CbCr row formatters, fed with the 10-bit output of bgra_to_yuv.
+
+// Odd widths repeat the last luma sample in the final macropixel.
+void write_uyvy(const int16_t* y, const int16_t* u, const int16_t* v, int width, uint8_t* dest)
+{
+	for(int x = 0; x < (width+1)/2; ++x)
+	{
+		dest[x*4+0] = to_8bit(u[x]);
+		dest[x*4+1] = to_8bit(y[x*2+0]);
+		dest[x*4+2] = to_8bit(v[x]);
+		dest[x*4+3] = to_8bit(y[std::min(x*2+1, width-1)]);
+	}
+}
+
+void write_v210(const int16_t* y, const int16_t* u, const int16_t* v, int width, uint8_t* dest)
+{
+	auto dest32 = reinterpret_cast<uint32_t*>(dest);
+
+	int chroma_width = (width + 1)/2;
+	for(int x = 0; x < width; x += 6, dest32 += 4)
+	{
+		uint32_t ys[6];
+		uint32_t us[3];
+		uint32_t vs[3];
+
+		for(int n = 0; n < 6; ++n)
+			ys[n] = y[std::min(x+n, width-1)];
+		for(int n = 0; n < 3; ++n)
+		{
+			us[n] = u[std::min(x/2+n, chroma_width-1)];
+			vs[n] = v[std::min(x/2+n, chroma_width-1)];
+		}
+
+		dest32[0] = us[0] | (ys[0] << 10) | (vs[0] << 20);
+		dest32[1] = ys[1] | (us[1] << 10) | (ys[2] << 20);
+		dest32[2] = vs[1] | (ys[3] << 10) | (us[2] << 20);
+		dest32[3] = ys[4] | (vs[2] << 10) | (ys[5] << 20);
+	}
+}
+
+void write_planar(const int16_t* src, int count, uint8_t* dest)
+{
+	for(int x = 0; x < count; ++x)
+		dest[x] = to_8bit(src[x]);
+}
+
+void write_planar_average(const int16_t* src0, const int16_t* src1, int count, uint8_t* dest)
+{
+	for(int x = 0; x < count; ++x)
+		dest[x] = static_cast<uint8_t>(std::min(255, (src0[x] + src1[x] + 4) >> 3));
+}
+
+template<typename F>
+void for_each_row(int rows, const F& func)
+{
+	tbb::parallel_for(tbb::blocked_range<int>(0, rows, ROW_GRAIN), [&](const tbb::blocked_range<int>& r)
+	{
+		for(int row = r.begin(); row != r.end(); ++row)
+			func(row);
+	});
+}
+
+// src_stride is the distance between source rows, matrix_height the height
+// of the whole frame, which picks the matrix even when packing one field.
+void pack_yuv(packed_format::type format, const uint8_t* bgra, int src_stride, int width, int height, int matrix_height, const packed_plane* planes)
+{
+	const auto& matrix		= get_matrix(matrix_height);
+	const int chroma_width	= (width + 1)/2;
+	const int rows			= format == packed_format::yuv420p ? (height + 1)/2 : height;
+
+	tbb::parallel_for(tbb::blocked_range<int>(0, rows, ROW_GRAIN), [&](const tbb::blocked_range<int>& r)
+	{
+		// 8 samples of slack for the SIMD stores.
+		std::vector<int16_t> y(width + 8), u(chroma_width + 8), v(chroma_width + 8);
+		std::vector<int16_t> u2, v2;
+
+		for(int row = r.begin(); row != r.end(); ++row)
+		{
+			if(format == packed_format::yuv420p)
+			{
+				int y0 = row*2;
+				int y1 = std::min(y0 + 1, height - 1);
+
+				u2.resize(u.size());
+				v2.resize(v.size());
+
+				g_kernels.bgra_to_yuv(bgra + y0*src_stride, 0, width, matrix, y.data(), u.data(), v.data());
+				write_planar(y.data(), width, planes[0].data + y0*planes[0].linesize);
+				
+				g_kernels.bgra_to_yuv(bgra + y1*src_stride, 0, width, matrix, y.data(), u2.data(), v2.data());
+				if(y1 != y0)
+					write_planar(y.data(), width, planes[0].data + y1*planes[0].linesize);
+
+				write_planar_average(u.data(), u2.data(), chroma_width, planes[1].data + row*planes[1].linesize);
+				write_planar_average(v.data(), v2.data(), chroma_width, planes[2].data + row*planes[2].linesize);
+				continue;
+			}
+
+			g_kernels.bgra_to_yuv(bgra + row*src_stride, 0, width, matrix, y.data(), u.data(), v.data());
+
+			switch(format)
+			{
+			case packed_format::uyvy:
+				write_uyvy(y.data(), u.data(), v.data(), width, planes[0].data + row*planes[0].linesize);
+				break;
+			case packed_format::v210:
+				write_v210(y.data(), u.data(), v.data(), width, planes[0].data + row*planes[0].linesize);
+				break;
+			case packed_format::yuv422p:
+				write_planar(y.data(), width, planes[0].data + row*planes[0].linesize);
+				write_planar(u.data(), chroma_width, planes[1].data + row*planes[1].linesize);
+				write_planar(v.data(), chroma_width, planes[2].data + row*planes[2].linesize);
+				break;
+			}
+		}
+	});
+}
+
+void pack_rows(packed_format::type format, const uint8_t* bgra, int src_stride, int width, int height, int matrix_height, const packed_plane* planes)
+{
+	if(width < 1 || height < 1)
+		return;
+
+	switch(format)
+	{
+	case packed_format::bgra:
+		for_each_row(height, [&](int row)
+		{
+			std::memcpy(planes[0].data + row*planes[0].linesize, bgra + row*src_stride, width*4);
+		});
+		break;
+	case packed_format::key_bgra:
+		for_each_row(height, [&](int row)
+		{
+			g_kernels.key_bgra(bgra + row*src_stride, planes[0].data + row*planes[0].linesize, width);
+		});
+		break;
+	case packed_format::key_luma:
+		for_each_row(height, [&](int row)
+		{
+			g_kernels.key_luma(bgra + row*src_stride, planes[0].data + row*planes[0].linesize, width);
+		});
+		break;
+	case packed_format::straight_bgra:
+		for_each_row(height, [&](int row)
+		{
+			g_kernels.unpremultiply(bgra + row*src_stride, planes[0].data + row*planes[0].linesize, width);
+		});
+		break;
+	case packed_format::premultiplied_bgra:
+		for_each_row(height, [&](int row)
+		{
+			g_kernels.premultiply(bgra + row*src_stride, planes[0].data + row*planes[0].linesize, width);
+		});
+		break;
+	case packed_format::uyvy:
+	case packed_format::v210:
+	case packed_format::yuv422p:
+	case packed_format::yuv420p:
+		pack_yuv(format, bgra, src_stride, width, height, matrix_height, planes);
+		break;
+	default:
+		BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid packed format."));
+	}
+}
+
+}
+
+packed_format::type packed_format::from_string(const std::wstring& name)
+{
+	auto str = boost::to_upper_copy(name);
+
+	for(int n = 0; n < packed_format::count; ++n)
+	{
+		if(boost::to_upper_copy(print(static_cast<type>(n))) == str)
+			return static_cast<type>(n);
+	}
+
+	BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Unknown packed format.") << arg_value_info(narrow(name)));
+}
+
+std::wstring packed_format::print(type format)
+{
+	switch(format)
+	{
+	case bgra:					return L"bgra";
+	case key_bgra:				return L"key_bgra";
+	case key_luma:				return L"key_luma";
+	case straight_bgra:			return L"straight_bgra";
+	case premultiplied_bgra:	return L"premultiplied_bgra";
+	case uyvy:					return L"uyvy";
+	case v210:					return L"v210";
+	case yuv422p:				return L"yuv422p";
+	case yuv420p:				return L"yuv420p";
+	default:					return L"invalid";
+	}
+}
+
+int packed_plane_count(packed_format::type format)
+{
+	return format == packed_format::yuv422p || format == packed_format::yuv420p ? 3 : 1;
+}
+
+int packed_linesize(packed_format::type format, int width, int plane)
+{
+	switch(format)
+	{
+	case packed_format::key_luma:	return width;
+	case packed_format::uyvy:		return ((width + 1)/2)*4;
+	case packed_format::v210:		return ((width + 47)/48)*128;
+	case packed_format::yuv422p:	
+	case packed_format::yuv420p:	return plane == 0 ? width : (width + 1)/2;
+	default:						return width*4;
+	}
+}
+
+int packed_plane_height(packed_format::type format, int height, int plane)
+{
+	return format == packed_format::yuv420p && plane > 0 ? (height + 1)/2 : height;
+}
+
+size_t packed_size(packed_format::type format, int width, int height)
+{
+	size_t size = 0;
+	for(int plane = 0; plane < packed_plane_count(format); ++plane)
+		size += static_cast<size_t>(packed_linesize(format, width, plane))*packed_plane_height(format, height, plane);
+	return size;
+}
+
+void pack(packed_format::type format, const uint8_t* bgra, int width, int height, const packed_plane* planes)
+{
+	pack_rows(format, bgra, width*4, width, height, height, planes);
+}
+
+int field_height(int height, field_mode::type field)
+{
+	return field == field_mode::lower ? height/2 : (height + 1)/2;
+}
+
+void pack_field(packed_format::type format, field_mode::type field, const uint8_t* bgra, int width, int height, const packed_plane* planes)
+{
+	if(field != field_mode::upper && field != field_mode::lower)
+		BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Only the upper or the lower field can be packed."));
+
+	auto first_row = field == field_mode::lower ? bgra + width*4 : bgra;
+	pack_rows(format, first_row, width*8, width, field_height(height, field), height, planes);
+}
+
+void split_fields(const uint8_t* src, int linesize, int height, uint8_t* upper, uint8_t* lower)
+{
+	for_each_row(height, [&](int row)
+	{
+		auto dest = (row % 2 == 0 ? upper : lower) + (row/2)*linesize;
+		std::memcpy(dest, src + row*linesize, linesize);
+	});
+}
+
+std::wstring get_pixel_packing_simd_level()
+{
+	return g_kernels.name;
+}
+
+}}
@@ -0,0 +1,88 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include "../video_format.h"
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace core {
+
+// Output layouts a consumer can request from the 8-bit premultiplied BGRA
+// delivered by read_frame::image_data().
+struct packed_format
+{
+	enum type
+	{
+		bgra = 0,			// Straight copy.
+		key_bgra,			// Alpha replicated into B, G, R and A.
+		key_luma,			// Alpha as an 8-bit luma plane.
+		straight_bgra,		// Premultiplied -> straight alpha.
+		premultiplied_bgra,	// Straight -> premultiplied alpha.
+		uyvy,				// 8-bit 4:2:2 packed.
+		v210,				// 10-bit 4:2:2 packed, 48 pixels per 128 bytes.
+		yuv422p,			// 8-bit 4:2:2 planar (Y, Cb, Cr).
+		yuv420p,			// 8-bit 4:2:0 planar (Y, Cb, Cr).
+		count
+	};
+
+	static type from_string(const std::wstring& name);
+	static std::wstring print(type format);
+};
+
+struct packed_plane
+{
+	uint8_t*	data;
+	int			linesize;
+
+	packed_plane() : data(nullptr), linesize(0){}
+	packed_plane(uint8_t* data, int linesize) : data(data), linesize(linesize){}
+};
+
+int		packed_plane_count(packed_format::type format);
+int		packed_linesize(packed_format::type format, int width, int plane);
+int		packed_plane_height(packed_format::type format, int height, int plane);
+size_t	packed_size(packed_format::type format, int width, int height);
+
+// Converts a BGRA image into consumer provided planes. Rows are processed
+// tile-parallel; kernels are chosen once at startup (SSE2, or plain C on
+// processors without it). Y'CbCr output is studio range,
+// BT.709 for HD formats and BT.601 otherwise.
+void pack(packed_format::type format, const uint8_t* bgra, int width, int height, const packed_plane* planes);
+
+// Rows in the upper (rows 0, 2, 4...) or lower (rows 1, 3, 5...) field of an
+// image with the given height.
+int field_height(int height, field_mode::type field);
+
+// Packs one field of an interlaced BGRA image, for consumers which output
+// fields separately. The planes are laid out as for pack with
+// field_height(height, field) rows. The matrix follows the frame height.
+void pack_field(packed_format::type format, field_mode::type field, const uint8_t* bgra, int width, int height, const packed_plane* planes);
+
+// Separates an interlaced image into its upper (even) and lower (odd) field.
+void split_fields(const uint8_t* src, int linesize, int height, uint8_t* upper, uint8_t* lower);
+
+// Name of the instruction set the kernels were dispatched to.
+std::wstring get_pixel_packing_simd_level();
+
+}}
@@ -0,0 +1,198 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "audio_meter.h"
+#include "audio_util.h"
+#include "loudness_meter.h"
+
+#include <common/concurrency/executor.h>
+#include <common/diagnostics/graph.h>
+
+#include <tbb/concurrent_queue.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const size_t	MAX_QUEUED_FRAMES	= 16;
+
+// BS.1770 channel weights: surrounds +1.5 dB, LFE excluded.
+double channel_weight(const std::wstring& name)
+{
+	if(name == L"LFE")
+		return 0.0;
+
+	if(name == L"Ls" || name == L"Rs" || name == L"Lss" || name == L"Rss" || name == L"Lrs" || name == L"Rrs")
+		return 1.41;
+
+	return 1.0;
+}
+
+std::vector<double> get_channel_weights(const channel_layout& layout)
+{
+	std::vector<double> weights(layout.num_channels, 1.0);
+
+	if(!layout.no_channel_names())
+	{
+		for(int c = 0; c < layout.num_channels && c < static_cast<int>(layout.channel_names.size()); ++c)
+			weights[c] = channel_weight(layout.channel_names[c]);
+	}
+
+	return weights;
+}
+
+float to_dbfs(float pfs)
+{
+	// Makes the dBFS of silence => -dynamic range of 32bit LPCM => about -192 dBFS
+	// Otherwise it would be -infinity
+	static const auto MIN_PFS = 0.5f / static_cast<float>(std::numeric_limits<int32_t>::max());
+
+	return 20.0f * std::log10(std::max(MIN_PFS, pfs));
+}
+
+}
+
+struct audio_meter::implementation : boost::noncopyable
+{
+	struct channel_paths
+	{
+		std::string pfs;
+		std::string dbfs;
+		std::string dbtp;
+	};
+
+	safe_ptr<diagnostics::graph>					graph_;
+	monitor::subject								monitor_subject_;
+
+	// Mixer thread.
+	std::shared_ptr<const channel_layout>			layout_;
+	tbb::concurrent_queue<std::shared_ptr<audio_buffer>> buffers_;
+
+	// Meter thread.
+	std::unique_ptr<loudness_meter>					meter_;
+	std::shared_ptr<const channel_layout>			meter_layout_;
+	int												meter_sample_rate_;
+	std::vector<channel_paths>						paths_;
+	std::vector<float>								sample_peaks_;
+	std::vector<float>								true_peaks_;
+
+	executor										executor_;
+
+	implementation(const safe_ptr<diagnostics::graph>& graph)
+		: graph_(graph)
+		, meter_sample_rate_(0)
+		, executor_(L"audio_meter")
+	{
+		graph_->set_color("volume", diagnostics::color(1.0f, 0.8f, 0.1f));
+		graph_->set_color("meter-dropped", diagnostics::color(0.9f, 0.3f, 0.3f));
+	}
+
+	void push(const audio_buffer& samples, const channel_layout& layout, int sample_rate)
+	{
+		if(!layout_ || !(*layout_ == layout))
+			layout_ = std::make_shared<channel_layout>(layout);
+
+		if(executor_.size() >= MAX_QUEUED_FRAMES)
+		{
+			graph_->set_tag("meter-dropped");
+			return;
+		}
+
+		std::shared_ptr<audio_buffer> buffer;
+		if(!buffers_.try_pop(buffer))
+			buffer = std::make_shared<audio_buffer>();
+
+		buffer->assign(samples.begin(), samples.end());
+
+		auto frame_layout = layout_;
+		executor_.begin_invoke([=]
+		{
+			try
+			{
+				process(*buffer, frame_layout, sample_rate);
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+
+			buffers_.push(buffer);
+		});
+	}
+
+	void process(const audio_buffer& samples, const std::shared_ptr<const channel_layout>& layout, int sample_rate)
+	{
+		const int num_channels = layout->num_channels;
+
+		if(num_channels < 1)
+			return;
+
+		if(!meter_ || layout != meter_layout_ || sample_rate != meter_sample_rate_)
+		{
+			meter_.reset(new loudness_meter(get_channel_weights(*layout), sample_rate));
+			meter_layout_		= layout;
+			meter_sample_rate_	= sample_rate;
+
+			paths_.resize(num_channels);
+			for(int c = 0; c < num_channels; ++c)
+			{
+				auto chan_str = boost::lexical_cast<std::string>(c + 1);
+				paths_[c].pfs	= "/" + chan_str + "/pFS";
+				paths_[c].dbfs	= "/" + chan_str + "/dBFS";
+				paths_[c].dbtp	= "/" + chan_str + "/dBTP";
+			}
+		}
+
+		meter_->process(samples.data(), samples.size() / num_channels);
+		meter_->take_peaks(sample_peaks_, true_peaks_);
+
+		monitor_subject_ << monitor::message("/nb_channels") % num_channels;
+
+		for(int c = 0; c < num_channels; ++c)
+		{
+			monitor_subject_ << monitor::message(paths_[c].pfs) % sample_peaks_[c];
+			monitor_subject_ << monitor::message(paths_[c].dbfs) % to_dbfs(sample_peaks_[c]);
+			monitor_subject_ << monitor::message(paths_[c].dbtp) % to_dbfs(true_peaks_[c]);
+		}
+
+		monitor_subject_ << monitor::message("/loudness/momentary")	% static_cast<float>(meter_->momentary());
+		monitor_subject_ << monitor::message("/loudness/short_term")	% static_cast<float>(meter_->short_term());
+		monitor_subject_ << monitor::message("/loudness/integrated")	% static_cast<float>(meter_->integrated());
+
+		graph_->set_value("volume", *std::max_element(sample_peaks_.begin(), sample_peaks_.end()));
+	}
+};
+
+audio_meter::audio_meter(const safe_ptr<diagnostics::graph>& graph) : impl_(new implementation(graph)){}
+void audio_meter::push(const audio_buffer& samples, const channel_layout& layout, int sample_rate){impl_->push(samples, layout, sample_rate);}
+monitor::subject& audio_meter::monitor_output(){return impl_->monitor_subject_;}
+
+}}
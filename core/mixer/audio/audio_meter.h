@@ -0,0 +1,68 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include "audio_mixer.h"
+
+#include <common/memory/safe_ptr.h>
+
+#include "../../monitor/monitor.h"
+
+#include <boost/noncopyable.hpp>
+
+namespace caspar { 
+	
+namespace diagnostics {
+	
+class graph;
+
+}
+
+namespace core {
+
+struct channel_layout;
+
+// EBU R128 / ITU-R BS.1770-4 loudness and true peak metering of the mixed
+// audio. Frames are metered on the meter's own thread and reported on
+// monitor_output():
+//
+//   /nb_channels
+//   /<channel>/pFS, /<channel>/dBFS	sample peak of the frame
+//   /<channel>/dBTP					true peak of the frame (4x oversampled)
+//   /loudness/momentary				LUFS over 400 ms
+//   /loudness/short_term				LUFS over 3 s
+//   /loudness/integrated				gated LUFS since the layout or sample rate changed
+class audio_meter : boost::noncopyable
+{
+public:
+	explicit audio_meter(const safe_ptr<diagnostics::graph>& graph);
+
+	// Copies one frame of interleaved samples and queues it for metering.
+	void push(const audio_buffer& samples, const channel_layout& layout, int sample_rate);
+
+	monitor::subject& monitor_output();
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
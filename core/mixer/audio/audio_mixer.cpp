@@ -22,6 +22,7 @@
 #include "../../stdafx.h"
 
 #include "audio_mixer.h"
+#include "audio_meter.h"
 
 #include <core/mixer/write_frame.h>
 #include <core/producer/frame/frame_transform.h>
@@ -77,7 +78,8 @@ struct audio_mixer::implementation
 	channel_layout						channel_layout_;
 	float								master_volume_;
 	float								previous_master_volume_;
-	monitor::subject					monitor_subject_;
+	safe_ptr<monitor::subject>			monitor_subject_;
+	audio_meter							meter_;
 	
 public:
 	implementation(const safe_ptr<diagnostics::graph>& graph)
@@ -86,9 +88,10 @@ public:
 		, channel_layout_(channel_layout::stereo())
 		, master_volume_(1.0f)
 		, previous_master_volume_(master_volume_)
-		, monitor_subject_("/audio")
+		, monitor_subject_(make_safe<monitor::subject>("/audio"))
+		, meter_(graph)
 	{
-		graph_->set_color("volume", diagnostics::color(1.0f, 0.8f, 0.1f));
+		meter_.monitor_output().attach_parent(monitor_subject_);
 		transform_stack_.push(core::frame_transform());
 	}
 	
@@ -243,31 +246,7 @@ public:
 		result.reserve(result_ps.size());
 		boost::range::transform(result_ps, std::back_inserter(result), [](float sample){return static_cast<int32_t>(sample);});		
 		
-		const int num_channels = channel_layout_.num_channels;
-		monitor_subject_ << monitor::message("/nb_channels") % num_channels;
-
-		auto max = std::vector<int32_t>(num_channels, std::numeric_limits<int32_t>::min());
-
-		for (size_t n = 0; n < result.size(); n += num_channels)
-			for (int ch = 0; ch < num_channels; ++ch)
-				max[ch] = std::max(max[ch], std::abs(result[n + ch]));
-		
-		// Makes the dBFS of silence => -dynamic range of 32bit LPCM => about -192 dBFS
-		// Otherwise it would be -infinity
-		static const auto MIN_PFS = 0.5f / static_cast<float>(std::numeric_limits<int32_t>::max());
-
-		for (int i = 0; i < num_channels; ++i)
-		{
-			const auto pFS  = max[i] / static_cast<float>(std::numeric_limits<int32_t>::max());
-			const auto dBFS = 20.0f * std::log10(std::max(MIN_PFS, pFS));
-			
-			auto chan_str = boost::lexical_cast<std::string>(i + 1);
-
-			monitor_subject_ << monitor::message("/" + chan_str + "/pFS") % pFS;
-			monitor_subject_ << monitor::message("/" + chan_str + "/dBFS") % dBFS;
-		}
-
-		graph_->set_value("volume", static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
+		meter_.push(result, channel_layout_, static_cast<int>(format_desc_.audio_sample_rate));
 
 		return result;
 	}
@@ -298,6 +277,6 @@ void audio_mixer::end(){impl_->end();}
 float audio_mixer::get_master_volume() const { return impl_->get_master_volume(); }
 void audio_mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
 audio_buffer audio_mixer::operator()(const video_format_desc& format_desc, const channel_layout& layout){return impl_->mix(format_desc, layout);}
-monitor::subject& audio_mixer::monitor_output(){return impl_->monitor_subject_;}
+monitor::subject& audio_mixer::monitor_output(){return *impl_->monitor_subject_;}
 
 }}
\ No newline at end of file
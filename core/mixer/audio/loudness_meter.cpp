@@ -0,0 +1,380 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "loudness_meter.h"
+
+#include <common/exception/exceptions.h>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace core {
+
+namespace {
+
+const double	PI					= 3.14159265358979323846;
+const float		SAMPLE_SCALE		= 1.0f / 2147483648.0f;
+const size_t	SUBBLOCKS_MOMENTARY	= 4;	// 400 ms
+const size_t	SUBBLOCKS_SHORT		= 30;	// 3 s
+const double	ABSOLUTE_GATE		= -70.0;
+const double	RELATIVE_GATE		= -10.0;
+const double	HISTOGRAM_MAX		= 10.0;
+const double	HISTOGRAM_STEP		= 0.01;
+const double	MIN_LOUDNESS		= -200.0;
+const size_t	TRUE_PEAK_TAPS		= 12;
+
+// ITU-R BS.1770-4 Annex 2, 4x oversampling interpolation filter, one row per phase.
+const float TRUE_PEAK_FILTER[4][TRUE_PEAK_TAPS] =
+{
+	{ 0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,  0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f},
+	{-0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,  0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f},
+	{-0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,  0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f},
+	{-0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,  0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f}
+};
+
+struct biquad
+{
+	double b0, b1, b2, a1, a2;
+};
+
+// K-weighting (pre-filter shelf and RLB high-pass) for any sample rate,
+// matching the BS.1770 48kHz coefficients.
+void k_weighting(int sample_rate, biquad& shelf, biquad& high_pass)
+{
+	{
+		const double f0	= 1681.974450955533;
+		const double G	= 3.999843853973347;
+		const double Q	= 0.7071752369554196;
+		const double K	= std::tan(PI * f0 / sample_rate);
+		const double Vh	= std::pow(10.0, G / 20.0);
+		const double Vb	= std::pow(Vh, 0.4996667741545416);
+		const double a0	= 1.0 + K / Q + K * K;
+
+		shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+		shelf.b1 = 2.0 * (K * K - Vh) / a0;
+		shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+		shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+		shelf.a2 = (1.0 - K / Q + K * K) / a0;
+	}
+	{
+		const double f0	= 38.13547087602444;
+		const double Q	= 0.5003270373238773;
+		const double K	= std::tan(PI * f0 / sample_rate);
+		const double a0	= 1.0 + K / Q + K * K;
+
+		high_pass.b0 = 1.0;
+		high_pass.b1 = -2.0;
+		high_pass.b2 = 1.0;
+		high_pass.a1 = 2.0 * (K * K - 1.0) / a0;
+		high_pass.a2 = (1.0 - K / Q + K * K) / a0;
+	}
+}
+
+double to_loudness(double energy)
+{
+	return energy > 0.0 ? std::max(MIN_LOUDNESS, -0.691 + 10.0 * std::log10(energy)) : MIN_LOUDNESS;
+}
+
+double to_energy(double loudness)
+{
+	return std::pow(10.0, (loudness + 0.691) / 10.0);
+}
+
+// Filter state of four channels, one per lane. The true peak history is
+// mirrored so that the newest TRUE_PEAK_TAPS samples are always contiguous.
+struct channel_group
+{
+	__m128	shelf_z1, shelf_z2;
+	__m128	high_pass_z1, high_pass_z2;
+	__m128	energy;
+	__m128	sample_peak;
+	__m128	true_peak;
+	__m128	history[TRUE_PEAK_TAPS * 2];
+};
+
+struct group_deleter
+{
+	void operator()(channel_group* groups) const
+	{
+		tbb::cache_aligned_allocator<channel_group>().deallocate(groups, 0);
+	}
+};
+
+}
+
+struct loudness_meter::implementation : boost::noncopyable
+{
+	const size_t									num_channels_;
+	const size_t									num_groups_;
+	const size_t									subblock_size_;
+	std::vector<double>								weights_;
+
+	std::unique_ptr<channel_group[], group_deleter>	groups_;
+	std::vector<int32_t>							padded_;
+	std::vector<float>								lanes_;
+
+	__m128											shelf_[5];
+	__m128											high_pass_[5];
+	__m128											true_peak_filter_[4][TRUE_PEAK_TAPS];
+
+	size_t											subblock_count_;
+	size_t											history_pos_;
+	std::vector<double>								subblocks_;		// Weighted energy of the last SUBBLOCKS_SHORT subblocks.
+	size_t											nb_subblocks_;
+
+	std::vector<uint64_t>							histogram_count_;
+	std::vector<double>								histogram_energy_;
+	double											integrated_;
+
+	implementation(const std::vector<double>& weights, int sample_rate)
+		: num_channels_(weights.size())
+		, num_groups_((weights.size() + 3) / 4)
+		, subblock_size_(static_cast<size_t>(sample_rate / 10))
+		, weights_(weights)
+		, groups_(tbb::cache_aligned_allocator<channel_group>().allocate(std::max<size_t>(1, (weights.size() + 3) / 4)))
+		, padded_(num_groups_ * 4, 0)
+		, lanes_(num_groups_ * 4, 0.0f)
+		, subblock_count_(0)
+		, history_pos_(0)
+		, subblocks_(SUBBLOCKS_SHORT, 0.0)
+		, nb_subblocks_(0)
+		, histogram_count_(static_cast<size_t>((HISTOGRAM_MAX - ABSOLUTE_GATE) / HISTOGRAM_STEP) + 1, 0)
+		, histogram_energy_(histogram_count_.size(), 0.0)
+		, integrated_(MIN_LOUDNESS)
+	{
+		if(weights.empty() || sample_rate < 10)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("loudness_meter: no channels or invalid sample rate."));
+
+		std::memset(groups_.get(), 0, sizeof(channel_group) * num_groups_);
+
+		biquad shelf, high_pass;
+		k_weighting(sample_rate, shelf, high_pass);
+
+		const double shelf_coeffs[]		= {shelf.b0, shelf.b1, shelf.b2, shelf.a1, shelf.a2};
+		const double high_pass_coeffs[]	= {high_pass.b0, high_pass.b1, high_pass.b2, high_pass.a1, high_pass.a2};
+		for(int n = 0; n < 5; ++n)
+		{
+			shelf_[n]		= _mm_set1_ps(static_cast<float>(shelf_coeffs[n]));
+			high_pass_[n]	= _mm_set1_ps(static_cast<float>(high_pass_coeffs[n]));
+		}
+
+		// Reversed so that tap t applies to history (oldest first) slot t.
+		for(int phase = 0; phase < 4; ++phase)
+		{
+			for(size_t t = 0; t < TRUE_PEAK_TAPS; ++t)
+				true_peak_filter_[phase][t] = _mm_set1_ps(TRUE_PEAK_FILTER[phase][TRUE_PEAK_TAPS - 1 - t]);
+		}
+	}
+
+	size_t num_channels() const
+	{
+		return num_channels_;
+	}
+
+	void process(const int32_t* samples, size_t nb_frames)
+	{
+		const __m128 scale		= _mm_set1_ps(SAMPLE_SCALE);
+		const __m128 abs_mask	= _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		const bool	 aligned	= num_channels_ % 4 == 0;
+
+		for(size_t n = 0; n < nb_frames; ++n, samples += num_channels_)
+		{
+			const int32_t* frame = samples;
+			if(!aligned)
+			{
+				std::memcpy(padded_.data(), samples, num_channels_ * sizeof(int32_t));
+				frame = padded_.data();
+			}
+
+			const auto write_pos = history_pos_;
+
+			for(size_t g = 0; g < num_groups_; ++g)
+			{
+				auto& group = groups_[g];
+
+				__m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(frame + g * 4))), scale);
+
+				group.sample_peak = _mm_max_ps(group.sample_peak, _mm_and_ps(x, abs_mask));
+
+				// True peak, the four interpolated phases of the newest sample.
+				group.history[write_pos]					= x;
+				group.history[write_pos + TRUE_PEAK_TAPS]	= x;
+
+				const __m128* window = group.history + write_pos + 1;
+				for(int phase = 0; phase < 4; ++phase)
+				{
+					__m128 y = _mm_setzero_ps();
+					for(size_t t = 0; t < TRUE_PEAK_TAPS; ++t)
+						y = _mm_add_ps(y, _mm_mul_ps(window[t], true_peak_filter_[phase][t]));
+					group.true_peak = _mm_max_ps(group.true_peak, _mm_and_ps(y, abs_mask));
+				}
+
+				// K-weighting, transposed direct form II.
+				__m128 y = _mm_add_ps(_mm_mul_ps(shelf_[0], x), group.shelf_z1);
+				group.shelf_z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(shelf_[1], x), _mm_mul_ps(shelf_[3], y)), group.shelf_z2);
+				group.shelf_z2 = _mm_sub_ps(_mm_mul_ps(shelf_[2], x), _mm_mul_ps(shelf_[4], y));
+
+				__m128 z = _mm_add_ps(_mm_mul_ps(high_pass_[0], y), group.high_pass_z1);
+				group.high_pass_z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(high_pass_[1], y), _mm_mul_ps(high_pass_[3], z)), group.high_pass_z2);
+				group.high_pass_z2 = _mm_sub_ps(_mm_mul_ps(high_pass_[2], y), _mm_mul_ps(high_pass_[4], z));
+
+				group.energy = _mm_add_ps(group.energy, _mm_mul_ps(z, z));
+			}
+
+			history_pos_ = (history_pos_ + 1) % TRUE_PEAK_TAPS;
+
+			if(++subblock_count_ == subblock_size_)
+				end_subblock();
+		}
+	}
+
+	double momentary() const
+	{
+		return window_loudness(SUBBLOCKS_MOMENTARY);
+	}
+
+	double short_term() const
+	{
+		return window_loudness(SUBBLOCKS_SHORT);
+	}
+
+	double integrated() const
+	{
+		return integrated_;
+	}
+
+	// Linear full scale peaks since the previous call.
+	void take_peaks(std::vector<float>& sample_peaks, std::vector<float>& true_peaks)
+	{
+		sample_peaks.resize(num_channels_);
+		true_peaks.resize(num_channels_);
+
+		for(size_t g = 0; g < num_groups_; ++g)
+		{
+			auto& group = groups_[g];
+
+			_mm_storeu_ps(lanes_.data() + g * 4, group.sample_peak);
+			group.sample_peak = _mm_setzero_ps();
+		}
+		std::copy(lanes_.begin(), lanes_.begin() + num_channels_, sample_peaks.begin());
+
+		for(size_t g = 0; g < num_groups_; ++g)
+		{
+			auto& group = groups_[g];
+
+			_mm_storeu_ps(lanes_.data() + g * 4, group.true_peak);
+			group.true_peak = _mm_setzero_ps();
+		}
+		std::copy(lanes_.begin(), lanes_.begin() + num_channels_, true_peaks.begin());
+
+		// The interpolation can not show less than the samples themselves.
+		for(size_t c = 0; c < num_channels_; ++c)
+			true_peaks[c] = std::max(true_peaks[c], sample_peaks[c]);
+	}
+
+	void end_subblock()
+	{
+		double energy = 0.0;
+
+		for(size_t g = 0; g < num_groups_; ++g)
+		{
+			auto& group = groups_[g];
+
+			_mm_storeu_ps(lanes_.data() + g * 4, group.energy);
+			group.energy = _mm_setzero_ps();
+		}
+
+		for(size_t c = 0; c < num_channels_; ++c)
+			energy += weights_[c] * lanes_[c];
+
+		subblocks_[nb_subblocks_ % SUBBLOCKS_SHORT] = energy / static_cast<double>(subblock_size_);
+		++nb_subblocks_;
+		subblock_count_ = 0;
+
+		// Gating blocks are 400 ms long with 75% overlap, one per subblock.
+		if(nb_subblocks_ >= SUBBLOCKS_MOMENTARY)
+			add_gating_block(momentary());
+	}
+
+	double window_loudness(size_t subblocks) const
+	{
+		if(nb_subblocks_ < subblocks)
+			return MIN_LOUDNESS;
+
+		double energy = 0.0;
+		for(size_t n = 0; n < subblocks; ++n)
+			energy += subblocks_[(nb_subblocks_ - 1 - n) % SUBBLOCKS_SHORT];
+
+		return to_loudness(energy / static_cast<double>(subblocks));
+	}
+
+	// Block loudness is kept in a histogram of HISTOGRAM_STEP LU bins, which
+	// bounds memory for any duration and the gating error to one bin.
+	void add_gating_block(double loudness)
+	{
+		if(loudness <= ABSOLUTE_GATE)
+			return;
+
+		auto bin = std::min(histogram_count_.size() - 1, static_cast<size_t>((loudness - ABSOLUTE_GATE) / HISTOGRAM_STEP));
+		histogram_count_[bin]	+= 1;
+		histogram_energy_[bin]	+= to_energy(loudness);
+
+		uint64_t	count	= 0;
+		double		energy	= 0.0;
+		for(size_t n = 0; n < histogram_count_.size(); ++n)
+		{
+			count	+= histogram_count_[n];
+			energy	+= histogram_energy_[n];
+		}
+
+		const auto relative_gate	= to_loudness(energy / static_cast<double>(count)) + RELATIVE_GATE;
+		const auto first_bin		= relative_gate <= ABSOLUTE_GATE ? 0 : static_cast<size_t>((relative_gate - ABSOLUTE_GATE) / HISTOGRAM_STEP);
+
+		count	= 0;
+		energy	= 0.0;
+		for(size_t n = first_bin; n < histogram_count_.size(); ++n)
+		{
+			count	+= histogram_count_[n];
+			energy	+= histogram_energy_[n];
+		}
+
+		integrated_ = count > 0 ? to_loudness(energy / static_cast<double>(count)) : MIN_LOUDNESS;
+	}
+};
+
+loudness_meter::loudness_meter(const std::vector<double>& weights, int sample_rate) : impl_(new implementation(weights, sample_rate)){}
+size_t loudness_meter::num_channels() const{return impl_->num_channels();}
+void loudness_meter::process(const int32_t* samples, size_t nb_frames){impl_->process(samples, nb_frames);}
+double loudness_meter::momentary() const{return impl_->momentary();}
+double loudness_meter::short_term() const{return impl_->short_term();}
+double loudness_meter::integrated() const{return impl_->integrated();}
+void loudness_meter::take_peaks(std::vector<float>& sample_peaks, std::vector<float>& true_peaks){impl_->take_peaks(sample_peaks, true_peaks);}
+
+}}
@@ -0,0 +1,59 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// ITU-R BS.1770-4 loudness and true peak of interleaved 32 bit samples, on 
+// the calling thread. Channels are processed four at a time in SSE lanes:
+// K-weighting biquads, energy per 100 ms subblock, sample peak and 4x
+// oversampled true peak. audio_meter runs one on its own thread.
+class loudness_meter : boost::noncopyable
+{
+public:
+	// One BS.1770 weight per channel, 0 leaves a channel (LFE) out of the loudness.
+	loudness_meter(const std::vector<double>& weights, int sample_rate);
+
+	size_t num_channels() const;
+
+	void process(const int32_t* samples, size_t nb_frames);
+
+	// LUFS, -200 until there is enough audio for the window.
+	double momentary() const;	// 400 ms
+	double short_term() const;	// 3 s
+	double integrated() const;	// Gated, since construction.
+
+	// Linear full scale peaks since the previous call.
+	void take_peaks(std::vector<float>& sample_peaks, std::vector<float>& true_peaks);
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
@@ -19,14 +19,13 @@
 * Author: Robert Nagy, ronag89@gmail.com
 */
 
-// TODO: Smart GC
-
 #include "../../stdafx.h"
 
 #include "ogl_device.h"
 
 #include "shader.h"
 
+#include <common/env.h>
 #include <common/exception/exceptions.h>
 #include <common/utility/assert.h>
 #include <common/gl/gl_check.h>
@@ -36,8 +35,76 @@
 
 #include <gl/glew.h>
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <vector>
+
 namespace caspar { namespace core {
 
+namespace {
+
+// Must be called on the ogl thread since the buffers are destroyed here.
+template<typename T>
+size_t release_idle(buffer_pool<T>& pool, int count)
+{
+	size_t released = 0;
+
+	std::shared_ptr<T> buffer;
+	for(int n = 0; n < count && pool.items.try_pop(buffer); ++n)
+	{
+		released += buffer->size();
+		++pool.trimmed;
+	}
+
+	return released;
+}
+
+// Keeps as many idle buffers as the pool needed at its peak during the last
+// interval, everything above that was never going to be used.
+template<typename T>
+size_t trim_to_high_water(buffer_pool<T>& pool)
+{
+	int in_use	= pool.in_use;
+	int spare	= std::max(0, pool.high_water - in_use);
+
+	auto released = release_idle(pool, static_cast<int>(pool.items.size()) - spare);
+
+	pool.high_water = in_use;
+
+	return released;
+}
+
+struct idle_pool
+{
+	unsigned int				last_use;
+	std::function<size_t(int)>	release;
+};
+
+template<typename T>
+void add_idle_pool(std::vector<idle_pool>& idle_pools, const safe_ptr<buffer_pool<T>>& pool)
+{
+	if(pool->items.size() <= 0)
+		return;
+
+	idle_pool idle;
+	idle.last_use	= pool->last_use;
+	idle.release	= [=](int count){return release_idle(*pool, count);};
+	idle_pools.push_back(idle);
+}
+
+template<typename T>
+void add_pool_statistics(boost::property_tree::wptree& pool_info, const buffer_pool<T>& pool)
+{
+	pool_info.add(L"in_use", static_cast<int>(pool.in_use));
+	pool_info.add(L"high_water", static_cast<int>(pool.high_water));
+	pool_info.add(L"allocations", static_cast<unsigned int>(pool.allocations));
+	pool_info.add(L"reuses", static_cast<unsigned int>(pool.reuses));
+	pool_info.add(L"trimmed", static_cast<unsigned int>(pool.trimmed));
+}
+
+}
+
 ogl_device::ogl_device() 
 	: executor_(L"ogl_device")
 	, pattern_(nullptr)
@@ -45,7 +112,13 @@ ogl_device::ogl_device()
 	, attached_fbo_(0)
 	, active_shader_(0)
 	, read_buffer_(0)
+	, pool_budget_(static_cast<size_t>(std::max(0, env::properties().get(L"configuration.gl.pool-budget-mb", 1024))) * 1024 * 1024)
+	, pool_trim_interval_millis_(env::properties().get(L"configuration.gl.pool-trim-interval-millis", 10000))
 {
+	pooled_size_	= 0;
+	tick_			= 0;
+	trim_pending_	= false;
+
 	CASPAR_LOG(info) << L"Initializing OpenGL Device.";
 
 	std::fill(binded_textures_.begin(), binded_textures_.end(), 0);
@@ -118,13 +191,25 @@ safe_ptr<device_buffer> ogl_device::create_device_buffer(size_t width, size_t he
 	CASPAR_VERIFY(width > 0 && height > 0);
 	auto& pool = device_pools_[stride-1 + (mipmapped ? 4 : 0)][((width << 16) & 0xFFFF0000) | (height & 0x0000FFFF)];
 	std::shared_ptr<device_buffer> buffer;
-	if(!pool->items.try_pop(buffer))		
+	if(pool->items.try_pop(buffer))
+	{
+		pooled_size_ -= buffer->size();
+		++pool->reuses;
+	}
+	else
+	{
 		buffer = executor_.invoke([&]{return allocate_device_buffer(width, height, stride, mipmapped);}, high_priority);			
+		pool->item_size = buffer->size();
+		++pool->allocations;
+	}
 	
-	//++pool->usage_count;
+	pool->acquired(tick_);
 
+	auto self = shared_from_this();
 	return safe_ptr<device_buffer>(buffer.get(), [=](device_buffer*) mutable
 	{		
+		--pool->in_use;
+		self->pooled_size_ += buffer->size();
 		pool->items.push(buffer);	
 	});
 }
@@ -173,14 +258,24 @@ safe_ptr<host_buffer> ogl_device::create_host_buffer(size_t size, host_buffer::u
 	CASPAR_VERIFY(size > 0);
 	auto& pool = host_pools_[usage][size];
 	std::shared_ptr<host_buffer> buffer;
-	if(!pool->items.try_pop(buffer))	
+	if(pool->items.try_pop(buffer))
+	{
+		pooled_size_ -= buffer->size();
+		++pool->reuses;
+	}
+	else
+	{
 		buffer = executor_.invoke([=]{return allocate_host_buffer(size, usage);}, high_priority);	
+		pool->item_size = size;
+		++pool->allocations;
+	}
 	
-	//++pool->usage_count;
+	pool->acquired(tick_);
 
 	auto self = shared_from_this();
 	return safe_ptr<host_buffer>(buffer.get(), [=](host_buffer*) mutable
 	{
+		--pool->in_use;
 		self->executor_.begin_invoke([=]() mutable
 		{		
 			if(usage == host_buffer::write_only)
@@ -188,6 +283,7 @@ safe_ptr<host_buffer> ogl_device::create_host_buffer(size_t size, host_buffer::u
 			else
 				buffer->unmap();
 
+			self->pooled_size_ += buffer->size();
 			pool->items.push(buffer);
 		}, high_priority);	
 	});
@@ -198,43 +294,89 @@ safe_ptr<ogl_device> ogl_device::create()
 	return safe_ptr<ogl_device>(new ogl_device());
 }
 
-//template<typename T>
-//void flush_pool(buffer_pool<T>& pool)
-//{	
-//	if(pool.flush_count.fetch_and_increment() < 16)
-//		return;
-//
-//	if(pool.usage_count.fetch_and_store(0) < pool.items.size())
-//	{
-//		std::shared_ptr<T> buffer;
-//		pool.items.try_pop(buffer);
-//	}
-//
-//	pool.flush_count = 0;
-//	pool.usage_count = 0;
-//}
-
 void ogl_device::flush()
 {
 	GL(glFlush());	
+
+	++tick_;
 		
-	//try
-	//{
-	//	BOOST_FOREACH(auto& pools, device_pools_)
-	//	{
-	//		BOOST_FOREACH(auto& pool, pools)
-	//			flush_pool(*pool.second);
-	//	}
-	//	BOOST_FOREACH(auto& pools, host_pools_)
-	//	{
-	//		BOOST_FOREACH(auto& pool, pools)
-	//			flush_pool(*pool.second);
-	//	}
-	//}
-	//catch(...)
-	//{
-	//	CASPAR_LOG_CURRENT_EXCEPTION();
-	//}
+	bool interval_elapsed	= pool_trim_interval_millis_ > 0 && trim_timer_.elapsed() * 1000.0 >= pool_trim_interval_millis_;
+	bool over_budget		= pool_budget_ > 0 && pooled_size_ > pool_budget_;
+
+	if((interval_elapsed || over_budget) && !trim_pending_.fetch_and_store(true))
+	{
+		if(interval_elapsed)
+			trim_timer_.restart();
+
+		// Queued behind the current frame instead of delaying it.
+		executor_.begin_invoke([=]{trim(interval_elapsed);});
+	}
+}
+
+void ogl_device::trim(bool interval_elapsed)
+{
+	trim_pending_ = false;
+
+	try
+	{
+		size_t released = 0;
+
+		if(interval_elapsed)
+		{
+			BOOST_FOREACH(auto& pools, device_pools_)
+			{
+				BOOST_FOREACH(auto& pool, pools)
+					released += trim_to_high_water(*pool.second);
+			}
+			BOOST_FOREACH(auto& pools, host_pools_)
+			{
+				BOOST_FOREACH(auto& pool, pools)
+					released += trim_to_high_water(*pool.second);
+			}
+			pooled_size_ -= released;
+		}
+
+		if(pool_budget_ > 0 && pooled_size_ > pool_budget_)
+		{
+			// Least recently used sizes go first.
+			std::vector<idle_pool> idle_pools;
+			BOOST_FOREACH(auto& pools, device_pools_)
+			{
+				BOOST_FOREACH(auto& pool, pools)
+					add_idle_pool(idle_pools, pool.second);
+			}
+			BOOST_FOREACH(auto& pools, host_pools_)
+			{
+				BOOST_FOREACH(auto& pool, pools)
+					add_idle_pool(idle_pools, pool.second);
+			}
+
+			std::sort(idle_pools.begin(), idle_pools.end(), [](const idle_pool& lhs, const idle_pool& rhs)
+			{
+				return lhs.last_use < rhs.last_use;
+			});
+
+			BOOST_FOREACH(auto& idle, idle_pools)
+			{
+				while(pooled_size_ > pool_budget_)
+				{
+					auto size = idle.release(1);
+					if(size == 0)
+						break;
+
+					pooled_size_ -= size;
+					released	 += size;
+				}
+			}
+		}
+
+		if(released > 0)
+			CASPAR_LOG(debug) << L" ogl: Trimmed " << released << L" bytes of pooled buffers, " << pooled_size_ << L" bytes remain pooled.";
+	}
+	catch(...)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+	}
 }
 
 void ogl_device::yield()
@@ -249,6 +391,9 @@ boost::property_tree::wptree ogl_device::info() const
 	boost::property_tree::wptree pooled_device_buffers;
 	size_t total_pooled_device_buffer_size = 0;
 	size_t total_pooled_device_buffer_count = 0;
+	size_t total_allocations = 0;
+	size_t total_reuses = 0;
+	size_t total_trimmed = 0;
 
 	for (size_t i = 0; i < device_pools_.size(); ++i)
 	{
@@ -263,7 +408,11 @@ boost::property_tree::wptree ogl_device::info() const
 			auto size = width * height * stride;
 			auto count = pool.second->items.size();
 
-			if (count == 0)
+			total_allocations += pool.second->allocations;
+			total_reuses += pool.second->reuses;
+			total_trimmed += pool.second->trimmed;
+
+			if (count == 0 && pool.second->in_use == 0)
 				continue;
 
 			boost::property_tree::wptree pool_info;
@@ -274,6 +423,7 @@ boost::property_tree::wptree ogl_device::info() const
 			pool_info.add(L"height", height);
 			pool_info.add(L"size", size);
 			pool_info.add(L"count", count);
+			add_pool_statistics(pool_info, *pool.second);
 
 			total_pooled_device_buffer_size += size * count;
 			total_pooled_device_buffer_count += count;
@@ -300,7 +450,11 @@ boost::property_tree::wptree ogl_device::info() const
 			auto size = pool.first;
 			auto count = pool.second->items.size();
 
-			if (count == 0)
+			total_allocations += pool.second->allocations;
+			total_reuses += pool.second->reuses;
+			total_trimmed += pool.second->trimmed;
+
+			if (count == 0 && pool.second->in_use == 0)
 				continue;
 
 			boost::property_tree::wptree pool_info;
@@ -309,6 +463,7 @@ boost::property_tree::wptree ogl_device::info() const
 				? L"read_only" : L"write_only");
 			pool_info.add(L"size", size);
 			pool_info.add(L"count", count);
+			add_pool_statistics(pool_info, *pool.second);
 
 			pooled_host_buffers.add_child(L"host_buffer_pool", pool_info);
 
@@ -329,6 +484,13 @@ boost::property_tree::wptree ogl_device::info() const
 	info.add(L"gl.summary.pooled_host_buffers.total_read_size", total_read_size);
 	info.add(L"gl.summary.pooled_host_buffers.total_write_size", total_write_size);
 	info.add_child(L"gl.summary.all_host_buffers", host_buffer::info());
+	info.add(L"gl.summary.pools.budget", pool_budget_);
+	info.add(L"gl.summary.pools.pooled_size", static_cast<size_t>(pooled_size_));
+	info.add(L"gl.summary.pools.trim_interval_millis", pool_trim_interval_millis_);
+	info.add(L"gl.summary.pools.allocations", total_allocations);
+	info.add(L"gl.summary.pools.reuses", total_reuses);
+	info.add(L"gl.summary.pools.reuse_rate", total_allocations + total_reuses > 0 ? static_cast<double>(total_reuses) / static_cast<double>(total_allocations + total_reuses) : 0.0);
+	info.add(L"gl.summary.pools.trimmed", total_trimmed);
 
 	return info;
 }
@@ -341,16 +503,20 @@ boost::unique_future<void> ogl_device::gc()
 	
 		try
 		{
+			size_t released = 0;
+
 			BOOST_FOREACH(auto& pools, device_pools_)
 			{
 				BOOST_FOREACH(auto& pool, pools)
-					pool.second->items.clear();
+					released += release_idle(*pool.second, std::numeric_limits<int>::max());
 			}
 			BOOST_FOREACH(auto& pools, host_pools_)
 			{
 				BOOST_FOREACH(auto& pool, pools)
-					pool.second->items.clear();
+					released += release_idle(*pool.second, std::numeric_limits<int>::max());
 			}
+
+			pooled_size_ -= released;
 		}
 		catch(...)
 		{
@@ -359,6 +525,30 @@ boost::unique_future<void> ogl_device::gc()
 	}, high_priority);
 }
 
+boost::unique_future<void> ogl_device::prewarm(size_t width, size_t height, size_t count)
+{
+	return begin_invoke([=]
+	{
+		try
+		{
+			std::vector<safe_ptr<device_buffer>> device_buffers;
+			std::vector<safe_ptr<host_buffer>>	 host_buffers;
+
+			// Returned to the pools when going out of scope.
+			for(size_t n = 0; n < count; ++n)
+			{
+				device_buffers.push_back(create_device_buffer(width, height, 4, false));
+				host_buffers.push_back(create_host_buffer(width*height*4, host_buffer::read_only));
+				host_buffers.push_back(create_host_buffer(width*height*4, host_buffer::write_only));
+			}
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+	});
+}
+
 std::wstring ogl_device::version()
 {	
 	static std::wstring ver = L"Not found";
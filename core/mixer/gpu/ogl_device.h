@@ -35,6 +35,7 @@
 #include <tbb/concurrent_queue.h>
 
 #include <boost/noncopyable.hpp>
+#include <boost/timer.hpp>
 #include <boost/thread/future.hpp>
 #include <boost/property_tree/ptree_fwd.hpp>
 
@@ -45,17 +46,41 @@ namespace caspar { namespace core {
 
 class shader;
 
+// Idle buffers of one size. in_use and high_water tell the trimming how many
+// idle buffers the pool actually needed since the last trim interval.
 template<typename T>
 struct buffer_pool
 {
-	tbb::atomic<int> usage_count;
-	tbb::atomic<int> flush_count;
+	tbb::atomic<size_t>			item_size;
+	tbb::atomic<int>			in_use;
+	tbb::atomic<int>			high_water;
+	tbb::atomic<unsigned int>	last_use;
+	tbb::atomic<unsigned int>	allocations;
+	tbb::atomic<unsigned int>	reuses;
+	tbb::atomic<unsigned int>	trimmed;
 	tbb::concurrent_bounded_queue<std::shared_ptr<T>> items;
 
 	buffer_pool()
 	{
-		usage_count = 0;
-		flush_count = 0;
+		item_size	= 0;
+		in_use		= 0;
+		high_water	= 0;
+		last_use	= 0;
+		allocations = 0;
+		reuses		= 0;
+		trimmed		= 0;
+	}
+
+	void acquired(unsigned int tick)
+	{
+		last_use = tick;
+
+		int count = ++in_use;
+		for(int peak = high_water; count > peak; peak = high_water)
+		{
+			if(high_water.compare_and_swap(count, peak) == peak)
+				break;
+		}
 	}
 };
 
@@ -76,6 +101,13 @@ class ogl_device : public std::enable_shared_from_this<ogl_device>, boost::nonco
 	
 	std::array<tbb::concurrent_unordered_map<size_t, safe_ptr<buffer_pool<device_buffer>>>, 8> device_pools_;
 	std::array<tbb::concurrent_unordered_map<size_t, safe_ptr<buffer_pool<host_buffer>>>, 2> host_pools_;
+
+	const size_t					 pool_budget_;
+	const int						 pool_trim_interval_millis_;
+	tbb::atomic<size_t>				 pooled_size_;
+	tbb::atomic<unsigned int>		 tick_;
+	tbb::atomic<bool>				 trim_pending_;
+	boost::timer					 trim_timer_;
 	
 	GLuint fbo_;
 
@@ -125,11 +157,16 @@ public:
 	boost::property_tree::wptree info() const;
 	boost::unique_future<void> gc();
 
+	// Fills the pools with the buffers a channel of the given resolution
+	// uses every frame, so the first frames don't pay for the allocations.
+	boost::unique_future<void> prewarm(size_t width, size_t height, size_t count);
+
 	std::wstring version();
 
 private:
 	safe_ptr<device_buffer> allocate_device_buffer(size_t width, size_t height, size_t stride, bool mipmapped);
 	safe_ptr<host_buffer> allocate_host_buffer(size_t size, host_buffer::usage_t usage);
+	void trim(bool interval_elapsed);
 };
 
 }}
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "image_culling.h"
+#include "image_kernel.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace caspar { namespace core {
+
+bool is_invisible(const frame_transform& transform, double aspect_ratio)
+{
+	static const double epsilon = 0.001;
+
+	if (transform.is_key)
+		return false;
+
+	return transform.field_mode == field_mode::empty
+		|| transform.opacity < epsilon
+		|| is_outside_screen(transform, aspect_ratio);
+}
+
+bool is_opaque_fill(const pixel_format_desc& pix_desc, const frame_transform& transform)
+{
+	if (pix_desc.planes.empty())
+		return false;
+
+	if (pix_desc.pix_fmt != pixel_format::ycbcr && pix_desc.pix_fmt != pixel_format::uyvy && pix_desc.pix_fmt != pixel_format::gray && pix_desc.pix_fmt != pixel_format::luma)
+		return false;
+
+	if (transform.is_key || transform.is_mix || transform.opacity < 1.0 || transform.field_mode != field_mode::progressive)
+		return false;
+
+	// Same condition as the scissor test of the image_kernel.
+	auto m_p = transform.clip_translation;
+	auto m_s = transform.clip_scale;
+
+	if (m_p[0] > std::numeric_limits<double>::epsilon()			|| m_p[1] > std::numeric_limits<double>::epsilon() ||
+		m_s[0] < (1.0 - std::numeric_limits<double>::epsilon())	|| m_s[1] < (1.0 - std::numeric_limits<double>::epsilon()))
+		return false;
+
+	if (transform.angle != 0.0)
+		return false;
+
+	const corners straight;
+	auto pers = transform.perspective;
+
+	if (pers.ul != straight.ul || pers.ur != straight.ur || pers.lr != straight.lr || pers.ll != straight.ll)
+		return false;
+
+	auto f_p	= transform.fill_translation;
+	auto f_s	= transform.fill_scale;
+	auto anchor	= transform.anchor;
+	auto crop	= transform.crop;
+
+	for (int n = 0; n < 2; ++n)
+	{
+		auto from	= f_p[n] + (crop.ul[n] - anchor[n]) * f_s[n];
+		auto to		= f_p[n] + (crop.lr[n] - anchor[n]) * f_s[n];
+
+		if (std::min(from, to) > 0.0 || std::max(from, to) < 1.0)
+			return false;
+	}
+
+	return true;
+}
+
+}}
@@ -0,0 +1,163 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include "blend_modes.h"
+
+#include <core/producer/frame/frame_transform.h>
+#include <core/producer/frame/pixel_format.h>
+
+#include <boost/foreach.hpp>
+#include <boost/range/algorithm_ext/erase.hpp>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace core {
+
+struct culling_stats
+{
+	size_t	items;
+	size_t	invisible;
+	size_t	occluded;
+
+	culling_stats()
+		: items(0)
+		, invisible(0)
+		, occluded(0)
+	{
+	}
+};
+
+// Whether an item draws nothing, because it is in no field, fully transparent
+// or entirely outside the screen.
+bool is_invisible(const frame_transform& transform, double aspect_ratio);
+
+// Whether an item overwrites every pixel of both fields: a format without
+// alpha drawn at full opacity, unclipped, unrotated and covering the screen.
+bool is_opaque_fill(const pixel_format_desc& pix_desc, const frame_transform& transform);
+
+// Drops the items of a layer stack that cannot contribute to the output. The
+// stack is ordered bottom to top and an item only needs a pix_desc and a
+// transform. Everything drawn before the topmost opaque fill is removed, and
+// so are invisible items. Keys and mixes apply to the items drawn after them,
+// so layers holding key or mix items keep their invisible items, and opaque
+// fills are only searched below the lowest key.
+template<typename T>
+culling_stats cull_layers(std::vector<std::pair<blend_mode, std::vector<T>>>& layers, double aspect_ratio)
+{
+	typedef std::pair<blend_mode, std::vector<T>> layer_t;
+
+	culling_stats stats;
+
+	auto has_key = [](const layer_t& layer) -> bool
+	{
+		return std::any_of(layer.second.begin(), layer.second.end(), [](const T& item)
+		{
+			return item.transform.is_key;
+		});
+	};
+
+	auto has_mix = [](const layer_t& layer) -> bool
+	{
+		return std::any_of(layer.second.begin(), layer.second.end(), [](const T& item)
+		{
+			return item.transform.is_mix;
+		});
+	};
+
+	BOOST_FOREACH(auto& layer, layers)
+		stats.items += layer.second.size();
+
+	// Occlusion
+
+	auto first_key = static_cast<int>(std::find_if(layers.begin(), layers.end(), has_key) - layers.begin());
+
+	for (int n = first_key - 1; n >= 0; --n)
+	{
+		auto& layer = layers[n];
+
+		if (layer.first.mode != blend_mode::normal || layer.first.chroma.key != chroma::none)
+			continue;
+
+		auto fill = std::find_if(layer.second.rbegin(), layer.second.rend(), [](const T& item)
+		{
+			return is_opaque_fill(item.pix_desc, item.transform);
+		});
+
+		if (fill == layer.second.rend())
+			continue;
+
+		for (int m = 0; m < n; ++m)
+		{
+			stats.occluded += layers[m].second.size();
+			layers[m].second.clear();
+		}
+
+		auto hidden = layer.second.size() - (fill - layer.second.rbegin()) - 1;
+		stats.occluded += hidden;
+		layer.second.erase(layer.second.begin(), layer.second.begin() + hidden);
+
+		break;
+	}
+
+	// Invisible items. An emptied layer would pass a key from below on to the
+	// layer above it, so above the lowest key layers are either kept or trimmed.
+
+	bool key_below = false;
+
+	BOOST_FOREACH(auto& layer, layers)
+	{
+		if (has_key(layer))
+		{
+			key_below = true;
+			continue;
+		}
+
+		if (has_mix(layer))
+			continue;
+
+		auto visible = std::count_if(layer.second.begin(), layer.second.end(), [&](const T& item)
+		{
+			return !is_invisible(item.transform, aspect_ratio);
+		});
+
+		if (visible == 0 && key_below)
+			continue;
+
+		stats.invisible += layer.second.size() - visible;
+		boost::remove_erase_if(layer.second, [&](const T& item)
+		{
+			return is_invisible(item.transform, aspect_ratio);
+		});
+	}
+
+	boost::remove_erase_if(layers, [](const layer_t& layer)
+	{
+		return layer.second.empty();
+	});
+
+	return stats;
+}
+
+}}
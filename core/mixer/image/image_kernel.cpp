@@ -116,6 +116,74 @@ bool is_outside_screen(
 		|| (is_right_of_screen(x1) && is_right_of_screen(x2) && is_right_of_screen(x3) && is_right_of_screen(x4));
 }
 
+struct screen_quad
+{
+	double upper_left_x;
+	double upper_left_y;
+	double upper_right_x;
+	double upper_right_y;
+	double lower_right_x;
+	double lower_right_y;
+	double lower_left_x;
+	double lower_left_y;
+};
+
+// Screen coordinates of the corners an item is drawn at.
+screen_quad get_quad(const frame_transform& transform, double aspect_ratio)
+{
+	auto f_p = transform.fill_translation;
+	auto f_s = transform.fill_scale;
+
+	// Calculate rotation
+	auto aspect = aspect_ratio;
+	auto angle = transform.angle;
+
+	auto rotate = [angle, aspect](double orig_x, double orig_y) -> boost::array<double, 2>
+	{
+		boost::array<double, 2> result;
+		result[0] = orig_x * std::cos(angle) - orig_y * std::sin(angle);
+		result[1] = orig_x * std::sin(angle) + orig_y * std::cos(angle);
+		result[1] *= aspect;
+
+		return result;
+	};
+
+	auto anchor = transform.anchor;
+	auto crop = transform.crop;
+	auto pers = transform.perspective;
+
+	auto ul = rotate((-anchor[0] + pers.ul[0] + crop.ul[0]      ) * f_s[0], (-anchor[1] + pers.ul[1] + crop.ul[1]      ) * f_s[1] / aspect);
+	auto ur = rotate((-anchor[0] + pers.ur[0] + crop.lr[0] - 1.0) * f_s[0], (-anchor[1] + pers.ur[1] + crop.ul[1]      ) * f_s[1] / aspect);
+	auto lr = rotate((-anchor[0] + pers.lr[0] + crop.lr[0] - 1.0) * f_s[0], (-anchor[1] + pers.lr[1] + crop.lr[1] - 1.0) * f_s[1] / aspect);
+	auto ll = rotate((-anchor[0] + pers.ll[0] + crop.ul[0]      ) * f_s[0], (-anchor[1] + pers.ll[1] + crop.lr[1] - 1.0) * f_s[1] / aspect);
+
+	screen_quad result;
+	result.upper_left_x =  f_p[0] + ul[0];
+	result.upper_left_y =  f_p[1] + ul[1];
+	result.upper_right_x = f_p[0] + ur[0];
+	result.upper_right_y = f_p[1] + ur[1];
+	result.lower_right_x = f_p[0] + lr[0];
+	result.lower_right_y = f_p[1] + lr[1];
+	result.lower_left_x =  f_p[0] + ll[0];
+	result.lower_left_y =  f_p[1] + ll[1];
+
+	return result;
+}
+
+bool is_outside_screen(const screen_quad& quad)
+{
+	return is_outside_screen(
+			quad.upper_left_x, quad.upper_left_y,
+			quad.upper_right_x, quad.upper_right_y,
+			quad.lower_right_x, quad.lower_right_y,
+			quad.lower_left_x, quad.lower_left_y);
+}
+
+bool is_outside_screen(const frame_transform& transform, double aspect_ratio)
+{
+	return is_outside_screen(get_quad(transform, aspect_ratio));
+}
+
 GLubyte upper_pattern[] = {
 	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
 	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,	0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00,
@@ -157,50 +225,13 @@ struct image_kernel::implementation : boost::noncopyable
 		if(params.transform.opacity < epsilon)
 			return;
 
-		auto f_p = params.transform.fill_translation;
-		auto f_s = params.transform.fill_scale;
-
-		// Calculate rotation
-		auto aspect = params.aspect_ratio;
-		auto angle = params.transform.angle;
-
-		auto rotate = [angle, aspect](double orig_x, double orig_y) -> boost::array<double, 2>
-		{
-			boost::array<double, 2> result;
-			result[0] = orig_x * std::cos(angle) - orig_y * std::sin(angle);
-			result[1] = orig_x * std::sin(angle) + orig_y * std::cos(angle);
-			result[1] *= aspect;
-
-			return result;
-		};
-
-		auto anchor = params.transform.anchor;
 		auto crop = params.transform.crop;
 		auto pers = params.transform.perspective;
-
-		auto ul = rotate((-anchor[0] + pers.ul[0] + crop.ul[0]      ) * f_s[0], (-anchor[1] + pers.ul[1] + crop.ul[1]      ) * f_s[1] / aspect);
-		auto ur = rotate((-anchor[0] + pers.ur[0] + crop.lr[0] - 1.0) * f_s[0], (-anchor[1] + pers.ur[1] + crop.ul[1]      ) * f_s[1] / aspect);
-		auto lr = rotate((-anchor[0] + pers.lr[0] + crop.lr[0] - 1.0) * f_s[0], (-anchor[1] + pers.lr[1] + crop.lr[1] - 1.0) * f_s[1] / aspect);
-		auto ll = rotate((-anchor[0] + pers.ll[0] + crop.ul[0]      ) * f_s[0], (-anchor[1] + pers.ll[1] + crop.lr[1] - 1.0) * f_s[1] / aspect);
-
-		auto upper_left_x =  f_p[0] + ul[0];
-		auto upper_left_y =  f_p[1] + ul[1];
-		auto upper_right_x = f_p[0] + ur[0];
-		auto upper_right_y = f_p[1] + ur[1];
-		auto lower_right_x = f_p[0] + lr[0];
-		auto lower_right_y = f_p[1] + lr[1];
-		auto lower_left_x =  f_p[0] + ll[0];
-		auto lower_left_y =  f_p[1] + ll[1];
+		auto quad = get_quad(params.transform, params.aspect_ratio);
 
 		// Skip drawing if the QUAD will be outside the screen.
-		if (is_outside_screen(
-					upper_left_x, upper_left_y,
-					upper_right_x, upper_right_y,
-					lower_right_x, lower_right_y,
-					lower_left_x, lower_left_y))
-		{
+		if (is_outside_screen(quad))
 			return;
-		}
 		
 		if(!std::all_of(params.textures.begin(), params.textures.end(), std::mem_fn(&device_buffer::ready)))
 		{
@@ -378,10 +409,10 @@ struct image_kernel::implementation : boost::noncopyable
 			GL_TEXTURE1 are texture coordinates to background- / key-material, that which will have to be taken in consideration when blending. These are set to the rectangle over which the source will be rendered
 		*/
 		glBegin(GL_QUADS);
-			glMultiTexCoord4d(GL_TEXTURE0, crop.ul[0] * ulq, crop.ul[1] * ulq, 0, ulq); glMultiTexCoord2d(GL_TEXTURE1, upper_left_x,  upper_left_y);		glVertex2d(upper_left_x  * 2.0 - 1.0, upper_left_y  * 2.0 - 1.0);
-			glMultiTexCoord4d(GL_TEXTURE0, crop.lr[0] * urq, crop.ul[1] * urq, 0, urq); glMultiTexCoord2d(GL_TEXTURE1, upper_right_x, upper_right_y);		glVertex2d(upper_right_x * 2.0 - 1.0, upper_right_y * 2.0 - 1.0);
-			glMultiTexCoord4d(GL_TEXTURE0, crop.lr[0] * lrq, crop.lr[1] * lrq, 0, lrq); glMultiTexCoord2d(GL_TEXTURE1, lower_right_x, lower_right_y);		glVertex2d(lower_right_x * 2.0 - 1.0, lower_right_y * 2.0 - 1.0);
-			glMultiTexCoord4d(GL_TEXTURE0, crop.ul[0] * llq, crop.lr[1] * llq, 0, llq); glMultiTexCoord2d(GL_TEXTURE1, lower_left_x,  lower_left_y);		glVertex2d(lower_left_x  * 2.0 - 1.0, lower_left_y  * 2.0 - 1.0);
+			glMultiTexCoord4d(GL_TEXTURE0, crop.ul[0] * ulq, crop.ul[1] * ulq, 0, ulq); glMultiTexCoord2d(GL_TEXTURE1, quad.upper_left_x,  quad.upper_left_y);		glVertex2d(quad.upper_left_x  * 2.0 - 1.0, quad.upper_left_y  * 2.0 - 1.0);
+			glMultiTexCoord4d(GL_TEXTURE0, crop.lr[0] * urq, crop.ul[1] * urq, 0, urq); glMultiTexCoord2d(GL_TEXTURE1, quad.upper_right_x, quad.upper_right_y);		glVertex2d(quad.upper_right_x * 2.0 - 1.0, quad.upper_right_y * 2.0 - 1.0);
+			glMultiTexCoord4d(GL_TEXTURE0, crop.lr[0] * lrq, crop.lr[1] * lrq, 0, lrq); glMultiTexCoord2d(GL_TEXTURE1, quad.lower_right_x, quad.lower_right_y);		glVertex2d(quad.lower_right_x * 2.0 - 1.0, quad.lower_right_y * 2.0 - 1.0);
+			glMultiTexCoord4d(GL_TEXTURE0, crop.ul[0] * llq, crop.lr[1] * llq, 0, llq); glMultiTexCoord2d(GL_TEXTURE1, quad.lower_left_x,  quad.lower_left_y);		glVertex2d(quad.lower_left_x  * 2.0 - 1.0, quad.lower_left_y  * 2.0 - 1.0);
 		glEnd();
 		
 		// Cleanup
@@ -64,6 +64,9 @@ struct draw_params
 	}
 };
 
+// Whether an item drawn with the transform lies entirely outside the screen.
+bool is_outside_screen(const frame_transform& transform, double aspect_ratio);
+
 class image_kernel : boost::noncopyable
 {
 public:
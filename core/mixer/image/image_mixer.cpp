@@ -23,12 +23,15 @@
 
 #include "image_mixer.h"
 
+#include "image_culling.h"
 #include "image_kernel.h"
 #include "../write_frame.h"
 #include "../gpu/ogl_device.h"
 #include "../gpu/host_buffer.h"
 #include "../gpu/device_buffer.h"
 
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/exception/exceptions.h>
 #include <common/gl/gl_check.h>
 #include <common/utility/move_on_copy.h>
@@ -247,15 +250,21 @@ private:
 struct image_mixer::implementation : boost::noncopyable
 {	
 	safe_ptr<ogl_device>			ogl_;
+	safe_ptr<diagnostics::graph>	graph_;
 	image_renderer					renderer_;
 	std::vector<frame_transform>	transform_stack_;
 	std::vector<layer>				layers_; // layer/stream/items
+	const bool						culling_;
 public:
-	implementation(const safe_ptr<ogl_device>& ogl) 
+	implementation(const safe_ptr<ogl_device>& ogl, const safe_ptr<diagnostics::graph>& graph) 
 		: ogl_(ogl)
+		, graph_(graph)
 		, renderer_(ogl)
 		, transform_stack_(1)	
+		, culling_(env::properties().get(L"configuration.mixer.culling", true))
 	{
+		graph_->set_color("culled-invisible", diagnostics::color(0.4f, 0.8f, 0.4f));
+		graph_->set_color("culled-occluded", diagnostics::color(0.2f, 0.5f, 0.9f));
 	}
 
 	void begin_layer(blend_mode blend_mode)
@@ -289,11 +298,20 @@ public:
 	
 	boost::unique_future<safe_ptr<host_buffer>> render(const video_format_desc& format_desc, bool straighten_alpha)
 	{
+		if(culling_)
+		{
+			auto stats = cull_layers(layers_, static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height));
+			auto items = static_cast<double>(std::max<size_t>(stats.items, 1));
+
+			graph_->set_value("culled-invisible", static_cast<double>(stats.invisible) / items);
+			graph_->set_value("culled-occluded", static_cast<double>(stats.occluded) / items);
+		}
+
 		return renderer_(std::move(layers_), format_desc, straighten_alpha);
 	}
 };
 
-image_mixer::image_mixer(const safe_ptr<ogl_device>& ogl) : impl_(new implementation(ogl)){}
+image_mixer::image_mixer(const safe_ptr<ogl_device>& ogl, const safe_ptr<diagnostics::graph>& graph) : impl_(new implementation(ogl, graph)){}
 void image_mixer::begin(basic_frame& frame){impl_->begin(frame);}
 void image_mixer::visit(write_frame& frame){impl_->visit(frame);}
 void image_mixer::end(){impl_->end();}
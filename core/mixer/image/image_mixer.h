@@ -31,7 +31,15 @@
 
 #include <boost/thread/future.hpp>
 
-namespace caspar { namespace core {
+namespace caspar {
+
+namespace diagnostics {
+
+class graph;
+
+}
+
+namespace core {
 
 class write_frame;
 class host_buffer;
@@ -42,7 +50,7 @@ struct pixel_format_desc;
 class image_mixer : public core::frame_visitor, boost::noncopyable
 {
 public:
-	image_mixer(const safe_ptr<ogl_device>& ogl);
+	image_mixer(const safe_ptr<ogl_device>& ogl, const safe_ptr<diagnostics::graph>& graph);
 	
 	virtual void begin(core::basic_frame& frame);
 	virtual void visit(core::write_frame& frame);
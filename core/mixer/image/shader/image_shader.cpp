@@ -223,6 +223,14 @@ std::string get_fragment(bool blend_modes, bool chroma_key, bool post_processing
 	"		return ycbcra_to_rgba_sd(y, cb, cr, a);										\n"
 	"}																					\n"
 	"																					\n"
+	"float get_uyvy_luma(float x, float t)												\n"
+	"{																					\n"
+	"	float width = float(textureSize(plane[0], 0).x);								\n"
+	"	x = clamp(x, 0.0, width * 2.0 - 1.0);											\n"
+	"	vec4  cbycry = texture2D(plane[0], vec2((floor(x / 2.0) + 0.5) / width, t));	\n"
+	"	return mod(x, 2.0) < 1.0 ? cbycry.g : cbycry.a;									\n"
+	"}																					\n"
+	"																					\n"
 	"vec4 get_rgba_color()																\n"
 	"{																					\n"
 	"	switch(pixel_format)															\n"
@@ -257,6 +265,14 @@ std::string get_fragment(bool blend_modes, bool chroma_key, bool post_processing
 	"			vec3 y3 = texture2D(plane[0], gl_TexCoord[0].st / gl_TexCoord[0].q).rrr;					\n"
 	"			return vec4((y3-0.065)/0.859, 1.0);										\n"
 	"		}																			\n"
+	"	case 8:		//uyvy																\n"
+	"		{																			\n"
+	"			vec2  coord  = gl_TexCoord[0].st / gl_TexCoord[0].q;					\n"
+	"			vec4  cbycry = texture2D(plane[0], coord);								\n"
+	"			float x      = coord.s * float(textureSize(plane[0], 0).x) * 2.0 - 0.5;	\n"
+	"			float y      = mix(get_uyvy_luma(floor(x), coord.t), get_uyvy_luma(floor(x) + 1.0, coord.t), fract(x));\n"
+	"			return ycbcra_to_rgba(y, cbycry.b, cbycry.r, 1.0);						\n"
+	"		}																			\n"
 	"	}																				\n"
 	"	return vec4(0.0, 0.0, 0.0, 0.0);												\n"
 	"}																					\n"
@@ -143,7 +143,7 @@ public:
 		, audio_channel_layout_(audio_channel_layout)
 		, straighten_alpha_(false)
 		, audio_mixer_(graph_)
-		, image_mixer_(ogl)
+		, image_mixer_(ogl, graph_)
 		, executor_(L"mixer " + boost::lexical_cast<std::wstring>(channel_index))
 		, monitor_subject_(make_safe<monitor::subject>("/mixer"))
 	{
@@ -159,7 +159,7 @@ public:
 		audio_mixer_.monitor_output().attach_parent(monitor_subject_);
 	}
 	
-	void send(const std::pair<std::map<int, safe_ptr<core::basic_frame>>, std::shared_ptr<void>>& packet)
+	void send(const std::pair<stage_frames, std::shared_ptr<void>>& packet)
 	{			
 		executor_.begin_invoke([=]
 		{		
@@ -167,7 +167,7 @@ public:
 			{
 				mix_timer_.restart();
 
-				auto frames = packet.first;
+				auto frames = packet.first.layers;
 				
 				BOOST_FOREACH(auto& frame, frames)
 				{
@@ -187,8 +187,9 @@ public:
 				auto mix_time = mix_timer_.elapsed();
 				graph_->set_value("mix-time", mix_time*format_desc_.fps*0.5);
 				current_mix_time_ = static_cast<int64_t>(mix_time * 1000.0);
+				*monitor_subject_ << monitor::message("/mix_time") % mix_time;
 
-				target_->send(std::make_pair(make_safe<read_frame>(ogl_, format_desc_.size, std::move(image.get()), std::move(audio), audio_channel_layout_), packet.second));
+				target_->send(std::make_pair(make_safe<read_frame>(ogl_, format_desc_.size, std::move(image.get()), std::move(audio), audio_channel_layout_, packet.first.frame_number), packet.second));
 			}
 			catch(...)
 			{
@@ -361,7 +362,7 @@ mixer::mixer(
 		const channel_layout& audio_channel_layout,
 		int channel_index)
 	: impl_(new implementation(graph, target, format_desc, ogl, audio_channel_layout, channel_index)){}
-void mixer::send(const std::pair<std::map<int, safe_ptr<core::basic_frame>>, std::shared_ptr<void>>& frames){ impl_->send(frames);}
+void mixer::send(const std::pair<stage_frames, std::shared_ptr<void>>& frames){ impl_->send(frames);}
 safe_ptr<frame_factory> mixer::get_frame_factory(int layer_index) { return impl_->get_frame_factory(layer_index); }
 blend_mode::type mixer::get_blend_mode(int index) { return impl_->get_blend_mode(index); }
 void mixer::set_blend_mode(int index, blend_mode::type value){impl_->set_blend_mode(index, value);}
@@ -24,6 +24,7 @@
 #include "image/blend_modes.h"
 
 #include "../producer/frame/frame_factory.h"
+#include "../producer/stage.h"
 #include "../monitor/monitor.h"
 
 #include <common/memory/safe_ptr.h>
@@ -49,7 +50,7 @@ struct frame_transform;
 struct pixel_format;
 struct channel_layout;
 
-class mixer : public target<std::pair<std::map<int, safe_ptr<core::basic_frame>>, std::shared_ptr<void>>>
+class mixer : public stage::target_t
 {
 public:	
 	typedef target<std::pair<safe_ptr<read_frame>, std::shared_ptr<void>>> target_t;
@@ -64,7 +65,7 @@ public:
 		
 	// target
 
-	virtual void send(const std::pair<std::map<int, safe_ptr<basic_frame>>, std::shared_ptr<void>>& frames) override; 
+	virtual void send(const std::pair<stage_frames, std::shared_ptr<void>>& frames) override; 
 		
 	// mixer
 
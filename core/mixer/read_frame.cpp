@@ -49,6 +49,7 @@ struct read_frame::implementation : boost::noncopyable
 	tbb::mutex					mutex_;
 	audio_buffer				audio_data_;
 	channel_layout				audio_channel_layout_;
+	int64_t						frame_number_;
 	int64_t						created_timestamp_;
 
 public:
@@ -57,12 +58,14 @@ public:
 			size_t size,
 			safe_ptr<host_buffer>&& image_data,
 			audio_buffer&& audio_data,
-			const channel_layout& audio_channel_layout) 
+			const channel_layout& audio_channel_layout,
+			int64_t frame_number) 
 		: ogl_(ogl)
 		, size_(size)
 		, image_data_(std::move(image_data))
 		, audio_data_(std::move(audio_data))
 		, audio_channel_layout_(audio_channel_layout)
+		, frame_number_(frame_number)
 		, created_timestamp_(get_current_time_millis())
 	{
 	}	
@@ -93,8 +96,9 @@ read_frame::read_frame(
 		size_t size,
 		safe_ptr<host_buffer>&& image_data,
 		audio_buffer&& audio_data,
-		const channel_layout& audio_channel_layout) 
-	: impl_(new implementation(ogl, size, std::move(image_data), std::move(audio_data), audio_channel_layout))
+		const channel_layout& audio_channel_layout,
+		int64_t frame_number) 
+	: impl_(new implementation(ogl, size, std::move(image_data), std::move(audio_data), audio_channel_layout, frame_number))
 {
 }
 
@@ -124,6 +128,11 @@ int64_t read_frame::get_age_millis() const
 	return impl_ ? get_current_time_millis() - impl_->created_timestamp_ : 0;
 }
 
+int64_t read_frame::frame_number() const
+{
+	return impl_ ? impl_->frame_number_ : -1;
+}
+
 //#include <tbb/scalable_allocator.h>
 //#include <tbb/parallel_for.h>
 //#include <tbb/enumerable_thread_specific.h>
@@ -47,7 +47,8 @@ public:
 			size_t size,
 			safe_ptr<host_buffer>&& image_data,
 			audio_buffer&& audio_data,
-			const channel_layout& audio_channel_layout);
+			const channel_layout& audio_channel_layout,
+			int64_t frame_number);
 
 	virtual const boost::iterator_range<const uint8_t*> image_data();
 	virtual const boost::iterator_range<const int32_t*> audio_data();
@@ -55,6 +56,7 @@ public:
 	virtual size_t image_size() const;
 	virtual int num_channels() const;
 	virtual int64_t get_age_millis() const;
+	virtual int64_t frame_number() const; // The stage frame it was mixed from, -1 if not from a channel.
 	virtual const multichannel_view<const int32_t, boost::iterator_range<const int32_t*>::const_iterator> multichannel_view() const;
 		
 private:
@@ -0,0 +1,483 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "multiview_producer.h"
+
+#include "../../monitor/monitor.h"
+#include "../../consumer/frame_consumer.h"
+#include "../../consumer/output.h"
+#include "../../video_channel.h"
+
+#include "../frame/basic_frame.h"
+#include "../frame/frame_factory.h"
+#include "../frame/pixel_format.h"
+#include "../../mixer/write_frame.h"
+#include "../../mixer/read_frame.h"
+
+#include <common/memory/memclr.h>
+#include <common/concurrency/executor.h>
+#include <common/concurrency/future_util.h>
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/timer.hpp>
+
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace caspar { namespace core {
+
+static const int MAX_METERED_CHANNELS = 16;
+
+// Frames waiting for a reduction. Further frames are skipped until the
+// reducing thread catches up, so a busy machine only lowers the tile rate.
+static const size_t MAX_QUEUED_FRAMES = 1;
+
+struct multiview_tile
+{
+	std::vector<uint8_t>					image;
+	std::array<float, MAX_METERED_CHANNELS>	peaks;
+	int										num_channels;
+	int64_t									age_millis;
+};
+
+// Attached to a source channel. Hands every read_frame to a thread of its
+// own which reduces it to a tile sized proxy, so the source channel's output
+// thread never waits for the reduction and only the proxy is kept around.
+class multiview_consumer : public frame_consumer
+{
+	const int								tile_width_;
+	const int								tile_height_;
+	int										consumer_index_;
+	int										channel_index_;
+	core::video_format_desc					format_desc_;
+	tbb::atomic<bool>						is_running_;
+
+	mutable tbb::spin_mutex					mutex_;
+	std::shared_ptr<const multiview_tile>	tile_;
+
+	executor								executor_;
+
+public:
+	multiview_consumer(int tile_width, int tile_height)
+		: tile_width_(tile_width)
+		, tile_height_(tile_height)
+		, consumer_index_(next_consumer_index())
+		, channel_index_(-1)
+		, executor_(L"multiview_consumer")
+	{
+		is_running_ = true;
+	}
+
+	static int next_consumer_index()
+	{
+		static tbb::atomic<int> consumer_index_counter;
+		static boost::once_flag consumer_index_counter_initialized;
+
+		boost::call_once(consumer_index_counter_initialized, [&]()
+		{
+			consumer_index_counter = 0;
+		});
+
+		return ++consumer_index_counter;
+	}
+
+	// frame_consumer
+
+	virtual boost::unique_future<bool> send(const safe_ptr<read_frame>& frame) override
+	{
+		if(!is_running_)
+			return caspar::wrap_as_future(false);
+
+		auto format_desc = format_desc_;
+		if(frame->image_data().empty() || format_desc.width < 1 || format_desc.height < 1)
+			return caspar::wrap_as_future(true);
+
+		if(executor_.size() >= MAX_QUEUED_FRAMES)
+			return caspar::wrap_as_future(true);
+
+		executor_.begin_invoke([=]
+		{
+			try
+			{
+				auto tile = std::make_shared<multiview_tile>();
+				tile->image.resize(tile_width_*tile_height_*4);
+				tile->age_millis = frame->get_age_millis();
+
+				downsample(frame->image_data().begin(), format_desc, tile->image.data());
+				measure_peaks(frame, *tile);
+
+				tbb::spin_mutex::scoped_lock lock(mutex_);
+				tile_ = tile;
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+		});
+
+		return caspar::wrap_as_future(true);
+	}
+
+	virtual void initialize(
+			const video_format_desc& format_desc,
+			const channel_layout& audio_channel_layout,
+			int channel_index) override
+	{
+		format_desc_	= format_desc;
+		channel_index_	= channel_index;
+	}
+
+	virtual int64_t presentation_frame_age_millis() const override
+	{
+		auto tile = get_tile();
+		return tile ? tile->age_millis : 0;
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"[multiview-consumer|" + boost::lexical_cast<std::wstring>(channel_index_) + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::property_tree::wptree info;
+		info.add(L"type", L"multiview-consumer");
+		info.add(L"channel-index", channel_index_);
+		info.add(L"tile-width", tile_width_);
+		info.add(L"tile-height", tile_height_);
+		return info;
+	}
+	
+	virtual bool has_synchronization_clock() const override
+	{
+		return false;
+	}
+
+	virtual int buffer_depth() const override
+	{
+		return -1;
+	}
+
+	virtual int index() const override
+	{
+		return 78600 + consumer_index_;
+	}
+
+	// multiview_consumer
+
+	void stop()
+	{
+		is_running_ = false;
+	}
+
+	int channel_index() const
+	{
+		return channel_index_;
+	}
+
+	std::shared_ptr<const multiview_tile> get_tile() const
+	{
+		tbb::spin_mutex::scoped_lock lock(mutex_);
+		return tile_;
+	}
+
+private:
+	// Box filter over the whole source footprint of each tile pixel, so that
+	// e.g. a 1080p channel shrunk to 480x270 averages every 4x4 block instead
+	// of point sampling it.
+	void downsample(const uint8_t* src, const video_format_desc& format_desc, uint8_t* dest) const
+	{
+		const int src_width		= format_desc.width;
+		const int src_height	= format_desc.height;
+		const int src_stride	= src_width*4;
+
+		std::vector<int> columns(tile_width_ + 1);
+		for(int x = 0; x <= tile_width_; ++x)
+			columns[x] = static_cast<int>(static_cast<int64_t>(x)*src_width/tile_width_);
+
+		tbb::parallel_for(0, tile_height_, [&](int y)
+		{
+			int sy0 = static_cast<int>(static_cast<int64_t>(y)*src_height/tile_height_);
+			int sy1 = std::max(sy0 + 1, static_cast<int>(static_cast<int64_t>(y + 1)*src_height/tile_height_));
+
+			auto out = dest + y*tile_width_*4;
+
+			for(int x = 0; x < tile_width_; ++x)
+			{
+				int sx0 = columns[x];
+				int sx1 = std::max(sx0 + 1, columns[x + 1]);
+
+				uint32_t sum[4] = {0, 0, 0, 0};
+				for(int sy = sy0; sy < sy1; ++sy)
+				{
+					auto row = src + sy*src_stride;
+					for(int sx = sx0; sx < sx1; ++sx)
+					{
+						sum[0] += row[sx*4+0];
+						sum[1] += row[sx*4+1];
+						sum[2] += row[sx*4+2];
+						sum[3] += row[sx*4+3];
+					}
+				}
+
+				const uint32_t count = (sy1 - sy0)*(sx1 - sx0);
+				for(int c = 0; c < 4; ++c)
+					out[x*4+c] = static_cast<uint8_t>((sum[c] + count/2) / count);
+			}
+		});
+	}
+
+	void measure_peaks(const safe_ptr<read_frame>& frame, multiview_tile& tile) const
+	{
+		auto audio			= frame->audio_data();
+		int num_channels	= std::max(0, std::min(frame->num_channels(), MAX_METERED_CHANNELS));
+
+		tile.num_channels = num_channels;
+		tile.peaks.fill(0.0f);
+
+		if(num_channels == 0)
+			return;
+
+		std::array<int64_t, MAX_METERED_CHANNELS> peaks;
+		peaks.fill(0);
+
+		int n = 0;
+		for(auto it = audio.begin(); it != audio.end(); ++it, n = (n + 1) % frame->num_channels())
+		{
+			if(n < num_channels)
+				peaks[n] = std::max<int64_t>(peaks[n], std::abs(static_cast<int64_t>(*it)));
+		}
+
+		for(int c = 0; c < num_channels; ++c)
+			tile.peaks[c] = static_cast<float>(static_cast<double>(peaks[c]) / std::numeric_limits<int32_t>::max());
+	}
+};
+
+namespace {
+
+// 3x5 bitmap digits used for the tile labels.
+const uint16_t DIGITS[10] =
+{
+	0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF
+};
+
+void fill_rect(uint8_t* image, int stride, int x0, int y0, int width, int height, uint32_t bgra)
+{
+	for(int y = y0; y < y0 + height; ++y)
+	{
+		auto row = reinterpret_cast<uint32_t*>(image + y*stride);
+		std::fill(row + x0, row + x0 + width, bgra);
+	}
+}
+
+void draw_label(uint8_t* image, int stride, int x0, int y0, int max_width, int max_height, int number)
+{
+	static const int SCALE = 2;
+
+	if(number < 0)
+		return;
+
+	auto text = boost::lexical_cast<std::string>(number);
+	int width = static_cast<int>(text.size())*4*SCALE + SCALE;
+
+	if(width > max_width || 7*SCALE > max_height)
+		return;
+
+	fill_rect(image, stride, x0, y0, width, 7*SCALE, 0xC0000000);
+
+	for(size_t n = 0; n < text.size(); ++n)
+	{
+		auto glyph = DIGITS[text[n] - '0'];
+
+		for(int gy = 0; gy < 5; ++gy)
+		{
+			for(int gx = 0; gx < 3; ++gx)
+			{
+				if(glyph & (1 << (14 - (gy*3 + gx))))
+					fill_rect(image, stride, x0 + SCALE + (static_cast<int>(n)*4 + gx)*SCALE, y0 + SCALE + gy*SCALE, SCALE, SCALE, 0xFFFFFFFF);
+			}
+		}
+	}
+}
+
+// Draws the meters against the right edge of the tile spanning x0 to x1, or
+// nothing if they do not fit.
+void draw_meters(uint8_t* image, int stride, int x0, int x1, int y0, int height, const multiview_tile& tile)
+{
+	static const int BAR_WIDTH = 3;
+
+	int x = x1 - tile.num_channels*(BAR_WIDTH+1);
+	if(x < x0 || height < 4)
+		return;
+
+	fill_rect(image, stride, x, y0, tile.num_channels*(BAR_WIDTH+1), height, 0xC0000000);
+
+	for(int c = 0; c < tile.num_channels; ++c)
+	{
+		// -60 dBFS .. 0 dBFS mapped onto the tile height.
+		double db	 = tile.peaks[c] > 0.0f ? 20.0*std::log10(tile.peaks[c]) : -60.0;
+		double level = std::max(0.0, std::min(1.0, (db + 60.0)/60.0));
+		int bar		 = static_cast<int>(level*(height-2));
+		uint32_t color = db > -9.0 ? 0xFFFF0000 : db > -20.0 ? 0xFFFFFF00 : 0xFF00FF00;
+
+		fill_rect(image, stride, x + c*(BAR_WIDTH+1), y0 + height - 1 - bar, BAR_WIDTH, bar, color);
+	}
+}
+
+}
+	
+class multiview_producer : public frame_producer
+{
+	monitor::subject								monitor_subject_;
+
+	const safe_ptr<frame_factory>					frame_factory_;
+	const core::video_format_desc					format_desc_;
+	const int										columns_;
+	const int										rows_;
+	const int										tile_width_;
+	const int										tile_height_;
+
+	std::vector<safe_ptr<video_channel>>			channels_;
+	std::vector<safe_ptr<multiview_consumer>>		consumers_;
+
+	safe_ptr<basic_frame>							last_frame_;
+	boost::timer									compose_timer_;
+
+public:
+	explicit multiview_producer(const safe_ptr<frame_factory>& frame_factory, const std::vector<safe_ptr<video_channel>>& channels) 
+		: frame_factory_(frame_factory)
+		, format_desc_(frame_factory->get_video_format_desc())
+		, columns_(std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(channels.size()))))))
+		, rows_(std::max(1, (static_cast<int>(channels.size()) + columns_ - 1) / columns_))
+		, tile_width_(format_desc_.width / columns_)
+		, tile_height_(format_desc_.height / rows_)
+		, channels_(channels)
+		, last_frame_(basic_frame::empty())
+	{
+		BOOST_FOREACH(auto& channel, channels_)
+		{
+			auto consumer = make_safe<multiview_consumer>(tile_width_, tile_height_);
+			channel->output()->add(consumer);
+			consumers_.push_back(consumer);
+		}
+
+		CASPAR_LOG(info) << print() << L" Initialized";
+	}
+
+	~multiview_producer()
+	{
+		for(size_t n = 0; n < consumers_.size(); ++n)
+		{
+			consumers_[n]->stop();
+			channels_[n]->output()->remove(consumers_[n]);
+		}
+
+		CASPAR_LOG(info) << print() << L" Uninitialized";
+	}
+
+	// frame_producer
+			
+	virtual safe_ptr<basic_frame> receive(int) override
+	{
+		compose_timer_.restart();
+
+		core::pixel_format_desc desc;
+		desc.pix_fmt = core::pixel_format::bgra;
+		desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, format_desc_.height, 4));
+		auto frame = frame_factory_->create_frame(this, desc);
+
+		auto image	= frame->image_data().begin();
+		int stride	= format_desc_.width*4;
+
+		fast_memclr(image, frame->image_data().size());
+
+		tbb::parallel_for(0, static_cast<int>(consumers_.size()), [&](int n)
+		{
+			int x0 = (n % columns_)*tile_width_;
+			int y0 = (n / columns_)*tile_height_;
+
+			auto tile = consumers_[n]->get_tile();
+			if(tile)
+			{
+				for(int y = 0; y < tile_height_; ++y)
+					std::memcpy(image + (y0+y)*stride + x0*4, tile->image.data() + y*tile_width_*4, tile_width_*4);
+
+				draw_meters(image, stride, x0, x0 + tile_width_, y0, tile_height_, *tile);
+			}
+
+			draw_label(image, stride, x0 + 4, y0 + 4, tile_width_ - 8, tile_height_ - 8, consumers_[n]->channel_index());
+		});
+
+		frame->commit();
+
+		monitor_subject_ << monitor::message("/profiler/time") % compose_timer_.elapsed() % (1.0/format_desc_.fps);
+
+		return last_frame_ = frame;
+	}	
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return last_frame_; 
+	}	
+
+	virtual std::wstring print() const override
+	{
+		return L"multiview[" + boost::lexical_cast<std::wstring>(consumers_.size()) + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::property_tree::wptree info;
+		info.add(L"type", L"multiview-producer");
+		info.add(L"columns", columns_);
+		info.add(L"rows", rows_);
+		info.add(L"tile-width", tile_width_);
+		info.add(L"tile-height", tile_height_);
+		BOOST_FOREACH(auto& consumer, consumers_)
+			info.add_child(L"sources.source", consumer->info());
+		return info;
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return monitor_subject_;
+	}
+};
+
+safe_ptr<frame_producer> create_multiview_producer(const safe_ptr<core::frame_factory>& frame_factory, const std::vector<safe_ptr<video_channel>>& channels)
+{
+	return create_producer_print_proxy(
+			make_safe<multiview_producer>(frame_factory, channels));
+}
+
+}}
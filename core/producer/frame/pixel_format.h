@@ -37,6 +37,7 @@ struct pixel_format
 		ycbcr,
 		ycbcra,
 		luma,
+		uyvy, // Packed 4:2:2, each four channel texel holds Cb, Y, Cr, Y of two pixels.
 		count,
 		invalid
 	};
@@ -0,0 +1,332 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "prefetch_producer.h"
+
+#include "../frame/basic_frame.h"
+#include "../frame/frame_visitor.h"
+#include "../../mixer/write_frame.h"
+
+#include <common/concurrency/executor.h>
+#include <common/diagnostics/graph.h>
+#include <common/exception/exceptions.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <tbb/atomic.h>
+
+#include <algorithm>
+#include <deque>
+
+namespace caspar { namespace core {
+
+// Finds the audio stream of a frame, so that a repeat can continue it with silence.
+struct audio_stream_finder : public frame_visitor
+{
+	const void*		tag;
+	channel_layout	layout;
+	bool			found;
+
+	audio_stream_finder()
+		: tag(nullptr)
+		, layout(channel_layout::stereo())
+		, found(false)
+	{
+	}
+
+	virtual void begin(basic_frame&) override {}
+	virtual void end() override {}
+
+	virtual void visit(write_frame& frame) override
+	{
+		if(found || frame.audio_data().empty())
+			return;
+
+		tag		= frame.tag();
+		layout	= frame.get_channel_layout();
+		found	= true;
+	}
+};
+
+struct prefetch_producer : public frame_producer
+{	
+	const safe_ptr<diagnostics::graph>			graph_;
+	const size_t								capacity_;
+	const boost::posix_time::milliseconds		max_wait_;
+	tbb::atomic<int>							hints_;
+
+	safe_ptr<frame_producer>					producer_; // Calls are serialized on executor_.
+
+	mutable boost::mutex						mutex_;
+	boost::condition_variable					cond_;
+	std::deque<safe_ptr<basic_frame>>			frames_;
+	std::exception_ptr							exception_;
+	bool										producing_;
+	bool										eof_;
+	bool										stopped_;
+	bool										delivered_;
+	safe_ptr<basic_frame>						last_frame_;
+	safe_ptr<basic_frame>						repeat_frame_; // Returned by last_frame() while repeating.
+	bool										repeating_;
+	std::vector<size_t>							audio_cadence_;
+	std::wstring								print_;
+	boost::property_tree::wptree				info_;
+	uint32_t									nb_frames_;
+	int64_t										repeats_;
+
+	executor									executor_;
+		
+	prefetch_producer(const safe_ptr<frame_producer>& producer, const video_format_desc& format_desc, size_t capacity, int max_wait_millis) 
+		: capacity_(std::max<size_t>(1, capacity))
+		, max_wait_(std::max(0, max_wait_millis))
+		, producer_(producer)
+		, producing_(false)
+		, eof_(false)
+		, stopped_(false)
+		, delivered_(false)
+		, last_frame_(basic_frame::empty())
+		, repeat_frame_(basic_frame::empty())
+		, repeating_(false)
+		, audio_cadence_(format_desc.audio_cadence)
+		, print_(producer->print())
+		, info_(producer->info())
+		, nb_frames_(producer->nb_frames())
+		, repeats_(0)
+		, executor_(L"prefetch")
+	{
+		hints_ = frame_producer::NO_HINT;
+
+		graph_->set_color("buffer", diagnostics::color(0.7f, 0.4f, 0.4f));
+		graph_->set_color("repeat", diagnostics::color(0.6f, 0.3f, 0.9f));
+		graph_->set_text(print());
+		diagnostics::register_graph(graph_);
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		schedule();
+	}
+
+	~prefetch_producer()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			stopped_ = true;
+		}
+		executor_.clear();
+	}
+
+	// Must be called with mutex_ held.
+	void schedule()
+	{
+		if(producing_ || eof_ || stopped_ || exception_ != nullptr || frames_.size() >= capacity_)
+			return;
+
+		producing_ = true;
+		executor_.begin_invoke([=]{produce();});
+	}
+
+	void produce()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			if(stopped_)
+			{
+				producing_ = false;
+				return;
+			}
+		}
+
+		try
+		{
+			auto frame		= producer_->receive(hints_);
+			auto print		= producer_->print();
+			auto info		= producer_->info();
+			auto nb_frames	= producer_->nb_frames();
+
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			frames_.push_back(frame);
+			eof_		= frame == basic_frame::eof();
+			print_		= std::move(print);
+			info_		= std::move(info);
+			nb_frames_	= nb_frames;
+			producing_	= false;
+			graph_->set_value("buffer", static_cast<double>(frames_.size())/static_cast<double>(capacity_));
+			schedule();
+		}
+		catch(...)
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			exception_ = std::current_exception();
+			producing_ = false;
+		}
+
+		cond_.notify_all();
+	}
+
+	// frame_producer
+	
+	safe_ptr<basic_frame> make_repeat_frame(size_t nb_samples)
+	{
+		audio_stream_finder finder;
+		last_frame_->accept(finder);
+
+		if(!finder.found)
+			return disable_audio(last_frame_);
+
+		auto silence = make_safe<write_frame>(finder.tag, finder.layout);
+		silence->audio_data().resize(nb_samples * finder.layout.num_channels, 0);
+
+		std::vector<safe_ptr<basic_frame>> frames;
+		frames.push_back(disable_audio(last_frame_));
+		frames.push_back(silence);
+		return make_safe<basic_frame>(std::move(frames));
+	}
+
+	virtual safe_ptr<basic_frame> receive(int hints) override
+	{
+		hints_ = hints;
+
+		// One cadence step per channel tick, whether the frame is fresh or repeated.
+		auto nb_samples = audio_cadence_.empty() ? 0 : audio_cadence_.front();
+		if(!audio_cadence_.empty())
+			std::rotate(audio_cadence_.begin(), audio_cadence_.begin() + 1, audio_cadence_.end());
+
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		auto ready = [&]{return !frames_.empty() || eof_ || exception_ != nullptr;};
+
+		if(!delivered_) // Nothing to repeat yet, block on the first frame just as the undecorated producer would.
+			cond_.wait(lock, ready);
+		else if(!ready())
+			cond_.timed_wait(lock, max_wait_, ready);
+		
+		if(exception_ != nullptr)
+		{
+			// Keep producing in case the caller keeps this producer, like the 
+			// undecorated producer would be called again.
+			auto exception = exception_;
+			exception_ = nullptr;
+			schedule();
+			std::rethrow_exception(exception);
+		}
+
+		if(frames_.empty())
+		{
+			if(eof_)
+				return basic_frame::eof();
+
+			++repeats_;
+			graph_->set_tag("repeat");
+
+			// The layer answers a late frame with last_frame(), which then carries the silence.
+			repeat_frame_	= make_repeat_frame(nb_samples);
+			repeating_		= true;
+			return basic_frame::late();
+		}
+
+		auto frame = frames_.front();
+		frames_.pop_front();
+
+		delivered_	= true;
+		repeating_	= false;
+		if(frame != basic_frame::eof() && frame != basic_frame::late())
+			last_frame_ = frame;
+		
+		graph_->set_value("buffer", static_cast<double>(frames_.size())/static_cast<double>(capacity_));
+		schedule();
+
+		return frame;
+	}
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return repeating_ ? repeat_frame_ : disable_audio(last_frame_);
+	}
+
+	virtual safe_ptr<basic_frame> create_thumbnail_frame() override
+	{
+		return executor_.invoke([&]{return producer_->create_thumbnail_frame();});
+	}
+
+	virtual boost::unique_future<std::wstring> call(const std::wstring& param) override
+	{
+		return std::move(*executor_.invoke([&]() -> std::shared_ptr<boost::unique_future<std::wstring>>
+		{
+			auto result = std::make_shared<boost::unique_future<std::wstring>>(std::move(producer_->call(param)));
+			
+			// Frames rendered ahead predate the call (e.g. a SEEK), drop them.
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			frames_.clear();
+			eof_ = false;
+			schedule();
+
+			return result;
+		}, high_priority));
+	}
+
+	virtual safe_ptr<frame_producer> get_following_producer() const override
+	{
+		return executor_.invoke([&]{return producer_->get_following_producer();});
+	}
+
+	virtual void set_leading_producer(const safe_ptr<frame_producer>& producer) override
+	{
+		executor_.invoke([&]{producer_->set_leading_producer(producer);}, high_priority);
+	}
+
+	virtual uint32_t nb_frames() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return nb_frames_;
+	}
+	
+	virtual std::wstring print() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return L"prefetch[" + print_ + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		auto info = info_;
+		info.add(L"prefetch.capacity",	capacity_);
+		info.add(L"prefetch.buffered",	frames_.size());
+		info.add(L"prefetch.repeats",	repeats_);
+		return info;
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return producer_->monitor_output();
+	}
+};
+
+safe_ptr<frame_producer> create_prefetch_producer(const safe_ptr<frame_producer>& producer, const video_format_desc& format_desc, size_t capacity, int max_wait_millis)
+{
+	return create_producer_destroy_proxy(make_safe<prefetch_producer>(producer, format_desc, capacity, max_wait_millis));
+}
+
+}}
@@ -0,0 +1,38 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include "../frame_producer.h"
+
+#include "../../video_format.h"
+
+namespace caspar { namespace core {
+
+// Decorates a producer so that it renders ahead on its own thread into a small 
+// bounded frame queue. receive() never waits longer than "max_wait_millis" for 
+// a frame; when none is ready the layer repeats its last frame and the repeat 
+// is counted, instead of the whole channel tick running late. The audio of a 
+// repeat is one cadence step of silence, so the mixer's stream for the producer
+// continues without a gap.
+safe_ptr<frame_producer> create_prefetch_producer(const safe_ptr<frame_producer>& producer, const video_format_desc& format_desc, size_t capacity, int max_wait_millis);
+
+}}
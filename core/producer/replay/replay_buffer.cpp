@@ -0,0 +1,385 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "replay_buffer.h"
+
+#include "../../consumer/frame_consumer.h"
+#include "../../consumer/pixel_packing.h"
+#include "../../mixer/read_frame.h"
+#include "../../parameters/parameters.h"
+#include "../../video_format.h"
+#include "../frame/pixel_format.h"
+
+#include <common/concurrency/executor.h>
+#include <common/exception/exceptions.h>
+#include <common/log/log.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/range/algorithm/max_element.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+
+namespace caspar { namespace core {
+
+replay_format::type replay_format::from_string(const std::wstring& name)
+{
+	if(boost::iequals(name, L"BGRA"))
+		return bgra;
+	if(boost::iequals(name, L"YCBCR"))
+		return ycbcr;
+
+	BOOST_THROW_EXCEPTION(invalid_argument() << arg_name_info("FORMAT") << arg_value_info(narrow(name)));
+}
+
+std::wstring replay_format::print(type format)
+{
+	return format == bgra ? L"bgra" : L"ycbcr";
+}
+
+pixel_format_desc get_replay_pixel_desc(const video_format_desc& format_desc, replay_format::type format)
+{
+	pixel_format_desc desc;
+
+	if(format == replay_format::ycbcr)
+	{
+		desc.pix_fmt = pixel_format::ycbcr;
+		desc.planes.push_back(pixel_format_desc::plane(format_desc.width,	  format_desc.height, 1));
+		desc.planes.push_back(pixel_format_desc::plane(format_desc.width / 2, format_desc.height, 1));
+		desc.planes.push_back(pixel_format_desc::plane(format_desc.width / 2, format_desc.height, 1));
+	}
+	else
+	{
+		desc.pix_fmt = pixel_format::bgra;
+		desc.planes.push_back(pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
+	}
+
+	return desc;
+}
+
+struct replay_buffer::implementation : boost::noncopyable
+{
+	const video_format_desc							format_desc_;
+	const int										channel_index_;
+	const replay_format::type						format_;
+	const pixel_format_desc							pixel_desc_;
+	const size_t									image_size_;
+	const size_t									capacity_;
+
+	mutable boost::mutex							mutex_;
+	std::vector<std::shared_ptr<replay_frame>>		slots_;
+	int64_t											first_frame_;
+	int64_t											last_frame_;
+	
+	implementation(const video_format_desc& format_desc, int channel_index, replay_format::type format, size_t budget_bytes)
+		: format_desc_(format_desc)
+		, channel_index_(channel_index)
+		, format_(format)
+		, pixel_desc_(get_replay_pixel_desc(format_desc, format))
+		, image_size_(total_size(pixel_desc_))
+		, capacity_(std::max<size_t>(2, budget_bytes / (image_size_ + max_audio_size(format_desc))))
+		, slots_(capacity_)
+		, first_frame_(-1)
+		, last_frame_(-1)
+	{
+	}
+
+	static size_t total_size(const pixel_format_desc& desc)
+	{
+		size_t size = 0;
+		BOOST_FOREACH(auto& plane, desc.planes)
+			size += plane.size;
+		return size;
+	}
+
+	static size_t max_audio_size(const video_format_desc& format_desc)
+	{
+		// Budget for up to 8 channels of the largest cadence step.
+		return *boost::max_element(format_desc.audio_cadence) * 8 * sizeof(int32_t);
+	}
+
+	void push(const safe_ptr<read_frame>& frame)
+	{
+		if(frame->image_data().size() != format_desc_.size)
+			return;
+
+		std::shared_ptr<replay_frame> stored;
+		int64_t number;
+		size_t	slot;
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+
+			// Frames that do not come from a channel continue the sequence.
+			number = frame->frame_number() >= 0 ? frame->frame_number() : last_frame_ + 1;
+
+			// The channel restarted its frame numbers, what is held belongs to the old sequence.
+			if(number <= last_frame_)
+			{
+				BOOST_FOREACH(auto& held, slots_)
+					held.reset();
+				first_frame_ = -1;
+				last_frame_	 = -1;
+			}
+
+			// Frame numbers can skip, the oldest frame is whichever the ring still holds.
+			first_frame_ = std::max(first_frame_ < 0 ? number : first_frame_, number - static_cast<int64_t>(capacity_) + 1);
+			slot		 = static_cast<size_t>(number % capacity_);
+
+			// Reuse the storage of the evicted frame unless a producer still holds it.
+			stored.swap(slots_[slot]);
+			if(!stored || !stored.unique())
+				stored = std::make_shared<replay_frame>();
+		}
+
+		stored->number = number;
+		stored->image_data.resize(image_size_);
+
+		if(format_ == replay_format::ycbcr)
+		{
+			packed_plane planes[3];
+			auto data = stored->image_data.data();
+			for(int n = 0; n < 3; ++n)
+			{
+				planes[n] = packed_plane(data, static_cast<int>(pixel_desc_.planes[n].linesize));
+				data += pixel_desc_.planes[n].size;
+			}
+			pack(packed_format::yuv422p, frame->image_data().begin(), static_cast<int>(format_desc_.width), static_cast<int>(format_desc_.height), planes);
+		}
+		else
+			std::copy(frame->image_data().begin(), frame->image_data().end(), stored->image_data.begin());
+
+		stored->audio_data.assign(frame->audio_data().begin(), frame->audio_data().end());
+		stored->audio_channel_layout = frame->multichannel_view().channel_layout();
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		slots_[slot]	= std::move(stored);
+		last_frame_		= number;
+	}
+
+	std::shared_ptr<const replay_frame> get(int64_t number) const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		if(number < first_frame_ || number > last_frame_)
+			return nullptr;
+
+		auto& frame = slots_[static_cast<size_t>(number % capacity_)];
+		return frame && frame->number == number ? frame : std::shared_ptr<replay_frame>();
+	}
+
+	int64_t first_frame() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return last_frame_ < 0 ? -1 : first_frame_;
+	}
+
+	int64_t last_frame() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return last_frame_;
+	}
+
+	std::wstring print() const
+	{
+		return L"replay-buffer[" + boost::lexical_cast<std::wstring>(channel_index_) + L"|" + format_desc_.name + L"]";
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::property_tree::wptree info;
+		info.add(L"channel-index",	channel_index_);
+		info.add(L"format",			replay_format::print(format_));
+		info.add(L"capacity",		capacity_);
+		info.add(L"seconds",		static_cast<double>(capacity_) / format_desc_.fps);
+		info.add(L"budget-mb",		capacity_ * (image_size_ + max_audio_size(format_desc_)) / (1024 * 1024));
+		info.add(L"first-frame",	first_frame());
+		info.add(L"last-frame",		last_frame());
+		return info;
+	}
+};
+
+replay_buffer::replay_buffer(const video_format_desc& format_desc, int channel_index, replay_format::type format, size_t budget_bytes)
+	: impl_(new implementation(format_desc, channel_index, format, budget_bytes)){}
+void replay_buffer::push(const safe_ptr<read_frame>& frame){impl_->push(frame);}
+std::shared_ptr<const replay_frame> replay_buffer::get(int64_t number) const{return impl_->get(number);}
+int64_t replay_buffer::first_frame() const{return impl_->first_frame();}
+int64_t replay_buffer::last_frame() const{return impl_->last_frame();}
+size_t replay_buffer::capacity() const{return impl_->capacity_;}
+int replay_buffer::channel_index() const{return impl_->channel_index_;}
+replay_format::type replay_buffer::format() const{return impl_->format_;}
+const video_format_desc& replay_buffer::format_desc() const{return impl_->format_desc_;}
+pixel_format_desc replay_buffer::pixel_desc() const{return impl_->pixel_desc_;}
+std::wstring replay_buffer::print() const{return impl_->print();}
+boost::property_tree::wptree replay_buffer::info() const{return impl_->info();}
+
+struct replay_registry::implementation : boost::noncopyable
+{
+	mutable boost::mutex							mutex_;
+	std::map<int, std::weak_ptr<replay_buffer>>		buffers_;
+};
+
+replay_registry::replay_registry() : impl_(new implementation()){}
+
+void replay_registry::add(int channel_index, const std::shared_ptr<replay_buffer>& buffer)
+{
+	boost::lock_guard<boost::mutex> lock(impl_->mutex_);
+	impl_->buffers_[channel_index] = buffer;
+}
+
+void replay_registry::remove(int channel_index, const std::shared_ptr<replay_buffer>& buffer)
+{
+	boost::lock_guard<boost::mutex> lock(impl_->mutex_);
+	auto it = impl_->buffers_.find(channel_index);
+	if(it != impl_->buffers_.end() && it->second.lock() == buffer)
+		impl_->buffers_.erase(it);
+}
+
+std::shared_ptr<replay_buffer> replay_registry::find(int channel_index) const
+{
+	boost::lock_guard<boost::mutex> lock(impl_->mutex_);
+	auto it = impl_->buffers_.find(channel_index);
+	return it != impl_->buffers_.end() ? it->second.lock() : std::shared_ptr<replay_buffer>();
+}
+
+class replay_consumer : public frame_consumer
+{
+	const replay_format::type		format_;
+	const size_t					budget_bytes_;
+	const safe_ptr<replay_registry>	registry_;
+
+	// Written on the executor, info() and print() read them from other threads.
+	mutable boost::mutex			mutex_;
+	std::shared_ptr<replay_buffer>	buffer_;
+	int								channel_index_;
+
+	executor						executor_;
+public:
+	replay_consumer(replay_format::type format, size_t budget_bytes, const safe_ptr<replay_registry>& registry)
+		: format_(format)
+		, budget_bytes_(budget_bytes)
+		, registry_(registry)
+		, channel_index_(-1)
+		, executor_(L"replay_consumer")
+	{
+		executor_.set_capacity(2);
+	}
+
+	~replay_consumer()
+	{
+		executor_.stop();
+		executor_.join();
+
+		if(buffer_)
+			registry_->remove(channel_index_, buffer_);
+	}
+
+	// frame_consumer
+
+	virtual void initialize(const video_format_desc& format_desc, const channel_layout&, int channel_index) override
+	{
+		executor_.invoke([=]
+		{
+			if(buffer_)
+				registry_->remove(channel_index_, buffer_);
+
+			// Producers still playing the old buffer keep it alive until they are done.
+			auto buffer = std::make_shared<replay_buffer>(format_desc, channel_index, format_, budget_bytes_);
+			{
+				boost::lock_guard<boost::mutex> lock(mutex_);
+				channel_index_	= channel_index;
+				buffer_			= buffer;
+			}
+			registry_->add(channel_index, buffer);
+
+			CASPAR_LOG(info) << print() << L" Holding " << buffer->capacity() << L" frames.";
+		});
+	}
+
+	virtual boost::unique_future<bool> send(const safe_ptr<read_frame>& frame) override
+	{
+		return executor_.begin_invoke([=]() -> bool
+		{
+			buffer_->push(frame);
+			return true;
+		});
+	}
+
+	virtual int64_t presentation_frame_age_millis() const override
+	{
+		return 0;
+	}
+
+	virtual std::wstring print() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return L"replay[" + boost::lexical_cast<std::wstring>(channel_index_) + L"|" + replay_format::print(format_) + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		std::shared_ptr<replay_buffer> buffer;
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			buffer = buffer_;
+		}
+
+		boost::property_tree::wptree info;
+		info.add(L"type", L"replay-consumer");
+		if(buffer)
+			info.add_child(L"buffer", buffer->info());
+		return info;
+	}
+
+	virtual bool has_synchronization_clock() const override
+	{
+		return false;
+	}
+
+	virtual int buffer_depth() const override
+	{
+		return -1;
+	}
+
+	virtual int index() const override
+	{
+		return 700;
+	}
+};
+
+safe_ptr<frame_consumer> create_replay_consumer(const core::parameters& params, const safe_ptr<replay_registry>& registry)
+{
+	if(params.size() < 1 || params[0] != L"REPLAY")
+		return core::frame_consumer::empty();
+
+	auto budget_mb	= params.get(L"BUDGET", 1024);
+	auto format		= replay_format::from_string(params.get(L"FORMAT", L"YCBCR"));
+
+	if(budget_mb <= 0)
+		BOOST_THROW_EXCEPTION(invalid_argument() << arg_name_info("BUDGET") << arg_value_info(boost::lexical_cast<std::string>(budget_mb)));
+
+	return make_safe<replay_consumer>(format, static_cast<size_t>(budget_mb) * 1024 * 1024, registry);
+}
+
+}}
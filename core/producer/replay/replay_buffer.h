@@ -0,0 +1,120 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include "../../mixer/audio/audio_mixer.h"
+#include "../../mixer/audio/audio_util.h"
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+class read_frame;
+class parameters;
+struct frame_consumer;
+struct video_format_desc;
+struct pixel_format_desc;
+
+// How frames are kept in the ring.
+struct replay_format
+{
+	enum type
+	{
+		bgra = 0,	// Untouched premultiplied BGRA, keeps the key.
+		ycbcr,		// 8-bit 4:2:2 planar, half the size of bgra, drops the key.
+	};
+
+	static type from_string(const std::wstring& name);
+	static std::wstring print(type format);
+};
+
+// One stored channel frame. Instances are shared with readers and only
+// recycled by the writer once no reader holds them any more.
+struct replay_frame
+{
+	int64_t					number;
+	std::vector<uint8_t>	image_data;
+	audio_buffer			audio_data;
+	channel_layout			audio_channel_layout;
+
+	replay_frame() : number(-1), audio_channel_layout(channel_layout::stereo()){}
+};
+
+// Memory budgeted ring of the most recent frames of a channel, keyed by the
+// channel frame number (read_frame::frame_number). Written by a replay
+// consumer, read by any number of replay producers. Thread-safe.
+class replay_buffer : boost::noncopyable
+{
+public:
+	replay_buffer(const video_format_desc& format_desc, int channel_index, replay_format::type format, size_t budget_bytes);
+
+	void push(const safe_ptr<read_frame>& frame);
+
+	// nullptr if the frame has not been written yet or has been overwritten.
+	std::shared_ptr<const replay_frame> get(int64_t number) const;
+
+	// Oldest and newest frame number still held, -1 while empty.
+	int64_t first_frame() const;
+	int64_t last_frame() const;
+
+	size_t capacity() const;
+	int channel_index() const;
+	replay_format::type format() const;
+	const video_format_desc& format_desc() const;
+	pixel_format_desc pixel_desc() const;
+
+	std::wstring print() const;
+	boost::property_tree::wptree info() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+// The buffers recording each channel of a server, replay consumers add
+// theirs and replay producers look them up. Thread-safe.
+class replay_registry : boost::noncopyable
+{
+public:
+	replay_registry();
+
+	void add(int channel_index, const std::shared_ptr<replay_buffer>& buffer);
+	void remove(int channel_index, const std::shared_ptr<replay_buffer>& buffer); // Only if it is still the channel's buffer.
+
+	// The buffer currently recording the given channel, nullptr if none.
+	std::shared_ptr<replay_buffer> find(int channel_index) const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+// ADD <channel> REPLAY [BUDGET <megabytes>] [FORMAT YCBCR|BGRA]
+safe_ptr<frame_consumer> create_replay_consumer(const core::parameters& params, const safe_ptr<replay_registry>& registry);
+
+}}
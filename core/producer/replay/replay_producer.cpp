@@ -0,0 +1,211 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "replay_producer.h"
+#include "replay_buffer.h"
+
+#include "../../monitor/monitor.h"
+#include "../../parameters/parameters.h"
+#include "../../video_format.h"
+#include "../frame/basic_frame.h"
+#include "../frame/frame_factory.h"
+#include "../frame/pixel_format.h"
+#include "../../mixer/write_frame.h"
+
+#include <common/concurrency/future_util.h>
+#include <common/exception/exceptions.h>
+#include <common/log/log.h>
+#include <common/memory/memcpy.h>
+#include <common/utility/string.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cmath>
+
+namespace caspar { namespace core {
+
+class replay_producer : public frame_producer
+{
+	monitor::subject						monitor_subject_;
+
+	const safe_ptr<frame_factory>			frame_factory_;
+	const std::shared_ptr<replay_buffer>	buffer_;
+
+	mutable boost::mutex					mutex_;
+	double									position_;
+	double									speed_;
+
+	int64_t									frame_number_;
+	safe_ptr<basic_frame>					frame_;
+	safe_ptr<basic_frame>					last_frame_;
+
+public:
+	replay_producer(const safe_ptr<frame_factory>& frame_factory, const std::shared_ptr<replay_buffer>& buffer, const core::parameters& params) 
+		: frame_factory_(frame_factory)
+		, buffer_(buffer)
+		, position_(0.0)
+		, speed_(1.0)
+		, frame_number_(-1)
+		, frame_(basic_frame::empty())
+		, last_frame_(basic_frame::empty())
+	{
+		configure(params);
+		CASPAR_LOG(info) << print() << L" Initialized";
+	}
+
+	~replay_producer()
+	{
+		CASPAR_LOG(info) << print() << L" Uninitialized";
+	}
+
+	// frame_producer
+			
+	virtual safe_ptr<basic_frame> receive(int) override
+	{
+		int64_t number;
+		bool	play_audio;
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+
+			auto first = buffer_->first_frame();
+			auto last  = buffer_->last_frame();
+			if(last < 0)
+				return basic_frame::late();
+
+			// Running into either end of the ring holds the frame there.
+			position_	= std::max(static_cast<double>(first), std::min(static_cast<double>(last), position_));
+			number		= static_cast<int64_t>(std::floor(position_));
+			play_audio	= speed_ == 1.0;
+			position_  += speed_;
+		}
+
+		if(number == frame_number_)
+			return last_frame_ = disable_audio(frame_);
+
+		auto stored = buffer_->get(number);
+		if(!stored)
+			return basic_frame::late();
+
+		auto desc  = buffer_->pixel_desc();
+		auto frame = frame_factory_->create_frame(this, desc, stored->audio_channel_layout);
+
+		auto src = stored->image_data.data();
+		for(size_t n = 0; n < desc.planes.size(); ++n)
+		{
+			fast_memcpy(frame->image_data(n).begin(), src, desc.planes[n].size);
+			src += desc.planes[n].size;
+		}
+
+		if(play_audio)
+			frame->audio_data().assign(stored->audio_data.begin(), stored->audio_data.end());
+
+		frame->commit();
+
+		frame_number_ = number;
+		frame_		  = frame;
+
+		return last_frame_ = frame;
+	}	
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return disable_audio(last_frame_); 
+	}	
+
+	virtual boost::unique_future<std::wstring> call(const std::wstring& param) override
+	{
+		std::vector<std::wstring> tokens;
+		boost::split(tokens, boost::trim_copy(param), boost::is_any_of(L" \t"), boost::token_compress_on);
+
+		core::parameters params(tokens);
+		params.to_upper();
+
+		if(!params.has(L"SPEED") && !params.has(L"OFFSET") && !params.has(L"FRAME") && !params.has(L"SEEK"))
+			BOOST_THROW_EXCEPTION(invalid_argument() << arg_name_info("param") << arg_value_info(narrow(param)));
+
+		configure(params);
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return caspar::wrap_as_future(boost::lexical_cast<std::wstring>(static_cast<int64_t>(std::floor(position_))));
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"replay[" + boost::lexical_cast<std::wstring>(buffer_->channel_index()) + L"|" + boost::lexical_cast<std::wstring>(frame_number_) + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		boost::property_tree::wptree info;
+		info.add(L"type",			L"replay-producer");
+		info.add(L"channel-index",	buffer_->channel_index());
+		info.add(L"frame-number",	frame_number_);
+		info.add(L"speed",			speed_);
+		info.add(L"first-frame",	buffer_->first_frame());
+		info.add(L"last-frame",		buffer_->last_frame());
+		return info;
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return monitor_subject_;
+	}
+
+	// replay_producer
+
+	void configure(const core::parameters& params)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		speed_ = params.get(L"SPEED", speed_);
+
+		if(params.has(L"FRAME"))
+			position_ = static_cast<double>(params.get(L"FRAME", static_cast<int64_t>(position_)));
+		else if(params.has(L"SEEK"))
+			position_ = static_cast<double>(params.get(L"SEEK", static_cast<int64_t>(position_)));
+		else if(params.has(L"OFFSET") || frame_number_ < 0)
+			position_ = static_cast<double>(buffer_->last_frame() - std::abs(params.get(L"OFFSET", static_cast<int64_t>(0))));
+	}
+};
+
+safe_ptr<frame_producer> create_replay_producer(const safe_ptr<core::frame_factory>& frame_factory, const core::parameters& params, const safe_ptr<replay_registry>& registry)
+{
+	if(params.size() < 2 || params[0] != L"REPLAY")
+		return core::frame_producer::empty();
+
+	auto channel_index = boost::lexical_cast<int>(params[1]);
+	auto buffer		   = registry->find(channel_index);
+
+	if(!buffer)
+		BOOST_THROW_EXCEPTION(file_not_found() << msg_info("No replay consumer on channel " + boost::lexical_cast<std::string>(channel_index)));
+
+	return create_producer_print_proxy(
+			make_safe<replay_producer>(frame_factory, buffer, params));
+}
+
+}}
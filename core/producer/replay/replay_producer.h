@@ -0,0 +1,39 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include "../frame_producer.h"
+
+namespace caspar { namespace core {
+
+struct frame_factory;
+class parameters;
+class replay_registry;
+
+// PLAY <channel>-<layer> REPLAY <source channel> [OFFSET <frames>|FRAME <number>] [SPEED <speed>]
+//
+// Plays back the replay buffer recorded on the source channel. OFFSET counts
+// frames back from the newest frame, FRAME is a frame number of the source
+// channel's stage. Negative speeds play in reverse.
+safe_ptr<frame_producer> create_replay_producer(const safe_ptr<frame_factory>& frame_factory, const core::parameters& params, const safe_ptr<replay_registry>& registry);
+
+}}
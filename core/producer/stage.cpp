@@ -29,6 +29,8 @@
 #include "frame/frame_factory.h"
 
 #include <common/concurrency/executor.h>
+#include <common/concurrency/future_util.h>
+#include <common/concurrency/published.h>
 
 #include <core/producer/frame/frame_transform.h>
 #include <core/consumer/frame_consumer.h>
@@ -37,6 +39,7 @@
 #include <boost/foreach.hpp>
 #include <boost/timer.hpp>
 
+#include <tbb/atomic.h>
 #include <tbb/parallel_for_each.h>
 #include <tbb/concurrent_unordered_map.h>
 
@@ -91,6 +94,16 @@ public:
 struct stage::implementation : public std::enable_shared_from_this<implementation>
 							 , boost::noncopyable
 {		
+	struct state
+	{
+		std::map<int, boost::property_tree::wptree>	layers;
+		std::map<int, boost::property_tree::wptree>	layer_delays;
+		int64_t										frame_number;
+		size_t										scheduled;
+
+		state() : frame_number(0), scheduled(0){}
+	};
+
 	safe_ptr<diagnostics::graph>												 graph_;
 	safe_ptr<stage::target_t>													 target_;
 	video_format_desc															 format_desc_;
@@ -102,9 +115,15 @@ struct stage::implementation : public std::enable_shared_from_this<implementatio
 	tbb::concurrent_unordered_map<int, tweened_transform<core::frame_transform>> transforms_;	
 	// map of layer -> map of tokens (src ref) -> layer_consumer
 	std::map<int, std::map<void*, std::shared_ptr<write_frame_consumer>>>		 layer_consumers_;
+
+	std::multimap<int64_t, std::function<void()>>								 schedule_;
+	tbb::atomic<int64_t>														 frame_number_;
 	
 	safe_ptr<monitor::subject>													 monitor_subject_;
 
+	published<state>															 state_;
+	tbb::atomic<bool>															 state_requested_;
+
 	executor																	 executor_;
 
 public:
@@ -121,6 +140,8 @@ public:
 	{
 		graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f, 0.8));	
 		graph_->set_color("produce-time", diagnostics::color(0.0f, 1.0f, 0.0f));
+		frame_number_ = 0;
+		state_requested_ = true;
 	}
 
 	void spawn_token()
@@ -137,6 +158,39 @@ public:
 		}, high_priority);
 	}
 
+	void schedule(int64_t frame_number, const std::function<void()>& task)
+	{
+		executor_.begin_invoke([=]
+		{
+			schedule_.insert(std::make_pair(frame_number, task));
+		}, high_priority);
+	}
+
+	void run_schedule()
+	{
+		while(!schedule_.empty() && schedule_.begin()->first <= frame_number_)
+		{
+			auto task = std::move(schedule_.begin()->second);
+
+			if(schedule_.begin()->first < frame_number_)
+				CASPAR_LOG(warning) << L"[stage] Scheduled for frame " << schedule_.begin()->first << L" running late at frame " << frame_number_;
+
+			schedule_.erase(schedule_.begin());
+
+			try
+			{
+				task();
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+		}
+
+		// Stage calls are queued as high priority tasks, run them before the layers are produced.
+		executor_.yield();
+	}
+
 	void remove_layer_consumer(void* token, int layer)
 	{
 		executor_.begin_invoke([=]
@@ -156,6 +210,10 @@ public:
 		{
 			produce_timer_.restart();
 
+			run_schedule();
+
+			const int64_t frame_number = frame_number_;
+
 			std::map<int, safe_ptr<basic_frame>> frames;
 		
 			for(auto it = layers_.begin(); it != layers_.end(); ++it)
@@ -205,6 +263,13 @@ public:
 					elem.second.fetch_and_tick(format_desc_.field_mode != core::field_mode::progressive ? 2 : 1);
 			
 			graph_->set_value("produce-time", produce_timer_.elapsed()*format_desc_.fps*0.5);
+			*monitor_subject_ << monitor::message("/produce_time") % produce_timer_.elapsed();
+
+			++frame_number_;
+
+			// Only rebuild the layer infos when someone has read the last snapshot.
+			if(state_requested_.fetch_and_store(false))
+				publish_state();
 
 			std::shared_ptr<void> ticket(nullptr, [self](void*)
 			{
@@ -213,7 +278,11 @@ public:
 					self2->executor_.begin_invoke([=]{tick(self);});				
 			});
 
-			target_->send(std::make_pair(frames, ticket));
+			stage_frames packet;
+			packet.frame_number = frame_number;
+			packet.layers.swap(frames);
+
+			target_->send(std::make_pair(packet, ticket));
 
 			graph_->set_value("tick-time", tick_timer_.elapsed()*format_desc_.fps*0.5);
 			tick_timer_.restart();
@@ -221,9 +290,50 @@ public:
 		catch(...)
 		{
 			layers_.clear();
+			++frame_number_;
+			publish_state();
 			CASPAR_LOG_CURRENT_EXCEPTION();
 		}		
 	}
+
+	void publish_state()
+	{
+		try
+		{
+			state new_state;
+			BOOST_FOREACH(auto& layer, layers_)
+			{
+				new_state.layers[layer.first]		= layer.second->info();
+				new_state.layer_delays[layer.first]	= layer.second->delay_info();
+			}
+			new_state.frame_number	= frame_number_;
+			new_state.scheduled		= schedule_.size();
+			state_.publish(std::move(new_state));
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+	}
+
+	// Snapshots are only published by ticks following a read. A reader that 
+	// finds one older than the last tick has the stage publish it first.
+	std::shared_ptr<const state> current_state()
+	{
+		state_requested_ = true;
+
+		auto snapshot = state_.get();
+		int64_t frame_number = frame_number_;
+		if(snapshot->frame_number == frame_number || snapshot->frame_number + 1 == frame_number)
+			return snapshot;
+
+		if(executor_.is_current())
+			publish_state();
+		else
+			executor_.invoke([this]{publish_state();}, high_priority);
+
+		return state_.get();
+	}
 		
 	void set_transform(int index, const frame_transform& transform, unsigned int mix_duration, const std::wstring& tween)
 	{
@@ -430,6 +540,9 @@ public:
 		
 	boost::unique_future<safe_ptr<frame_producer>> foreground(int index)
 	{
+		if(executor_.is_current()) // Called from a scheduled task.
+			return wrap_as_future(get_layer(index).foreground());
+
 		return executor_.begin_invoke([=]
 		{
 			return get_layer(index).foreground();
@@ -438,6 +551,9 @@ public:
 	
 	boost::unique_future<safe_ptr<frame_producer>> background(int index)
 	{
+		if(executor_.is_current())
+			return wrap_as_future(get_layer(index).background());
+
 		return executor_.begin_invoke([=]
 		{
 			return get_layer(index).background();
@@ -448,48 +564,65 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
+			if(format_desc_ == format_desc)
+				return;
+
 			format_desc_ = format_desc;
+
+			// Frame numbers restart on the new frame grid. Pending tasks were scheduled against
+			// the old one, they run in order at the first frame of the new format.
+			if(!schedule_.empty())
+				CASPAR_LOG(warning) << L"[stage] Video format changed, running " << schedule_.size() << L" scheduled tasks at the next frame.";
+
+			std::multimap<int64_t, std::function<void()>> schedule;
+			BOOST_FOREACH(auto& task, schedule_)
+				schedule.insert(std::make_pair(0, std::move(task.second)));
+			schedule_.swap(schedule);
+
+			frame_number_ = 0;
 		}, high_priority);
 	}
 
+	// The info functions read the state published by the last tick and never enter the executor.
+
 	boost::unique_future<boost::property_tree::wptree> info()
 	{
-		return std::move(executor_.begin_invoke([this]() -> boost::property_tree::wptree
-		{
-			boost::property_tree::wptree info;
-			BOOST_FOREACH(auto& layer, layers_)			
-				info.add_child(L"layers.layer", layer.second->info())
-					.add(L"index", layer.first);	
-			return info;
-		}, high_priority));
+		auto snapshot = current_state();
+
+		boost::property_tree::wptree info;
+		info.add(L"frame-number", snapshot->frame_number);
+		info.add(L"scheduled", snapshot->scheduled);
+		BOOST_FOREACH(auto& layer, snapshot->layers)			
+			info.add_child(L"layers.layer", layer.second)
+				.add(L"index", layer.first);	
+		return wrap_as_future(std::move(info));
 	}
 
 	boost::unique_future<boost::property_tree::wptree> info(int index)
 	{
-		return std::move(executor_.begin_invoke([=]() -> boost::property_tree::wptree
-		{
-			return get_layer(index).info();
-		}, high_priority));
+		auto snapshot = current_state();
+		auto it = snapshot->layers.find(index);
+
+		return wrap_as_future(it != snapshot->layers.end() ? boost::property_tree::wptree(it->second) : layer(index).info());
 	}
 
 	boost::unique_future<boost::property_tree::wptree> delay_info()
 	{
-		return std::move(executor_.begin_invoke([this]() -> boost::property_tree::wptree
-		{
-			boost::property_tree::wptree info;
-			BOOST_FOREACH(auto& layer, layers_)			
-				info.add_child(L"layer", layer.second->delay_info())
-					.add(L"index", layer.first);	
-			return info;
-		}, high_priority));
+		auto snapshot = current_state();
+
+		boost::property_tree::wptree info;
+		BOOST_FOREACH(auto& layer, snapshot->layer_delays)			
+			info.add_child(L"layer", layer.second)
+				.add(L"index", layer.first);	
+		return wrap_as_future(std::move(info));
 	}
 
 	boost::unique_future<boost::property_tree::wptree> delay_info(int index)
 	{
-		return std::move(executor_.begin_invoke([=]() -> boost::property_tree::wptree
-		{
-			return get_layer(index).delay_info();
-		}, high_priority));
+		auto snapshot = current_state();
+		auto it = snapshot->layer_delays.find(index);
+
+		return wrap_as_future(it != snapshot->layer_delays.end() ? boost::property_tree::wptree(it->second) : layer(index).delay_info());
 	}
 };
 
@@ -505,6 +638,8 @@ void stage::clear_transforms(int index){impl_->clear_transforms(index);}
 void stage::clear_transforms(){impl_->clear_transforms();}
 frame_transform stage::get_current_transform(int index) { return impl_->get_current_transform(index); }
 void stage::spawn_token(){impl_->spawn_token();}
+void stage::schedule(int64_t frame_number, const std::function<void()>& task){impl_->schedule(frame_number, task);}
+int64_t stage::frame_number() const{return impl_->frame_number_;}
 void stage::load(int index, const safe_ptr<frame_producer>& producer, bool preview, int auto_play_delta){impl_->load(index, producer, preview, auto_play_delta);}
 void stage::pause(int index){impl_->pause(index);}
 void stage::resume(int index){impl_->resume(index);}
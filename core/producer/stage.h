@@ -34,6 +34,7 @@
 #include <boost/thread/future.hpp>
 
 #include <functional>
+#include <map>
 
 namespace caspar { namespace core {
 
@@ -41,6 +42,13 @@ struct video_format_desc;
 struct frame_transform;
 struct write_frame_consumer;
 
+// The layer frames of one tick, numbered like stage::frame_number().
+struct stage_frames
+{
+	int64_t									frame_number;
+	std::map<int, safe_ptr<basic_frame>>	layers;
+};
+
 class stage : boost::noncopyable
 {
 public:
@@ -49,7 +57,7 @@ public:
 
 	typedef std::function<struct frame_transform(struct frame_transform)>							transform_func_t;
 	typedef std::tuple<int, transform_func_t, unsigned int, std::wstring>							transform_tuple_t;
-	typedef target<std::pair<std::map<int, safe_ptr<basic_frame>>, std::shared_ptr<void>>> target_t;
+	typedef target<std::pair<stage_frames, std::shared_ptr<void>>>								target_t;
 
 	// Constructors
 
@@ -68,6 +76,11 @@ public:
 	frame_transform get_current_transform(int index);
 
 	void spawn_token();
+
+	// Runs the task at the start of the tick producing the given channel frame, before
+	// any layer is produced. Stage calls made by the task apply to that very frame.
+	// Tasks for frames that have already been produced run on the next tick.
+	void schedule(int64_t frame_number, const std::function<void()>& task);
 			
 	void load(int index, const safe_ptr<frame_producer>& producer, bool preview = false, int auto_play_delta = -1);
 	void pause(int index);
@@ -90,6 +103,10 @@ public:
 	boost::unique_future<safe_ptr<frame_producer>>	foreground(int index);
 	boost::unique_future<safe_ptr<frame_producer>>	background(int index);
 
+	// Number of the next frame to be produced, counted from 0 at construction and
+	// again from 0 whenever set_video_format_desc() changes the format.
+	int64_t frame_number() const;
+
 	boost::unique_future<boost::property_tree::wptree> info() const;
 	boost::unique_future<boost::property_tree::wptree> info(int layer) const;
 
@@ -71,6 +71,8 @@ public:
 		for(int n = 0; n < std::max(1, env::properties().get(L"configuration.pipeline-tokens", 2)); ++n)
 			stage_->spawn_token();
 
+		prewarm_buffers(format_desc);
+
 		stage_->monitor_output().attach_parent(monitor_subject_);
 		mixer_->monitor_output().attach_parent(monitor_subject_);
 		output_->monitor_output().attach_parent(monitor_subject_);
@@ -89,6 +91,7 @@ public:
 			mixer_->set_video_format_desc(format_desc);
 			stage_->set_video_format_desc(format_desc);
 			ogl_->gc();
+			prewarm_buffers(format_desc);
 		}
 		catch(...)
 		{
@@ -99,6 +102,11 @@ public:
 		}
 		format_desc_ = format_desc;
 	}
+
+	void prewarm_buffers(const video_format_desc& format_desc)
+	{
+		ogl_->prewarm(format_desc.width, format_desc.height, std::max(0, env::properties().get(L"configuration.gl.prewarm-buffers", 2)));
+	}
 		
 	std::wstring print() const
 	{
@@ -33,10 +33,10 @@
 #include <common/diagnostics/graph.h>
 #include <common/memory/memclr.h>
 #include <common/memory/memcpy.h>
-#include <common/memory/memshfl.h>
 #include <common/utility/timer.h>
 
 #include <core/consumer/frame_consumer.h>
+#include <core/consumer/pixel_packing.h>
 #include <core/mixer/audio/audio_util.h>
 
 #include <tbb/concurrent_queue.h>
@@ -249,8 +249,11 @@ public:
 		
 		if(!frame->image_data().empty())
 		{
-			if(key_only_)						
-				fast_memshfl(reserved_frames_.front()->image_data(), std::begin(frame->image_data()), frame->image_data().size(), 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+			if(key_only_)
+			{
+				core::packed_plane plane(reserved_frames_.front()->image_data(), format_desc_.width*4);
+				core::pack(core::packed_format::key_bgra, std::begin(frame->image_data()), format_desc_.width, format_desc_.height, &plane);
+			}
 			else
 				fast_memcpy(reserved_frames_.front()->image_data(), std::begin(frame->image_data()), frame->image_data().size());
 		}
@@ -0,0 +1,170 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../stdafx.h"
+
+#include "decklink_ingest.h"
+
+#include <common/memory/memcpy.h>
+
+#include <core/mixer/write_frame.h>
+#include <core/producer/frame/frame_factory.h>
+#include <core/producer/frame/frame_transform.h>
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace caspar { namespace decklink {
+
+namespace {
+
+uint8_t to_8bit(uint32_t value)
+{
+	return static_cast<uint8_t>(std::min<uint32_t>((value + 2) >> 2, 255));
+}
+
+// v210 packs six pixels into four little endian words of three 10 bit
+// components: Cb0 Y0 Cr0 | Y1 Cb1 Y2 | Cr1 Y3 Cb2 | Y4 Cr2 Y5.
+void unpack_v210_row(const uint8_t* src, int width, uint8_t* y, uint8_t* cb, uint8_t* cr)
+{
+	auto words = reinterpret_cast<const uint32_t*>(src);
+	const int chroma_width = (width + 1) / 2;
+
+	for (int x = 0; x < width; x += 6, words += 4)
+	{
+		uint8_t s[12];
+		for (int n = 0; n < 4; ++n)
+		{
+			s[n*3+0] = to_8bit( words[n]        & 0x3ff);
+			s[n*3+1] = to_8bit((words[n] >> 10) & 0x3ff);
+			s[n*3+2] = to_8bit((words[n] >> 20) & 0x3ff);
+		}
+
+		const int c = x / 2;
+
+		if (x + 6 <= width)
+		{
+			y[x+0] = s[1]; y[x+1] = s[3]; y[x+2] = s[5]; y[x+3] = s[7]; y[x+4] = s[9]; y[x+5] = s[11];
+			cb[c+0] = s[0]; cb[c+1] = s[4]; cb[c+2] = s[8];
+			cr[c+0] = s[2]; cr[c+1] = s[6]; cr[c+2] = s[10];
+		}
+		else // The last group of a line may be partial.
+		{
+			for (int n = 0; n < 6 && x + n < width; ++n)
+				y[x+n] = s[n*2+1];
+
+			for (int n = 0; n < 3 && c + n < chroma_width; ++n)
+			{
+				cb[c+n] = s[n*4+0];
+				cr[c+n] = s[n*4+2];
+			}
+		}
+	}
+}
+
+}
+
+core::pixel_format_desc get_ingest_pixel_format_desc(capture_format::type format, int width, int height)
+{
+	core::pixel_format_desc desc;
+
+	if (format == capture_format::v210)
+	{
+		desc.pix_fmt = core::pixel_format::ycbcr;
+		desc.planes.push_back(core::pixel_format_desc::plane(width,				height, 1));
+		desc.planes.push_back(core::pixel_format_desc::plane((width + 1) / 2,	height, 1));
+		desc.planes.push_back(core::pixel_format_desc::plane((width + 1) / 2,	height, 1));
+	}
+	else
+	{
+		desc.pix_fmt = core::pixel_format::uyvy;
+		desc.planes.push_back(core::pixel_format_desc::plane((width + 1) / 2,	height, 4));
+	}
+
+	return desc;
+}
+
+void ingest_video(capture_format::type format, const uint8_t* bytes, int row_bytes, const core::pixel_format_desc& desc, uint8_t* const* planes)
+{
+	const auto& luma	= desc.planes.at(0);
+	const int	height	= static_cast<int>(luma.height);
+
+	if (format == capture_format::v210)
+	{
+		const auto& chroma = desc.planes.at(1);
+
+		tbb::parallel_for(0, height, [&](int y)
+		{
+			unpack_v210_row(
+					bytes + y * row_bytes, 
+					static_cast<int>(luma.width), 
+					planes[0] + y * luma.linesize, 
+					planes[1] + y * chroma.linesize, 
+					planes[2] + y * chroma.linesize);
+		});
+	}
+	else if (row_bytes == static_cast<int>(luma.linesize))
+		fast_memcpy(planes[0], bytes, luma.size);
+	else
+	{
+		// Copy line by line since the card may pad each line.
+		tbb::parallel_for(0, height, [&](int y)
+		{
+			fast_memcpy(planes[0] + y * luma.linesize, bytes + y * row_bytes, luma.linesize);
+		});
+	}
+}
+
+safe_ptr<core::write_frame> make_ingest_frame(
+		const void* tag,
+		capture_format::type format,
+		const void* bytes,
+		int row_bytes,
+		int width,
+		int height,
+		core::field_mode::type field_mode,
+		const safe_ptr<core::frame_factory>& frame_factory,
+		const core::channel_layout& audio_channel_layout)
+{
+	auto desc	= get_ingest_pixel_format_desc(format, width, height);
+	auto frame	= frame_factory->create_frame(tag, desc, audio_channel_layout);
+	frame->set_type(field_mode);
+
+	std::vector<uint8_t*> planes;
+	for (size_t n = 0; n < desc.planes.size(); ++n)
+		planes.push_back(frame->image_data(n).begin());
+
+	ingest_video(format, reinterpret_cast<const uint8_t*>(bytes), row_bytes, desc, planes.data());
+	frame->commit();
+
+	// Fix field-order if needed
+	auto format_desc = frame_factory->get_video_format_desc();
+	if(field_mode == core::field_mode::lower && format_desc.field_mode == core::field_mode::upper)
+		frame->get_frame_transform().fill_translation[1] += 1.0/static_cast<double>(format_desc.height);
+	else if(field_mode == core::field_mode::upper && format_desc.field_mode == core::field_mode::lower)
+		frame->get_frame_transform().fill_translation[1] -= 1.0/static_cast<double>(format_desc.height);
+
+	return frame;
+}
+
+}}
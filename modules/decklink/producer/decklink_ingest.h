@@ -0,0 +1,72 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <core/producer/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <cstdint>
+
+namespace caspar { 
+
+namespace core {
+
+class write_frame;
+struct frame_factory;
+struct channel_layout;
+
+}
+
+namespace decklink {
+
+struct capture_format
+{
+	enum type
+	{
+		uyvy,	// bmdFormat8BitYUV
+		v210	// bmdFormat10BitYUV
+	};
+};
+
+// Planes a captured frame is ingested into. UYVY stays packed and is unpacked
+// by the image shader, v210 is unpacked to planar 8 bit Y'CbCr 4:2:2.
+core::pixel_format_desc get_ingest_pixel_format_desc(capture_format::type format, int width, int height);
+
+// Copies or unpacks one captured frame into planes laid out as described by
+// get_ingest_pixel_format_desc.
+void ingest_video(capture_format::type format, const uint8_t* bytes, int row_bytes, const core::pixel_format_desc& desc, uint8_t* const* planes);
+
+// Wraps one captured frame in a write_frame without ffmpeg filtering or scaling.
+safe_ptr<core::write_frame> make_ingest_frame(
+		const void* tag,
+		capture_format::type format,
+		const void* bytes,
+		int row_bytes,
+		int width,
+		int height,
+		core::field_mode::type field_mode,
+		const safe_ptr<core::frame_factory>& frame_factory,
+		const core::channel_layout& audio_channel_layout);
+
+}}
@@ -22,6 +22,7 @@
 #include "../stdafx.h"
 
 #include "decklink_producer.h"
+#include "decklink_ingest.h"
 
 #include "../interop/DeckLinkAPI_h.h"
 #include "../util/util.h"
@@ -96,6 +97,7 @@ class decklink_producer : boost::noncopyable, public IDeckLinkInputCallback
 	const std::wstring											model_name_;
 	const size_t												device_index_;
 	const std::wstring											filter_;
+	const capture_format::type									capture_format_;
 	
 	core::video_format_desc										format_desc_;
 	std::vector<size_t>											audio_cadence_;
@@ -118,6 +120,7 @@ public:
 			size_t device_index,
 			const safe_ptr<core::frame_factory>& frame_factory,
 			const std::wstring& filter,
+			capture_format::type capture_format,
 			std::size_t buffer_depth)
 		: decklink_(get_device(device_index))
 		, input_(decklink_)
@@ -125,6 +128,7 @@ public:
 		, model_name_(get_model_name(decklink_))
 		, device_index_(device_index)
 		, filter_(filter)
+		, capture_format_(capture_format)
 		, format_desc_(format_desc)
 		, audio_cadence_(format_desc.audio_cadence)
 		, muxer_(format_desc.fps, frame_factory, false, audio_channel_layout, filter, ffmpeg::filter::is_deinterlacing(filter))
@@ -150,7 +154,8 @@ public:
 		graph_->set_text(print());
 		diagnostics::register_graph(graph_);
 		
-		auto display_mode = get_display_mode(input_, format_desc_.format, bmdFormat8BitYUV, bmdVideoInputFlagDefault);
+		auto pixel_format = capture_format_ == capture_format::v210 ? bmdFormat10BitYUV : bmdFormat8BitYUV;
+		auto display_mode = get_display_mode(input_, format_desc_.format, pixel_format, bmdVideoInputFlagDefault);
 		
 		allocator_.reset(new thread_safe_decklink_allocator(print()));
 
@@ -160,7 +165,7 @@ public:
 									<< boost::errinfo_api_function("SetVideoInputFrameMemoryAllocator"));
 
 		// NOTE: bmdFormat8BitARGB is currently not supported by any decklink card. (2011-05-08)
-		if(FAILED(input_->EnableVideoInput(display_mode, bmdFormat8BitYUV, bmdVideoInputFlagDefault))) 
+		if(FAILED(input_->EnableVideoInput(display_mode, pixel_format, bmdVideoInputFlagDefault))) 
 			BOOST_THROW_EXCEPTION(caspar_exception() 
 									<< msg_info(narrow(print()) + " Could not enable video input.")
 									<< boost::errinfo_api_function("EnableVideoInput"));
@@ -214,22 +219,11 @@ public:
 
 			// PUSH
 
-			void* bytes = nullptr;
-			if(FAILED(video->GetBytes(&bytes)) || !bytes)
+			void* video_bytes = nullptr;
+			if(FAILED(video->GetBytes(&video_bytes)) || !video_bytes)
 				return S_OK;
-			
-			safe_ptr<AVFrame> av_frame(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-			//avcodec_get_frame_defaults(av_frame.get());
-						
-			av_frame->data[0]			= reinterpret_cast<uint8_t*>(bytes);
-			av_frame->linesize[0]		= video->GetRowBytes();			
-			av_frame->format			= PIX_FMT_UYVY422;
-			av_frame->width				= video->GetWidth();
-			av_frame->height			= video->GetHeight();
-			av_frame->interlaced_frame	= format_desc_.field_mode != core::field_mode::progressive;
-			av_frame->top_field_first	= format_desc_.field_mode == core::field_mode::upper ? 1 : 0;
-			av_frame->key_frame = 1;
 				
+			void* bytes = nullptr;
 			std::shared_ptr<core::audio_buffer> audio_buffer;
 
 			// It is assumed that audio is always equal or ahead of video.
@@ -275,7 +269,15 @@ public:
 			}
 
 			muxer_.push(audio_buffer);
-			muxer_.push(av_frame, hints_);	
+
+			// Captures the muxer can pass through unfiltered are copied straight into a frame,
+			// everything else goes through the ffmpeg filter as before.
+
+			int hints = hints_;
+			if(muxer_.can_bypass_filter(format_desc_.field_mode, video->GetHeight(), hints))
+				muxer_.push(make_ingest_frame(this, capture_format_, video_bytes, video->GetRowBytes(), video->GetWidth(), video->GetHeight(), format_desc_.field_mode, frame_factory_, audio_channel_layout_));
+			else
+				muxer_.push(make_av_frame(video, video_bytes), hints);	
 											
 			boost::range::rotate(audio_cadence_, std::begin(audio_cadence_)+1);
 			
@@ -307,6 +309,49 @@ public:
 		return S_OK;
 	}
 	
+	safe_ptr<AVFrame> make_av_frame(IDeckLinkVideoInputFrame* video, void* video_bytes)
+	{
+		// v210 is fed to the filter graph as planar 4:2:2, unpacked into a buffer owned by the frame.
+
+		auto desc	= get_ingest_pixel_format_desc(capture_format_, video->GetWidth(), video->GetHeight());
+		auto buffer	= std::make_shared<std::vector<uint8_t>>(capture_format_ == capture_format::v210 ? desc.planes[0].size + desc.planes[1].size + desc.planes[2].size : 0);
+
+		safe_ptr<AVFrame> av_frame(av_frame_alloc(), [buffer](AVFrame* ptr) { av_frame_free(&ptr); });
+		//avcodec_get_frame_defaults(av_frame.get());
+		
+		if(capture_format_ == capture_format::v210)
+		{
+			uint8_t* planes[] = 
+			{
+				buffer->data(), 
+				buffer->data() + desc.planes[0].size, 
+				buffer->data() + desc.planes[0].size + desc.planes[1].size
+			};
+			ingest_video(capture_format_, reinterpret_cast<const uint8_t*>(video_bytes), video->GetRowBytes(), desc, planes);
+
+			for(int n = 0; n < 3; ++n)
+			{
+				av_frame->data[n]		= planes[n];
+				av_frame->linesize[n]	= desc.planes[n].linesize;
+			}
+			av_frame->format			= PIX_FMT_YUV422P;
+		}
+		else
+		{
+			av_frame->data[0]			= reinterpret_cast<uint8_t*>(video_bytes);
+			av_frame->linesize[0]		= video->GetRowBytes();			
+			av_frame->format			= PIX_FMT_UYVY422;
+		}
+
+		av_frame->width				= video->GetWidth();
+		av_frame->height			= video->GetHeight();
+		av_frame->interlaced_frame	= format_desc_.field_mode != core::field_mode::progressive;
+		av_frame->top_field_first	= format_desc_.field_mode == core::field_mode::upper ? 1 : 0;
+		av_frame->key_frame = 1;
+
+		return av_frame;
+	}
+	
 	safe_ptr<core::basic_frame> get_frame(int hints)
 	{
 		if(exception_ != nullptr)
@@ -345,13 +390,14 @@ public:
 			const core::channel_layout& audio_channel_layout,
 			size_t device_index,
 			const std::wstring& filter_str,
+			capture_format::type capture_format,
 			uint32_t length,
 			std::size_t buffer_depth)
 		: context_(L"decklink_producer[" + boost::lexical_cast<std::wstring>(device_index) + L"]")
 		, last_frame_(core::basic_frame::empty())
 		, length_(length)
 	{
-		context_.reset([&]{return new decklink_producer(format_desc, audio_channel_layout, device_index, frame_factory, filter_str, buffer_depth);}); 
+		context_.reset([&]{return new decklink_producer(format_desc, audio_channel_layout, device_index, frame_factory, filter_str, capture_format, buffer_depth);}); 
 	}
 	
 	// frame_producer
@@ -406,6 +452,7 @@ safe_ptr<core::frame_producer> create_producer(
 	auto filter_str		= params.get(L"FILTER"); 	
 	auto length			= params.get(L"LENGTH", std::numeric_limits<uint32_t>::max()); 	
 	auto buffer_depth	= params.get(L"BUFFER", 2); 	
+	auto capture_format	= params.has(L"10BIT") ? capture_format::v210 : capture_format::uyvy;
 	auto format_desc	= core::video_format_desc::get(params.get(L"FORMAT", L"INVALID"));
 	auto audio_layout		= core::create_custom_channel_layout(
 			params.get(L"CHANNEL_LAYOUT", L"STEREO"),
@@ -419,7 +466,7 @@ safe_ptr<core::frame_producer> create_producer(
 			
 	return create_producer_print_proxy(
 		   create_producer_destroy_proxy(
-			make_safe<decklink_producer_proxy>(frame_factory, format_desc, audio_layout, device_index, filter_str, length, buffer_depth)));
+			make_safe<decklink_producer_proxy>(frame_factory, format_desc, audio_layout, device_index, filter_str, capture_format, length, buffer_depth)));
 }
 
 }}
\ No newline at end of file
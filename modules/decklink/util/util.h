@@ -23,8 +23,8 @@
 
 #include <common/exception/exceptions.h>
 #include <common/log/log.h>
-#include <common/memory/memshfl.h>
 #include <core/video_format.h>
+#include <core/consumer/pixel_packing.h>
 #include <core/mixer/read_frame.h>
 
 #include "../interop/DeckLinkAPI_h.h"
@@ -202,16 +202,15 @@ static std::wstring get_model_name(const T& device)
 }
 
 static std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> extract_key(
-		const safe_ptr<core::read_frame>& frame)
+		const safe_ptr<core::read_frame>& frame,
+		const core::video_format_desc& format_desc)
 {
 	std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> result;
 
 	result.resize(frame->image_data().size());
-	fast_memshfl(
-			result.data(),
-			frame->image_data().begin(),
-			frame->image_data().size(),
-			0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+
+	core::packed_plane plane(result.data(), format_desc.width*4);
+	core::pack(core::packed_format::key_bgra, frame->image_data().begin(), format_desc.width, format_desc.height, &plane);
 
 	return std::move(result);
 }
@@ -287,7 +286,9 @@ public:
 				if(data_.empty())
 				{
 					data_.resize(frame_->image_data().size());
-					fast_memshfl(data_.data(), frame_->image_data().begin(), frame_->image_data().size(), 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+
+					core::packed_plane plane(data_.data(), format_desc_.width*4);
+					core::pack(core::packed_format::key_bgra, frame_->image_data().begin(), format_desc_.width, format_desc_.height, &plane);
 				}
 				*buffer = data_.data();
 			}
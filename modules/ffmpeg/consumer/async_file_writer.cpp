@@ -0,0 +1,381 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../StdAfx.h"
+
+#include "async_file_writer.h"
+
+#include <common/concurrency/executor.h>
+#include <common/diagnostics/graph.h>
+#include <common/exception/exceptions.h>
+#include <common/log/log.h>
+
+#include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Unbuffered writes have to be whole sectors, 4096 covers 512e and 4Kn disks.
+const size_t SECTOR_SIZE = 4096;
+
+class win32_file_sink : public file_sink
+{
+	HANDLE file_;
+public:
+	win32_file_sink()
+		: file_(INVALID_HANDLE_VALUE)
+	{
+	}
+
+	~win32_file_sink()
+	{
+		close();
+	}
+
+	virtual bool open(const std::wstring& filename, bool unbuffered) override
+	{
+		close();
+
+		DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+		if(unbuffered)
+			flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+
+		file_ = ::CreateFileW(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, flags, NULL);
+		return file_ != INVALID_HANDLE_VALUE;
+	}
+
+	virtual bool write(const uint8_t* data, size_t size) override
+	{
+		DWORD written = 0;
+		return ::WriteFile(file_, data, static_cast<DWORD>(size), &written, NULL) && written == size;
+	}
+
+	virtual bool truncate(uint64_t size) override
+	{
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(size);
+		return ::SetFilePointerEx(file_, position, NULL, FILE_BEGIN) && ::SetEndOfFile(file_);
+	}
+
+	virtual bool flush() override
+	{
+		return ::FlushFileBuffers(file_) != FALSE;
+	}
+
+	virtual void close() override
+	{
+		if(file_ == INVALID_HANDLE_VALUE)
+			return;
+
+		::CloseHandle(file_);
+		file_ = INVALID_HANDLE_VALUE;
+	}
+};
+
+}
+
+safe_ptr<file_sink> create_file_sink()
+{
+	return make_safe<win32_file_sink>();
+}
+
+async_file_writer::configuration::configuration()
+	: buffer_size(4 * 1024 * 1024)
+	, buffer_count(32)
+	, unbuffered(false)
+	, sync(false)
+{
+}
+
+struct async_file_writer::implementation : boost::noncopyable
+{
+	struct buffer
+	{
+		uint8_t*	data;
+		size_t		size;
+	};
+
+	const configuration							config_;
+	const safe_ptr<diagnostics::graph>			graph_;
+
+	std::shared_ptr<uint8_t>					memory_;
+	std::vector<buffer>							buffers_;
+	tbb::concurrent_bounded_queue<buffer*>		free_;
+	buffer*										current_;
+	bool										is_open_;
+
+	// Owned by the writer thread.
+	const safe_ptr<file_sink>					sink_;
+	bool										file_open_;
+	std::wstring								filename_;
+	uint64_t									file_size_;
+
+	tbb::atomic<uint64_t>						bytes_written_;
+	tbb::atomic<uint64_t>						files_;
+	tbb::atomic<uint64_t>						write_errors_;
+	tbb::atomic<uint64_t>						blocked_writes_;
+	tbb::atomic<size_t>							min_free_;
+
+	executor									executor_;
+
+	implementation(const configuration& config, const safe_ptr<diagnostics::graph>& graph)
+		: config_(config)
+		, graph_(graph)
+		, current_(nullptr)
+		, is_open_(false)
+		, sink_(config.sink ? make_safe_ptr(config.sink) : create_file_sink())
+		, file_open_(false)
+		, file_size_(0)
+		, executor_(L"async_file_writer")
+	{
+		if(config_.buffer_size < SECTOR_SIZE || config_.buffer_size % SECTOR_SIZE != 0 || config_.buffer_count < 2)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("async_file_writer: buffer size has to be a multiple of 4096 and at least two buffers."));
+
+		auto memory = static_cast<uint8_t*>(::VirtualAlloc(NULL, config_.buffer_size * config_.buffer_count, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+		if(!memory)
+			BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("async_file_writer: could not allocate the write buffers.") << boost::errinfo_api_function("VirtualAlloc"));
+
+		memory_.reset(memory, [](uint8_t* p)
+		{
+			::VirtualFree(p, 0, MEM_RELEASE);
+		});
+
+		buffers_.resize(config_.buffer_count);
+		for(size_t n = 0; n < buffers_.size(); ++n)
+		{
+			buffers_[n].data = memory + n * config_.buffer_size;
+			buffers_[n].size = 0;
+			free_.push(&buffers_[n]);
+		}
+
+		bytes_written_	= 0;
+		files_			= 0;
+		write_errors_	= 0;
+		blocked_writes_	= 0;
+		min_free_		= config_.buffer_count;
+
+		graph_->set_color("write-buffer", diagnostics::color(0.6f, 0.6f, 1.0f));
+		graph_->set_color("write-blocked", diagnostics::color(0.9f, 0.5f, 0.0f));
+		graph_->set_color("write-error", diagnostics::color(1.0f, 0.0f, 0.0f));
+
+		executor_.set_priority_class(above_normal_priority_class);
+	}
+
+	~implementation()
+	{
+		if(is_open_)
+			close();
+
+		executor_.wait();
+	}
+
+	void open(const std::wstring& filename)
+	{
+		if(is_open_)
+			close();
+
+		is_open_ = true;
+		executor_.begin_invoke([=]
+		{
+			open_file(filename);
+		});
+	}
+
+	void write(const uint8_t* data, size_t size)
+	{
+		while(size > 0)
+		{
+			if(!current_)
+				current_ = acquire();
+
+			auto count = std::min(size, config_.buffer_size - current_->size);
+			std::memcpy(current_->data + current_->size, data, count);
+
+			current_->size	+= count;
+			data			+= count;
+			size			-= count;
+
+			if(current_->size == config_.buffer_size)
+				submit();
+		}
+	}
+
+	void close()
+	{
+		if(current_ && current_->size > 0)
+			submit();
+
+		is_open_ = false;
+		executor_.begin_invoke([=]
+		{
+			close_file();
+		});
+	}
+
+	bool ready() const
+	{
+		return free_.size() >= static_cast<std::ptrdiff_t>(config_.buffer_count / 4);
+	}
+
+	buffer* acquire()
+	{
+		buffer* buf = nullptr;
+		if(!free_.try_pop(buf))
+		{
+			++blocked_writes_;
+			graph_->set_tag("write-blocked");
+			free_.pop(buf);
+		}
+
+		buf->size = 0;
+
+		auto free = static_cast<size_t>(std::max<std::ptrdiff_t>(free_.size(), 0));
+		if(free < min_free_)
+			min_free_ = free;
+
+		return buf;
+	}
+
+	void submit()
+	{
+		auto buf = current_;
+		current_ = nullptr;
+
+		executor_.begin_invoke([=]
+		{
+			write_buffer(buf);
+		});
+	}
+
+	void open_file(const std::wstring& filename)
+	{
+		if(file_open_)
+			close_file();
+
+		filename_	= filename;
+		file_size_	= 0;
+
+		file_open_ = sink_->open(filename, config_.unbuffered);
+		if(!file_open_)
+			fail(L"CreateFile");
+		else
+			++files_;
+	}
+
+	void write_buffer(buffer* buf)
+	{
+		if(file_open_)
+		{
+			// Only the last buffer of a file can be partial, the padding is cut off again in close_file().
+			auto size = buf->size;
+			if(config_.unbuffered && size % SECTOR_SIZE != 0)
+			{
+				auto padded = (size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+				std::memset(buf->data + size, 0, padded - size);
+				size = padded;
+			}
+
+			if(!sink_->write(buf->data, size))
+				fail(L"WriteFile");
+			else
+			{
+				file_size_		+= buf->size;
+				bytes_written_	+= buf->size;
+			}
+		}
+
+		free_.push(buf);
+
+		if(config_.sync && file_open_ && executor_.empty())
+			sink_->flush();
+
+		graph_->set_value("write-buffer", 1.0 - static_cast<double>(std::max<std::ptrdiff_t>(free_.size(), 0)) / static_cast<double>(config_.buffer_count));
+	}
+
+	void close_file()
+	{
+		if(!file_open_)
+			return;
+
+		if(config_.unbuffered && !sink_->truncate(file_size_))
+			fail(L"SetEndOfFile");
+
+		if(file_open_ && !sink_->flush())
+			fail(L"FlushFileBuffers");
+
+		if(file_open_)
+		{
+			sink_->close();
+			file_open_ = false;
+		}
+	}
+
+	// The rest of the file is lost, the next open() starts over.
+	void fail(const wchar_t* api)
+	{
+		auto error = ::GetLastError();
+
+		++write_errors_;
+		graph_->set_tag("write-error");
+		CASPAR_LOG(error) << L"[async_file_writer] " << api << L" failed with error " << error << L" for " << filename_ << L".";
+
+		if(file_open_)
+		{
+			sink_->close();
+			file_open_ = false;
+		}
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::property_tree::wptree info;
+		info.add(L"files",				static_cast<uint64_t>(files_));
+		info.add(L"bytes-written",		static_cast<uint64_t>(bytes_written_));
+		info.add(L"write-errors",		static_cast<uint64_t>(write_errors_));
+		info.add(L"blocked-writes",		static_cast<uint64_t>(blocked_writes_));
+		info.add(L"buffers",			config_.buffer_count);
+		info.add(L"buffer-size",		config_.buffer_size);
+		info.add(L"min-free-buffers",	static_cast<size_t>(min_free_));
+		info.add(L"unbuffered",			config_.unbuffered);
+		info.add(L"sync",				config_.sync);
+		return info;
+	}
+};
+
+async_file_writer::async_file_writer(const configuration& config, const safe_ptr<diagnostics::graph>& graph) : impl_(new implementation(config, graph)){}
+async_file_writer::~async_file_writer(){}
+void async_file_writer::open(const std::wstring& filename){impl_->open(filename);}
+void async_file_writer::write(const uint8_t* data, size_t size){impl_->write(data, size);}
+void async_file_writer::close(){impl_->close();}
+bool async_file_writer::ready() const{return impl_->ready();}
+boost::property_tree::wptree async_file_writer::info() const{return impl_->info();}
+
+}}
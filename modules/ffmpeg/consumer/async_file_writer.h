@@ -0,0 +1,94 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar {
+
+namespace diagnostics {
+	class graph;
+}
+
+namespace ffmpeg {
+
+// Where the writer thread puts the bytes, one file at a time. Failures
+// return false and leave the Win32 error in GetLastError().
+class file_sink
+{
+public:
+	virtual ~file_sink() {}
+
+	virtual bool open(const std::wstring& filename, bool unbuffered) = 0;
+	virtual bool write(const uint8_t* data, size_t size) = 0;
+	virtual bool truncate(uint64_t size) = 0;	// Cuts the sector padding of unbuffered writes.
+	virtual bool flush() = 0;
+	virtual void close() = 0;
+};
+
+// Writes files through CreateFile/WriteFile.
+safe_ptr<file_sink> create_file_sink();
+
+// Writes a sequence of files on its own thread. The caller copies bytes into
+// a ring of page aligned buffers and only hands full buffers over, so a slow
+// or stalling disk never holds up the caller as long as the ring has room.
+// open(), write() and close() are queued in call order, one file can be
+// closed and the next opened without waiting for either.
+class async_file_writer : boost::noncopyable
+{
+public:
+	struct configuration
+	{
+		size_t	buffer_size;		// Bytes per ring buffer, a multiple of 4096.
+		size_t	buffer_count;
+		bool	unbuffered;			// FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, the Win32 O_DIRECT.
+		bool	sync;				// FlushFileBuffers whenever the queue drains, not only on close.
+
+		std::shared_ptr<file_sink>	sink;	// nullptr writes to disk, see create_file_sink.
+
+		configuration();
+	};
+
+	async_file_writer(const configuration& config, const safe_ptr<diagnostics::graph>& graph);
+	~async_file_writer(); // Finishes every queued write.
+
+	void open(const std::wstring& filename);
+	void write(const uint8_t* data, size_t size);
+	void close(); // Flushes the file to disk before closing it.
+
+	// False when fewer than a quarter of the buffers are free, callers should
+	// drop input rather than block in write().
+	bool ready() const;
+
+	boost::property_tree::wptree info() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
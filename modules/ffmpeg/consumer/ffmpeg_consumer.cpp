@@ -24,6 +24,7 @@
 #include "../ffmpeg_error.h"
 
 #include "ffmpeg_consumer.h"
+#include "async_file_writer.h"
 
 #include "../ffmpeg_params.h"
 #include "../producer/audio/audio_resampler.h"
@@ -32,16 +33,18 @@
 #include <core/mixer/read_frame.h>
 #include <core/mixer/audio/audio_util.h>
 #include <core/consumer/frame_consumer.h>
+#include <core/consumer/pixel_packing.h>
 #include <core/video_format.h>
 
 #include <common/concurrency/executor.h>
 #include <common/concurrency/future_util.h>
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
+#include <common/scope_exit.h>
 #include <common/utility/string.h>
-#include <common/memory/memshfl.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/timer.hpp>
 #include <boost/property_tree/ptree.hpp>
 
@@ -53,6 +56,7 @@
 #include <boost/range/algorithm_ext.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
 #include <string>
 
 #if defined(_MSC_VER)
@@ -211,6 +215,77 @@ struct output_format
 
 typedef std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>>	byte_vector;
 
+const size_t MAX_PARALLEL_ENCODERS = 16;
+
+// Packing or scaling state for one encoder context.
+struct video_conversion
+{
+	byte_vector								key_picture_buf;
+	byte_vector								picture_buf;
+	std::shared_ptr<SwsContext>				sws;
+};
+
+// A codec context of its own for frame parallel encoding of intra only codecs.
+struct video_encoder : boost::noncopyable
+{
+	std::shared_ptr<AVCodecContext>			codec;
+	video_conversion						conversion;
+	executor								worker;
+
+	video_encoder(const std::shared_ptr<AVCodecContext>& codec, const std::wstring& name)
+		: codec(codec)
+		, worker(name)
+	{
+	}
+};
+
+std::shared_ptr<AVPacket> create_output_packet()
+{
+	std::shared_ptr<AVPacket> pkt(new AVPacket, [](AVPacket* p)
+	{
+		av_free_packet(p);
+		delete p;
+	});
+	av_init_packet(pkt.get());
+	pkt->data = nullptr;
+	pkt->size = 0;
+	return pkt;
+}
+
+// Removes a consumer option that is not passed on to ffmpeg.
+template<typename T>
+T take_option(std::vector<option>& options, const std::string& name, T default_value)
+{
+	auto value = default_value;
+
+	boost::range::remove_erase_if(options, [&](const option& o) -> bool
+	{
+		if(o.name != name)
+			return false;
+
+		try
+		{
+			value = boost::lexical_cast<T>(o.value);
+		}
+		catch(boost::bad_lexical_cast&)
+		{
+			BOOST_THROW_EXCEPTION(invalid_argument() << arg_name_info(name));
+		}
+
+		return true;
+	});
+
+	return value;
+}
+
+int write_to_file_writer(void* opaque, uint8_t* buf, int buf_size)
+{
+	static_cast<async_file_writer*>(opaque)->write(buf, buf_size);
+	return buf_size;
+}
+
+const int SEGMENT_IO_BUFFER_SIZE = 256 * 1024;
+
 struct ffmpeg_consumer : boost::noncopyable
 {		
 	const std::string						filename_;
@@ -229,10 +304,8 @@ struct ffmpeg_consumer : boost::noncopyable
 	byte_vector								audio_outbuf_;
 	byte_vector								audio_buf_;
 	byte_vector								video_outbuf_;
-	byte_vector								key_picture_buf_;
-	byte_vector								picture_buf_;
+	video_conversion						conversion_;
 	std::shared_ptr<audio_resampler>		swr_;
-	std::shared_ptr<SwsContext>				sws_;
 
 	int64_t									in_frame_number_;
 	int64_t									out_frame_number_;
@@ -240,9 +313,28 @@ struct ffmpeg_consumer : boost::noncopyable
 	output_format							output_format_;
 	bool									key_only_;
 	tbb::atomic<int64_t>					current_encoding_delay_;
+
+	std::vector<safe_ptr<video_encoder>>	parallel_encoders_;
+	size_t									next_encoder_;
+	size_t									max_frames_in_flight_;
+	tbb::atomic<size_t>						frames_in_flight_;
+
+	// Segmented recording, oc_ only holds the encoders and every segment is
+	// a muxer of its own writing through writer_.
+	int64_t									segment_duration_;	// AV_TIME_BASE units, 0 when not segmented.
+	std::shared_ptr<async_file_writer>		writer_;
+	std::shared_ptr<AVFormatContext>		segment_oc_;
+	int64_t									segment_start_;		// In video_st_ time base.
+	size_t									segment_index_;
+
+	tbb::atomic<uint64_t>					loop_count_;
+	tbb::atomic<uint64_t>					loop_total_micros_;
+	tbb::atomic<uint64_t>					loop_max_micros_;
+	tbb::atomic<uint64_t>					loop_late_;
+	tbb::atomic<uint64_t>					dropped_frames_;
 	
 public:
-	ffmpeg_consumer(const std::string& filename, const core::video_format_desc& format_desc, std::vector<option> options, bool key_only, const core::channel_layout& audio_channel_layout)
+	ffmpeg_consumer(const std::string& filename, const core::video_format_desc& format_desc, std::vector<option> options, bool key_only, const core::channel_layout& audio_channel_layout, async_file_writer::configuration writer_config = async_file_writer::configuration())
 		: filename_(filename)
 		, video_outbuf_(1920*1080*8)
 		, audio_outbuf_(10000)
@@ -253,18 +345,28 @@ public:
 		, out_frame_number_(0)
 		, output_format_(format_desc, filename, options)
 		, key_only_(key_only)
+		, next_encoder_(0)
+		, max_frames_in_flight_(8)
+		, segment_duration_(0)
+		, segment_start_(0)
+		, segment_index_(0)
 	{
 		current_encoding_delay_ = 0;
+		frames_in_flight_ = 0;
+		loop_count_ = 0;
+		loop_total_micros_ = 0;
+		loop_max_micros_ = 0;
+		loop_late_ = 0;
+		dropped_frames_ = 0;
 
 		// TODO: Ask stakeholders about case where file already exists.
 		boost::filesystem::remove(boost::filesystem::path(env::media_folder() + widen(filename))); // Delete the file if it exists
 
 		graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
 		graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+		graph_->set_color("encode-queue", diagnostics::color(0.7f, 0.4f, 0.4f));
 		graph_->set_text(print());
 		diagnostics::register_graph(graph_);
-
-		encode_executor_.set_capacity(8);
 				
 		AVFormatContext* oc;
 
@@ -276,20 +378,50 @@ public:
 
 		oc_.reset(oc);
 								
+		const auto encoders = parallel_encoder_count(take_option<size_t>(options, "encoders", 0));
+
+		segment_duration_ = static_cast<int64_t>(take_option<double>(options, "segment_time", 0.0) * AV_TIME_BASE);
+
+		writer_config.buffer_count	= std::max<size_t>(take_option<size_t>(options, "write_buffer", writer_config.buffer_size * writer_config.buffer_count >> 20) * 1024 * 1024 / writer_config.buffer_size, 2);
+		writer_config.unbuffered	= take_option<int>(options, "unbuffered", writer_config.unbuffered ? 1 : 0) != 0;
+		writer_config.sync			= take_option<int>(options, "sync", writer_config.sync ? 1 : 0) != 0;
+
 		//  Add the audio and video streams using the default format codecs	and initialize the codecs.
 		auto options2 = options;
-		video_st_ = add_video_stream(options2);
+		video_st_ = add_video_stream(options2, encoders > 1 ? 1 : boost::thread::hardware_concurrency());
+
+		if (video_st_ && encoders > 1)
+		{
+			for (size_t n = 0; n < encoders; ++n)
+				parallel_encoders_.push_back(make_safe<video_encoder>(open_parallel_encoder(options), print() + L" encoder " + boost::lexical_cast<std::wstring>(n)));
+
+			// Two frames per encoder keeps every context busy while the oldest frame is muxed.
+			max_frames_in_flight_ = encoders * 2;
+		}
+
+		encode_executor_.set_capacity(max_frames_in_flight_);
 
 		if (!key_only)
 			audio_st_ = add_audio_stream(options);
 				
 		av_dump_format(oc_.get(), 0, filename_.c_str(), 1);
 		 
-		// Open the output ffmpeg, if needed.
-		if (!(oc_->oformat->flags & AVFMT_NOFILE)) 
-			THROW_ON_ERROR2(avio_open2(&oc_->pb, filename_.c_str(), AVIO_FLAG_WRITE, NULL, NULL), "[ffmpeg_consumer]");
+		if (segment_duration_ > 0)
+		{
+			if (oc_->oformat->flags & AVFMT_NOFILE)
+				BOOST_THROW_EXCEPTION(invalid_argument() << arg_name_info("segment_time") << msg_info(oc_->oformat->name + std::string(" does not write files.")));
+
+			// The first segment is opened at the first video key frame.
+			writer_ = std::make_shared<async_file_writer>(writer_config, graph_);
+		}
+		else
+		{
+			// Open the output ffmpeg, if needed.
+			if (!(oc_->oformat->flags & AVFMT_NOFILE)) 
+				THROW_ON_ERROR2(avio_open2(&oc_->pb, filename_.c_str(), AVIO_FLAG_WRITE, NULL, NULL), "[ffmpeg_consumer]");
 				
-		THROW_ON_ERROR2(avformat_write_header(oc_.get(), nullptr), "[ffmpeg_consumer]");
+			THROW_ON_ERROR2(avformat_write_header(oc_.get(), nullptr), "[ffmpeg_consumer]");
+		}
 
 		if(options.size() > 0)
 		{
@@ -297,6 +429,9 @@ public:
 				CASPAR_LOG(warning) << L"Invalid option: -" << widen(option.name) << L" " << widen(option.value);
 		}
 
+		if (!parallel_encoders_.empty())
+			CASPAR_LOG(info) << print() << L" Encoding " << parallel_encoders_.size() << L" frames in parallel.";
+
 		CASPAR_LOG(info) << print() << L" Successfully Initialized.";	
 	}
 
@@ -305,13 +440,19 @@ public:
 		encode_executor_.stop();
 		encode_executor_.join();
 
-		LOG_ON_ERROR2(av_write_trailer(oc_.get()), "[ffmpeg_consumer]");
+		if (writer_)
+		{
+			close_segment();
+			writer_.reset(); // Waits for the last segment to reach the disk.
+		}
+		else
+			LOG_ON_ERROR2(av_write_trailer(oc_.get()), "[ffmpeg_consumer]");
 		
 		if (!key_only_)
 			audio_st_.reset();
 		video_st_.reset();
 			  
-		if (!(oc_->oformat->flags & AVFMT_NOFILE)) 
+		if (segment_duration_ == 0 && !(oc_->oformat->flags & AVFMT_NOFILE)) 
 			LOG_ON_ERROR2(avio_close(oc_->pb), "[ffmpeg_consumer]"); // Close the output ffmpeg.
 
 		CASPAR_LOG(info) << print() << L" Successfully Uninitialized.";	
@@ -322,7 +463,25 @@ public:
 		return L"ffmpeg[" + widen(filename_) + L"]";
 	}
 
-	std::shared_ptr<AVStream> add_video_stream(std::vector<option>& options)
+	// Intra only codecs can encode consecutive frames on separate contexts.
+	size_t parallel_encoder_count(size_t requested) const
+	{
+		auto descriptor = avcodec_descriptor_get(output_format_.vcodec);
+		if (!descriptor || !(descriptor->props & AV_CODEC_PROP_INTRA_ONLY))
+		{
+			if (requested > 1)
+				CASPAR_LOG(warning) << print() << L" Ignoring -encoders, " << (descriptor ? widen(std::string(descriptor->name)) : L"codec") << L" is not intra only.";
+
+			return 1;
+		}
+
+		if (requested == 0)
+			requested = boost::thread::hardware_concurrency();
+
+		return std::min(std::max<size_t>(requested, 1), MAX_PARALLEL_ENCODERS);
+	}
+
+	std::shared_ptr<AVStream> add_video_stream(std::vector<option>& options, int thread_count)
 	{ 
 		if(output_format_.vcodec == CODEC_ID_NONE)
 			return nullptr;
@@ -337,6 +496,48 @@ public:
 
 		auto c = st->codec;
 
+		configure_video_codec(c, encoder, options);
+		
+		c->thread_count = thread_count;
+		if(avcodec_open2(c, encoder, nullptr) < 0)
+		{
+			c->thread_count = 1;
+			THROW_ON_ERROR2(avcodec_open2(c, encoder, nullptr), "[ffmpeg_consumer]");
+		}
+
+		return std::shared_ptr<AVStream>(st, [](AVStream* st)
+		{
+			LOG_ON_ERROR2(avcodec_close(st->codec), "[ffmpeg_consumer]");
+			av_freep(&st->codec);
+			av_freep(&st);
+		});
+	}
+
+	// Opens a single threaded context configured like the video stream's own.
+	std::shared_ptr<AVCodecContext> open_parallel_encoder(std::vector<option> options)
+	{
+		auto encoder = avcodec_find_encoder(output_format_.vcodec);
+		if (!encoder)
+			BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Codec not found."));
+
+		std::shared_ptr<AVCodecContext> c(avcodec_alloc_context3(nullptr), [](AVCodecContext* c)
+		{
+			LOG_ON_ERROR2(avcodec_close(c), "[ffmpeg_consumer]");
+			av_free(c);
+		});
+		if (!c)
+			BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Could not allocate codec context.") << boost::errinfo_api_function("avcodec_alloc_context3"));
+
+		configure_video_codec(c.get(), encoder, options);
+
+		c->thread_count = 1;
+		THROW_ON_ERROR2(avcodec_open2(c.get(), encoder, nullptr), "[ffmpeg_consumer]");
+
+		return c;
+	}
+
+	void configure_video_codec(AVCodecContext* c, AVCodec* encoder, std::vector<option>& options)
+	{
 		avcodec_get_context_defaults3(c, encoder);
 				
 		c->codec_id			= output_format_.vcodec;
@@ -393,6 +594,10 @@ public:
 		{
 			c->pix_fmt = PIX_FMT_ARGB;
 		}
+		else if(c->codec_id == CODEC_ID_MJPEG)
+		{
+			c->pix_fmt = PIX_FMT_YUVJ422P;
+		}
 				
 		c->max_b_frames = 0; // b-frames not supported.
 				
@@ -404,20 +609,6 @@ public:
 				
 		if(output_format_.format->flags & AVFMT_GLOBALHEADER)
 			c->flags |= CODEC_FLAG_GLOBAL_HEADER;
-		
-		c->thread_count = boost::thread::hardware_concurrency();
-		if(avcodec_open2(c, encoder, nullptr) < 0)
-		{
-			c->thread_count = 1;
-			THROW_ON_ERROR2(avcodec_open2(c, encoder, nullptr), "[ffmpeg_consumer]");
-		}
-
-		return std::shared_ptr<AVStream>(st, [](AVStream* st)
-		{
-			LOG_ON_ERROR2(avcodec_close(st->codec), "[ffmpeg_consumer]");
-			av_freep(&st->codec);
-			av_freep(&st);
-		});
 	}
 		
 	std::shared_ptr<AVStream> add_audio_stream(std::vector<option>& options)
@@ -464,13 +655,41 @@ public:
 		});
 	}
 
-	std::shared_ptr<AVFrame> convert_video(core::read_frame& frame, AVCodecContext* c)
+	std::shared_ptr<AVFrame> convert_video(core::read_frame& frame, AVCodecContext* c, video_conversion& conversion) const
 	{
-		if(!sws_) 
+		std::shared_ptr<AVFrame> out_frame(avcodec_alloc_frame(), av_free);
+		conversion.picture_buf.resize(avpicture_get_size(c->pix_fmt, c->width, c->height));
+		avpicture_fill(reinterpret_cast<AVPicture*>(out_frame.get()), conversion.picture_buf.data(), c->pix_fmt, c->width, c->height);
+
+		auto packed = get_packed_format(c);
+
+		if(packed != core::packed_format::count && !key_only_)
+		{
+			core::packed_plane planes[3];
+			for(int n = 0; n < core::packed_plane_count(packed); ++n)
+				planes[n] = core::packed_plane(out_frame->data[n], out_frame->linesize[n]);
+
+			core::pack(packed, frame.image_data().begin(), format_desc_.width, format_desc_.height, planes);
+
+			return out_frame;
+		}
+
+		if(!conversion.sws) 
 		{
-			sws_.reset(sws_getContext(format_desc_.width, format_desc_.height, PIX_FMT_BGRA, c->width, c->height, c->pix_fmt, SWS_BICUBIC, nullptr, nullptr, nullptr), sws_freeContext);
-			if (sws_ == nullptr) 
+			conversion.sws.reset(sws_getContext(format_desc_.width, format_desc_.height, PIX_FMT_BGRA, c->width, c->height, c->pix_fmt, SWS_BICUBIC, nullptr, nullptr, nullptr), sws_freeContext);
+			if (conversion.sws == nullptr) 
 				BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Cannot initialize the conversion context"));
+
+			// Use the same Y'CbCr matrix as core::pack so that HD recordings do not
+			// change colour depending on whether the codec's pix_fmt is packed directly.
+			int* inv_table;
+			int* table;
+			int src_range, dst_range, brightness, contrast, saturation;
+			if(sws_getColorspaceDetails(conversion.sws.get(), &inv_table, &src_range, &table, &dst_range, &brightness, &contrast, &saturation) >= 0)
+			{
+				auto coefficients = sws_getCoefficients(format_desc_.height >= 720 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+				sws_setColorspaceDetails(conversion.sws.get(), inv_table, src_range, coefficients, dst_range, brightness, contrast, saturation);
+			}
 		}
 
 		std::shared_ptr<AVFrame> in_frame(avcodec_alloc_frame(), av_free);
@@ -478,42 +697,67 @@ public:
 
 		if (key_only_)
 		{
-			key_picture_buf_.resize(frame.image_data().size());
+			conversion.key_picture_buf.resize(frame.image_data().size());
 			in_picture->linesize[0] = format_desc_.width * 4;
-			in_picture->data[0] = key_picture_buf_.data();
+			in_picture->data[0] = conversion.key_picture_buf.data();
 
-			fast_memshfl(in_picture->data[0], frame.image_data().begin(), frame.image_data().size(), 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+			core::packed_plane plane(in_picture->data[0], in_picture->linesize[0]);
+			core::pack(core::packed_format::key_bgra, frame.image_data().begin(), format_desc_.width, format_desc_.height, &plane);
 		}
 		else
 		{
 			avpicture_fill(in_picture, const_cast<uint8_t*>(frame.image_data().begin()), PIX_FMT_BGRA, format_desc_.width, format_desc_.height);
 		}
 
-		std::shared_ptr<AVFrame> out_frame(avcodec_alloc_frame(), av_free);
-		picture_buf_.resize(avpicture_get_size(c->pix_fmt, c->width, c->height));
-		avpicture_fill(reinterpret_cast<AVPicture*>(out_frame.get()), picture_buf_.data(), c->pix_fmt, c->width, c->height);
-
-		sws_scale(sws_.get(), in_frame->data, in_frame->linesize, 0, format_desc_.height, out_frame->data, out_frame->linesize);
+		sws_scale(conversion.sws.get(), in_frame->data, in_frame->linesize, 0, format_desc_.height, out_frame->data, out_frame->linesize);
 
 		return out_frame;
 	}
+
+	// Formats that can be packed directly from the channel frame without sws_scale.
+	core::packed_format::type get_packed_format(AVCodecContext* c) const
+	{
+		if(c->width != format_desc_.width || c->height != format_desc_.height)
+			return core::packed_format::count;
+
+		switch(c->pix_fmt)
+		{
+		case PIX_FMT_UYVY422:	return core::packed_format::uyvy;
+		case PIX_FMT_YUV422P:	return core::packed_format::yuv422p;
+		case PIX_FMT_YUV420P:	return core::packed_format::yuv420p;
+		default:				return core::packed_format::count;
+		}
+	}
   
-	void encode_video_frame(core::read_frame& frame)
-	{ 
+	// Skips channel frames when the codec runs at a lower frame rate than the channel.
+	bool next_video_pts(int64_t& pts)
+	{
 		auto c = video_st_->codec;
-		
+
 		auto in_time  = static_cast<double>(in_frame_number_) / format_desc_.fps;
 		auto out_time = static_cast<double>(out_frame_number_) / (static_cast<double>(c->time_base.den) / static_cast<double>(c->time_base.num));
 		
 		in_frame_number_++;
 
 		if(out_time - in_time > 0.01)
+			return false;
+
+		pts = out_frame_number_++;
+		return true;
+	}
+
+	void encode_video_frame(core::read_frame& frame)
+	{ 
+		auto c = video_st_->codec;
+		
+		int64_t pts;
+		if(!next_video_pts(pts))
 			return;
  
-		auto av_frame = convert_video(frame, c);
+		auto av_frame = convert_video(frame, c, conversion_);
 		av_frame->interlaced_frame	= format_desc_.field_mode != core::field_mode::progressive;
 		av_frame->top_field_first	= format_desc_.field_mode == core::field_mode::upper;
-		av_frame->pts				= out_frame_number_++;
+		av_frame->pts				= pts;
 
 		int out_size = THROW_ON_ERROR2(avcodec_encode_video(c, video_outbuf_.data(), video_outbuf_.size(), av_frame.get()), "[ffmpeg_consumer]");
 		if(out_size == 0)
@@ -536,27 +780,209 @@ public:
 		pkt->data			= video_outbuf_.data();
 		pkt->size			= out_size;
  			
-		av_interleaved_write_frame(oc_.get(), pkt.get());		
+		write_packet(*pkt);
+	}
+
+	// Runs on the encoder's own worker, packets come back in codec time base.
+	std::shared_ptr<AVPacket> encode_parallel_video_frame(video_encoder& encoder, core::read_frame& frame, int64_t pts) const
+	{
+		boost::timer frame_timer;
+
+		auto c = encoder.codec.get();
+
+		auto av_frame = convert_video(frame, c, encoder.conversion);
+		av_frame->interlaced_frame	= format_desc_.field_mode != core::field_mode::progressive;
+		av_frame->top_field_first	= format_desc_.field_mode == core::field_mode::upper;
+		av_frame->pts				= pts;
+
+		auto pkt = create_output_packet();
+
+		int got_packet = 0;
+		THROW_ON_ERROR2(avcodec_encode_video2(c, pkt.get(), av_frame.get(), &got_packet), "[ffmpeg_consumer]");
+
+		graph_->set_value("frame-time", frame_timer.elapsed()*format_desc_.fps*0.5 / static_cast<double>(parallel_encoders_.size()));
+
+		if(!got_packet)
+			return nullptr;
+
+		if(pkt->pts == AV_NOPTS_VALUE)
+			pkt->pts = pts;
+
+		return pkt;
+	}
+
+	void write_parallel_video_packet(AVPacket& pkt)
+	{
+		auto c = parallel_encoders_.front()->codec.get();
+
+		pkt.pts = av_rescale_q(pkt.pts, c->time_base, video_st_->time_base);
+		if(pkt.dts != AV_NOPTS_VALUE)
+			pkt.dts = av_rescale_q(pkt.dts, c->time_base, video_st_->time_base);
+
+		pkt.flags		|= AV_PKT_FLAG_KEY;
+		pkt.stream_index = video_st_->index;
+
+		write_packet(pkt);
+	}
+
+	void write_packet(AVPacket& pkt)
+	{
+		if (!writer_)
+		{
+			av_interleaved_write_frame(oc_.get(), &pkt);
+			return;
+		}
+
+		auto st = oc_->streams[pkt.stream_index];
+
+		// Segments start at video key frames so that each one plays on its own.
+		if (st == video_st_.get() && (pkt.flags & AV_PKT_FLAG_KEY) && pkt.pts != AV_NOPTS_VALUE)
+		{
+			if (!segment_oc_ || av_rescale_q(pkt.pts - segment_start_, st->time_base, AV_TIME_BASE_Q) >= segment_duration_)
+			{
+				segment_start_ = pkt.pts;
+
+				try
+				{
+					open_segment();
+				}
+				catch(...)
+				{
+					CASPAR_LOG_CURRENT_EXCEPTION();
+					graph_->set_tag("write-error");
+				}
+			}
+		}
+
+		if (!segment_oc_)
+			return;
+
+		// Every segment starts at zero.
+		auto segment_st = segment_oc_->streams[pkt.stream_index];
+		auto offset		= av_rescale_q(segment_start_, video_st_->time_base, st->time_base);
+
+		if (pkt.pts != AV_NOPTS_VALUE)
+			pkt.pts = av_rescale_q(pkt.pts - offset, st->time_base, segment_st->time_base);
+		if (pkt.dts != AV_NOPTS_VALUE)
+			pkt.dts = av_rescale_q(pkt.dts - offset, st->time_base, segment_st->time_base);
+		pkt.duration = static_cast<int>(av_rescale_q(pkt.duration, st->time_base, segment_st->time_base));
+
+		av_interleaved_write_frame(segment_oc_.get(), &pkt);
+	}
+
+	std::wstring segment_filename(size_t index) const
+	{
+		boost::filesystem::path path(widen(filename_));
+
+		auto number = boost::lexical_cast<std::wstring>(index);
+		if (number.size() < 5)
+			number.insert(0, 5 - number.size(), L'0');
+
+		return (path.parent_path() / (path.stem().wstring() + L"_" + number + path.extension().wstring())).wstring();
+	}
+
+	// Muxes into a non seekable io context feeding writer_. MOV and MP4 are
+	// fragmented, a crash loses no more than the segment being written.
+	void open_segment()
+	{
+		close_segment();
+
+		auto filename = segment_filename(segment_index_++);
+
+		AVFormatContext* weak_oc = nullptr;
+		THROW_ON_ERROR2(avformat_alloc_output_context2(&weak_oc, oc_->oformat, nullptr, narrow(filename).c_str()), "[ffmpeg_consumer]");
+
+		std::shared_ptr<AVFormatContext> oc(weak_oc, [](AVFormatContext* oc)
+		{
+			if (oc->pb)
+			{
+				av_freep(&oc->pb->buffer);
+				av_freep(&oc->pb);
+			}
+			avformat_free_context(oc);
+		});
+
+		for (unsigned int n = 0; n < oc_->nb_streams; ++n)
+		{
+			auto st = avformat_new_stream(oc.get(), nullptr);
+			if (!st)
+				BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Could not allocate segment stream.") << boost::errinfo_api_function("avformat_new_stream"));
+
+			THROW_ON_ERROR2(avcodec_copy_context(st->codec, oc_->streams[n]->codec), "[ffmpeg_consumer]");
+			st->codec->codec_tag	= 0;
+			st->time_base			= oc_->streams[n]->codec->time_base;
+		}
+
+		auto buffer = static_cast<uint8_t*>(av_malloc(SEGMENT_IO_BUFFER_SIZE));
+		if (!buffer)
+			BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Could not allocate segment io buffer.") << boost::errinfo_api_function("av_malloc"));
+
+		oc->pb = avio_alloc_context(buffer, SEGMENT_IO_BUFFER_SIZE, 1, writer_.get(), nullptr, write_to_file_writer, nullptr);
+		if (!oc->pb)
+		{
+			av_free(buffer);
+			BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Could not allocate segment io context.") << boost::errinfo_api_function("avio_alloc_context"));
+		}
+		oc->pb->seekable = 0;
+		oc->flags		|= AVFMT_FLAG_CUSTOM_IO;
+
+		AVDictionary* format_options = nullptr;
+		if (av_opt_find(&oc->oformat->priv_class, "movflags", nullptr, 0, AV_OPT_SEARCH_FAKE_OBJ))
+		{
+			av_dict_set(&format_options, "movflags", "empty_moov", 0);
+			av_dict_set(&format_options, "frag_duration", "1000000", 0);
+		}
+
+		writer_->open(filename);
+
+		auto ret = avformat_write_header(oc.get(), &format_options);
+		av_dict_free(&format_options);
+		THROW_ON_ERROR2(ret, "[ffmpeg_consumer]");
+
+		segment_oc_ = oc;
+
+		CASPAR_LOG(info) << print() << L" Recording segment " << filename << L".";
+	}
+
+	void close_segment()
+	{
+		if (!segment_oc_)
+			return;
+
+		LOG_ON_ERROR2(av_write_trailer(segment_oc_.get()), "[ffmpeg_consumer]");
+		avio_flush(segment_oc_->pb);
+		writer_->close();
+
+		segment_oc_.reset();
+	}
+
+	void record_loop_time(double seconds)
+	{
+		auto micros = static_cast<uint64_t>(seconds * 1000000.0);
+
+		++loop_count_;
+		loop_total_micros_ += micros;
+		if (micros > loop_max_micros_)
+			loop_max_micros_ = micros;
+		if (seconds > 1.0 / format_desc_.fps)
+			++loop_late_;
 	}
 		
-	byte_vector convert_audio(core::read_frame& frame, AVCodecContext* c)
+	boost::iterator_range<const uint8_t*> convert_audio(core::read_frame& frame, AVCodecContext* c)
 	{
+		if(frame.num_channels() < 1)
+			return boost::iterator_range<const uint8_t*>();
+
 		if(!swr_) 		
 			swr_.reset(new audio_resampler(c->channels, frame.num_channels(), 
 										   c->sample_rate, format_desc_.audio_sample_rate,
 										   c->sample_fmt, AV_SAMPLE_FMT_S32));
-		
 
 		auto audio_data = frame.audio_data();
 
-		std::vector<int8_t,  tbb::cache_aligned_allocator<int8_t>> audio_resample_buffer;
-		std::copy(reinterpret_cast<const uint8_t*>(audio_data.begin()), 
-				  reinterpret_cast<const uint8_t*>(audio_data.begin()) + audio_data.size()*4, 
-				  std::back_inserter(audio_resample_buffer));
-		
-		audio_resample_buffer = swr_->resample(std::move(audio_resample_buffer));
+		const uint8_t* input[] = { reinterpret_cast<const uint8_t*>(audio_data.begin()) };
 		
-		return byte_vector(audio_resample_buffer.begin(), audio_resample_buffer.end());
+		return swr_->resample(input, audio_data.size() / frame.num_channels());
 	}
 
 	void encode_audio_frame(core::read_frame& frame)
@@ -600,12 +1026,18 @@ public:
 			pkt->stream_index = audio_st_->index;
 			pkt->data		  = reinterpret_cast<uint8_t*>(audio_outbuf_.data());
 		
-			av_interleaved_write_frame(oc_.get(), pkt.get());
+			write_packet(*pkt);
 		}
 	}
 		 
 	void send(const safe_ptr<core::read_frame>& frame)
 	{
+		if(!parallel_encoders_.empty())
+		{
+			send_parallel(frame);
+			return;
+		}
+
 		encode_executor_.begin_invoke([=]
 		{		
 			boost::timer frame_timer;
@@ -616,17 +1048,107 @@ public:
 				encode_audio_frame(*frame);
 
 			graph_->set_value("frame-time", frame_timer.elapsed()*format_desc_.fps*0.5);
+			record_loop_time(frame_timer.elapsed());
+			current_encoding_delay_ = frame->get_age_millis();
+		});
+	}
+
+	// Frame n goes to encoder n % N, encode_executor_ waits for the packets in
+	// send order, so the muxer sees them in sequence without a reorder buffer.
+	void send_parallel(const safe_ptr<core::read_frame>& frame)
+	{
+		std::shared_ptr<boost::unique_future<std::shared_ptr<AVPacket>>> packet;
+
+		int64_t pts;
+		if(next_video_pts(pts))
+		{
+			// The consumer outlives the workers' tasks, it joins encode_executor_ which waits for every packet.
+			auto encoder = parallel_encoders_[next_encoder_++ % parallel_encoders_.size()].get();
+
+			packet = std::make_shared<boost::unique_future<std::shared_ptr<AVPacket>>>(encoder->worker.begin_invoke([=]
+			{
+				return encode_parallel_video_frame(*encoder, *frame, pts);
+			}));
+		}
+
+		++frames_in_flight_;
+		graph_->set_value("encode-queue", static_cast<double>(frames_in_flight_) / static_cast<double>(max_frames_in_flight_));
+
+		encode_executor_.begin_invoke([=]
+		{
+			CASPAR_SCOPE_EXIT
+			{
+				--frames_in_flight_;
+			};
+
+			try
+			{
+				std::shared_ptr<AVPacket> pkt;
+				if(packet)
+					pkt = packet->get();
+
+				// Excludes waiting for the workers, only muxing and audio block the loop.
+				boost::timer loop_timer;
+
+				if(pkt)
+					write_parallel_video_packet(*pkt);
+
+				if (!key_only_)
+					encode_audio_frame(*frame);
+
+				record_loop_time(loop_timer.elapsed());
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+
 			current_encoding_delay_ = frame->get_age_millis();
 		});
 	}
 
 	bool ready_for_frame()
 	{
+		if(writer_ && !writer_->ready())
+			return false;
+
+		if(!parallel_encoders_.empty())
+			return frames_in_flight_ < max_frames_in_flight_;
+
 		return encode_executor_.size() < encode_executor_.capacity();
 	}
 
+	boost::property_tree::wptree info() const
+	{
+		const uint64_t count = loop_count_;
+
+		boost::property_tree::wptree info;
+		info.add(L"encoders",							std::max<size_t>(parallel_encoders_.size(), 1));
+		info.add(L"encode-queue",						parallel_encoders_.empty() ? static_cast<size_t>(encode_executor_.size()) : static_cast<size_t>(frames_in_flight_));
+		info.add(L"encode-queue-capacity",				parallel_encoders_.empty() ? static_cast<size_t>(encode_executor_.capacity()) : max_frames_in_flight_);
+		info.add(L"encode-loop.frames",					count);
+		info.add(L"encode-loop.mean-micros",			count > 0 ? static_cast<uint64_t>(loop_total_micros_) / count : 0);
+		info.add(L"encode-loop.max-micros",				static_cast<uint64_t>(loop_max_micros_));
+		info.add(L"encode-loop.late-frames",			static_cast<uint64_t>(loop_late_));
+		info.add(L"dropped-frames",						static_cast<uint64_t>(dropped_frames_));
+
+		if(writer_)
+		{
+			info.add(L"segment-time",					static_cast<double>(segment_duration_) / AV_TIME_BASE);
+			info.add_child(L"writer",					writer_->info());
+		}
+
+		return info;
+	}
+
+	size_t parallel_encoders() const
+	{
+		return parallel_encoders_.size();
+	}
+
 	void mark_dropped()
 	{
+		++dropped_frames_;
 		graph_->set_tag("dropped-frame");
 
 		// TODO: adjust PTS accordingly to make dropped frames contribute
@@ -636,19 +1158,21 @@ public:
 
 struct ffmpeg_consumer_proxy : public core::frame_consumer
 {
-	const std::wstring				filename_;
-	const std::vector<option>		options_;
-	const bool						separate_key_;
+	const std::wstring							filename_;
+	const std::vector<option>					options_;
+	const bool									separate_key_;
+	const async_file_writer::configuration		writer_config_;
 
 	std::unique_ptr<ffmpeg_consumer> consumer_;
 	std::unique_ptr<ffmpeg_consumer> key_only_consumer_;
 
 public:
 
-	ffmpeg_consumer_proxy(const std::wstring& filename, const std::vector<option>& options, bool separate_key_)
+	ffmpeg_consumer_proxy(const std::wstring& filename, const std::vector<option>& options, bool separate_key_, const async_file_writer::configuration& writer_config = async_file_writer::configuration())
 		: filename_(filename)
 		, options_(options)
 		, separate_key_(separate_key_)
+		, writer_config_(writer_config)
 	{
 	}
 	
@@ -664,7 +1188,8 @@ public:
 				format_desc,
 				options_,
 				false,
-				audio_channel_layout));
+				audio_channel_layout,
+				writer_config_));
 
 		if (separate_key_)
 		{
@@ -677,7 +1202,8 @@ public:
 					format_desc,
 					options_,
 					true,
-					audio_channel_layout));
+					audio_channel_layout,
+					writer_config_));
 		}
 	}
 
@@ -722,6 +1248,8 @@ public:
 		info.add(L"type", L"ffmpeg-consumer");
 		info.add(L"filename", filename_);
 		info.add(L"separate_key", separate_key_);
+		if (consumer_)
+			info.add_child(L"recording", consumer_->info());
 		return info;
 	}
 		
@@ -792,4 +1320,9 @@ safe_ptr<core::frame_consumer> create_consumer(const boost::property_tree::wptre
 	return make_safe<ffmpeg_consumer_proxy>(env::media_folder() + filename, options, separate_key);
 }
 
+safe_ptr<core::frame_consumer> create_consumer(const std::wstring& path, const std::vector<option>& options, const async_file_writer::configuration& writer_config)
+{
+	return make_safe<ffmpeg_consumer_proxy>(path, options, false, writer_config);
+}
+
 }}
@@ -21,6 +21,10 @@
 
 #pragma once
 
+#include "async_file_writer.h"
+
+#include "../ffmpeg_params.h"
+
 #include <boost/property_tree/ptree.hpp>
 
 #include <string>
@@ -38,4 +42,9 @@ namespace ffmpeg {
 safe_ptr<core::frame_consumer> create_consumer(const core::parameters& params);
 safe_ptr<core::frame_consumer> create_consumer(const boost::property_tree::wptree& ptree);
 
+// Records to path as given, not relative to the media folder, with the
+// options of the FILE consumer ("vcodec", "encoders", "segment_time", ...).
+// Segmented recordings write through a writer configured by writer_config.
+safe_ptr<core::frame_consumer> create_consumer(const std::wstring& path, const std::vector<option>& options, const async_file_writer::configuration& writer_config = async_file_writer::configuration());
+
 }}
\ No newline at end of file
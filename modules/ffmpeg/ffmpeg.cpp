@@ -25,6 +25,8 @@
 #include "consumer/streaming_consumer.h"
 #include "producer/ffmpeg_producer.h"
 #include "producer/util/util.h"
+#include "producer/cache/clip_cache.h"
+#include "producer/util/context_pool.h"
 
 #include <common/log/log.h>
 #include <common/exception/win32_exception.h>
@@ -249,7 +251,7 @@ void log_for_thread(void* ptr, int level, const char* fmt, va_list vl)
 //}
 //#pragma warning (pop)
 
-void init(const safe_ptr<core::media_info_repository>& media_info_repo)
+void init(const safe_ptr<core::media_info_repository>& media_info_repo, const safe_ptr<clip_cache>& clip_cache, const safe_ptr<context_pools>& context_pools)
 {
 	av_lockmgr_register(ffmpeg_lock_callback);
 	av_log_set_callback(log_for_thread);
@@ -262,7 +264,12 @@ void init(const safe_ptr<core::media_info_repository>& media_info_repo)
 	
 	core::register_consumer_factory([](const core::parameters& params){return ffmpeg::create_consumer(params);});
 	core::register_consumer_factory([](const core::parameters& params){return ffmpeg::create_streaming_consumer(params);});
-	core::register_producer_factory(create_producer);
+	std::weak_ptr<ffmpeg::clip_cache> weak_clip_cache = clip_cache;
+	std::weak_ptr<ffmpeg::context_pools> weak_context_pools = context_pools;
+	core::register_producer_factory([=](const safe_ptr<core::frame_factory>& frame_factory, const core::parameters& params)
+	{
+		return create_producer(frame_factory, params, weak_clip_cache.lock(), weak_context_pools.lock());
+	});
 	core::register_thumbnail_producer_factory(create_thumbnail_producer);
 
 	media_info_repo->register_extractor(
@@ -33,7 +33,10 @@ struct media_info_repository;
 
 namespace ffmpeg {
 
-void init(const safe_ptr<core::media_info_repository>& media_info_repo);
+class clip_cache;
+class context_pools;
+
+void init(const safe_ptr<core::media_info_repository>& media_info_repo, const safe_ptr<clip_cache>& clip_cache, const safe_ptr<context_pools>& context_pools);
 void uninit();
 void disable_logging_for_thread();
 std::shared_ptr<void> temporary_disable_logging_for_thread(bool disable);
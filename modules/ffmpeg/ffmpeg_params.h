@@ -31,6 +31,8 @@ namespace caspar {
 	
 namespace ffmpeg {
 
+class context_pools;
+
 enum FFMPEG_Resource {
 	FFMPEG_FILE,
 	FFMPEG_DEVICE,
@@ -61,6 +63,15 @@ struct ffmpeg_producer_params
 
 	std::vector<option> options;
 
+	// Audio streams to decode and merge, see audio_decoder.
+	std::wstring        audio_streams;
+
+	// Trim the audio resampling ratio to follow drift against the video, see audio_decoder.
+	bool                drift_compensation;
+
+	// Decoders and filter graphs are reused from these when set.
+	std::shared_ptr<context_pools> context_pools;
+
 	ffmpeg_producer_params() 
 		: loop(false)
 		, start(0)
@@ -68,6 +79,8 @@ struct ffmpeg_producer_params
 		, filter_str(L"")
 		, resource_type(FFMPEG_FILE)
 		, resource_name(L"")
+		, audio_streams(L"")
+		, drift_compensation(false)
 	{
 	}
 
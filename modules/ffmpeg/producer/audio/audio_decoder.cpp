@@ -23,6 +23,7 @@
 
 #include "audio_decoder.h"
 
+#include "audio_merge.h"
 #include "audio_resampler.h"
 
 #include "../util/util.h"
@@ -31,8 +32,17 @@
 #include <core/video_format.h>
 #include <core/mixer/audio/audio_util.h>
 
+#include <tbb/atomic.h>
 #include <tbb/cache_aligned_allocator.h>
+#include <tbb/parallel_for.h>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstring>
+#include <deque>
+#include <limits>
 #include <queue>
 
 #if defined(_MSC_VER)
@@ -50,57 +60,181 @@ extern "C"
 #endif
 
 namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Slabs beyond this are handed out unpooled, only reached when something
+// holds on to decoded audio.
+const size_t MAX_SLABS = 16;
+
+// Frames over which the buffer level drift compensation holds is learned.
+const size_t DRIFT_TARGET_FRAMES = 50;
+
+// Recycles the buffers handed out by a decoder. Only the decoding thread
+// takes slabs, so a slab nobody else references can not be picked up
+// concurrently.
+class slab_pool : boost::noncopyable
+{
+	std::vector<std::shared_ptr<core::audio_buffer>>	slabs_;
+	size_t												next_slab_;
+public:
+	tbb::atomic<uint64_t>								allocations;
+	tbb::atomic<uint64_t>								reuses;
+	tbb::atomic<size_t>									nb_slabs;
+
+	slab_pool()
+		: next_slab_(0)
+	{
+		allocations	= 0;
+		reuses		= 0;
+		nb_slabs	= 0;
+	}
+
+	std::shared_ptr<core::audio_buffer> get(size_t size)
+	{
+		for(size_t n = 0; n < slabs_.size(); ++n)
+		{
+			auto index = (next_slab_ + n) % slabs_.size();
+			auto& slab = slabs_[index];
+
+			if(!slab.unique())
+				continue;
+
+			if(slab->capacity() < size)
+				++allocations;
+			else
+				++reuses;
+
+			slab->resize(size);
+			next_slab_ = (index + 1) % slabs_.size();
+			return slab;
+		}
+
+		++allocations;
+
+		auto slab = std::make_shared<core::audio_buffer>(size);
+		if(slabs_.size() < MAX_SLABS)
+		{
+			slabs_.push_back(slab);
+			nb_slabs = slabs_.size();
+		}
+
+		return slab;
+	}
+};
+
+// L"" selects the best audio stream. L"ALL" merges every audio stream,
+// otherwise a comma separated list of audio stream numbers (0 based, in file
+// order) is merged in that order.
+std::vector<int> select_audio_streams(AVFormatContext& context, const std::wstring& audio_streams)
+{
+	std::vector<int> audio;
+
+	for(unsigned int n = 0; n < context.nb_streams; ++n)
+	{
+		if(context.streams[n]->codec->codec_type == AVMEDIA_TYPE_AUDIO)
+			audio.push_back(static_cast<int>(n));
+	}
+
+	if(audio.empty())
+		BOOST_THROW_EXCEPTION(averror_stream_not_found() << msg_info("No audio stream found."));
+
+	if(audio_streams.empty())
+		return std::vector<int>(1, THROW_ON_ERROR2(av_find_best_stream(&context, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0), "[audio_decoder]"));
+
+	if(boost::iequals(audio_streams, L"ALL"))
+		return audio;
+
+	std::vector<std::wstring> tokens;
+	boost::split(tokens, audio_streams, boost::is_any_of(L","));
+
+	std::vector<int> selected;
+	BOOST_FOREACH(auto& token, tokens)
+	{
+		auto n = boost::lexical_cast<size_t>(boost::trim_copy(token));
+		if(n >= audio.size())
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("No audio stream " + boost::lexical_cast<std::string>(n) + "."));
+
+		selected.push_back(audio[n]);
+	}
+
+	return selected;
+}
+
+core::channel_layout get_merged_channel_layout(int num_channels, const std::wstring& custom_channel_order)
+{
+	if(!custom_channel_order.empty())
+	{
+		auto layout = core::create_custom_channel_layout(custom_channel_order, core::default_channel_layout_repository());
+		layout.num_channels = num_channels;
+		return layout;
+	}
+
+	if(num_channels == 2)
+		return core::default_channel_layout_repository().get_by_name(L"STEREO");
+
+	return core::create_unspecified_layout(num_channels);
+}
+
+}
 	
-struct audio_decoder::implementation : boost::noncopyable
+// Decodes and converts one audio stream to the channel's sample rate.
+struct stream_decoder : boost::noncopyable
 {	
 	int																index_;
 	const safe_ptr<AVCodecContext>									codec_context_;		
 	const core::video_format_desc									format_desc_;
 	
-	std::vector<int32_t,  tbb::cache_aligned_allocator<int32_t>>	buffer_;
+	std::shared_ptr<AVFrame>										decoded_frame_;
+	slab_pool														slabs_;
 
 	std::queue<safe_ptr<AVPacket>>									packets_;
 
-	const int64_t													nb_frames_;
 	tbb::atomic<size_t>												file_frame_number_;
-	core::channel_layout											channel_layout_;
 
 	std::shared_ptr<SwrContext>										swr_;
+	std::unique_ptr<audio_resampler>								resampler_;
+
+	tbb::atomic<uint64_t>											decoded_packets_;
+	tbb::atomic<uint64_t>											allocations_;
 
 public:
-	explicit implementation(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, const std::wstring& custom_channel_order) 
-		: format_desc_(format_desc)	
-		, codec_context_(open_codec(*context, AVMEDIA_TYPE_AUDIO, index_))
-		, buffer_(480000*2)
-		, nb_frames_(0)//context->streams[index_]->nb_frames)
-		, channel_layout_(get_audio_channel_layout(*codec_context_, custom_channel_order))
+	stream_decoder(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, int index, bool drift_compensation, const std::shared_ptr<context_pools>& context_pools) 
+		: index_(index)
+		, codec_context_(open_pooled_codec(*context, index, context_pools))
+		, format_desc_(format_desc)	
+		, decoded_frame_(av_frame_alloc(), [](AVFrame* frame){av_frame_free(&frame);})
 		, swr_(swr_alloc_set_opts(nullptr,
 								codec_context_->channel_layout ? codec_context_->channel_layout : av_get_default_channel_layout(codec_context_->channels), AV_SAMPLE_FMT_S32, format_desc_.audio_sample_rate,
 								codec_context_->channel_layout ? codec_context_->channel_layout : av_get_default_channel_layout(codec_context_->channels), codec_context_->sample_fmt, codec_context_->sample_rate,
 								0, nullptr), [](SwrContext* p){swr_free(&p);})
 	{	
-		if(!swr_)
+		if(!swr_ || !decoded_frame_)
 			BOOST_THROW_EXCEPTION(bad_alloc());
 		
 		THROW_ON_ERROR2(swr_init(swr_.get()), "[audio_decoder]");
 
-		file_frame_number_ = 0;
+		file_frame_number_	= 0;
+		decoded_packets_	= 0;
+		allocations_		= 1;
 
 		codec_context_->refcounted_frames = 1;
 
-		CASPAR_LOG(debug) << print() 
-				<< " Selected channel layout " << channel_layout_.name;
+		// swr can only compensate by dropping or inserting samples, the
+		// resampler trims its ratio instead.
+		if(drift_compensation)
+		{
+			resampler_.reset(new audio_resampler(codec_context_->channels, codec_context_->channels, format_desc_.audio_sample_rate, codec_context_->sample_rate, AV_SAMPLE_FMT_S32, codec_context_->sample_fmt));
+			resampler_->enable_drift_compensation(true);
+		}
 	}
 
 	void push(const std::shared_ptr<AVPacket>& packet)
 	{			
-		if(!packet)
-			return;
-
 		if(packet->stream_index == index_ || packet->data == nullptr)
 			packets_.push(make_safe_ptr(packet));
 	}	
-	
+
 	std::shared_ptr<core::audio_buffer> poll()
 	{
 		if(packets_.empty())
@@ -126,13 +260,10 @@ public:
 
 	std::shared_ptr<core::audio_buffer> decode(AVPacket& pkt)
 	{				
-		auto decoded_frame = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* frame)
-		{
-			av_frame_free(&frame);
-		});
+		av_frame_unref(decoded_frame_.get());
 				
 		int got_frame = 0;
-		auto len = THROW_ON_ERROR2(avcodec_decode_audio4(codec_context_.get(), decoded_frame.get(), &got_frame, &pkt), "[audio_decoder]");
+		auto len = THROW_ON_ERROR2(avcodec_decode_audio4(codec_context_.get(), decoded_frame_.get(), &got_frame, &pkt), "[audio_decoder]");
 					
 		if(len == 0)
 		{
@@ -145,17 +276,43 @@ public:
 					
 		if(!got_frame)
 			return nullptr;
-				
-		const uint8_t **in = const_cast<const uint8_t**>(decoded_frame->extended_data);			
-		uint8_t* out[]	   = { reinterpret_cast<uint8_t*>(buffer_.data()) };
-		
-		const auto channel_samples = swr_convert(swr_.get(), 
-												 out, static_cast<int>(buffer_.size()) / codec_context_->channels, 
-												 in, decoded_frame->nb_samples);
+
+		auto audio = resampler_ ? resample(*decoded_frame_) : convert(*decoded_frame_);
+
+		av_frame_unref(decoded_frame_.get());
 		
 		++file_frame_number_;
+		++decoded_packets_;
 
-		return std::make_shared<core::audio_buffer>(buffer_.begin(), buffer_.begin() + channel_samples * decoded_frame->channels);
+		return audio;
+	}
+
+	std::shared_ptr<core::audio_buffer> convert(AVFrame& decoded_frame)
+	{
+		const auto channels		= codec_context_->channels;
+		const auto max_samples	= static_cast<int>(av_rescale_rnd(swr_get_delay(swr_.get(), codec_context_->sample_rate) + decoded_frame.nb_samples, 
+																   format_desc_.audio_sample_rate, codec_context_->sample_rate, AV_ROUND_UP));
+
+		auto audio = slabs_.get(max_samples * channels);
+
+		const uint8_t **in = const_cast<const uint8_t**>(decoded_frame.extended_data);			
+		uint8_t* out[]	   = { reinterpret_cast<uint8_t*>(audio->data()) };
+
+		const auto channel_samples = THROW_ON_ERROR2(swr_convert(swr_.get(), out, max_samples, in, decoded_frame.nb_samples), "[audio_decoder]");
+
+		audio->resize(channel_samples * channels);
+
+		return audio;
+	}
+
+	std::shared_ptr<core::audio_buffer> resample(AVFrame& decoded_frame)
+	{
+		auto samples	= resampler_->resample(const_cast<const uint8_t**>(decoded_frame.extended_data), decoded_frame.nb_samples);
+		auto audio		= slabs_.get(samples.size() / sizeof(int32_t));
+
+		std::memcpy(audio->data(), samples.begin(), samples.size());
+
+		return audio;
 	}
 
 	bool ready() const
@@ -163,24 +320,251 @@ public:
 		return packets_.size() > 10;
 	}
 
+	std::wstring print() const
+	{		
+		return widen(codec_context_->codec->long_name);
+	}
+};
+
+struct audio_decoder::implementation : boost::noncopyable
+{
+	// Decoded buffers are merged from where they are, offset is the position
+	// in the front one and pending the samples (per channel) in all of them.
+	struct merge_input
+	{
+		std::deque<std::shared_ptr<core::audio_buffer>>	buffers;
+		size_t											offset;
+		size_t											pending;
+		size_t											channels;
+		bool											flushed;
+	};
+
+	const core::video_format_desc									format_desc_;
+	const bool														drift_compensation_;
+	std::vector<std::shared_ptr<stream_decoder>>					streams_;
+	core::channel_layout											channel_layout_;
+
+	std::vector<merge_input>										inputs_;
+	std::vector<std::shared_ptr<core::audio_buffer>>				decoded_;
+	std::vector<const int32_t*>										sources_;
+	std::vector<size_t>												source_channels_;
+	slab_pool														slabs_;
+
+	size_t															drift_frames_;
+	int64_t															drift_level_sum_;
+	int64_t															drift_target_;
+
+public:
+	explicit implementation(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, const std::wstring& custom_channel_order, const std::wstring& audio_streams, bool drift_compensation, const std::shared_ptr<context_pools>& context_pools) 
+		: format_desc_(format_desc)	
+		, drift_compensation_(drift_compensation)
+		, drift_frames_(0)
+		, drift_level_sum_(0)
+		, drift_target_(0)
+	{	
+		BOOST_FOREACH(auto index, select_audio_streams(*context, audio_streams))
+			streams_.push_back(std::make_shared<stream_decoder>(context, format_desc, index, drift_compensation, context_pools));
+
+		if(streams_.size() == 1)
+			channel_layout_ = get_audio_channel_layout(*streams_.front()->codec_context_, custom_channel_order);
+		else
+		{
+			int num_channels = 0;
+			BOOST_FOREACH(auto& stream, streams_)
+			{
+				merge_input input;
+				input.offset	= 0;
+				input.pending	= 0;
+				input.channels	= stream->codec_context_->channels;
+				input.flushed	= false;
+				inputs_.push_back(input);
+				source_channels_.push_back(input.channels);
+				num_channels += stream->codec_context_->channels;
+			}
+
+			decoded_.resize(streams_.size());
+			sources_.resize(streams_.size());
+			channel_layout_ = get_merged_channel_layout(num_channels, custom_channel_order);
+		}
+
+		CASPAR_LOG(debug) << print() 
+				<< " Selected channel layout " << channel_layout_.name;
+	}
+
+	void push(const std::shared_ptr<AVPacket>& packet)
+	{			
+		if(!packet)
+			return;
+
+		BOOST_FOREACH(auto& stream, streams_)
+			stream->push(packet);
+	}	
+	
+	std::shared_ptr<core::audio_buffer> poll()
+	{
+		if(streams_.size() == 1)
+			return streams_.front()->poll();
+
+		// Each track decodes one packet concurrently. try_decode_frame splits
+		// video and audio with parallel_invoke, but the number of tracks is
+		// only known at runtime, so this is a parallel_for with one task per
+		// track. A track far ahead of the others waits, unless another track
+		// already reached a flush.
+		const bool	any_flushed = std::any_of(inputs_.begin(), inputs_.end(), [](const merge_input& input){return input.flushed;});
+		const auto	max_pending	= static_cast<size_t>(format_desc_.audio_sample_rate);
+
+		tbb::parallel_for<size_t>(0, streams_.size(), [&](size_t n)
+		{
+			const auto& input = inputs_[n];
+			if(!input.flushed && (any_flushed || input.pending < max_pending))
+				decoded_[n] = streams_[n]->poll();
+		});
+
+		for(size_t n = 0; n < inputs_.size(); ++n)
+		{
+			auto& input = inputs_[n];
+
+			if(decoded_[n] == flush_audio())
+				input.flushed = true;
+			else if(decoded_[n] && !decoded_[n]->empty())
+			{
+				input.pending += decoded_[n]->size() / input.channels;
+				input.buffers.push_back(decoded_[n]);
+			}
+
+			decoded_[n].reset();
+		}
+
+		if(std::all_of(inputs_.begin(), inputs_.end(), [](const merge_input& input){return input.flushed;}))
+		{
+			BOOST_FOREACH(auto& input, inputs_)
+			{
+				input.buffers.clear();
+				input.offset	= 0;
+				input.pending	= 0;
+				input.flushed	= false;
+			}
+			return flush_audio();
+		}
+
+		auto nb_samples = std::numeric_limits<size_t>::max();
+		BOOST_FOREACH(auto& input, inputs_)
+			nb_samples = std::min(nb_samples, input.pending);
+
+		if(nb_samples == 0)
+			return nullptr;
+
+		auto audio = slabs_.get(nb_samples * channel_layout_.num_channels);
+
+		// Packet boundaries differ between the tracks, so this merges up to
+		// the nearest end of a buffer at a time.
+		for(size_t merged = 0; merged < nb_samples;)
+		{
+			auto count = nb_samples - merged;
+			BOOST_FOREACH(auto& input, inputs_)
+				count = std::min(count, (input.buffers.front()->size() - input.offset) / input.channels);
+
+			for(size_t n = 0; n < inputs_.size(); ++n)
+				sources_[n] = inputs_[n].buffers.front()->data() + inputs_[n].offset;
+
+			merge_channels(sources_.data(), source_channels_.data(), inputs_.size(), count, audio->data() + merged * channel_layout_.num_channels);
+
+			BOOST_FOREACH(auto& input, inputs_)
+			{
+				input.offset	+= count * input.channels;
+				input.pending	-= count;
+
+				if(input.offset == input.buffers.front()->size())
+				{
+					input.buffers.pop_front();
+					input.offset = 0;
+				}
+			}
+
+			merged += count;
+		}
+
+		return audio;
+	}
+
+	// The level settles wherever the stream starts out, so the first frames
+	// only learn the target.
+	void compensate_drift(size_t buffered_samples)
+	{
+		if(!drift_compensation_)
+			return;
+
+		if(drift_frames_ < DRIFT_TARGET_FRAMES)
+		{
+			drift_level_sum_ += buffered_samples;
+			if(++drift_frames_ == DRIFT_TARGET_FRAMES)
+				drift_target_ = drift_level_sum_ / DRIFT_TARGET_FRAMES;
+			return;
+		}
+
+		BOOST_FOREACH(auto& stream, streams_)
+			stream->resampler_->follow_buffer_level(buffered_samples, drift_target_);
+	}
+
+	bool ready() const
+	{
+		return std::all_of(streams_.begin(), streams_.end(), [](const std::shared_ptr<stream_decoder>& stream){return stream->ready();});
+	}
+
 	uint32_t nb_frames() const
 	{
-		return 0;//std::max<int64_t>(nb_frames_, file_frame_number_);
+		return 0;
+	}
+
+	uint32_t file_frame_number() const
+	{
+		return streams_.front()->file_frame_number_;
 	}
 
 	std::wstring print() const
 	{		
-		return L"[audio-decoder] " + widen(codec_context_->codec->long_name);
+		if(streams_.size() == 1)
+			return L"[audio-decoder] " + streams_.front()->print();
+
+		return L"[audio-decoder] " + boost::lexical_cast<std::wstring>(streams_.size()) + L" streams merged, " + streams_.front()->print();
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		uint64_t packets		= 0;
+		uint64_t allocations	= slabs_.allocations;
+		uint64_t reuses			= slabs_.reuses;
+		size_t	 slabs			= slabs_.nb_slabs;
+
+		BOOST_FOREACH(auto& stream, streams_)
+		{
+			packets		+= stream->decoded_packets_;
+			allocations	+= stream->allocations_ + stream->slabs_.allocations;
+			reuses		+= stream->slabs_.reuses;
+			slabs		+= stream->slabs_.nb_slabs;
+		}
+
+		boost::property_tree::wptree info;
+		info.add(L"streams",		streams_.size());
+		info.add(L"packets",		packets);
+		info.add(L"allocations",	allocations);
+		info.add(L"reuses",			reuses);
+		info.add(L"slabs",			slabs);
+		if(drift_compensation_)
+			info.add(L"drift-ratio",	streams_.front()->resampler_->ratio_adjustment());
+		return info;
 	}
 };
 
-audio_decoder::audio_decoder(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, const std::wstring& custom_channel_order) : impl_(new implementation(context, format_desc, custom_channel_order)){}
+audio_decoder::audio_decoder(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, const std::wstring& custom_channel_order, const std::wstring& audio_streams, bool drift_compensation, const std::shared_ptr<context_pools>& context_pools) : impl_(new implementation(context, format_desc, custom_channel_order, audio_streams, drift_compensation, context_pools)){}
 void audio_decoder::push(const std::shared_ptr<AVPacket>& packet){impl_->push(packet);}
 bool audio_decoder::ready() const{return impl_->ready();}
 std::shared_ptr<core::audio_buffer> audio_decoder::poll(){return impl_->poll();}
+void audio_decoder::compensate_drift(size_t buffered_samples){impl_->compensate_drift(buffered_samples);}
 uint32_t audio_decoder::nb_frames() const{return impl_->nb_frames();}
-uint32_t audio_decoder::file_frame_number() const{return impl_->file_frame_number_;}
+uint32_t audio_decoder::file_frame_number() const{return impl_->file_frame_number();}
 const core::channel_layout& audio_decoder::channel_layout() const { return impl_->channel_layout_; }
 std::wstring audio_decoder::print() const{return impl_->print();}
+boost::property_tree::wptree audio_decoder::info() const{return impl_->info();}
 
 }}
\ No newline at end of file
@@ -26,6 +26,7 @@
 #include <common/memory/safe_ptr.h>
 
 #include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
 
 struct AVPacket;
 struct AVFormatContext;
@@ -40,16 +41,37 @@ struct channel_layout;
 }
 
 namespace ffmpeg {
+
+class context_pools;
 	
+// Decoded packets are handed out in recycled, cache-aligned slabs which swr
+// writes into directly. A slab returns to the decoder once the last
+// reference (normally frame_muxer's) is dropped.
+//
+// audio_streams selects the streams to decode: L"" picks the best stream,
+// L"ALL" merges every audio stream and L"0,1,2" merges the listed audio
+// streams (0 based) in that order. Merged streams are decoded concurrently
+// and interleaved into one channel layout.
+//
+// Decoders are taken from and returned to "context_pools" when given.
+//
+// drift_compensation resamples through audio_resampler, whose ratio follows
+// the level of decoded audio waiting in the muxer (see compensate_drift).
+// This lets live streams whose audio clock drifts against their video play
+// on without the muxer overflowing or running dry.
 class audio_decoder : boost::noncopyable
 {
 public:
-	explicit audio_decoder(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, const std::wstring& custom_channel_order);
+	explicit audio_decoder(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, const std::wstring& custom_channel_order, const std::wstring& audio_streams = L"", bool drift_compensation = false, const std::shared_ptr<context_pools>& context_pools = nullptr);
 	
 	bool ready() const;
 	void push(const std::shared_ptr<AVPacket>& packet);
 	std::shared_ptr<core::audio_buffer> poll();
 
+	// Called once per frame with the samples (per channel) decoded but not
+	// yet played. Does nothing unless drift_compensation was asked for.
+	void compensate_drift(size_t buffered_samples);
+
 	uint32_t nb_frames() const;
 	
 	uint32_t file_frame_number() const;
@@ -57,6 +79,7 @@ public:
 	const core::channel_layout& channel_layout() const;
 
 	std::wstring print() const;
+	boost::property_tree::wptree info() const;
 private:
 	struct implementation;
 	safe_ptr<implementation> impl_;
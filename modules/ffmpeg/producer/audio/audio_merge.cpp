@@ -0,0 +1,215 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../StdAfx.h"
+
+#include "audio_merge.h"
+
+#include <common/os/windows/system_info.h>
+
+#include <emmintrin.h>
+
+// The 8 track transpose only moves 32 bit lanes, which the AVX float shuffles
+// do as well as the AVX2 integer ones. VS2010 SP1 has the AVX intrinsics.
+#if defined(_MSC_VER) && _MSC_FULL_VER >= 160040219
+#define CASPAR_HAS_AVX_INTRINSICS
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Samples per pass over all tracks, keeps the written rows in L1 for 16 tracks.
+const size_t BLOCK_SAMPLES = 256;
+
+typedef void (*transpose_kernel)(const int32_t* const* inputs, size_t nb_samples, int32_t* dest, size_t stride);
+
+void copy_channels(const int32_t* input, size_t channels, size_t nb_samples, int32_t* dest, size_t stride)
+{
+	for(size_t n = 0; n < nb_samples; ++n)
+	{
+		for(size_t c = 0; c < channels; ++c)
+			dest[n * stride + c] = input[n * channels + c];
+	}
+}
+
+void transpose4_sse2(const int32_t* const* inputs, size_t nb_samples, int32_t* dest, size_t stride)
+{
+	size_t n = 0;
+	for(; n + 4 <= nb_samples; n += 4)
+	{
+		__m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[0] + n));
+		__m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[1] + n));
+		__m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[2] + n));
+		__m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[3] + n));
+
+		__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+		__m128i t1 = _mm_unpackhi_epi32(r0, r1);
+		__m128i t2 = _mm_unpacklo_epi32(r2, r3);
+		__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + (n + 0) * stride), _mm_unpacklo_epi64(t0, t2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + (n + 1) * stride), _mm_unpackhi_epi64(t0, t2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + (n + 2) * stride), _mm_unpacklo_epi64(t1, t3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + (n + 3) * stride), _mm_unpackhi_epi64(t1, t3));
+	}
+
+	for(size_t c = 0; c < 4; ++c)
+		copy_channels(inputs[c] + n, 1, nb_samples - n, dest + n * stride + c, stride);
+}
+
+#ifdef CASPAR_HAS_AVX_INTRINSICS
+
+__m256d as_pd(__m256 value)
+{
+	return _mm256_castps_pd(value);
+}
+
+void transpose8_avx(const int32_t* const* inputs, size_t nb_samples, int32_t* dest, size_t stride)
+{
+	size_t n = 0;
+	for(; n + 8 <= nb_samples; n += 8)
+	{
+		__m256 r[8];
+		for(int c = 0; c < 8; ++c)
+			r[c] = _mm256_loadu_ps(reinterpret_cast<const float*>(inputs[c] + n));
+
+		__m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+		__m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+		__m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+		__m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+		__m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+		__m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+		__m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+		__m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+		__m256 u0 = _mm256_castpd_ps(_mm256_unpacklo_pd(as_pd(t0), as_pd(t2)));
+		__m256 u1 = _mm256_castpd_ps(_mm256_unpackhi_pd(as_pd(t0), as_pd(t2)));
+		__m256 u2 = _mm256_castpd_ps(_mm256_unpacklo_pd(as_pd(t1), as_pd(t3)));
+		__m256 u3 = _mm256_castpd_ps(_mm256_unpackhi_pd(as_pd(t1), as_pd(t3)));
+		__m256 u4 = _mm256_castpd_ps(_mm256_unpacklo_pd(as_pd(t4), as_pd(t6)));
+		__m256 u5 = _mm256_castpd_ps(_mm256_unpackhi_pd(as_pd(t4), as_pd(t6)));
+		__m256 u6 = _mm256_castpd_ps(_mm256_unpacklo_pd(as_pd(t5), as_pd(t7)));
+		__m256 u7 = _mm256_castpd_ps(_mm256_unpackhi_pd(as_pd(t5), as_pd(t7)));
+
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 0) * stride), _mm256_permute2f128_ps(u0, u4, 0x20));
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 1) * stride), _mm256_permute2f128_ps(u1, u5, 0x20));
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 2) * stride), _mm256_permute2f128_ps(u2, u6, 0x20));
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 3) * stride), _mm256_permute2f128_ps(u3, u7, 0x20));
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 4) * stride), _mm256_permute2f128_ps(u0, u4, 0x31));
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 5) * stride), _mm256_permute2f128_ps(u1, u5, 0x31));
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 6) * stride), _mm256_permute2f128_ps(u2, u6, 0x31));
+		_mm256_storeu_ps(reinterpret_cast<float*>(dest + (n + 7) * stride), _mm256_permute2f128_ps(u3, u7, 0x31));
+	}
+
+	_mm256_zeroupper();
+
+	for(size_t c = 0; c < 8; ++c)
+		copy_channels(inputs[c] + n, 1, nb_samples - n, dest + n * stride + c, stride);
+}
+
+#endif
+
+struct merge_kernels
+{
+	transpose_kernel transpose4;
+	transpose_kernel transpose8;
+
+	merge_kernels()
+		: transpose4(nullptr)
+		, transpose8(nullptr)
+	{
+		auto features = get_cpu_features();
+
+		if(features.sse2)
+			transpose4 = transpose4_sse2;
+
+#ifdef CASPAR_HAS_AVX_INTRINSICS
+		if(features.avx)
+			transpose8 = transpose8_avx;
+#endif
+	}
+};
+
+const merge_kernels& get_merge_kernels()
+{
+	static merge_kernels kernels;
+	return kernels;
+}
+
+// Ensures the kernels are selected before any concurrent use (no thread-safe
+// statics in VS2010).
+const merge_kernels& g_merge_kernels = get_merge_kernels();
+
+}
+
+void merge_channels(const int32_t* const* inputs, const size_t* channels, size_t nb_inputs, size_t nb_samples, int32_t* dest)
+{
+	const auto& kernels = g_merge_kernels;
+
+	size_t stride = 0;
+	for(size_t i = 0; i < nb_inputs; ++i)
+		stride += channels[i];
+
+	std::vector<const int32_t*> block(nb_inputs);
+
+	for(size_t first = 0; first < nb_samples; first += BLOCK_SAMPLES)
+	{
+		const auto count = std::min(BLOCK_SAMPLES, nb_samples - first);
+
+		for(size_t i = 0; i < nb_inputs; ++i)
+			block[i] = inputs[i] + first * channels[i];
+
+		auto out = dest + first * stride;
+
+		for(size_t i = 0; i < nb_inputs;)
+		{
+			size_t mono = 0;
+			while(i + mono < nb_inputs && mono < 8 && channels[i + mono] == 1)
+				++mono;
+
+			if(mono == 8 && kernels.transpose8)
+			{
+				kernels.transpose8(&block[i], count, out, stride);
+				i	+= 8;
+				out += 8;
+			}
+			else if(mono >= 4 && kernels.transpose4)
+			{
+				kernels.transpose4(&block[i], count, out, stride);
+				i	+= 4;
+				out += 4;
+			}
+			else
+			{
+				copy_channels(block[i], channels[i], count, out, stride);
+				out += channels[i];
+				++i;
+			}
+		}
+	}
+}
+
+}}
@@ -0,0 +1,35 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caspar { namespace ffmpeg {
+
+// Interleaves nb_inputs sources of channels[n] interleaved channels each into
+// dest, which holds the sum of all channels per sample in input order. Runs
+// of mono sources (the usual MXF/MOV track layout) are transposed 4 (SSE2) or
+// 8 (AVX) tracks at a time.
+void merge_channels(const int32_t* const* inputs, const size_t* channels, size_t nb_inputs, size_t nb_samples, int32_t* dest);
+
+}}
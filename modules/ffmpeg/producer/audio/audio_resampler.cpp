@@ -1,109 +1,512 @@
-/*
-* Copyright 2013 Sveriges Television AB http://casparcg.com/
-*
-* This file is part of CasparCG (www.casparcg.com).
-*
-* CasparCG is free software: you can redistribute it and/or modify
-* it under the terms of the GNU General Public License as published by
-* the Free Software Foundation, either version 3 of the License, or
-* (at your option) any later version.
-*
-* CasparCG is distributed in the hope that it will be useful,
-* but WITHOUT ANY WARRANTY; without even the implied warranty of
-* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-* GNU General Public License for more details.
-*
-* You should have received a copy of the GNU General Public License
-* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
-*
-* Author: Robert Nagy, ronag89@gmail.com
-*/
-
-#include "../../StdAfx.h"
-
-#include "audio_resampler.h"
-
-#include <common/exception/exceptions.h>
-
-#if defined(_MSC_VER)
-#pragma warning (push)
-#pragma warning (disable : 4244)
-#endif
-extern "C" 
-{
-	#include <libavcodec/avcodec.h>
-}
-#if defined(_MSC_VER)
-#pragma warning (pop)
-#endif
-
-namespace caspar { namespace ffmpeg {
-
-struct audio_resampler::implementation
-{	
-	std::shared_ptr<ReSampleContext> resampler_;
-	
-	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> copy_buffer_;
-	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> buffer2_;
-
-	const size_t			output_channels_;
-	const AVSampleFormat	output_sample_format_;
-
-	const size_t			input_channels_;
-	const AVSampleFormat	input_sample_format_;
-
-	implementation(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format)
-		: output_channels_(output_channels)
-		, output_sample_format_(output_sample_format)
-		, input_channels_(input_channels)
-		, input_sample_format_(input_sample_format)
-	{
-		if(input_channels		!= output_channels || 
-		   input_sample_rate	!= output_sample_rate ||
-		   input_sample_format	!= output_sample_format)
-		{	
-			auto resampler = av_audio_resample_init(output_channels,		input_channels,
-													output_sample_rate,		input_sample_rate,
-													output_sample_format,	input_sample_format,
-													16, 10, 0, 0.8);
-
-			buffer2_.resize(480000*2);
-
-			char sample_fmt_string[200];
-			av_get_sample_fmt_string(sample_fmt_string, 200, input_sample_format);
-
-			CASPAR_LOG(warning) << L"[audio-resampler]"		
-								<< L" sample-rate: "	<< input_sample_rate 
-								<< L" channels: "		<< input_channels 
-								<< L" sample-fmt: "		<< widen(sample_fmt_string);
-
-			if(resampler)
-				resampler_.reset(resampler, audio_resample_close);
-			else
-				BOOST_THROW_EXCEPTION(caspar_exception());
-		}		
-	}
-
-	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data)
-	{
-		if(resampler_ && !data.empty())
-		{
-			buffer2_.resize(480000*2);
-			auto ret = audio_resample(resampler_.get(),
-									  reinterpret_cast<short*>(buffer2_.data()), 
-									  reinterpret_cast<short*>(data.data()), 
-									  data.size() / (av_get_bytes_per_sample(input_sample_format_) * input_channels_)); 
-			buffer2_.resize(ret * av_get_bytes_per_sample(output_sample_format_) * output_channels_);
-			std::swap(data, buffer2_);
-		}
-
-		return std::move(data);
-	}
-};
-
-
-audio_resampler::audio_resampler(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format)
-				: impl_(new implementation(output_channels, input_channels, output_sample_rate, input_sample_rate, output_sample_format, input_sample_format)){}
-std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> audio_resampler::resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data){return impl_->resample(std::move(data));}
-
-}}
\ No newline at end of file
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../StdAfx.h"
+
+#include "audio_resampler.h"
+
+#include <common/exception/exceptions.h>
+
+#if defined(_MSC_VER)
+#pragma warning (push)
+#pragma warning (disable : 4244)
+#endif
+extern "C" 
+{
+	#include <libavcodec/avcodec.h>
+	#include <libavutil/channel_layout.h>
+}
+#if defined(_MSC_VER)
+#pragma warning (pop)
+#endif
+
+#include <xmmintrin.h>
+
+#include <cmath>
+#include <cstring>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const int		PHASES				= 256;
+const int		TAPS				= 32;
+const int		HALF_TAPS			= TAPS / 2;
+const int64_t	HISTORY_CAPACITY	= 1 << 14; // Per channel, must be a power of two.
+const int64_t	PHASE_SCALE			= 1 << 10; // Sub steps of the phase, for fine ratio adjustments.
+const double	MAX_ADJUSTMENT		= 0.005;
+const double	PI					= 3.14159265358979323846;
+const float		MINUS_3DB			= 0.70710678f;
+
+typedef std::vector<float, tbb::cache_aligned_allocator<float>> float_buffer;
+
+float read_sample(const uint8_t* src, AVSampleFormat format)
+{
+	switch(format)
+	{
+	case AV_SAMPLE_FMT_U8:	return (static_cast<float>(*src) - 128.0f) * (1.0f / 128.0f);
+	case AV_SAMPLE_FMT_S16:	return static_cast<float>(*reinterpret_cast<const int16_t*>(src)) * (1.0f / 32768.0f);
+	case AV_SAMPLE_FMT_S32:	return static_cast<float>(*reinterpret_cast<const int32_t*>(src) * (1.0 / 2147483648.0));
+	case AV_SAMPLE_FMT_FLT:	return *reinterpret_cast<const float*>(src);
+	case AV_SAMPLE_FMT_DBL:	return static_cast<float>(*reinterpret_cast<const double*>(src));
+	default:				return 0.0f;
+	}
+}
+
+void write_sample(uint8_t* dest, AVSampleFormat format, float value)
+{
+	double v = std::max(-1.0, std::min(1.0, static_cast<double>(value)));
+
+	switch(format)
+	{
+	case AV_SAMPLE_FMT_U8:	*dest = static_cast<uint8_t>(std::min(255.0, std::floor(v * 128.0 + 128.5)));						break;
+	case AV_SAMPLE_FMT_S16:	*reinterpret_cast<int16_t*>(dest) = static_cast<int16_t>(std::min(32767.0, std::floor(v * 32768.0 + 0.5)));	break;
+	case AV_SAMPLE_FMT_S32:	*reinterpret_cast<int32_t*>(dest) = static_cast<int32_t>(std::min(2147483647.0, std::floor(v * 2147483648.0 + 0.5))); break;
+	case AV_SAMPLE_FMT_FLT:	*reinterpret_cast<float*>(dest) = value;															break;
+	case AV_SAMPLE_FMT_DBL:	*reinterpret_cast<double*>(dest) = value;															break;
+	}
+}
+
+// Windowed sinc (Blackman) table with one extra phase for interpolation.
+// Each phase is normalized to unity gain. Phases start on 16 byte
+// boundaries since TAPS is a multiple of four.
+float_buffer create_filter(double cutoff)
+{
+	float_buffer filter((PHASES + 1) * TAPS);
+
+	for(int p = 0; p <= PHASES; ++p)
+	{
+		double sum = 0.0;
+		for(int t = 0; t < TAPS; ++t)
+		{
+			double x = static_cast<double>(t - HALF_TAPS + 1) - static_cast<double>(p) / PHASES;
+			double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(PI * cutoff * x) / (PI * cutoff * x);
+			double window = std::abs(x) >= HALF_TAPS ? 0.0 : 0.42 + 0.5 * std::cos(PI * x / HALF_TAPS) + 0.08 * std::cos(2.0 * PI * x / HALF_TAPS);
+			double value = cutoff * sinc * window;
+			filter[p * TAPS + t] = static_cast<float>(value);
+			sum += value;
+		}
+		for(int t = 0; t < TAPS; ++t)
+			filter[p * TAPS + t] = static_cast<float>(filter[p * TAPS + t] / sum);
+	}
+
+	return filter;
+}
+
+// Linear interpolation between two adjacent (aligned) filter phases.
+void interpolate_phases(const float* c0, const float* c1, float frac, float* dest)
+{
+	const __m128 f = _mm_set1_ps(frac);
+	for(int t = 0; t < TAPS; t += 4)
+	{
+		__m128 a = _mm_load_ps(c0 + t);
+		__m128 b = _mm_load_ps(c1 + t);
+		_mm_store_ps(dest + t, _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(b, a))));
+	}
+}
+
+// Dot product of an (unaligned) history window with the aligned coefficients.
+float convolve(const float* window, const float* coeffs)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for(int t = 0; t < TAPS; t += 8)
+	{
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(window + t + 0), _mm_load_ps(coeffs + t + 0)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(window + t + 4), _mm_load_ps(coeffs + t + 4)));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(sum);
+}
+
+// Output x input gains, row major. Channels are assumed to be in the default
+// ffmpeg order for their count. Channels present in both layouts are copied,
+// the rest are folded into the front pair (centre at -3dB, left and right
+// surrounds into their side) and LFE is dropped, as in an ITU-R BS.775
+// downmix. A mono input feeds every output channel. Rows are scaled down
+// together if any of them could clip.
+std::vector<float> create_matrix(size_t output_channels, size_t input_channels)
+{
+	std::vector<float> matrix(output_channels * input_channels, 0.0f);
+
+	if(input_channels == 1)
+	{
+		for(size_t o = 0; o < output_channels; ++o)
+			matrix[o] = 1.0f;
+		return matrix;
+	}
+
+	if(output_channels >= input_channels)
+	{
+		for(size_t i = 0; i < input_channels; ++i)
+			matrix[i * input_channels + i] = 1.0f;
+		return matrix;
+	}
+
+	const uint64_t in_layout	= av_get_default_channel_layout(static_cast<int>(input_channels));
+	const uint64_t out_layout	= av_get_default_channel_layout(static_cast<int>(output_channels));
+
+	const uint64_t LEFT		= AV_CH_FRONT_LEFT_OF_CENTER | AV_CH_BACK_LEFT | AV_CH_SIDE_LEFT | AV_CH_TOP_FRONT_LEFT | AV_CH_TOP_BACK_LEFT | AV_CH_WIDE_LEFT | AV_CH_SURROUND_DIRECT_LEFT;
+	const uint64_t RIGHT	= AV_CH_FRONT_RIGHT_OF_CENTER | AV_CH_BACK_RIGHT | AV_CH_SIDE_RIGHT | AV_CH_TOP_FRONT_RIGHT | AV_CH_TOP_BACK_RIGHT | AV_CH_WIDE_RIGHT | AV_CH_SURROUND_DIRECT_RIGHT;
+	const uint64_t LFE		= AV_CH_LOW_FREQUENCY | AV_CH_LOW_FREQUENCY_2;
+
+	for(size_t i = 0; i < input_channels; ++i)
+	{
+		auto gain = [&](uint64_t channel) -> float&
+		{
+			return matrix[av_get_channel_layout_channel_index(out_layout, channel) * input_channels + i];
+		};
+
+		if(in_layout == 0 || out_layout == 0)
+		{
+			matrix[(i % output_channels) * input_channels + i] = 1.0f;
+			continue;
+		}
+
+		const uint64_t channel = av_channel_layout_extract_channel(in_layout, static_cast<int>(i));
+
+		if(out_layout & channel)
+			gain(channel) += 1.0f;
+		else if(channel & LFE)
+			continue;
+		else if(output_channels == 1)
+			gain(AV_CH_FRONT_CENTER) += channel & (AV_CH_FRONT_LEFT | AV_CH_FRONT_RIGHT) ? 1.0f : MINUS_3DB;
+		else if(channel & LEFT)
+			gain(AV_CH_FRONT_LEFT) += MINUS_3DB;
+		else if(channel & RIGHT)
+			gain(AV_CH_FRONT_RIGHT) += MINUS_3DB;
+		else
+		{
+			gain(AV_CH_FRONT_LEFT) += MINUS_3DB;
+			gain(AV_CH_FRONT_RIGHT) += MINUS_3DB;
+		}
+	}
+
+	float max_sum = 1.0f;
+	for(size_t o = 0; o < output_channels; ++o)
+	{
+		float sum = 0.0f;
+		for(size_t i = 0; i < input_channels; ++i)
+			sum += matrix[o * input_channels + i];
+		max_sum = std::max(max_sum, sum);
+	}
+
+	for(size_t n = 0; n < matrix.size(); ++n)
+		matrix[n] /= max_sum;
+
+	return matrix;
+}
+
+// Input channel copied to each output channel or -1 for silence, if the
+// matrix is a plain routing. Otherwise empty.
+std::vector<int> find_routing(const std::vector<float>& matrix, size_t output_channels, size_t input_channels)
+{
+	std::vector<int> routing(output_channels, -1);
+
+	for(size_t o = 0; o < output_channels; ++o)
+	{
+		for(size_t i = 0; i < input_channels; ++i)
+		{
+			float gain = matrix[o * input_channels + i];
+			if(gain == 0.0f)
+				continue;
+			if(gain != 1.0f || routing[o] != -1)
+				return std::vector<int>();
+			routing[o] = static_cast<int>(i);
+		}
+	}
+
+	return routing;
+}
+
+}
+
+struct audio_resampler::implementation
+{	
+	const size_t				output_channels_;
+	const AVSampleFormat		output_sample_format_;
+	const size_t				input_channels_;
+	const AVSampleFormat		input_sample_format_;
+	const int64_t				output_sample_rate_;
+	const int64_t				input_sample_rate_;
+
+	const bool					passthrough_;
+	const int64_t				denominator_;		// output_sample_rate_ * PHASE_SCALE.
+	int64_t						step_;				// Whole input samples per output sample.
+	int64_t						step_remainder_;	// Remaining input samples, in 1/denominator_ units.
+	const float_buffer			filter_;
+	const std::vector<float>	matrix_;
+	const std::vector<int>		routing_;
+
+	// One mirrored ring per output channel, filled after channel mixing.
+	// Sample k is stored at (k & mask) and (k & mask) + capacity so every
+	// filter window is contiguous.
+	std::vector<float_buffer>	history_;
+	int64_t						written_;
+
+	// The read position is kept as an exact fraction, position_ +
+	// phase_/denominator_, so that it never drifts.
+	int64_t						position_;
+	int64_t						phase_;
+
+	bool						drift_compensation_;
+	double						adjustment_;
+	double						filtered_error_;
+
+	float_buffer				coeffs_;
+	float_buffer				mixed_;
+	std::vector<float>			frame_;
+	std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> output_;
+
+	implementation(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format)
+		: output_channels_(output_channels)
+		, output_sample_format_(output_sample_format)
+		, input_channels_(input_channels)
+		, input_sample_format_(input_sample_format)
+		, output_sample_rate_(output_sample_rate)
+		, input_sample_rate_(input_sample_rate)
+		, passthrough_(input_channels == output_channels && input_sample_rate == output_sample_rate && input_sample_format == output_sample_format)
+		, denominator_(static_cast<int64_t>(output_sample_rate) * PHASE_SCALE)
+		, step_(output_sample_rate > 0 ? input_sample_rate / output_sample_rate : 0)
+		, step_remainder_(output_sample_rate > 0 ? (input_sample_rate % output_sample_rate) * PHASE_SCALE : 0)
+		, filter_(create_filter(std::min(1.0, static_cast<double>(output_sample_rate) / static_cast<double>(std::max<size_t>(input_sample_rate, 1))) * 0.95))
+		, matrix_(create_matrix(output_channels, input_channels))
+		, routing_(find_routing(matrix_, output_channels, input_channels))
+		, history_(output_channels, float_buffer(HISTORY_CAPACITY * 2, 0.0f))
+		, written_(HALF_TAPS)
+		, position_(HALF_TAPS)
+		, phase_(0)
+		, drift_compensation_(false)
+		, adjustment_(1.0)
+		, filtered_error_(0.0)
+		, coeffs_(TAPS)
+		, frame_(input_channels)
+	{
+		if(input_channels < 1 || output_channels < 1 || input_sample_rate < 1 || output_sample_rate < 1)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("audio_resampler: invalid channel count or sample rate."));
+
+		if(!passthrough_)
+		{
+			char sample_fmt_string[200];
+			av_get_sample_fmt_string(sample_fmt_string, 200, input_sample_format);
+
+			CASPAR_LOG(debug) << L"[audio-resampler]"		
+							  << L" sample-rate: "	<< input_sample_rate	<< L" -> " << output_sample_rate
+							  << L" channels: "		<< input_channels		<< L" -> " << output_channels
+							  << (routing_.empty() ? L" (mixed)" : L"")
+							  << L" sample-fmt: "	<< widen(sample_fmt_string);
+		}
+	}
+
+	boost::iterator_range<const uint8_t*> resample(const uint8_t* const* input, size_t nb_samples)
+	{
+		const int in_bps	= av_get_bytes_per_sample(input_sample_format_);
+		const int out_bps	= av_get_bytes_per_sample(output_sample_format_);
+
+		if(passthrough_ && !drift_compensation_)
+		{
+			size_t size = nb_samples * in_bps * input_channels_;
+			ensure_size(output_, size);
+			if(av_sample_fmt_is_planar(input_sample_format_))
+			{
+				for(size_t c = 0; c < input_channels_; ++c)
+					std::memcpy(output_.data() + c * nb_samples * in_bps, input[c], nb_samples * in_bps);
+			}
+			else
+				std::memcpy(output_.data(), input[0], size);
+
+			return boost::iterator_range<const uint8_t*>(output_.data(), output_.data() + size);
+		}
+
+		const size_t max_output		= static_cast<size_t>(static_cast<double>(nb_samples + TAPS * 2) * output_sample_rate_ / input_sample_rate_ / (1.0 - MAX_ADJUSTMENT)) + 2;
+		ensure_size(mixed_, max_output * output_channels_);
+
+		const bool	in_planar		= av_sample_fmt_is_planar(input_sample_format_) != 0;
+		const auto	in_format		= av_get_packed_sample_fmt(input_sample_format_);
+		const int64_t mask			= HISTORY_CAPACITY - 1;
+		const size_t chunk_size		= static_cast<size_t>(HISTORY_CAPACITY - TAPS * 2);
+
+		size_t nb_output = 0;
+
+		for(size_t offset = 0; offset < nb_samples; offset += chunk_size)
+		{
+			const size_t count = std::min(chunk_size, nb_samples - offset);
+
+			// Decode (and mix) into the history rings.
+
+			if(!routing_.empty())
+			{
+				for(size_t c = 0; c < output_channels_; ++c)
+				{
+					if(routing_[c] < 0)
+						continue; // The ring stays silent.
+
+					auto& ring = history_[c];
+					const size_t source = routing_[c];
+					const uint8_t* src = in_planar ? input[source] + offset * in_bps : input[0] + (offset * input_channels_ + source) * in_bps;
+					const size_t stride = in_planar ? in_bps : in_bps * input_channels_;
+
+					for(size_t n = 0; n < count; ++n, src += stride)
+					{
+						auto index = (written_ + static_cast<int64_t>(n)) & mask;
+						ring[index] = ring[index + HISTORY_CAPACITY] = read_sample(src, in_format);
+					}
+				}
+			}
+			else
+			{
+				for(size_t n = 0; n < count; ++n)
+				{
+					for(size_t i = 0; i < input_channels_; ++i)
+					{
+						const uint8_t* src = in_planar ? input[i] + (offset + n) * in_bps : input[0] + ((offset + n) * input_channels_ + i) * in_bps;
+						frame_[i] = read_sample(src, in_format);
+					}
+
+					auto index = (written_ + static_cast<int64_t>(n)) & mask;
+					for(size_t c = 0; c < output_channels_; ++c)
+					{
+						const float* gains = matrix_.data() + c * input_channels_;
+						float sum = 0.0f;
+						for(size_t i = 0; i < input_channels_; ++i)
+							sum += gains[i] * frame_[i];
+						history_[c][index] = history_[c][index + HISTORY_CAPACITY] = sum;
+					}
+				}
+			}
+			written_ += count;
+
+			// Filter every output sample whose window is complete.
+
+			while(position_ + HALF_TAPS < written_)
+			{
+				const int64_t	scaled	= phase_ * PHASES;
+				const int		p		= static_cast<int>(scaled / denominator_);
+				const float		frac	= static_cast<float>(static_cast<double>(scaled % denominator_) / static_cast<double>(denominator_));
+
+				interpolate_phases(filter_.data() + p * TAPS, filter_.data() + (p + 1) * TAPS, frac, coeffs_.data());
+
+				const int64_t start = (position_ - HALF_TAPS + 1) & mask;
+
+				float* out = mixed_.data() + nb_output * output_channels_;
+				for(size_t c = 0; c < output_channels_; ++c)
+					out[c] = convolve(history_[c].data() + start, coeffs_.data());
+
+				++nb_output;
+
+				position_	+= step_;
+				phase_		+= step_remainder_;
+				if(phase_ >= denominator_)
+				{
+					phase_ -= denominator_;
+					++position_;
+				}
+			}
+		}
+
+		// Encode into the requested output layout.
+
+		const size_t size		= nb_output * out_bps * output_channels_;
+		const bool out_planar	= av_sample_fmt_is_planar(output_sample_format_) != 0;
+		const auto out_format	= av_get_packed_sample_fmt(output_sample_format_);
+		ensure_size(output_, size);
+
+		for(size_t n = 0; n < nb_output; ++n)
+		{
+			for(size_t c = 0; c < output_channels_; ++c)
+			{
+				size_t index = out_planar ? c * nb_output + n : n * output_channels_ + c;
+				write_sample(output_.data() + index * out_bps, out_format, mixed_[n * output_channels_ + c]);
+			}
+		}
+
+		return boost::iterator_range<const uint8_t*>(output_.data(), output_.data() + size);
+	}
+
+	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data)
+	{
+		if((passthrough_ && !drift_compensation_) || data.empty())
+			return std::move(data);
+
+		const uint8_t* input[] = { reinterpret_cast<const uint8_t*>(data.data()) };
+		auto result = resample(input, data.size() / (av_get_bytes_per_sample(input_sample_format_) * input_channels_));
+
+		data.assign(result.begin(), result.end());
+
+		return std::move(data);
+	}
+
+	void enable_drift_compensation(bool value)
+	{
+		drift_compensation_ = value;
+		filtered_error_		= 0.0;
+		apply_adjustment(1.0);
+	}
+
+	void set_ratio_adjustment(double adjustment)
+	{
+		if(drift_compensation_)
+			apply_adjustment(adjustment);
+	}
+
+	void follow_buffer_level(int64_t buffered, int64_t target)
+	{
+		if(!drift_compensation_)
+			return;
+
+		// Proportional control on the smoothed error. A tenth of a second too
+		// much (or too little) trims the ratio by the whole range.
+		const double error = static_cast<double>(buffered - target) / (static_cast<double>(output_sample_rate_) * 0.1);
+		filtered_error_ += 0.02 * (error - filtered_error_);
+
+		apply_adjustment(1.0 + MAX_ADJUSTMENT * filtered_error_);
+	}
+
+	// Above 1.0 input is consumed faster, i.e. fewer output samples are made.
+	void apply_adjustment(double adjustment)
+	{
+		adjustment_ = std::max(1.0 - MAX_ADJUSTMENT, std::min(1.0 + MAX_ADJUSTMENT, adjustment));
+
+		const auto step = static_cast<int64_t>(std::floor(static_cast<double>(input_sample_rate_ * PHASE_SCALE) * adjustment_ + 0.5));
+		step_			= step / denominator_;
+		step_remainder_	= step % denominator_;
+	}
+
+	template<typename T>
+	static void ensure_size(T& buffer, size_t size)
+	{
+		if(buffer.size() < size)
+			buffer.resize(size);
+	}
+};
+
+audio_resampler::audio_resampler(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format)
+				: impl_(new implementation(output_channels, input_channels, output_sample_rate, input_sample_rate, output_sample_format, input_sample_format)){}
+boost::iterator_range<const uint8_t*> audio_resampler::resample(const uint8_t* const* input, size_t nb_samples){return impl_->resample(input, nb_samples);}
+std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> audio_resampler::resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data){return impl_->resample(std::move(data));}
+void audio_resampler::enable_drift_compensation(bool value){impl_->enable_drift_compensation(value);}
+void audio_resampler::set_ratio_adjustment(double adjustment){impl_->set_ratio_adjustment(adjustment);}
+void audio_resampler::follow_buffer_level(int64_t buffered, int64_t target){impl_->follow_buffer_level(buffered, target);}
+double audio_resampler::ratio_adjustment() const{return impl_->adjustment_;}
+
+}}
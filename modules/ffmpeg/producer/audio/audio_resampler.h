@@ -22,22 +22,50 @@
 #pragma once
 
 #include <memory>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/range/iterator_range.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
 
 #include <libavutil/samplefmt.h>
 
 namespace caspar { namespace ffmpeg {
 
-class audio_resampler
+// Streaming polyphase (windowed sinc) resampler. Converts sample format,
+// channel count and sample rate in a single pass, keeping its history in
+// preallocated per-channel ring buffers. Channels are downmixed when there
+// are fewer output than input channels. Planar output is written as
+// consecutive planes of equal length.
+class audio_resampler : boost::noncopyable
 {
 public:
 	audio_resampler(size_t			output_channels,		size_t			input_channels, 
 					size_t			output_sample_rate,		size_t			input_sample_rate, 
 					AVSampleFormat	output_sample_format,	AVSampleFormat	input_sample_format);
 	
+	// Resamples nb_samples (per channel) from input, one pointer per plane for
+	// planar formats. The returned range is valid until the next call.
+	boost::iterator_range<const uint8_t*> resample(const uint8_t* const* input, size_t nb_samples);
+
 	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data);
+
+	// Drift compensation, for live inputs whose sample clock is not the
+	// channel's. Once enabled (before the first resample call) the ratio may
+	// be trimmed within +-0.5%, so that the input follows the channel clock
+	// instead of periodically dropping or inserting samples. An adjustment
+	// above 1.0 consumes the input faster.
+	void	enable_drift_compensation(bool value);
+	void	set_ratio_adjustment(double adjustment);
+	// Steers the ratio towards keeping "buffered" output samples at "target",
+	// both per channel, wherever the output waits to be played. Meant to be
+	// called once per frame, the error is smoothed over about 50 calls.
+	void	follow_buffer_level(int64_t buffered, int64_t target);
+	double	ratio_adjustment() const;
 private:
 	struct implementation;
 	std::shared_ptr<implementation> impl_;
 };
 
-}}
\ No newline at end of file
+}}
@@ -0,0 +1,817 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "clip_cache.h"
+
+#include "../input/input.h"
+#include "../muxer/frame_muxer.h"
+#include "../util/util.h"
+#include "../audio/audio_decoder.h"
+#include "../video/video_decoder.h"
+
+#include "../../ffmpeg_error.h"
+
+#include <common/env.h>
+#include <common/concurrency/executor.h>
+#include <common/diagnostics/graph.h>
+#include <common/exception/exceptions.h>
+#include <common/log/log.h>
+#include <common/utility/string.h>
+
+#include <core/mixer/write_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_factory.h>
+#include <core/producer/frame/frame_visitor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/regex.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/timer.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+
+#if defined(_MSC_VER)
+#pragma warning (push)
+#pragma warning (disable : 4244)
+#endif
+extern "C" 
+{
+	#include <libavcodec/avcodec.h>
+	#include <libavformat/avformat.h>
+}
+#if defined(_MSC_VER)
+#pragma warning (pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+// A channel frame: the converted picture, its audio and the file frame it was made from.
+struct cached_frame
+{
+	safe_ptr<core::basic_frame>	image; // Without audio, see cached_producer::receive.
+	core::audio_buffer			audio;
+	uint32_t					file_frame;
+
+	cached_frame() : image(core::basic_frame::empty()), file_frame(0){}
+};
+
+struct cached_clip : boost::noncopyable
+{
+	std::wstring				filename;
+	core::video_format_desc		format_desc;
+	double						fps;
+	core::channel_layout		channel_layout;
+	size_t						width;
+	size_t						height;
+	bool						progressive;
+	uint32_t					file_nb_frames;
+	std::vector<cached_frame>	frames;
+	size_t						size;
+
+	cached_clip()
+		: format_desc(core::video_format_desc::get(core::video_format::invalid))
+		, fps(0.0)
+		, channel_layout(core::channel_layout::stereo())
+		, width(0)
+		, height(0)
+		, progressive(true)
+		, file_nb_frames(0)
+		, size(0)
+	{
+	}
+
+	// The first channel frame made from file frame "file_frame" or later.
+	size_t frame_at(uint32_t file_frame) const
+	{
+		if(file_frame >= file_nb_frames)
+			return frames.size();
+
+		auto it = std::upper_bound(frames.begin(), frames.end(), file_frame, [](uint32_t value, const cached_frame& frame)
+		{
+			return value < frame.file_frame;
+		});
+		return static_cast<size_t>(it - frames.begin());
+	}
+};
+
+// Moves the audio out of the write_frames of a channel frame and counts their picture bytes.
+struct frame_splitter : public core::frame_visitor
+{
+	core::audio_buffer	audio;
+	size_t				image_size;
+
+	frame_splitter() : image_size(0){}
+
+	virtual void begin(core::basic_frame&) override {}
+	virtual void end() override {}
+
+	virtual void visit(core::write_frame& frame) override
+	{
+		auto& audio = frame.audio_data();
+		this->audio.insert(this->audio.end(), audio.begin(), audio.end());
+		audio.clear();
+
+		for(size_t n = 0; n < frame.get_pixel_format_desc().planes.size(); ++n)
+			image_size += frame.image_data(n).size();
+	}
+};
+
+std::shared_ptr<AVFrame> clone_frame(const AVFrame& frame)
+{
+	auto clone = av_frame_clone(&frame);
+	if(!clone)
+		BOOST_THROW_EXCEPTION(bad_alloc());
+
+	return std::shared_ptr<AVFrame>(clone, [](AVFrame* p)
+	{
+		av_frame_free(&p);
+	});
+}
+
+size_t frame_size(const AVFrame& frame)
+{
+	size_t size = 0;
+	for(int n = 0; n < AV_NUM_DATA_POINTERS; ++n)
+		size += frame.buf[n] ? frame.buf[n]->size : 0;
+
+	return size > 0 ? size : static_cast<size_t>(avpicture_get_size(static_cast<PixelFormat>(frame.format), frame.width, frame.height));
+}
+
+// The decoded clip, only kept until it has been converted.
+struct decoded_clip
+{
+	std::vector<std::shared_ptr<AVFrame>>	video;
+	core::audio_buffer						audio;
+	int										audio_sample_rate;
+
+	decoded_clip() : audio_sample_rate(0){}
+
+	uint32_t nb_frames(double fps, size_t channels) const
+	{
+		if(!video.empty())
+			return static_cast<uint32_t>(video.size());
+
+		return static_cast<uint32_t>(static_cast<double>(audio.size() / channels) * fps / audio_sample_rate);
+	}
+
+	// Audio is sliced along the clip's own frame rate so that seeking stays sample accurate.
+	size_t audio_offset(uint32_t frame, double fps, size_t channels) const
+	{
+		auto sample = static_cast<size_t>(static_cast<double>(frame) * audio_sample_rate / fps);
+		return std::min(sample * channels, audio.size());
+	}
+};
+
+// "reserve" is called with the memory the clip holds whenever it grows and 
+// throws when the cache has no room for it.
+std::shared_ptr<cached_clip> decode_clip(const std::wstring& filename, const safe_ptr<core::frame_factory>& frame_factory, const std::function<void(size_t)>& reserve)
+{
+	boost::timer timer;
+
+	const auto format_desc = frame_factory->get_video_format_desc();
+
+	safe_ptr<diagnostics::graph> graph;
+	input file(graph, filename, FFMPEG_FILE, false, 0, std::numeric_limits<uint32_t>::max(), false, ffmpeg_producer_params());
+		
+	auto clip = std::make_shared<cached_clip>();
+	clip->filename		= filename;
+	clip->format_desc	= format_desc;
+	clip->fps			= read_fps(*file.context(), format_desc.fps);
+
+	decoded_clip decoded;
+	decoded.audio_sample_rate = format_desc.audio_sample_rate;
+
+	std::unique_ptr<video_decoder> video;
+	std::unique_ptr<audio_decoder> audio;
+
+	try
+	{
+		video.reset(new video_decoder(file.context(), nullptr));
+		clip->width		= video->width();
+		clip->height	= video->height();
+	}
+	catch(averror_stream_not_found&){}
+
+	try
+	{
+		audio.reset(new audio_decoder(file.context(), format_desc, L""));
+		clip->channel_layout = audio->channel_layout();
+
+		if(file.context()->duration > 0)
+			decoded.audio.reserve(static_cast<size_t>(file.context()->duration * format_desc.audio_sample_rate / AV_TIME_BASE + format_desc.audio_sample_rate) * clip->channel_layout.num_channels);
+	}
+	catch(averror_stream_not_found&){}
+
+	if(!video && !audio)
+		BOOST_THROW_EXCEPTION(averror_stream_not_found() << msg_info("No streams found"));
+
+	// The decoded frames not yet converted, together with clip->size that is what the clip holds.
+	size_t decoded_size = 0;
+
+	auto decode = [&](const std::shared_ptr<AVPacket>& packet)
+	{
+		if(video)
+		{
+			video->push(packet);
+			for(auto frame = video->poll(); frame && frame != flush_video(); frame = video->poll())
+			{
+				clip->progressive = clip->progressive && !frame->interlaced_frame;
+				decoded.video.push_back(clone_frame(*frame));
+				decoded_size += frame_size(*frame);
+				reserve(decoded_size);
+			}
+		}
+
+		if(audio)
+		{
+			audio->push(packet);
+			for(auto samples = audio->poll(); samples && samples != flush_audio(); samples = audio->poll())
+			{
+				decoded.audio.insert(decoded.audio.end(), samples->begin(), samples->end());
+				decoded_size += samples->size() * sizeof(int32_t);
+				reserve(decoded_size);
+			}
+		}
+	};
+
+	boost::timer idle;
+	while(true)
+	{
+		std::shared_ptr<AVPacket> packet;
+		if(!file.try_pop(packet))
+		{
+			if(!file.eof())
+			{
+				if(idle.elapsed() > 10.0)
+					BOOST_THROW_EXCEPTION(timed_out() << msg_info(narrow(filename) + " stalled while caching."));
+
+				boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+				continue;
+			}
+			if(!file.try_pop(packet))
+				break;
+		}
+
+		idle.restart();
+		decode(packet);
+	}
+
+	// Drain frames delayed by the decoders.
+	auto flush_packet	= create_packet();
+	flush_packet->data	= nullptr;
+	flush_packet->size	= 0;
+	decode(flush_packet);
+
+	// Convert once into the frames the channel plays, so that playback does no work at all.
+	const auto channels = clip->channel_layout.num_channels;
+	clip->file_nb_frames = decoded.nb_frames(clip->fps, channels);
+
+	frame_muxer muxer(clip->fps, frame_factory, false, clip->channel_layout, L"");
+	clip->frames.reserve(muxer.calc_nb_frames(clip->file_nb_frames));
+
+	auto poll = [&](uint32_t file_frame)
+	{
+		for(auto frame = muxer.poll(); frame; frame = muxer.poll())
+		{
+			frame_splitter splitter;
+			frame->accept(splitter);
+
+			clip->frames.push_back(cached_frame());
+			auto& cached = clip->frames.back();
+			cached.image		= make_safe_ptr(frame);
+			cached.file_frame	= file_frame;
+			cached.audio.swap(splitter.audio);
+
+			clip->size += splitter.image_size + cached.audio.size() * sizeof(int32_t);
+			reserve(decoded_size + clip->size);
+		}
+	};
+
+	for(uint32_t n = 0; n < clip->file_nb_frames; ++n)
+	{
+		// Hand the decoded frame over, so that it is released as soon as the muxer has converted it.
+		if(decoded.video.empty())
+			muxer.push(empty_video(), 0);
+		else
+		{
+			auto frame = std::move(decoded.video[n]);
+			decoded_size -= frame_size(*frame);
+			muxer.push(std::move(frame), core::frame_producer::NO_HINT);
+		}
+
+		if(decoded.audio.empty())
+			muxer.push(empty_audio());
+		else
+			muxer.push(std::make_shared<core::audio_buffer>(decoded.audio.begin() + decoded.audio_offset(n, clip->fps, channels), decoded.audio.begin() + decoded.audio_offset(n + 1, clip->fps, channels)));
+
+		poll(n + 1);
+	}
+
+	clip->frames.shrink_to_fit();
+
+	CASPAR_LOG(info) << L"[clip_cache] Cached " << filename << L" " << clip->frames.size() << L" frames, " 
+					 << clip->size / (1024*1024) << L" MB in " << static_cast<int>(timer.elapsed()*1000.0) << L" ms.";
+
+	return clip;
+}
+
+struct cached_producer : public core::frame_producer
+{
+	const safe_ptr<core::monitor::subject>		monitor_subject_;
+	const std::shared_ptr<const cached_clip>	clip_;
+	const size_t								start_;
+	const size_t								end_;
+	const clip_cache::producer_factory			fallback_factory_;
+	bool										loop_;
+
+	size_t										position_;
+	int64_t										frame_number_;
+	safe_ptr<core::basic_frame>					last_frame_;
+	std::shared_ptr<core::frame_producer>		fallback_;
+
+	bool										fallback_requested_;
+	bool										building_fallback_;
+	boost::unique_future<safe_ptr<core::frame_producer>> pending_fallback_;
+	std::unique_ptr<executor>					fallback_executor_; // Opens the file off the channel thread.
+
+	cached_producer(const std::shared_ptr<const cached_clip>& clip, bool loop, uint32_t start, uint32_t length, const clip_cache::producer_factory& fallback_factory)
+		: clip_(clip)
+		, start_(clip->frame_at(start))
+		, end_(clip->frame_at(static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(start) + length, clip->file_nb_frames))))
+		, fallback_factory_(fallback_factory)
+		, loop_(loop)
+		, position_(start_)
+		, frame_number_(0)
+		, last_frame_(core::basic_frame::empty())
+		, fallback_requested_(false)
+		, building_fallback_(false)
+	{
+		CASPAR_LOG(info) << print() << L" Serving from clip-cache.";
+	}
+
+	uint32_t file_frame_number() const
+	{
+		return position_ > 0 && position_ <= clip_->frames.size() ? clip_->frames[position_ - 1].file_frame : 0;
+	}
+
+	void build_fallback()
+	{
+		CASPAR_LOG(info) << print() << L" Layer hints need decoding, opening ffmpeg producer.";
+
+		auto factory	= fallback_factory_;
+		auto file_frame	= file_frame_number();
+
+		// Opening and seeking the file would stall the channel tick.
+		fallback_executor_.reset(new executor(L"clip-cache fallback"));
+		pending_fallback_ = fallback_executor_->begin_invoke([=]() -> safe_ptr<core::frame_producer>
+		{
+			auto producer = factory();
+			producer->call(L"SEEK " + boost::lexical_cast<std::wstring>(file_frame));
+			return producer;
+		});
+		fallback_requested_	= true;
+		building_fallback_	= true;
+	}
+
+	void switch_to_fallback()
+	{
+		building_fallback_ = false;
+
+		try
+		{
+			auto producer = pending_fallback_.get();
+
+			// Catch up with the cached frames played meanwhile, the seek only queues on the input thread.
+			producer->call(L"SEEK " + boost::lexical_cast<std::wstring>(file_frame_number()));
+			producer->call(L"LOOP " + boost::lexical_cast<std::wstring>(loop_ ? 1 : 0));
+			producer->monitor_output().attach_parent(monitor_subject_);
+
+			fallback_ = producer;
+			CASPAR_LOG(info) << print() << L" Switched to ffmpeg producer.";
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+			CASPAR_LOG(warning) << print() << L" Could not open ffmpeg producer, serving cached frames without layer hints.";
+		}
+
+		fallback_executor_.reset();
+	}
+
+	// frame_producer
+	
+	virtual safe_ptr<core::basic_frame> receive(int hints) override
+	{
+		if(!fallback_requested_ && hints != core::frame_producer::NO_HINT)
+			build_fallback();
+
+		if(building_fallback_ && pending_fallback_.is_ready())
+			switch_to_fallback();
+
+		if(fallback_)
+			return fallback_->receive(hints);
+
+		// A key layer would show the fill, hold the last frame until the file is open.
+		if(building_fallback_ && (hints & core::frame_producer::ALPHA_HINT))
+			return core::basic_frame::late();
+
+		if(position_ >= end_ && loop_ && end_ > start_)
+			position_ = start_;
+
+		if(position_ >= end_)
+		{
+			send_osc();
+			return last_frame();
+		}
+
+		auto& cached = clip_->frames[position_++];
+
+		// The picture is shared by every producer of the clip. The audio gets a 
+		// frame tagged with this producer, so that each one has its own stream in the mixer.
+		auto frame = cached.image;
+		if(!cached.audio.empty())
+		{
+			auto audio = make_safe<core::write_frame>(this, clip_->channel_layout);
+			audio->audio_data() = cached.audio;
+
+			std::vector<safe_ptr<core::basic_frame>> frames;
+			frames.push_back(cached.image);
+			frames.push_back(audio);
+			frame = make_safe<core::basic_frame>(std::move(frames));
+		}
+
+		last_frame_ = frame;
+		++frame_number_;
+
+		send_osc();
+
+		return frame;
+	}
+
+	virtual safe_ptr<core::basic_frame> last_frame() const override
+	{
+		if(fallback_)
+			return fallback_->last_frame();
+
+		return disable_audio(last_frame_);
+	}
+
+	virtual uint32_t nb_frames() const override
+	{
+		if(fallback_)
+			return fallback_->nb_frames();
+
+		if(loop_)
+			return std::numeric_limits<uint32_t>::max();
+
+		return static_cast<uint32_t>(end_ - start_);
+	}
+
+	virtual boost::unique_future<std::wstring> call(const std::wstring& param) override
+	{
+		if(fallback_)
+			return fallback_->call(param);
+
+		static const boost::wregex loop_exp(L"LOOP\\s*(?<VALUE>\\d?)?", boost::regex::icase);
+		static const boost::wregex seek_exp(L"SEEK\\s+(?<VALUE>\\d+)", boost::regex::icase);
+		
+		boost::promise<std::wstring> promise;
+
+		boost::wsmatch what;
+		if(boost::regex_match(param, what, loop_exp))
+		{
+			if(!what["VALUE"].str().empty())
+				loop_ = boost::lexical_cast<bool>(what["VALUE"].str());
+			promise.set_value(boost::lexical_cast<std::wstring>(loop_));
+		}
+		else if(boost::regex_match(param, what, seek_exp))
+		{
+			// Frames are in memory, so seeking is exact and immediate.
+			position_ = clip_->frame_at(boost::lexical_cast<uint32_t>(what["VALUE"].str()));
+			promise.set_value(L"");
+		}
+		else
+			BOOST_THROW_EXCEPTION(invalid_argument());
+
+		return promise.get_future();
+	}
+				
+	virtual std::wstring print() const override
+	{
+		return L"cached[" + boost::filesystem::path(clip_->filename).filename().wstring() + L"|" 
+						  + print_mode(clip_->width, clip_->height, clip_->fps, !clip_->progressive) + L"|" 
+						  + boost::lexical_cast<std::wstring>(file_frame_number()) + L"/" + boost::lexical_cast<std::wstring>(clip_->file_nb_frames) + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		if(fallback_)
+			return fallback_->info();
+
+		boost::property_tree::wptree info;
+		info.add(L"type",				L"cached-producer");
+		info.add(L"filename",			clip_->filename);
+		info.add(L"width",				clip_->width);
+		info.add(L"height",				clip_->height);
+		info.add(L"progressive",		clip_->progressive);
+		info.add(L"fps",				clip_->fps);
+		info.add(L"loop",				loop_);
+		info.add(L"frame-number",		frame_number_);
+		auto nb_frames2 = nb_frames();
+		info.add(L"nb-frames",			nb_frames2 == std::numeric_limits<uint32_t>::max() ? -1 : static_cast<int64_t>(nb_frames2));
+		info.add(L"file-frame-number",	file_frame_number());
+		info.add(L"file-nb-frames",		clip_->file_nb_frames);
+		return info;
+	}
+
+	void send_osc()
+	{
+		*monitor_subject_	<< core::monitor::message("/file/time")			% (file_frame_number()/clip_->fps) 
+																			% (clip_->file_nb_frames/clip_->fps)
+							<< core::monitor::message("/file/frame")		% static_cast<int32_t>(file_frame_number())
+																			% static_cast<int32_t>(clip_->file_nb_frames)
+							<< core::monitor::message("/file/fps")			% clip_->fps
+							<< core::monitor::message("/file/path")			% boost::filesystem::path(clip_->filename).filename().wstring()
+							<< core::monitor::message("/loop")				% loop_;
+	}
+
+	virtual core::monitor::subject& monitor_output() override
+	{
+		return *monitor_subject_;
+	}
+};
+
+struct clip_cache::implementation : boost::noncopyable
+{
+	struct entry
+	{
+		std::wstring						key;
+		std::shared_ptr<const cached_clip>	clip;
+		bool								pinned;
+		uint64_t							hits;
+	};
+
+	mutable boost::mutex	mutex_;
+	std::list<entry>		entries_; // Most recently used first.
+	size_t					size_;
+	size_t					pending_; // Held by clips being decoded.
+	bool					configured_;
+	size_t					max_size_;
+	uint64_t				evictions_;
+
+	implementation()
+		: size_(0)
+		, pending_(0)
+		, configured_(false)
+		, max_size_(0)
+		, evictions_(0)
+	{
+	}
+
+	// Must be called with mutex_ held.
+	void configure()
+	{
+		if(configured_)
+			return;
+
+		max_size_	= env::properties().get(L"configuration.ffmpeg.clip-cache.max-size-mb", 1024u) * 1024u * 1024u;
+		configured_	= true;
+	}
+
+	static std::wstring resolve(const std::wstring& clip)
+	{
+		auto filename = env::media_folder() + L"\\" + clip;
+		if(!boost::filesystem::exists(filename))
+			filename = probe_stem(filename);
+
+		return filename;
+	}
+
+	static std::wstring to_key(const std::wstring& filename)
+	{
+		return boost::to_upper_copy(boost::filesystem::path(filename).make_preferred().wstring());
+	}
+
+	std::list<entry>::iterator find(const std::wstring& key)
+	{
+		return std::find_if(entries_.begin(), entries_.end(), [&](const entry& e){return e.key == key;});
+	}
+
+	void erase(std::list<entry>::iterator it)
+	{
+		size_ -= it->clip->size;
+		entries_.erase(it);
+	}
+
+	// Must be called with mutex_ held.
+	bool make_room(size_t size)
+	{
+		while(size_ + pending_ + size > max_size_)
+		{
+			auto victim = std::find_if(entries_.rbegin(), entries_.rend(), [](const entry& e){return !e.pinned;});
+			if(victim == entries_.rend())
+				return false;
+
+			CASPAR_LOG(info) << L"[clip_cache] Evicting " << victim->clip->filename;
+			erase(std::next(victim).base());
+			++evictions_;
+		}
+		return true;
+	}
+
+	void add(const std::wstring& clip, const safe_ptr<core::frame_factory>& frame_factory, bool pinned)
+	{
+		auto filename = resolve(clip);
+		if(filename.empty())
+			BOOST_THROW_EXCEPTION(file_not_found() << msg_info(narrow(clip)));
+
+		auto key = to_key(filename);
+
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			configure();
+
+			auto it = find(key);
+			if(it != entries_.end() && frame_factory->get_video_format_desc() == it->clip->format_desc)
+			{
+				it->pinned = it->pinned || pinned;
+				entries_.splice(entries_.begin(), entries_, it);
+				return;
+			}
+		}
+		
+		// The memory held while decoding counts against the budget next to the 
+		// cached clips, which are evicted to make room for it.
+		size_t reserved = 0;
+		auto reserve = [&](size_t size)
+		{
+			if(size <= reserved)
+				return;
+
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			if(!make_room(size - reserved))
+				BOOST_THROW_EXCEPTION(bad_alloc() << msg_info(narrow(filename) + " does not fit in clip-cache, pinned clips use the budget."));
+
+			pending_ += size - reserved;
+			reserved  = size;
+		};
+
+		// Decode outside of the lock, playback of other cached clips continues meanwhile.
+		std::shared_ptr<cached_clip> decoded;
+		try
+		{
+			decoded = decode_clip(filename, frame_factory, reserve);
+		}
+		catch(...)
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			pending_ -= reserved;
+			throw;
+		}
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		pending_ -= reserved;
+
+		auto it = find(key);
+		if(it != entries_.end())
+			erase(it);
+		
+		if(!make_room(decoded->size))
+			BOOST_THROW_EXCEPTION(bad_alloc() << msg_info(narrow(filename) + " does not fit in clip-cache, pinned clips use the budget."));
+
+		entry e;
+		e.key		= key;
+		e.clip		= decoded;
+		e.pinned	= pinned;
+		e.hits		= 0;
+		entries_.push_front(e);
+		size_ += decoded->size;
+	}
+
+	bool remove(const std::wstring& clip)
+	{
+		auto key = to_key(resolve(clip));
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		auto it = find(key);
+		if(it == entries_.end())
+			return false;
+
+		erase(it);
+		return true;
+	}
+
+	bool pin(const std::wstring& clip, bool pinned)
+	{
+		auto key = to_key(resolve(clip));
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		auto it = find(key);
+		if(it == entries_.end())
+			return false;
+
+		it->pinned = pinned;
+		return true;
+	}
+
+	void clear()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		entries_.clear();
+		size_ = 0;
+	}
+
+	safe_ptr<core::frame_producer> create_producer(const safe_ptr<core::frame_factory>& frame_factory, const std::wstring& filename, bool loop, uint32_t start, uint32_t length, const producer_factory& fallback)
+	{
+		std::shared_ptr<const cached_clip> clip;
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+
+			if(entries_.empty())
+				return core::frame_producer::empty();
+
+			auto it = find(to_key(filename));
+			// Frames are converted for one channel format, other channels decode the file.
+			if(it == entries_.end() || frame_factory->get_video_format_desc() != it->clip->format_desc)
+				return core::frame_producer::empty();
+
+			++it->hits;
+			entries_.splice(entries_.begin(), entries_, it);
+			clip = it->clip;
+		}
+
+		// The producer keeps the clip alive even if it is evicted meanwhile.
+		return create_producer_destroy_proxy(make_safe<cached_producer>(clip, loop, start, length, fallback));
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		boost::property_tree::wptree info;
+		info.add(L"max-size",	configured_ ? max_size_ : 0);
+		info.add(L"size",		size_);
+		info.add(L"pending",	pending_);
+		info.add(L"evictions",	evictions_);
+
+		BOOST_FOREACH(auto& e, entries_)
+		{
+			boost::property_tree::wptree clip;
+			clip.add(L"filename",	e.clip->filename);
+			clip.add(L"size",		e.clip->size);
+			clip.add(L"nb-frames",	e.clip->file_nb_frames);
+			clip.add(L"fps",		e.clip->fps);
+			clip.add(L"width",		e.clip->width);
+			clip.add(L"height",		e.clip->height);
+			clip.add(L"pinned",		e.pinned);
+			clip.add(L"hits",		e.hits);
+			info.add_child(L"clips.clip", clip);
+		}
+
+		return info;
+	}
+};
+
+clip_cache::clip_cache() : impl_(new implementation()){}
+void clip_cache::add(const std::wstring& clip, const safe_ptr<core::frame_factory>& frame_factory, bool pinned){impl_->add(clip, frame_factory, pinned);}
+bool clip_cache::remove(const std::wstring& clip){return impl_->remove(clip);}
+bool clip_cache::pin(const std::wstring& clip, bool pinned){return impl_->pin(clip, pinned);}
+void clip_cache::clear(){impl_->clear();}
+boost::property_tree::wptree clip_cache::info() const{return impl_->info();}
+safe_ptr<core::frame_producer> clip_cache::create_producer(const safe_ptr<core::frame_factory>& frame_factory, const std::wstring& filename, bool loop, uint32_t start, uint32_t length, const producer_factory& fallback)
+{
+	return impl_->create_producer(frame_factory, filename, loop, start, length, fallback);
+}
+
+}}
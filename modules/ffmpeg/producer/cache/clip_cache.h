@@ -0,0 +1,81 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace caspar { 
+	
+namespace core {
+
+struct frame_producer;
+struct frame_factory;
+
+}
+
+namespace ffmpeg {
+
+// Keeps clips in RAM as the frames a channel plays (converted write_frames and 
+// their audio at the channel rate), so that short clips such as stings and 
+// bumpers play without disk I/O, decoding or conversion. A cached clip serves 
+// channels of the format it was cached for. Bounded by a memory budget, least
+// recently played clips are evicted first unless pinned. Owned by the server,
+// which clears it before the ogl device goes away.
+//
+// configuration.ffmpeg.clip-cache.max-size-mb
+class clip_cache : boost::noncopyable
+{
+public:
+	typedef std::function<safe_ptr<core::frame_producer>()> producer_factory;
+
+	clip_cache();
+
+	// Decodes and converts the whole clip with the frames of frame_factory, 
+	// blocking until done. The memory held meanwhile counts against the budget.
+	// Throws bad_alloc if the clip does not fit in it.
+	void add(const std::wstring& clip, const safe_ptr<core::frame_factory>& frame_factory, bool pinned);
+	bool remove(const std::wstring& clip);
+	bool pin(const std::wstring& clip, bool pinned);
+	void clear();
+
+	boost::property_tree::wptree info() const;
+	
+	// Returns frame_producer::empty() unless the resolved file is cached for the
+	// channel format. Cached frames are converted without producer hints, so
+	// when a layer passes any (e.g. ALPHA_HINT for a key) the producer has 
+	// "fallback" make one on its own thread and switches to it at the current 
+	// frame once it is open. Until then cached frames are served, or for a key
+	// the last frame is held.
+	safe_ptr<core::frame_producer> create_producer(const safe_ptr<core::frame_factory>& frame_factory, const std::wstring& filename, bool loop, uint32_t start, uint32_t length, const producer_factory& fallback);
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
@@ -27,6 +27,7 @@
 #include "../ffmpeg_error.h"
 #include "../ffmpeg_params.h"
 
+#include "cache/clip_cache.h"
 #include "muxer/frame_muxer.h"
 #include "input/input.h"
 #include "util/util.h"
@@ -142,7 +143,7 @@ public:
 	
 		try
 		{
-			video_decoder_.reset(new video_decoder(input_.context()));
+			video_decoder_.reset(new video_decoder(input_.context(), vid_params.context_pools));
 			if (!thumbnail_mode_)
 				CASPAR_LOG(info) << print() << L" " << video_decoder_->print();
 		}
@@ -165,7 +166,7 @@ public:
 		{
 			try
 			{
-				audio_decoder_.reset(new audio_decoder(input_.context(), frame_factory->get_video_format_desc(), custom_channel_order));
+				audio_decoder_.reset(new audio_decoder(input_.context(), frame_factory->get_video_format_desc(), custom_channel_order, vid_params.audio_streams, vid_params.drift_compensation, vid_params.context_pools));
 				audio_channel_layout = audio_decoder_->channel_layout();
 				CASPAR_LOG(info) << print() << L" " << audio_decoder_->print();
 			}
@@ -183,7 +184,7 @@ public:
 		if(!video_decoder_ && !audio_decoder_)
 			BOOST_THROW_EXCEPTION(averror_stream_not_found() << msg_info("No streams found"));
 
-		muxer_.reset(new frame_muxer(fps_, frame_factory, thumbnail_mode_, audio_channel_layout, filter));
+		muxer_.reset(new frame_muxer(fps_, frame_factory, thumbnail_mode_, audio_channel_layout, filter, true, vid_params.context_pools));
 
 		if ((resource_type_ == FFMPEG_FILE) && (start_ != 0) && (input_.correct_seek_mode())) seek_gop();
 	}
@@ -275,6 +276,9 @@ public:
 		auto disable_logging = temporary_disable_logging_for_thread(thumbnail_mode_);
 				
 		do_decode(hints);
+
+		if(audio_decoder_)
+			audio_decoder_->compensate_drift(muxer_->buffered_audio());
 		
 		graph_->set_value("frame-time", frame_timer_.elapsed()*format_desc_.fps*0.5);
 
@@ -475,6 +479,11 @@ public:
 		info.add(L"nb-frames",			nb_frames2 == std::numeric_limits<int64_t>::max() ? -1 : nb_frames2);
 		info.add(L"file-frame-number",	file_frame_number_);
 		info.add(L"file-nb-frames",		file_nb_frames());
+		auto io_info = input_.io_info();
+		if(!io_info.empty())
+			info.add_child(L"io",		io_info);
+		if(audio_decoder_)
+			info.add_child(L"audio-decoder",	audio_decoder_->info());
 		return info;
 	}
 
@@ -569,6 +578,15 @@ public:
 safe_ptr<core::frame_producer> create_producer(
 		const safe_ptr<core::frame_factory>& frame_factory,
 		const core::parameters& params)
+{
+	return create_producer(frame_factory, params, nullptr, nullptr);
+}
+
+safe_ptr<core::frame_producer> create_producer(
+		const safe_ptr<core::frame_factory>& frame_factory,
+		const core::parameters& params,
+		const std::shared_ptr<clip_cache>& clip_cache,
+		const std::shared_ptr<context_pools>& context_pools)
 {		
 	static const std::vector<std::wstring> invalid_exts = boost::assign::list_of(L".png")(L".tga")(L".bmp")(L".jpg")(L".jpeg")(L".gif")(L".tiff")(L".tif")(L".jp2")(L".jpx")(L".j2k")(L".j2c")(L".swf")(L".ct");
 
@@ -622,6 +640,9 @@ safe_ptr<core::frame_producer> create_producer(
 	boost::replace_all(filter_str, L"DEINTERLACE", L"YADIF=0:-1");
 	
 	ffmpeg_producer_params vid_params;
+	vid_params.audio_streams = params.get(L"AUDIO_STREAMS", L"");
+	vid_params.drift_compensation = params.has(L"DRIFT_COMPENSATION");
+	vid_params.context_pools = context_pools;
 	bool haveFFMPEGStartIndicator = false;
 	for (size_t i = 0; i < params.size() - 1; ++i)
 	{
@@ -638,6 +659,16 @@ safe_ptr<core::frame_producer> create_producer(
 		}
 	}
 
+	// Cached clips hold frames as the channel plays them, anything that changes the conversion decodes the file.
+	if(clip_cache && resource_type == FFMPEG_FILE && filter_str.empty() && vid_params.options.empty() && custom_channel_order.empty() && vid_params.audio_streams.empty() && !vid_params.drift_compensation)
+	{
+		auto cached = clip_cache->create_producer(frame_factory, filename, loop, start, length, [=]
+		{
+			return make_safe<ffmpeg_producer>(frame_factory, filename, resource_type, filter_str, loop, start, length, false, custom_channel_order, vid_params);
+		});
+		if(cached != core::frame_producer::empty())
+			return cached;
+	}
 	
 	return create_producer_destroy_proxy(make_safe<ffmpeg_producer>(frame_factory, filename, resource_type, filter_str, loop, start, length, false, custom_channel_order, vid_params));
 }
@@ -38,9 +38,19 @@ struct frame_factory;
 	
 namespace ffmpeg {
 
+class clip_cache;
+class context_pools;
+
 safe_ptr<core::frame_producer> create_producer(
 		const safe_ptr<core::frame_factory>& frame_factory,
 		const core::parameters& params);
+// Serves files held by clip_cache from memory and reuses decoders and filter
+// graphs of context_pools, either may be null.
+safe_ptr<core::frame_producer> create_producer(
+		const safe_ptr<core::frame_factory>& frame_factory,
+		const core::parameters& params,
+		const std::shared_ptr<clip_cache>& clip_cache,
+		const std::shared_ptr<context_pools>& context_pools);
 safe_ptr<core::frame_producer> create_thumbnail_producer(
 		const safe_ptr<core::frame_factory>& frame_factory,
 		const core::parameters& params);
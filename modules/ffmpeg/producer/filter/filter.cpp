@@ -25,6 +25,7 @@
 
 #include "../../ffmpeg_error.h"
 #include "../../ffmpeg.h"
+#include "../util/context_pool.h"
 
 #include <common/exception/exceptions.h>
 
@@ -61,6 +62,55 @@ extern "C"
 #endif
 
 namespace caspar { namespace ffmpeg {
+
+struct pooled_filter_graph
+{
+	std::shared_ptr<AVFilterGraph>	graph;
+	AVFilterContext*				in;
+	AVFilterContext*				out;
+};
+
+// Filters that work on each frame on its own. Anything else, e.g. 
+// deinterlacers, frame rate converters, temporal denoisers or filters with
+// expressions of the frame number or time, keeps state a pooled graph would
+// carry over to the next producer.
+static const char* STATELESS_FILTERS[] = 
+{
+	"null", "copy", "format", "noformat", "scale", "pad", "hflip", "vflip", "transpose", 
+	"setsar", "setdar", "negate", "lut", "lutrgb", "lutyuv", "colorchannelmixer", "colorlevels", 
+	"colormatrix", "boxblur", "unsharp", "gradfun"
+};
+
+bool filter::is_poolable(const std::string& filters)
+{
+	std::vector<std::string> chains;
+	boost::split(chains, filters, boost::is_any_of(",;"));
+
+	BOOST_FOREACH(auto& chain, chains)
+	{
+		// [in]name@instance=args[out]
+		auto name = boost::trim_copy(chain);
+		while(!name.empty() && name[0] == '[')
+		{
+			auto end = name.find(']');
+			name = end == std::string::npos ? "" : boost::trim_copy(name.substr(end + 1));
+		}
+		name = boost::to_lower_copy(name.substr(0, name.find_first_of("=@[ ")));
+
+		if(name.empty())
+			continue;
+
+		auto known = std::find_if(std::begin(STATELESS_FILTERS), std::end(STATELESS_FILTERS), [&](const char* stateless)
+		{
+			return name == stateless;
+		});
+
+		if(known == std::end(STATELESS_FILTERS))
+			return false;
+	}
+
+	return true;
+}
 	
 struct filter::implementation
 {
@@ -68,6 +118,8 @@ struct filter::implementation
 	std::shared_ptr<AVFilterGraph>	video_graph_;	
     AVFilterContext*				video_graph_in_;  
     AVFilterContext*				video_graph_out_; 
+	std::weak_ptr<context_pools>	context_pools_;
+	std::string						pool_key_;
 		
 	implementation(
 		int in_width,
@@ -78,8 +130,10 @@ struct filter::implementation
 		AVPixelFormat in_pix_fmt,
 		std::vector<AVPixelFormat> out_pix_fmts,
 		const std::string& filtergraph,
-		bool multithreaded) 
+		bool multithreaded,
+		const std::shared_ptr<context_pools>& context_pools) 
 		: filtergraph_(boost::to_lower_copy(filtergraph))
+		, context_pools_(context_pools)
 	{
 		if(out_pix_fmts.empty())
 		{
@@ -98,6 +152,31 @@ struct filter::implementation
 
 		out_pix_fmts.push_back(AV_PIX_FMT_NONE);
 
+		const auto vsrc_options = (boost::format("video_size=%1%x%2%:pix_fmt=%3%:time_base=%4%/%5%:pixel_aspect=%6%/%7%:frame_rate=%8%/%9%")
+			% in_width % in_height
+			% in_pix_fmt
+			% in_time_base.numerator() % in_time_base.denominator()
+			% in_sample_aspect_ratio.numerator() % in_sample_aspect_ratio.denominator()
+			% in_frame_rate.numerator() % in_frame_rate.denominator()).str();
+
+		if(context_pools && is_poolable(filtergraph_))
+		{
+			std::ostringstream key;
+			key << vsrc_options << "|" << filtergraph_ << "|" << multithreaded;
+			BOOST_FOREACH(auto pix_fmt, out_pix_fmts)
+				key << "|" << pix_fmt;
+			pool_key_ = key.str();
+
+			auto pooled = context_pools->filter().try_take<pooled_filter_graph>(pool_key_);
+			if(pooled)
+			{
+				video_graph_		= pooled->graph;
+				video_graph_in_		= pooled->in;
+				video_graph_out_	= pooled->out;
+				return;
+			}
+		}
+
 		video_graph_.reset(
 			avfilter_graph_alloc(), 
 			[](AVFilterGraph* p)
@@ -115,13 +194,6 @@ struct filter::implementation
 			video_graph_->nb_threads  = 1;
 		}
 
-		const auto vsrc_options = (boost::format("video_size=%1%x%2%:pix_fmt=%3%:time_base=%4%/%5%:pixel_aspect=%6%/%7%:frame_rate=%8%/%9%")
-			% in_width % in_height
-			% in_pix_fmt
-			% in_time_base.numerator() % in_time_base.denominator()
-			% in_sample_aspect_ratio.numerator() % in_sample_aspect_ratio.denominator()
-			% in_frame_rate.numerator() % in_frame_rate.denominator()).str();
-					
 		AVFilterContext* filt_vsrc = nullptr;			
 		FF(avfilter_graph_create_filter(
 			&filt_vsrc,
@@ -166,6 +238,30 @@ struct filter::implementation
 					video_graph_.get(), nullptr));
 	}
 	
+	~implementation()
+	{
+		auto context_pools = context_pools_.lock();
+		if(pool_key_.empty() || !video_graph_ || !context_pools)
+			return;
+
+		try
+		{
+			// Drop whatever is still queued so the next user starts empty.
+			while(poll())
+				;
+
+			auto pooled = std::make_shared<pooled_filter_graph>();
+			pooled->graph	= video_graph_;
+			pooled->in		= video_graph_in_;
+			pooled->out		= video_graph_out_;
+			context_pools->filter().give(pool_key_, pooled);
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+	}
+	
 	void configure_filtergraph(
 		AVFilterGraph& graph, 
 		const std::string& filtergraph, 
@@ -260,7 +356,8 @@ filter::filter(
 		AVPixelFormat in_pix_fmt,
 		std::vector<AVPixelFormat> out_pix_fmts,
 		const std::string& filtergraph,
-		bool multithreaded) 
+		bool multithreaded,
+		const std::shared_ptr<context_pools>& context_pools) 
 		: impl_(new implementation(
 			in_width,
 			in_height,
@@ -270,7 +367,8 @@ filter::filter(
 			in_pix_fmt,
 			out_pix_fmts,
 			filtergraph,
-			multithreaded)){}
+			multithreaded,
+			context_pools)){}
 filter::filter(filter&& other) : impl_(std::move(other.impl_)){}
 filter& filter::operator=(filter&& other){impl_ = std::move(other.impl_); return *this;}
 void filter::push(const std::shared_ptr<AVFrame>& frame){impl_->push(frame);}
@@ -35,6 +35,8 @@ enum AVPixelFormat;
 
 namespace caspar { namespace ffmpeg {
 
+class context_pools;
+
 static std::wstring append_filter(const std::wstring& filters, const std::wstring& filter)
 {
 	return filters + (filters.empty() ? L"" : L",") + filter;
@@ -52,7 +54,8 @@ public:
 		AVPixelFormat in_pix_fmt,
 		std::vector<AVPixelFormat> out_pix_fmts,
 		const std::string& filtergraph,
-		bool multithreaded = true);
+		bool multithreaded = true,
+		const std::shared_ptr<context_pools>& context_pools = nullptr);
 	filter(filter&& other);
 	filter& operator=(filter&& other);
 
@@ -82,6 +85,10 @@ public:
 			return true;	
 		return false;
 	}	
+
+	// Whether a graph can be handed from one producer to the next, i.e. it
+	// only has filters known to keep no frames or state between calls.
+	static bool is_poolable(const std::string& filters);
 	
 	static int delay(const std::wstring& filters)
 	{
@@ -22,6 +22,7 @@
 #include "../../stdafx.h"
 
 #include "input.h"
+#include "read_ahead_io.h"
 
 #include "../util/util.h"
 #include "../util/flv.h"
@@ -72,6 +73,7 @@ struct input::implementation : boost::noncopyable
 {		
 	const safe_ptr<diagnostics::graph>							graph_;
 
+	std::shared_ptr<read_ahead_io>								io_;
 	const safe_ptr<AVFormatContext>								format_context_; // Destroy this last
 	const int													default_stream_index_;
 			
@@ -273,6 +275,14 @@ struct input::implementation : boost::noncopyable
 
 		switch (resource_type) {
 			case FFMPEG_FILE:
+				if(is_read_ahead_enabled(resource_name))
+				{
+					io_.reset(new read_ahead_io(graph_, resource_name));
+					weak_context = avformat_alloc_context();
+					if(!weak_context)
+						BOOST_THROW_EXCEPTION(bad_alloc() << msg_info("avformat_alloc_context"));
+					weak_context->pb = io_->context();
+				}
 				THROW_ON_ERROR2(avformat_open_input(&weak_context, narrow(resource_name).c_str(), nullptr, nullptr), resource_name);
 				break;
 			case FFMPEG_DEVICE: {
@@ -321,12 +331,29 @@ struct input::implementation : boost::noncopyable
 				av_dict_free(&format_options);
 			} break;
 		};
-		safe_ptr<AVFormatContext> context(weak_context, av_close_input_file);      
+		auto io = io_;
+		safe_ptr<AVFormatContext> context(weak_context, [io](AVFormatContext* context)
+		{
+			av_close_input_file(context); // Custom I/O is not closed by ffmpeg and must outlive the context.
+		});      
 		THROW_ON_ERROR2(avformat_find_stream_info(weak_context, nullptr), resource_name);
 		fix_meta_data(*context);
+		if(io_)
+			io_->set_bit_rate(get_bit_rate(*context));
 		return context;
 	}
 
+	int64_t get_bit_rate(const AVFormatContext& context)
+	{
+		if(context.bit_rate > 0)
+			return context.bit_rate;
+
+		if(context.duration > 0 && context.pb)
+			return avio_size(context.pb) * 8 * AV_TIME_BASE / context.duration;
+
+		return 0;
+	}
+
   void fix_meta_data(AVFormatContext& context)
   {
     auto video_index = av_find_best_stream(&context, AVMEDIA_TYPE_VIDEO, -1, -1, 0, 0);
@@ -418,4 +445,5 @@ void input::loop(bool value){impl_->loop_ = value;}
 bool input::loop() const{return impl_->loop_;}
 boost::unique_future<bool> input::seek(uint32_t target){return impl_->seek(target);}
 bool input::correct_seek_mode() {return impl_->correct_seek_mode_;}
+boost::property_tree::wptree input::io_info() const{return impl_->io_ ? impl_->io_->info() : boost::property_tree::wptree();}
 }}
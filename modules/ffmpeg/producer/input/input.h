@@ -29,6 +29,7 @@
 #include <cstdint>
 
 #include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
 #include <boost/thread/future.hpp>
 
 struct AVFormatContext;
@@ -58,6 +59,8 @@ public:
 	boost::unique_future<bool> seek(uint32_t target);
 	bool correct_seek_mode();
 
+	boost::property_tree::wptree io_info() const;
+
 	safe_ptr<AVFormatContext> context();
 private:
 	struct implementation;
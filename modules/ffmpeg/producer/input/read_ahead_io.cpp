@@ -0,0 +1,440 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "read_ahead_io.h"
+
+#include "../../ffmpeg_error.h"
+
+#include <common/env.h>
+#include <common/diagnostics/graph.h>
+#include <common/exception/win32_exception.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/timer.hpp>
+
+#include <cstring>
+#include <map>
+#include <set>
+#include <vector>
+
+#if defined(_MSC_VER)
+#pragma warning (push)
+#pragma warning (disable : 4244)
+#endif
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavformat/avformat.h>
+	#include <libavformat/avio.h>
+}
+#if defined(_MSC_VER)
+#pragma warning (pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+static const int		AVIO_BUFFER_SIZE	= 64 * 1024;
+static const size_t		BLOCK_ALIGNMENT		= 64 * 1024;
+static const size_t		MIN_WINDOW_BLOCKS	= 4;
+static const size_t		DEFAULT_WINDOW_SIZE = 16 * 1024 * 1024; // Until the bitrate is known.
+static const int		READ_RETRIES		= 3;
+static const int		RETRY_DELAY_MS		= 100; // Doubled for every retry.
+
+struct read_ahead_io::implementation : boost::noncopyable
+{
+	typedef std::vector<uint8_t>	block_t;
+
+	const safe_ptr<diagnostics::graph>			graph_;
+	const std::wstring							filename_;
+	const std::shared_ptr<void>					handle_;
+	const int64_t								file_size_;
+	const size_t								block_size_;
+	const size_t								max_window_blocks_;
+	const double								window_seconds_;
+
+	mutable boost::mutex						mutex_;
+	boost::condition_variable					cond_;
+	std::map<int64_t, std::shared_ptr<block_t>>	blocks_;
+	int64_t										position_;
+	size_t										window_blocks_;
+	int64_t										byte_rate_;
+	bool										running_;
+	std::set<int64_t>							failed_blocks_; // Until the next read of the block or a seek.
+
+	uint64_t									bytes_read_;
+	double										read_time_;
+	double										stall_time_;
+	uint64_t									stalls_;
+	uint64_t									read_errors_;
+
+	std::shared_ptr<AVIOContext>				context_;
+	boost::thread								thread_;
+
+	implementation(const safe_ptr<diagnostics::graph>& graph, const std::wstring& filename)
+		: graph_(graph)
+		, filename_(filename)
+		, handle_(open_file(filename), CloseHandle)
+		, file_size_(get_file_size(handle_.get()))
+		, block_size_(get_block_size())
+		, max_window_blocks_(std::max(MIN_WINDOW_BLOCKS, static_cast<size_t>(env::properties().get(L"configuration.ffmpeg.read-ahead.max-size", 256)) * 1024 * 1024 / block_size_))
+		, window_seconds_(env::properties().get(L"configuration.ffmpeg.read-ahead.seconds", 4.0))
+		, position_(0)
+		, window_blocks_(std::min(max_window_blocks_, std::max(MIN_WINDOW_BLOCKS, DEFAULT_WINDOW_SIZE / block_size_)))
+		, byte_rate_(0)
+		, running_(true)
+		, bytes_read_(0)
+		, read_time_(0.0)
+		, stall_time_(0.0)
+		, stalls_(0)
+		, read_errors_(0)
+	{
+		auto buffer = reinterpret_cast<unsigned char*>(av_malloc(AVIO_BUFFER_SIZE));
+		if(!buffer)
+			BOOST_THROW_EXCEPTION(bad_alloc() << msg_info("avio_alloc_context"));
+
+		auto context = avio_alloc_context(buffer, AVIO_BUFFER_SIZE, 0, this, &read_callback, nullptr, &seek_callback);
+		if(!context)
+		{
+			av_free(buffer);
+			BOOST_THROW_EXCEPTION(bad_alloc() << msg_info("avio_alloc_context"));
+		}
+		context->seekable = AVIO_SEEKABLE_NORMAL;
+
+		context_.reset(context, [](AVIOContext* context)
+		{
+			av_free(context->buffer);
+			av_free(context);
+		});
+
+		graph_->set_color("io-buffer", diagnostics::color(0.3f, 0.6f, 0.9f));
+		graph_->set_color("io-load", diagnostics::color(0.9f, 0.6f, 0.3f));
+		graph_->set_color("io-stall", diagnostics::color(1.0f, 0.2f, 0.2f));
+
+		thread_ = boost::thread([this]{run();});
+	}
+
+	~implementation()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			running_ = false;
+		}
+		cond_.notify_all();
+		thread_.join();
+
+		CASPAR_LOG(debug) << print() << L" Read " << bytes_read_/(1024*1024) << L" MiB at " << throughput()/(1024.0*1024.0) 
+						  << L" MiB/s, stalled " << stalls_ << L" times for " << static_cast<int>(stall_time_*1000.0) << L" ms.";
+	}
+
+	static HANDLE open_file(const std::wstring& filename)
+	{
+		// FILE_FLAG_SEQUENTIAL_SCAN is the Win32 counterpart of POSIX_FADV_SEQUENTIAL, 
+		// it makes the cache manager read ahead more aggressively and drop pages behind us.
+		auto handle = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if(handle == INVALID_HANDLE_VALUE)
+			BOOST_THROW_EXCEPTION(file_read_error() << msg_info(narrow(filename)) << boost::errinfo_api_function("CreateFileW") << boost::errinfo_errno(GetLastError()));
+		return handle;
+	}
+
+	static int64_t get_file_size(HANDLE handle)
+	{
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(handle, &size))
+			BOOST_THROW_EXCEPTION(file_read_error() << boost::errinfo_api_function("GetFileSizeEx") << boost::errinfo_errno(GetLastError()));
+		return size.QuadPart;
+	}
+
+	static size_t get_block_size()
+	{
+		auto block_size = static_cast<size_t>(env::properties().get(L"configuration.ffmpeg.read-ahead.block-size", 1024)) * 1024;
+		return std::max(BLOCK_ALIGNMENT, block_size - block_size % BLOCK_ALIGNMENT);
+	}
+
+	std::wstring print() const
+	{
+		return L"read_ahead_io[" + boost::filesystem::path(filename_).filename().wstring() + L"]";
+	}
+
+	double throughput() const
+	{
+		return read_time_ > 0.0 ? bytes_read_ / read_time_ : 0.0;
+	}
+
+	void set_bit_rate(int64_t bit_rate)
+	{
+		if(bit_rate <= 0)
+			return;
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		byte_rate_		= bit_rate / 8;
+		auto blocks		= static_cast<size_t>(byte_rate_ * window_seconds_ / block_size_) + 1;
+		window_blocks_	= std::min(max_window_blocks_, std::max(MIN_WINDOW_BLOCKS, blocks));
+
+		CASPAR_LOG(debug) << print() << L" Window: " << window_blocks_ << L" x " << block_size_/1024 << L" KiB.";
+
+		cond_.notify_all();
+	}
+
+	// I/O thread
+
+	void run()
+	{
+		win32_exception::install_handler();
+
+		while(true)
+		{
+			int64_t index;
+			{
+				boost::unique_lock<boost::mutex> lock(mutex_);
+
+				while(running_ && (index = next_missing_block()) < 0)
+					cond_.wait(lock);
+
+				if(!running_)
+					return;
+			}
+
+			auto block = std::make_shared<block_t>(static_cast<size_t>(std::min<int64_t>(block_size_, file_size_ - index * block_size_)));
+
+			// Network shares fail transiently, so retry before giving up.
+			boost::timer timer;
+			auto result = read_block(index * block_size_, *block);
+			for(int retry = 0; !result && retry < READ_RETRIES; ++retry)
+			{
+				if(!wait_for_retry(RETRY_DELAY_MS << retry))
+					return;
+				result = read_block(index * block_size_, *block);
+			}
+			auto elapsed = timer.elapsed();
+
+			{
+				boost::lock_guard<boost::mutex> lock(mutex_);
+
+				if(result)
+				{
+					blocks_[index]	= block;
+					bytes_read_		+= block->size();
+					read_time_		+= elapsed;
+				}
+				else
+				{
+					failed_blocks_.insert(index);
+					++read_errors_;
+				}
+				
+				update_graph();
+			}
+			cond_.notify_all();
+		}
+	}
+
+	bool wait_for_retry(int milliseconds)
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		auto deadline = boost::get_system_time() + boost::posix_time::milliseconds(milliseconds);
+		while(running_ && cond_.timed_wait(lock, deadline))
+		{
+		}
+
+		return running_;
+	}
+
+	bool read_block(int64_t offset, block_t& block)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset		= static_cast<DWORD>(offset & 0xFFFFFFFF);
+		overlapped.OffsetHigh	= static_cast<DWORD>(offset >> 32);
+
+		DWORD read = 0;
+		if(!ReadFile(handle_.get(), block.data(), static_cast<DWORD>(block.size()), &read, &overlapped) || read != block.size())
+		{
+			CASPAR_LOG(error) << print() << L" Failed to read at offset " << offset << L". Error: " << GetLastError();
+			return false;
+		}
+
+		return true;
+	}
+
+	int64_t next_missing_block()
+	{
+		auto first	= position_ / block_size_;
+		auto last	= std::min<int64_t>(first + window_blocks_, (file_size_ + block_size_ - 1) / block_size_);
+
+		// Keep one block behind the read position for short backward seeks.
+		auto it = blocks_.begin();
+		while(it != blocks_.end())
+		{
+			if(it->first < first - 1 || it->first >= last)
+				it = blocks_.erase(it);
+			else
+				++it;
+		}
+
+		failed_blocks_.erase(failed_blocks_.begin(), failed_blocks_.lower_bound(first - 1));
+
+		// A failed block waits for the demuxer to ask for it again, the rest
+		// of the window is read meanwhile.
+		for(auto index = first; index < last; ++index)
+		{
+			if(blocks_.find(index) == blocks_.end() && failed_blocks_.find(index) == failed_blocks_.end())
+				return index;
+		}
+
+		return -1;
+	}
+
+	void update_graph()
+	{
+		size_t ahead = 0;
+		for(auto it = blocks_.lower_bound(position_ / block_size_); it != blocks_.end(); ++it)
+			ahead += it->second->size();
+
+		graph_->set_value("io-buffer", static_cast<double>(ahead)/(window_blocks_ * block_size_));
+
+		// 1.0 means that the storage is only just able to keep up with the stream.
+		auto rate = throughput();
+		if(byte_rate_ > 0 && rate > 0.0)
+			graph_->set_value("io-load", std::min(1.0, byte_rate_ / rate));
+	}
+
+	// Demuxer thread
+		
+	int read(uint8_t* buf, int buf_size)
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		if(position_ >= file_size_)
+			return AVERROR_EOF;
+
+		auto index = position_ / block_size_;
+		auto it	   = blocks_.find(index);
+
+		if(it == blocks_.end())
+		{
+			boost::timer timer;
+			cond_.notify_all();
+			while(failed_blocks_.find(index) == failed_blocks_.end() && (it = blocks_.find(index)) == blocks_.end())
+				cond_.wait(lock);
+
+			// The very first read of the file is not a stall.
+			if(position_ > 0)
+			{
+				stall_time_ += timer.elapsed();
+				++stalls_;
+				graph_->set_tag("io-stall");
+			}
+		}
+
+		if(it == blocks_.end())
+		{
+			// Report this read as failed but try the block again on the next one.
+			failed_blocks_.erase(index);
+			cond_.notify_all();
+			return AVERROR(EIO);
+		}
+
+		auto offset = static_cast<size_t>(position_ - index * block_size_);
+		auto size	= std::min(static_cast<size_t>(buf_size), it->second->size() - offset);
+
+		std::memcpy(buf, it->second->data() + offset, size);
+		position_ += size;
+
+		if(position_ / block_size_ != index)
+			cond_.notify_all();
+		
+		return static_cast<int>(size);
+	}
+
+	int64_t seek(int64_t offset, int whence)
+	{
+		if(whence & AVSEEK_SIZE)
+			return file_size_;
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		switch(whence & ~AVSEEK_FORCE)
+		{
+		case SEEK_SET:	break;
+		case SEEK_CUR:	offset += position_;	break;
+		case SEEK_END:	offset += file_size_;	break;
+		default:		return AVERROR(EINVAL);
+		}
+
+		if(offset < 0)
+			return AVERROR(EINVAL);
+
+		position_ = offset;
+		failed_blocks_.clear();
+		cond_.notify_all();
+
+		return position_;
+	}
+
+	static int read_callback(void* opaque, uint8_t* buf, int buf_size)
+	{
+		return static_cast<implementation*>(opaque)->read(buf, buf_size);
+	}
+
+	static int64_t seek_callback(void* opaque, int64_t offset, int whence)
+	{
+		return static_cast<implementation*>(opaque)->seek(offset, whence);
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		boost::property_tree::wptree info;
+		info.add(L"block-size",		block_size_);
+		info.add(L"window-blocks",	window_blocks_);
+		info.add(L"bytes-read",		bytes_read_);
+		info.add(L"throughput",		throughput());
+		info.add(L"stalls",			stalls_);
+		info.add(L"stall-time",		stall_time_);
+		info.add(L"read-errors",	read_errors_);
+		return info;
+	}
+};
+
+read_ahead_io::read_ahead_io(const safe_ptr<diagnostics::graph>& graph, const std::wstring& filename) : impl_(new implementation(graph, filename)){}
+AVIOContext* read_ahead_io::context(){return impl_->context_.get();}
+void read_ahead_io::set_bit_rate(int64_t bit_rate){impl_->set_bit_rate(bit_rate);}
+boost::property_tree::wptree read_ahead_io::info() const{return impl_->info();}
+
+bool is_read_ahead_enabled(const std::wstring& filename)
+{
+	if(!env::properties().get(L"configuration.ffmpeg.read-ahead.enabled", true))
+		return false;
+
+	boost::system::error_code ec;
+	return boost::filesystem::is_regular_file(filename, ec);
+}
+
+}}
@@ -0,0 +1,71 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstdint>
+#include <string>
+
+struct AVIOContext;
+
+namespace caspar {
+
+namespace diagnostics {
+
+class graph;
+
+}
+
+namespace ffmpeg {
+
+// Custom AVIOContext for local and network (SMB) files. A dedicated I/O thread
+// reads large block aligned chunks ahead of the demuxer, so that av_read_frame
+// is served from memory and share jitter is absorbed by the read-ahead window.
+//
+// configuration.ffmpeg.read-ahead.enabled
+// configuration.ffmpeg.read-ahead.seconds		(window, in seconds of media)
+// configuration.ffmpeg.read-ahead.block-size	(KiB)
+// configuration.ffmpeg.read-ahead.max-size		(MiB)
+class read_ahead_io : boost::noncopyable
+{
+public:
+	read_ahead_io(const safe_ptr<diagnostics::graph>& graph, const std::wstring& filename);
+
+	// Must outlive the AVFormatContext using it.
+	AVIOContext* context();
+
+	// Sizes the read-ahead window once the bitrate of the file is known.
+	void set_bit_rate(int64_t bit_rate);
+
+	boost::property_tree::wptree info() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+bool is_read_ahead_enabled(const std::wstring& filename);
+
+}}
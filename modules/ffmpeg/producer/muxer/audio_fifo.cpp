@@ -0,0 +1,194 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../StdAfx.h"
+
+#include "audio_fifo.h"
+
+#include <common/exception/exceptions.h>
+#include <common/utility/assert.h>
+
+#include <core/video_format.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+size_t next_power_of_two(size_t value)
+{
+	size_t result = 1;
+	while(result < value)
+		result <<= 1;
+	return result;
+}
+
+}
+
+audio_fifo::audio_fifo(size_t num_channels, size_t initial_capacity)
+	: num_channels_(std::max<size_t>(1, num_channels))
+	, buffer_(next_power_of_two(std::max<size_t>(initial_capacity, 1024)))
+	, mask_(buffer_.size() - 1)
+	, head_(0)
+	, tail_(0)
+{
+}
+
+void audio_fifo::reserve(size_t count)
+{
+	auto used = static_cast<size_t>(tail_ - head_);
+	if(used + count <= buffer_.size())
+		return;
+
+	buffer_t buffer(next_power_of_two(used + count));
+	auto mask = buffer.size() - 1;
+
+	// Positions are absolute, so every sample keeps its position and only
+	// moves to where the new mask puts it.
+	for(auto pos = head_; pos < tail_;)
+	{
+		auto from	= static_cast<size_t>(pos & mask_);
+		auto to		= static_cast<size_t>(pos & mask);
+		auto run	= std::min(std::min(buffer_.size() - from, buffer.size() - to), static_cast<size_t>(tail_ - pos));
+
+		std::memcpy(buffer.data() + to, buffer_.data() + from, run * sizeof(int32_t));
+		pos += run;
+	}
+
+	buffer_.swap(buffer);
+	mask_ = mask;
+}
+
+void audio_fifo::push(const int32_t* samples, size_t count)
+{
+	CASPAR_VERIFY(count % num_channels_ == 0);
+
+	reserve(count);
+
+	while(count > 0)
+	{
+		auto to		= static_cast<size_t>(tail_ & mask_);
+		auto run	= std::min(buffer_.size() - to, count);
+
+		std::memcpy(buffer_.data() + to, samples, run * sizeof(int32_t));
+
+		samples += run;
+		count	-= run;
+		tail_	+= run;
+	}
+}
+
+void audio_fifo::push_silence(size_t count)
+{
+	CASPAR_VERIFY(count % num_channels_ == 0);
+
+	reserve(count);
+
+	while(count > 0)
+	{
+		auto to		= static_cast<size_t>(tail_ & mask_);
+		auto run	= std::min(buffer_.size() - to, count);
+
+		std::memset(buffer_.data() + to, 0, run * sizeof(int32_t));
+
+		count	-= run;
+		tail_	+= run;
+	}
+}
+
+void audio_fifo::push_flush()
+{
+	flushes_.push_back(tail_);
+}
+
+size_t audio_fifo::size() const
+{
+	return static_cast<size_t>((flushes_.empty() ? tail_ : flushes_.front()) - head_);
+}
+
+size_t audio_fifo::back_size() const
+{
+	return static_cast<size_t>(tail_ - (flushes_.empty() ? head_ : flushes_.back()));
+}
+
+size_t audio_fifo::segments() const
+{
+	return flushes_.size() + 1;
+}
+
+size_t audio_fifo::capacity() const
+{
+	return buffer_.size();
+}
+
+size_t audio_fifo::num_channels() const
+{
+	return num_channels_;
+}
+
+audio_fifo::view audio_fifo::peek(size_t count) const
+{
+	CASPAR_VERIFY(count <= size());
+
+	auto from	= static_cast<size_t>(head_ & mask_);
+	auto first	= std::min(buffer_.size() - from, count);
+
+	view result;
+	result.data[0] = buffer_.data() + from;
+	result.size[0] = first;
+	result.data[1] = buffer_.data();
+	result.size[1] = count - first;
+	return result;
+}
+
+void audio_fifo::pop(size_t count)
+{
+	CASPAR_VERIFY(count <= size());
+
+	head_ += count;
+}
+
+void audio_fifo::pop_segment()
+{
+	if(flushes_.empty())
+	{
+		head_ = tail_;
+		return;
+	}
+
+	head_ = flushes_.front();
+	flushes_.pop_front();
+}
+
+void audio_fifo::read(size_t count, core::audio_buffer& dest)
+{
+	auto samples = peek(count);
+
+	dest.resize(count);
+	std::memcpy(dest.data(), samples.data[0], samples.size[0] * sizeof(int32_t));
+	std::memcpy(dest.data() + samples.size[0], samples.data[1], samples.size[1] * sizeof(int32_t));
+
+	pop(count);
+}
+
+}}
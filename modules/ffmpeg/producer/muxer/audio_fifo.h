@@ -0,0 +1,80 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <core/mixer/audio/audio_mixer.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace caspar { namespace ffmpeg {
+
+// Ring buffer of interleaved samples. Flushes are kept in-band as positions
+// in the stream, everything up to the first flush is the front segment and
+// the only one that can be read. Storage is preallocated and only grows
+// (doubling) when a segment runs far ahead of the video.
+class audio_fifo : boost::noncopyable
+{
+public:
+	// Up to two contiguous ranges, the second one is used when the samples
+	// wrap around the end of the ring.
+	struct view
+	{
+		const int32_t*	data[2];
+		size_t			size[2];
+	};
+
+	audio_fifo(size_t num_channels, size_t initial_capacity);
+
+	void push(const int32_t* samples, size_t count);
+	void push_silence(size_t count);
+	void push_flush();
+
+	size_t	size() const;		// Samples in the front segment.
+	size_t	back_size() const;	// Samples in the segment being pushed to.
+	size_t	segments() const;
+	size_t	capacity() const;
+	size_t	num_channels() const;
+
+	view	peek(size_t count) const;
+	void	pop(size_t count);
+	void	pop_segment();		// Drops what is left of the front segment.
+
+	// Copies count samples of the front segment into dest, reusing its storage.
+	void	read(size_t count, core::audio_buffer& dest);
+private:
+	void reserve(size_t count);
+
+	typedef std::vector<int32_t, tbb::cache_aligned_allocator<int32_t>> buffer_t;
+
+	const size_t		num_channels_;
+	buffer_t			buffer_;
+	size_t				mask_;
+	uint64_t			head_;
+	uint64_t			tail_;
+	std::deque<uint64_t> flushes_;
+};
+
+}}
@@ -22,6 +22,7 @@
 #include "../../StdAfx.h"
 
 #include "frame_muxer.h"
+#include "audio_fifo.h"
 
 #include "../filter/filter.h"
 #include "../util/util.h"
@@ -54,7 +55,6 @@ extern "C"
 #endif
 
 #include <boost/foreach.hpp>
-#include <boost/range/algorithm_ext/push_back.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
 #include <deque>
@@ -68,7 +68,6 @@ namespace caspar { namespace ffmpeg {
 struct frame_muxer::implementation : boost::noncopyable
 {	
 	std::queue<std::queue<safe_ptr<write_frame>>>	video_streams_;
-	std::queue<core::audio_buffer>					audio_streams_;
 	std::queue<safe_ptr<basic_frame>>				frame_buffer_;
 	display_mode::type								display_mode_;
 	const double									in_fps_;
@@ -77,6 +76,7 @@ struct frame_muxer::implementation : boost::noncopyable
 	bool											auto_deinterlace_;
 	
 	std::vector<size_t>								audio_cadence_;
+	audio_fifo										audio_fifo_;
 			
 	safe_ptr<core::frame_factory>					frame_factory_;
 	
@@ -86,6 +86,7 @@ struct frame_muxer::implementation : boost::noncopyable
 	const bool										thumbnail_mode_;
 	bool											force_deinterlacing_;
 	const core::channel_layout						audio_channel_layout_;
+	const std::shared_ptr<context_pools>			context_pools_;
 		
 	implementation(
 			double in_fps,
@@ -93,22 +94,24 @@ struct frame_muxer::implementation : boost::noncopyable
 			const std::wstring& filter_str,
 			bool multithreaded_filter,
 			bool thumbnail_mode,
-			const core::channel_layout& audio_channel_layout)
+			const core::channel_layout& audio_channel_layout,
+			const std::shared_ptr<context_pools>& context_pools)
 		: display_mode_(display_mode::invalid)
 		, in_fps_(in_fps)
 		, format_desc_(frame_factory->get_video_format_desc())
 		, auto_transcode_(env::properties().get(L"configuration.auto-transcode", true))
 		, auto_deinterlace_(env::properties().get(L"configuration.auto-deinterlace", true))
 		, audio_cadence_(format_desc_.audio_cadence)
+		, audio_fifo_(audio_channel_layout.num_channels, 8 * format_desc_.audio_cadence.front() * audio_channel_layout.num_channels)
 		, frame_factory_(frame_factory)
 		, filter_str_(filter_str)
 		, multithreaded_filter_(multithreaded_filter)
 		, thumbnail_mode_(thumbnail_mode)
 		, force_deinterlacing_(false)
 		, audio_channel_layout_(audio_channel_layout)
+		, context_pools_(context_pools)
 	{
 		video_streams_.push(std::queue<safe_ptr<write_frame>>());
-		audio_streams_.push(core::audio_buffer());
 		
 		// Note: Uses 1 step rotated cadence for 1001 modes (1602, 1602, 1601, 1602, 1601)
 		// This cadence fills the audio mixer most optimally.
@@ -166,6 +169,60 @@ struct frame_muxer::implementation : boost::noncopyable
 			BOOST_THROW_EXCEPTION(invalid_operation() << source_info("frame_muxer") << msg_info("video-stream overflow. This can be caused by incorrect frame-rate. Check clip meta-data."));
 	}
 
+	display_mode::type get_bypass_display_mode(core::field_mode::type field_mode, int height) const
+	{
+		if(!auto_transcode_)
+			return display_mode::simple;
+
+		auto mode = get_display_mode(field_mode, in_fps_, format_desc_.field_mode, format_desc_.fps);
+
+		if(mode == display_mode::simple && field_mode != core::field_mode::progressive && format_desc_.field_mode != core::field_mode::progressive && 
+				height != static_cast<int>(format_desc_.height))
+			mode = display_mode::deinterlace_bob_reinterlace;
+
+		return mode;
+	}
+
+	bool can_bypass_filter(core::field_mode::type field_mode, int height, int hints) const
+	{
+		if(!filter_str_.empty())
+			return false;
+
+		if(auto_deinterlace_ && (hints & core::frame_producer::DEINTERLACE_HINT) && field_mode != core::field_mode::progressive)
+			return false;
+
+		switch(get_bypass_display_mode(field_mode, height))
+		{
+		case display_mode::simple:
+		case display_mode::duplicate:
+		case display_mode::half:
+		case display_mode::interlace:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	void push(const safe_ptr<write_frame>& video_frame)
+	{
+		if(filter_ || display_mode_ == display_mode::invalid)
+		{
+			const auto& plane = video_frame->get_pixel_format_desc().planes.at(0);
+
+			// A frame pushed through the filter later on sets it up again.
+			filter_.reset();
+			display_mode_ = get_bypass_display_mode(video_frame->get_type(), static_cast<int>(plane.height));
+
+			if (!thumbnail_mode_)
+				CASPAR_LOG(info) << L"[frame_muxer] " << display_mode::print(display_mode_) << L" without filter";
+		}
+
+		video_streams_.back().push(video_frame);
+
+		if(video_streams_.back().size() > 32)
+			BOOST_THROW_EXCEPTION(invalid_operation() << source_info("frame_muxer") << msg_info("video-stream overflow. This can be caused by incorrect frame-rate. Check clip meta-data."));
+	}
+
 	void push(const std::shared_ptr<core::audio_buffer>& audio)
 	{
 		if(!audio)	
@@ -173,29 +230,34 @@ struct frame_muxer::implementation : boost::noncopyable
 
 		if(audio == flush_audio())
 		{
-			audio_streams_.push(core::audio_buffer());
+			audio_fifo_.push_flush();
 		}
 		else if(audio == empty_audio())
 		{
-			boost::range::push_back(audio_streams_.back(), core::audio_buffer(audio_cadence_.front() * audio_channel_layout_.num_channels, 0));
+			audio_fifo_.push_silence(audio_cadence_.front() * audio_channel_layout_.num_channels);
 		}
 		else
 		{
-			boost::range::push_back(audio_streams_.back(), *audio);
+			audio_fifo_.push(audio->data(), audio->size());
 		}
 
-		if(audio_streams_.back().size() > 32*audio_cadence_.front() * audio_channel_layout_.num_channels)
+		if(audio_fifo_.back_size() > 32*audio_cadence_.front() * audio_channel_layout_.num_channels)
 			BOOST_THROW_EXCEPTION(invalid_operation() << source_info("frame_muxer") << msg_info("audio-stream overflow. This can be caused by incorrect frame-rate. Check clip meta-data."));
 	}
 	
 	bool video_ready() const
 	{		
-		return video_streams_.size() > 1 || (video_streams_.size() >= audio_streams_.size() && video_ready2());
+		return video_streams_.size() > 1 || (video_streams_.size() >= audio_fifo_.segments() && video_ready2());
 	}
 	
 	bool audio_ready() const
 	{
-		return audio_streams_.size() > 1 || (audio_streams_.size() >= video_streams_.size() && audio_ready2());
+		return audio_fifo_.segments() > 1 || (audio_fifo_.segments() >= video_streams_.size() && audio_ready2());
+	}
+
+	size_t buffered_audio() const
+	{
+		return audio_fifo_.size() / audio_channel_layout_.num_channels;
 	}
 
 	bool video_ready2() const
@@ -216,9 +278,9 @@ struct frame_muxer::implementation : boost::noncopyable
 		switch(display_mode_)
 		{
 		case display_mode::duplicate:					
-			return audio_streams_.front().size()/2 >= audio_cadence_.front() * audio_channel_layout_.num_channels;
+			return audio_fifo_.size()/2 >= audio_cadence_.front() * audio_channel_layout_.num_channels;
 		default:										
-			return audio_streams_.front().size() >= audio_cadence_.front() * audio_channel_layout_.num_channels;
+			return audio_fifo_.size() >= audio_cadence_.front() * audio_channel_layout_.num_channels;
 		}
 	}
 		
@@ -231,20 +293,20 @@ struct frame_muxer::implementation : boost::noncopyable
 			return frame;
 		}
 
-		if(video_streams_.size() > 1 && audio_streams_.size() > 1 && (!video_ready2() || !audio_ready2()))
+		if(video_streams_.size() > 1 && audio_fifo_.segments() > 1 && (!video_ready2() || !audio_ready2()))
 		{
-			if(!video_streams_.front().empty() || !audio_streams_.front().empty())
-				CASPAR_LOG(trace) << "Truncating: " << video_streams_.front().size() << L" video-frames, " << audio_streams_.front().size() << L" audio-samples.";
+			if(!video_streams_.front().empty() || audio_fifo_.size() > 0)
+				CASPAR_LOG(trace) << "Truncating: " << video_streams_.front().size() << L" video-frames, " << audio_fifo_.size() << L" audio-samples.";
 
 			video_streams_.pop();
-			audio_streams_.pop();
+			audio_fifo_.pop_segment();
 		}
 
 		if(!video_ready2() || !audio_ready2() || display_mode_ == display_mode::invalid)
 			return nullptr;
 				
 		auto frame1				= pop_video();
-		frame1->audio_data()	= pop_audio();
+		pop_audio(frame1->audio_data());
 
 		switch(display_mode_)
 		{
@@ -266,7 +328,7 @@ struct frame_muxer::implementation : boost::noncopyable
 		case display_mode::duplicate:	
 			{
 				auto frame2				= make_safe<core::write_frame>(*frame1);
-				frame2->audio_data()	= pop_audio();
+				pop_audio(frame2->audio_data());
 
 				frame_buffer_.push(frame1);
 				frame_buffer_.push(frame2);
@@ -291,19 +353,13 @@ struct frame_muxer::implementation : boost::noncopyable
 		return frame;
 	}
 
-	core::audio_buffer pop_audio()
+	void pop_audio(core::audio_buffer& samples)
 	{
-		CASPAR_VERIFY(audio_streams_.front().size() >= audio_cadence_.front() * audio_channel_layout_.num_channels);
+		CASPAR_VERIFY(audio_fifo_.size() >= audio_cadence_.front() * audio_channel_layout_.num_channels);
 
-		auto begin = audio_streams_.front().begin();
-		auto end   = begin + (audio_cadence_.front() * audio_channel_layout_.num_channels);
-
-		core::audio_buffer samples(begin, end);
-		audio_streams_.front().erase(begin, end);
+		audio_fifo_.read(audio_cadence_.front() * audio_channel_layout_.num_channels, samples);
 		
 		boost::range::rotate(audio_cadence_, std::begin(audio_cadence_)+1);
-
-		return samples;
 	}
 				
 	void update_display_mode(const std::shared_ptr<AVFrame>& frame, bool force_deinterlace)
@@ -365,7 +421,8 @@ struct frame_muxer::implementation : boost::noncopyable
 				static_cast<AVPixelFormat>(frame->format),
 				std::vector<AVPixelFormat>(),
 				narrow(filter_str),
-				multithreaded_filter_));
+				multithreaded_filter_,
+				context_pools_));
 			if (!thumbnail_mode_)
 				CASPAR_LOG(info) << L"[frame_muxer] " << display_mode::print(display_mode_) << L" " << print_mode(frame->width, frame->height, in_fps_, frame->interlaced_frame > 0);
 		}
@@ -400,13 +457,17 @@ frame_muxer::frame_muxer(
 		bool thumbnail_mode,
 		const core::channel_layout& audio_channel_layout,
 		const std::wstring& filter,
-		bool multithreaded_filter)
-	: impl_(new implementation(in_fps, frame_factory, filter, multithreaded_filter, thumbnail_mode, audio_channel_layout)){}
+		bool multithreaded_filter,
+		const std::shared_ptr<context_pools>& context_pools)
+	: impl_(new implementation(in_fps, frame_factory, filter, multithreaded_filter, thumbnail_mode, audio_channel_layout, context_pools)){}
 void frame_muxer::push(const std::shared_ptr<AVFrame>& video_frame, int hints){impl_->push(video_frame, hints);}
 void frame_muxer::push(const std::shared_ptr<core::audio_buffer>& audio_samples){return impl_->push(audio_samples);}
+bool frame_muxer::can_bypass_filter(core::field_mode::type field_mode, int height, int hints) const{return impl_->can_bypass_filter(field_mode, height, hints);}
+void frame_muxer::push(const safe_ptr<core::write_frame>& video_frame){impl_->push(video_frame);}
 std::shared_ptr<basic_frame> frame_muxer::poll(){return impl_->poll();}
 uint32_t frame_muxer::calc_nb_frames(uint32_t nb_frames) const {return impl_->calc_nb_frames(nb_frames);}
 bool frame_muxer::video_ready() const{return impl_->video_ready();}
 bool frame_muxer::audio_ready() const{return impl_->audio_ready();}
+size_t frame_muxer::buffered_audio() const{return impl_->buffered_audio();}
 
 }}
\ No newline at end of file
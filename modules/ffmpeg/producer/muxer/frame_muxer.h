@@ -46,6 +46,9 @@ struct channel_layout;
 
 namespace ffmpeg {
 
+class context_pools;
+
+// Filter graphs are taken from and returned to "context_pools" when given.
 class frame_muxer : boost::noncopyable
 {
 public:
@@ -55,14 +58,23 @@ public:
 			bool thumbnail_mode,
 			const core::channel_layout& audio_channel_layout,
 			const std::wstring& filter = L"",
-			bool multithreaded_filter = true);
+			bool multithreaded_filter = true,
+			const std::shared_ptr<context_pools>& context_pools = nullptr);
 	
 	void push(const std::shared_ptr<AVFrame>& video_frame, int hints = 0);
 	void push(const std::shared_ptr<core::audio_buffer>& audio_samples);
+
+	// Frames the mixer can draw as they are may skip the filter, as long as no
+	// filter was asked for and the display mode does not deinterlace.
+	bool can_bypass_filter(core::field_mode::type field_mode, int height, int hints = 0) const;
+	void push(const safe_ptr<core::write_frame>& video_frame);
 	
 	bool video_ready() const;
 	bool audio_ready() const;
 
+	// Samples per channel waiting for a frame to go with.
+	size_t buffered_audio() const;
+
 	std::shared_ptr<core::basic_frame> poll();
 
 	uint32_t calc_nb_frames(uint32_t nb_frames) const;
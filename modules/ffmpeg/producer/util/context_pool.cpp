@@ -0,0 +1,266 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../../stdafx.h"
+
+#include "context_pool.h"
+
+#include <common/env.h>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread.hpp>
+
+#include <list>
+
+namespace caspar { namespace ffmpeg {
+
+static const int EXPIRY_INTERVAL_MS = 1000;
+
+struct context_pool::implementation : boost::noncopyable
+{
+	struct entry
+	{
+		std::string					key;
+		std::shared_ptr<void>		context;
+		boost::posix_time::ptime	returned;
+	};
+
+	const std::wstring			name_;
+
+	mutable boost::mutex		mutex_;
+	std::list<entry>			entries_; // Most recently returned first.
+
+	const size_t				max_size_;
+	const boost::posix_time::seconds	idle_expiry_;
+
+	uint64_t					hits_;
+	uint64_t					misses_;
+	uint64_t					evictions_;
+	uint64_t					expirations_;
+
+	implementation(const std::wstring& name, size_t max_size, int idle_expiry_seconds)
+		: name_(name)
+		, max_size_(max_size)
+		, idle_expiry_(idle_expiry_seconds)
+		, hits_(0)
+		, misses_(0)
+		, evictions_(0)
+		, expirations_(0)
+	{
+	}
+
+	std::shared_ptr<void> try_take(const std::string& key)
+	{
+		std::list<entry> expired;
+		std::shared_ptr<void> result;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			collect_expired(expired);
+
+			auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e)
+			{
+				return e.key == key;
+			});
+
+			if(it != entries_.end())
+			{
+				result = it->context;
+				entries_.erase(it);
+				++hits_;
+			}
+			else
+				++misses_;
+		}
+
+		return result;
+	}
+
+	void give(const std::string& key, const std::shared_ptr<void>& context)
+	{
+		if(!context)
+			return;
+
+		// Contexts are released outside of the lock since teardown can be slow.
+		std::list<entry> released;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			collect_expired(released);
+
+			if(max_size_ == 0)
+				return;
+
+			entry e;
+			e.key		= key;
+			e.context	= context;
+			e.returned	= boost::posix_time::microsec_clock::universal_time();
+			entries_.push_front(e);
+
+			while(entries_.size() > max_size_)
+			{
+				released.splice(released.end(), entries_, --entries_.end());
+				++evictions_;
+			}
+		}
+	}
+
+	void expire()
+	{
+		std::list<entry> expired;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			collect_expired(expired);
+		}
+	}
+
+	void clear()
+	{
+		std::list<entry> released;
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			released.swap(entries_);
+		}
+	}
+
+	void collect_expired(std::list<entry>& expired)
+	{
+		auto deadline = boost::posix_time::microsec_clock::universal_time() - idle_expiry_;
+
+		while(!entries_.empty() && entries_.back().returned < deadline)
+		{
+			expired.splice(expired.end(), entries_, --entries_.end());
+			++expirations_;
+		}
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		auto requests = hits_ + misses_;
+
+		boost::property_tree::wptree info;
+		info.add(L"name",			name_);
+		info.add(L"size",			entries_.size());
+		info.add(L"max-size",		max_size_);
+		info.add(L"idle-expiry",	idle_expiry_.total_seconds());
+		info.add(L"hits",			hits_);
+		info.add(L"misses",			misses_);
+		info.add(L"hit-rate",		requests > 0 ? static_cast<double>(hits_) / static_cast<double>(requests) : 0.0);
+		info.add(L"evictions",		evictions_);
+		info.add(L"expirations",	expirations_);
+		return info;
+	}
+};
+
+context_pool::context_pool(const std::wstring& name, size_t max_size, int idle_expiry_seconds) : impl_(new implementation(name, max_size, idle_expiry_seconds)){}
+std::shared_ptr<void> context_pool::do_try_take(const std::string& key){return impl_->try_take(key);}
+void context_pool::give(const std::string& key, const std::shared_ptr<void>& context){impl_->give(key, context);}
+void context_pool::expire(){impl_->expire();}
+void context_pool::clear(){impl_->clear();}
+boost::property_tree::wptree context_pool::info() const{return impl_->info();}
+
+struct context_pools::implementation : boost::noncopyable
+{
+	context_pool				codec_;
+	context_pool				filter_;
+
+	boost::mutex				mutex_;
+	boost::condition_variable	cond_;
+	bool						running_;
+	boost::thread				thread_;
+
+	implementation(size_t max_size, int idle_expiry_seconds)
+		: codec_(L"codec", max_size, idle_expiry_seconds)
+		, filter_(L"filter", max_size, idle_expiry_seconds)
+		, running_(true)
+	{
+		thread_ = boost::thread([this]{run();});
+	}
+
+	~implementation()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			running_ = false;
+		}
+		cond_.notify_all();
+		thread_.join();
+	}
+
+	void run()
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		while(running_)
+		{
+			auto deadline = boost::get_system_time() + boost::posix_time::milliseconds(EXPIRY_INTERVAL_MS);
+			while(running_ && cond_.timed_wait(lock, deadline))
+			{
+			}
+
+			if(!running_)
+				break;
+
+			lock.unlock();
+			try
+			{
+				codec_.expire();
+				filter_.expire();
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+			lock.lock();
+		}
+	}
+
+	void clear()
+	{
+		codec_.clear();
+		filter_.clear();
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::property_tree::wptree info;
+		info.add_child(L"pool", codec_.info());
+		info.add_child(L"pool", filter_.info());
+		return info;
+	}
+};
+
+context_pools::context_pools() 
+	: impl_(new implementation(
+		env::properties().get(L"configuration.ffmpeg.context-pool.max-size", 16), 
+		env::properties().get(L"configuration.ffmpeg.context-pool.idle-expiry", 60))){}
+context_pools::context_pools(size_t max_size, int idle_expiry_seconds) : impl_(new implementation(max_size, idle_expiry_seconds)){}
+context_pool& context_pools::codec(){return impl_->codec_;}
+context_pool& context_pools::filter(){return impl_->filter_;}
+void context_pools::clear(){impl_->clear();}
+boost::property_tree::wptree context_pools::info() const{return impl_->info();}
+
+}}
@@ -0,0 +1,89 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Keeps warm contexts (decoders, filter graphs) of finished producers so
+// that the next clip with the same parameters can skip their setup and
+// teardown. Bounded in size (least recently returned contexts are dropped
+// first) and contexts idle for too long are released. Per frame scaler
+// contexts are cached by make_write_frame instead.
+class context_pool : boost::noncopyable
+{
+public:
+	context_pool(const std::wstring& name, size_t max_size, int idle_expiry_seconds);
+
+	template<typename T>
+	std::shared_ptr<T> try_take(const std::string& key)
+	{
+		return std::static_pointer_cast<T>(do_try_take(key));
+	}
+
+	// The context must be reset (flushed) by the caller before it is returned.
+	void give(const std::string& key, const std::shared_ptr<void>& context);
+	// Releases contexts idle for longer than the expiry, whatever their key.
+	void expire();
+	void clear();
+
+	boost::property_tree::wptree info() const;
+private:
+	std::shared_ptr<void> do_try_take(const std::string& key);
+
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+// The codec and filter pools of a server, which hands them to the producers
+// through ffmpeg::init. Contexts given back after the pools are gone are
+// simply released. A timer expires idle contexts even while no producer is
+// created.
+//
+// configuration.ffmpeg.context-pool.max-size		(per pool, 0 disables)
+// configuration.ffmpeg.context-pool.idle-expiry	(seconds)
+class context_pools : boost::noncopyable
+{
+public:
+	// Limits are read from the configuration.
+	context_pools();
+	context_pools(size_t max_size, int idle_expiry_seconds);
+
+	context_pool& codec();
+	context_pool& filter();
+
+	void clear();
+
+	boost::property_tree::wptree info() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
@@ -24,6 +24,7 @@
 #include "util.h"
 
 #include "flv.h"
+#include "context_pool.h"
 
 #include "../tbb_avcodec.h"
 #include "../../ffmpeg_error.h"
@@ -46,6 +47,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/crc.hpp>
+#include <boost/format.hpp>
 
 #if defined(_MSC_VER)
 #pragma warning (push)
@@ -425,6 +428,87 @@ safe_ptr<AVCodecContext> open_codec(AVFormatContext& context, enum AVMediaType t
 	return safe_ptr<AVCodecContext>(context.streams[index]->codec, tbb_avcodec_close);
 }
 
+std::string get_codec_key(const AVCodecContext& codec)
+{
+	boost::crc_32_type extradata_crc;
+	if(codec.extradata && codec.extradata_size > 0)
+		extradata_crc.process_bytes(codec.extradata, codec.extradata_size);
+
+	// Decoders such as ADPCM and WMA are configured by block_align,
+	// bits_per_coded_sample and bit_rate as well.
+	auto key = boost::format("%1%:%2%:%3%:%4%x%5%:%6%:%7%:%8%:%9%:%10%:%11%:%12%:%13%:%14%")
+		% codec.codec_type
+		% codec.codec_id
+		% codec.codec_tag
+		% codec.width
+		% codec.height
+		% codec.pix_fmt
+		% codec.sample_rate
+		% codec.channels
+		% codec.channel_layout
+		% codec.sample_fmt
+		% codec.block_align
+		% codec.bits_per_coded_sample
+		% codec.bit_rate
+		% extradata_crc.checksum();
+
+	return key.str();
+}
+
+safe_ptr<AVCodecContext> open_pooled_codec(AVFormatContext& context, enum AVMediaType type, int& index, const std::shared_ptr<context_pools>& pools)
+{
+	AVCodec* decoder;
+	index = THROW_ON_ERROR2(av_find_best_stream(&context, type, -1, -1, &decoder, 0), "");
+
+	return open_pooled_codec(context, index, pools);
+}
+
+safe_ptr<AVCodecContext> open_pooled_codec(AVFormatContext& context, int index, const std::shared_ptr<context_pools>& pools)
+{
+	auto stream_codec	= context.streams[index]->codec;
+	auto decoder		= avcodec_find_decoder(stream_codec->codec_id);
+	if(!decoder)
+		BOOST_THROW_EXCEPTION(averror_decoder_not_found() << msg_info("No decoder for stream " + boost::lexical_cast<std::string>(index) + "."));
+
+	auto key			= get_codec_key(*stream_codec);
+
+	std::shared_ptr<AVCodecContext> codec_context;
+	if(pools)
+		codec_context = pools->codec().try_take<AVCodecContext>(key);
+
+	if(!codec_context)
+	{
+		codec_context.reset(avcodec_alloc_context3(decoder), [](AVCodecContext* c)
+		{
+			tbb_avcodec_close(c);
+			av_freep(&c->extradata);
+			av_freep(&c->subtitle_header);
+			av_free(c);
+		});
+
+		if(!codec_context)
+			BOOST_THROW_EXCEPTION(bad_alloc());
+
+		THROW_ON_ERROR2(avcodec_copy_context(codec_context.get(), stream_codec), "");
+		THROW_ON_ERROR2(tbb_avcodec_open(codec_context.get(), decoder), "");
+	}
+
+	if(!pools)
+		return make_safe_ptr(codec_context);
+
+	// Flush on release so the next producer starts from a clean decoder.
+	std::weak_ptr<context_pools> weak_pools = pools;
+	return safe_ptr<AVCodecContext>(codec_context.get(), [codec_context, key, weak_pools](AVCodecContext*)
+	{
+		auto pools = weak_pools.lock();
+		if(!pools)
+			return;
+
+		avcodec_flush_buffers(codec_context.get());
+		pools->codec().give(key, codec_context);
+	});
+}
+
 std::wstring print_mode(size_t width, size_t height, double fps, bool interlaced)
 {
 	std::wostringstream fps_ss;
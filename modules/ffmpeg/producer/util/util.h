@@ -53,6 +53,8 @@ struct channel_layout;
 }
 
 namespace ffmpeg {
+
+class context_pools;
 		
 std::shared_ptr<core::audio_buffer> flush_audio();
 std::shared_ptr<core::audio_buffer> empty_audio();
@@ -70,6 +72,13 @@ safe_ptr<core::write_frame> make_write_frame(const void* tag, const safe_ptr<AVF
 safe_ptr<AVPacket> create_packet();
 
 safe_ptr<AVCodecContext> open_codec(AVFormatContext& context,  enum AVMediaType type, int& index);
+// Like open_codec, but takes a warm decoder from the codec pool when one
+// matching the stream is available and returns it there once released.
+// Without pools the decoder is simply closed.
+safe_ptr<AVCodecContext> open_pooled_codec(AVFormatContext& context,  enum AVMediaType type, int& index, const std::shared_ptr<context_pools>& pools);
+safe_ptr<AVCodecContext> open_pooled_codec(AVFormatContext& context, int index, const std::shared_ptr<context_pools>& pools);
+// Pool key of a decoder, i.e. every parameter the decoder is opened with.
+std::string get_codec_key(const AVCodecContext& codec);
 
 bool is_sane_fps(AVRational time_base);
 AVRational fix_time_base(AVRational time_base);
@@ -69,8 +69,8 @@ struct video_decoder::implementation : boost::noncopyable
 	tbb::atomic<size_t>						file_frame_number_;
 
 public:
-	explicit implementation(const safe_ptr<AVFormatContext>& context) 
-		: codec_context_(open_codec(*context, AVMEDIA_TYPE_VIDEO, index_))
+	implementation(const safe_ptr<AVFormatContext>& context, const std::shared_ptr<context_pools>& context_pools) 
+		: codec_context_(open_pooled_codec(*context, AVMEDIA_TYPE_VIDEO, index_, context_pools))
 		, nb_frames_(static_cast<uint32_t>(context->streams[index_]->nb_frames))
 		, stream_tbn_(context->streams[index_]->time_base)
 		, stream_framerate_(context->streams[index_]->avg_frame_rate)
@@ -174,7 +174,7 @@ public:
 	}
 };
 
-video_decoder::video_decoder(const safe_ptr<AVFormatContext>& context) : impl_(new implementation(context)){}
+video_decoder::video_decoder(const safe_ptr<AVFormatContext>& context, const std::shared_ptr<context_pools>& context_pools) : impl_(new implementation(context, context_pools)){}
 void video_decoder::push(const std::shared_ptr<AVPacket>& packet){impl_->push(packet);}
 std::shared_ptr<AVFrame> video_decoder::poll(){return impl_->poll();}
 bool video_decoder::ready() const{return impl_->ready();}
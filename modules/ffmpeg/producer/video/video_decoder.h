@@ -38,10 +38,13 @@ namespace core {
 
 namespace ffmpeg {
 
+class context_pools;
+
+// Decoders are taken from and returned to "context_pools" when given.
 class video_decoder : boost::noncopyable
 {
 public:
-	explicit video_decoder(const safe_ptr<AVFormatContext>& context);
+	video_decoder(const safe_ptr<AVFormatContext>& context, const std::shared_ptr<context_pools>& context_pools);
 	
 	bool ready() const;
 	void push(const std::shared_ptr<AVPacket>& packet);
@@ -25,6 +25,7 @@
 #include "../util/image_loader.h"
 #include "../util/image_view.h"
 #include "../util/image_algorithms.h"
+#include "../util/png_row_reader.h"
 
 #include <core/video_format.h>
 
@@ -41,6 +42,7 @@
 #include <common/exception/exceptions.h>
 #include <common/utility/tweener.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/assign.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
@@ -50,6 +52,8 @@
 
 #include <algorithm>
 #include <array>
+#include <map>
+#include <memory>
 #include <boost/math/special_functions/round.hpp>
 #include <boost/scoped_array.hpp>
 
@@ -57,14 +61,21 @@ using namespace boost::assign;
 
 namespace caspar { namespace image {
 
+// The image is cut into screen sized tiles along the scroll direction. Only the
+// tiles intersecting the screen are emitted, plus one tile ahead of the scroll
+// position is kept ready, so texture memory and mixer work do not depend on the
+// length of the image. PNG files scrolling top to bottom are additionally
+// decoded row by row, a few rows per frame, into the tile ahead.
 struct image_scroll_producer : public core::frame_producer
 {	
 	core::monitor::subject						monitor_subject_;
 	const std::wstring							filename_;
-	std::vector<safe_ptr<core::basic_frame>>	frames_;
+	const safe_ptr<core::frame_factory>			frame_factory_;
 	core::video_format_desc						format_desc_;
 	size_t										width_;
 	size_t										height_;
+	bool										vertical_;
+	int											nb_tiles_;
 
 	double										delta_;
 	double										speed_;
@@ -72,6 +83,19 @@ struct image_scroll_producer : public core::frame_producer
 	int											start_offset_x_;
 	int											start_offset_y_;
 	bool										progressive_;
+	bool										premultiply_with_alpha_;
+
+	std::shared_ptr<FIBITMAP>					bitmap_;
+	boost::scoped_array<uint8_t>				blurred_copy_;
+	const uint8_t*								bytes_;
+	std::unique_ptr<png_row_reader>				reader_;
+
+	std::map<int, safe_ptr<core::write_frame>>	tiles_;
+	std::shared_ptr<core::write_frame>			pending_tile_;
+	int											pending_index_;
+	int											pending_rows_;
+	int											rows_per_render_;
+	int											nb_tiles_created_;
 
 	safe_ptr<core::basic_frame>					last_frame_;
 	
@@ -84,20 +108,45 @@ struct image_scroll_producer : public core::frame_producer
 		bool premultiply_with_alpha = false,
 		bool progressive = false) 
 		: filename_(filename)
+		, frame_factory_(frame_factory)
 		, delta_(0)
 		, format_desc_(frame_factory->get_video_format_desc())
 		, speed_(speed)
 		, progressive_(progressive)
+		, premultiply_with_alpha_(premultiply_with_alpha)
+		, bytes_(nullptr)
+		, pending_index_(0)
+		, pending_rows_(0)
+		, nb_tiles_created_(0)
 		, last_frame_(core::basic_frame::empty())
 	{
 		start_offset_x_ = 0;
 		start_offset_y_ = 0;
 
-		auto bitmap = load_image(filename_);
-		FreeImage_FlipVertical(bitmap.get());
+		// Rows are only streamed in top to bottom, which is when the image moves up.
+		bool moves_up = (duration != 0.0 ? duration : speed) < 0.0;
 
-		width_  = FreeImage_GetWidth(bitmap.get());
-		height_ = FreeImage_GetHeight(bitmap.get());
+		if (motion_blur_px == 0 && moves_up && boost::iequals(boost::filesystem::path(filename_).extension().wstring(), L".png") && png_row_reader::can_read(filename_))
+		{
+			reader_.reset(new png_row_reader(filename_));
+
+			if (reader_->width() == static_cast<int>(format_desc_.width))
+			{
+				width_  = reader_->width();
+				height_ = reader_->height();
+			}
+			else
+				reader_.reset();
+		}
+
+		if (!reader_)
+		{
+			bitmap_ = load_image(filename_);
+			FreeImage_FlipVertical(bitmap_.get());
+
+			width_  = FreeImage_GetWidth(bitmap_.get());
+			height_ = FreeImage_GetHeight(bitmap_.get());
+		}
 
 		bool vertical = width_ == format_desc_.width;
 		bool horizontal = height_ == format_desc_.height;
@@ -106,6 +155,8 @@ struct image_scroll_producer : public core::frame_producer
 			BOOST_THROW_EXCEPTION(
 				caspar::invalid_argument() << msg_info("Neither width nor height matched the video resolution"));
 
+		vertical_ = vertical;
+
 		if (vertical)
 		{
 			if (duration != 0.0)
@@ -120,6 +171,8 @@ struct image_scroll_producer : public core::frame_producer
 
 			if (speed_ < 0.0)
 				start_offset_y_ = height_ + format_desc_.height;
+
+			nb_tiles_ = static_cast<int>((height_ + format_desc_.height - 1) / format_desc_.height);
 		}
 		else
 		{
@@ -137,140 +190,219 @@ struct image_scroll_producer : public core::frame_producer
 				start_offset_x_ = format_desc_.width - (width_ % format_desc_.width);
 			else
 				start_offset_x_ = format_desc_.width - (width_ % format_desc_.width) + width_ + format_desc_.width;
+
+			nb_tiles_ = static_cast<int>((width_ + format_desc_.width - 1) / format_desc_.width);
+		}
+
+		// A tile ahead becomes visible after it has travelled a full tile, twice the rows it moves is enough to have it ready.
+		rows_per_render_ = 2 * static_cast<int>(std::ceil(std::abs(speed_))) + 8;
+
+		if (bitmap_)
+		{
+			bytes_ = FreeImage_GetBits(bitmap_.get());
+			image_view<bgra_pixel> original_view(FreeImage_GetBits(bitmap_.get()), width_, height_);
+
+			if (premultiply_with_alpha)
+				premultiply(original_view);
+
+			if (motion_blur_px > 0)
+			{
+				double angle = 3.14159265 / 2; // Up
+
+				if (horizontal && speed_ < 0)
+					angle *= 2; // Left
+				else if (vertical && speed > 0)
+					angle *= 3; // Down
+				else if (horizontal && speed  > 0)
+					angle = 0.0; // Right
+
+				blurred_copy_.reset(new uint8_t[width_*height_*4]);
+				image_view<bgra_pixel> blurred_view(blurred_copy_.get(), width_, height_);
+				tweener_t blur_tweener = get_tweener(L"easeInQuad");
+				blur(original_view, blurred_view, angle, motion_blur_px, blur_tweener);
+				bytes_ = blurred_copy_.get();
+				bitmap_.reset();
+			}
 		}
 
-		auto bytes = FreeImage_GetBits(bitmap.get());
-		int count = width_*height_*4;
-		image_view<bgra_pixel> original_view(bytes, width_, height_);
+		update_tiles(position());
 
-		if (premultiply_with_alpha)
-			premultiply(original_view);
+		CASPAR_LOG(info) << print() << L" Initialized";
+	}
 
-		boost::scoped_array<uint8_t> blurred_copy;
+	// tiles
 
-		if (motion_blur_px > 0)
+	// Scroll position in tiles. Tile n is placed n tiles before the position.
+	double position() const
+	{
+		if (vertical_)
+			return static_cast<double>(start_offset_y_) / static_cast<double>(format_desc_.height)
+				+ delta_ / static_cast<double>(format_desc_.height);
+		else
+			return static_cast<double>(start_offset_x_) / static_cast<double>(format_desc_.width)
+				+ delta_ / static_cast<double>(format_desc_.width);
+	}
+
+	safe_ptr<core::write_frame> create_tile(int index)
+	{
+		core::pixel_format_desc desc;
+		desc.pix_fmt = core::pixel_format::bgra;
+		if (vertical_)
+			desc.planes.push_back(core::pixel_format_desc::plane(width_, format_desc_.height, 4));
+		else
+			desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, height_, 4));
+
+		auto tile = frame_factory_->create_frame(reinterpret_cast<void*>(rand()), desc);
+
+		// Set the relative position to the other image fragments
+		tile->get_frame_transform().fill_translation[vertical_ ? 1 : 0] = - index;
+		++nb_tiles_created_;
+
+		return tile;
+	}
+
+	void copy_tile(core::write_frame& tile, int index)
+	{
+		auto dest = tile.image_data().begin();
+
+		if (vertical_)
+		{
+			const size_t linesize	= width_ * 4;
+			const int first_row		= static_cast<int>(height_) - index * static_cast<int>(format_desc_.height);
+			const int padding		= std::max(0, -first_row);
+
+			// The topmost tile is padded at its top.
+			fast_memclr(dest, padding * linesize);
+			std::copy_n(bytes_ + (first_row + padding) * linesize, (format_desc_.height - padding) * linesize, dest + padding * linesize);
+		}
+		else
 		{
-			double angle = 3.14159265 / 2; // Up
-
-			if (horizontal && speed_ < 0)
-				angle *= 2; // Left
-			else if (vertical && speed > 0)
-				angle *= 3; // Down
-			else if (horizontal && speed  > 0)
-				angle = 0.0; // Right
-
-			blurred_copy.reset(new uint8_t[count]);
-			image_view<bgra_pixel> blurred_view(blurred_copy.get(), width_, height_);
-			tweener_t blur_tweener = get_tweener(L"easeInQuad");
-			blur(original_view, blurred_view, angle, motion_blur_px, blur_tweener);
-			bytes = blurred_copy.get();
-			bitmap.reset();
+			const size_t column		= (nb_tiles_ - index) * format_desc_.width;
+			const size_t columns	= std::min(format_desc_.width, width_ - column);
+
+			// The rightmost tile is padded at its right.
+			if (columns < format_desc_.width)
+				fast_memclr(dest, tile.image_data().size());
+
+			for (size_t y = 0; y < height_; ++y)
+				std::copy_n(bytes_ + (y * width_ + column) * 4, columns * 4, dest + y * format_desc_.width * 4);
 		}
+	}
 
-		if (vertical)
+	// Decodes up to max_rows more rows of the tile, returns whether it is complete.
+	bool stream_tile(int index, int max_rows)
+	{
+		const int height		= static_cast<int>(format_desc_.height);
+		const int linesize		= static_cast<int>(width_) * 4;
+		const int first_row		= static_cast<int>(height_) - index * height;
+
+		if (!pending_tile_ || pending_index_ != index)
 		{
-			int n = 1;
+			pending_tile_	= create_tile(index);
+			pending_index_	= index;
+			pending_rows_	= std::max(0, -first_row);
 
-			while(count > 0)
-			{
-				core::pixel_format_desc desc;
-				desc.pix_fmt = core::pixel_format::bgra;
-				desc.planes.push_back(core::pixel_format_desc::plane(width_, format_desc_.height, 4));
-				auto frame = frame_factory->create_frame(reinterpret_cast<void*>(rand()), desc);
-
-				if(count >= static_cast<int>(frame->image_data().size()))
-				{	
-					std::copy_n(bytes + count - frame->image_data().size(), frame->image_data().size(), frame->image_data().begin());
-					count -= frame->image_data().size();
-				}
-				else
-				{
-					fast_memclr(frame->image_data().begin(), frame->image_data().size());	
-					std::copy_n(bytes, count, frame->image_data().begin() + format_desc_.size - count);
-					count = 0;
-				}
-
-				frame->commit();
-				frames_.push_back(frame);
-
-				// Set the relative position to the other image fragments
-				frame->get_frame_transform().fill_translation[1] = - n++;
-			}
+			fast_memclr(pending_tile_->image_data().begin(), pending_rows_ * linesize);
 
+			auto start_row = std::max(0, first_row);
+			if (reader_->next_row() > start_row)
+				reader_->rewind();
+			reader_->skip_rows(start_row - reader_->next_row());
 		}
-		else if (horizontal)
+
+		auto dest = pending_tile_->image_data().begin() + pending_rows_ * linesize;
+		auto rows = reader_->read_rows(dest, linesize, std::min(max_rows, height - pending_rows_));
+
+		if (premultiply_with_alpha_)
 		{
-			int i = 0;
-			while(count > 0)
-			{
-				core::pixel_format_desc desc;
-				desc.pix_fmt = core::pixel_format::bgra;
-				desc.planes.push_back(core::pixel_format_desc::plane(format_desc_.width, height_, 4));
-				auto frame = frame_factory->create_frame(reinterpret_cast<void*>(rand()), desc);
-				if(count >= static_cast<int>(frame->image_data().size()))
-				{	
-					for(size_t y = 0; y < height_; ++y)
-						std::copy_n(bytes + i * format_desc_.width*4 + y * width_*4, format_desc_.width*4, frame->image_data().begin() + y * format_desc_.width*4);
-					
-					++i;
-					count -= frame->image_data().size();
-				}
-				else
-				{
-					fast_memclr(frame->image_data().begin(), frame->image_data().size());	
-					int width2 = width_ % format_desc_.width;
-					for(size_t y = 0; y < height_; ++y)
-						std::copy_n(bytes + i * format_desc_.width*4 + y * width_*4, width2*4, frame->image_data().begin() + y * format_desc_.width*4);
-
-					count = 0;
-				}
-			
-				frame->commit();
-				frames_.push_back(frame);
-			}
+			image_view<bgra_pixel> view(dest, width_, rows);
+			premultiply(view);
+		}
 
-			std::reverse(frames_.begin(), frames_.end());
+		pending_rows_ += rows;
 
-			// Set the relative positions of the image fragments.
-			for (size_t n = 0; n < frames_.size(); ++n)
-			{
-				double translation = - (static_cast<double>(n) + 1.0);
-				frames_[n]->get_frame_transform().fill_translation[0] = translation;
-			}
+		if (pending_rows_ < height)
+			return false;
+
+		pending_tile_->commit();
+		tiles_.insert(std::make_pair(index, make_safe_ptr(pending_tile_)));
+		pending_tile_.reset();
+
+		return true;
+	}
+
+	bool prepare_tile(int index, bool complete)
+	{
+		if (tiles_.find(index) != tiles_.end())
+			return true;
+
+		if (reader_)
+			return stream_tile(index, complete ? static_cast<int>(format_desc_.height) : rows_per_render_);
+
+		auto tile = create_tile(index);
+		copy_tile(*tile, index);
+		tile->commit();
+		tiles_.insert(std::make_pair(index, tile));
+
+		return true;
+	}
+
+	// Makes the tiles intersecting the screen available, prepares the tile ahead
+	// of the scroll direction and evicts all other tiles.
+	std::vector<safe_ptr<core::basic_frame>> update_tiles(double position)
+	{
+		int first = static_cast<int>(std::floor(position - 1.0)) + 1;
+		int last  = static_cast<int>(std::ceil(position + 1.0)) - 1;
+		int ahead = speed_ < 0.0 ? first - 1 : last + 1;
+
+		std::vector<safe_ptr<core::basic_frame>> visible;
+
+		for (int index = std::max(1, first); index <= std::min(nb_tiles_, last); ++index)
+		{
+			prepare_tile(index, true);
+			visible.push_back(tiles_.find(index)->second);
 		}
 
-		CASPAR_LOG(info) << print() << L" Initialized";
+		// While nothing is on screen the next tile is finished right away.
+		if (ahead >= 1 && ahead <= nb_tiles_)
+			prepare_tile(ahead, visible.empty());
+
+		auto keep_first = std::min(first, ahead);
+		auto keep_last  = std::max(last, ahead);
+
+		for (auto it = tiles_.begin(); it != tiles_.end();)
+		{
+			if (it->first < keep_first || it->first > keep_last)
+				it = tiles_.erase(it);
+			else
+				++it;
+		}
+
+		return visible;
 	}
 	
 	// frame_producer
 
 	safe_ptr<core::basic_frame> render_frame(bool allow_eof)
 	{
-		if(frames_.empty())
+		if(nb_tiles_ == 0)
 			return core::basic_frame::eof();
 		
-		auto result = make_safe<core::basic_frame>(frames_);
-		auto& fill_translation = result->get_frame_transform().fill_translation;
-
-		if (width_ == format_desc_.width)
+		if (vertical_)
 		{
 			if (static_cast<size_t>(std::abs(delta_)) >= height_ + format_desc_.height && allow_eof)
 				return core::basic_frame::eof();
-
-			fill_translation[1] = 
-				static_cast<double>(start_offset_y_) / static_cast<double>(format_desc_.height)
-				+ delta_ / static_cast<double>(format_desc_.height);
 		}
 		else
 		{
 			if (static_cast<size_t>(std::abs(delta_)) >= width_ + format_desc_.width && allow_eof)
 				return core::basic_frame::eof();
-
-			fill_translation[0] = 
-				static_cast<double>(start_offset_x_) / static_cast<double>(format_desc_.width)
-				+ (delta_) / static_cast<double>(format_desc_.width);
 		}
 
+		auto position = this->position();
+		auto result = make_safe<core::basic_frame>(update_tiles(position));
+		result->get_frame_transform().fill_translation[vertical_ ? 1 : 0] = position;
+
 		return result;
 	}
 
@@ -332,12 +464,16 @@ struct image_scroll_producer : public core::frame_producer
 		boost::property_tree::wptree info;
 		info.add(L"type", L"image-scroll-producer");
 		info.add(L"filename", filename_);
+		info.add(L"streamed", reader_ != nullptr);
+		info.add(L"resident-tiles", tiles_.size());
+		info.add(L"created-tiles", nb_tiles_created_);
+		info.add(L"total-tiles", nb_tiles_);
 		return info;
 	}
 
 	virtual uint32_t nb_frames() const override
 	{
-		if(width_ == format_desc_.width)
+		if(vertical_)
 		{
 			auto length = (height_ + format_desc_.height * 2);
 			return static_cast<uint32_t>(length / std::abs(speed_));// + length % std::abs(delta_));
@@ -0,0 +1,487 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Helge Norberg, helge.norberg@svt.se
+*/
+
+#include "png_row_reader.h"
+
+#include "image_algorithms.h"
+#include "image_view.h"
+
+#include <common/exception/exceptions.h>
+#include <common/utility/string.h>
+
+#include <boost/exception/errinfo_file_name.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace image {
+
+namespace {
+
+const std::array<uint8_t, 8> PNG_SIGNATURE = {{ 137, 80, 78, 71, 13, 10, 26, 10 }};
+const uint32_t MAX_CHUNK_LENGTH = 0x7FFFFFFF; // 2^31-1, see the PNG specification 5.3.
+
+enum png_color_type
+{
+	gray		= 0,
+	rgb			= 2,
+	palette		= 3,
+	gray_alpha	= 4,
+	rgb_alpha	= 6
+};
+
+uint32_t read_be32(const uint8_t* data)
+{
+	return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+int channel_count(int color_type)
+{
+	switch(color_type)
+	{
+	case gray:			return 1;
+	case rgb:			return 3;
+	case palette:		return 1;
+	case gray_alpha:	return 2;
+	case rgb_alpha:		return 4;
+	default:			return 0;
+	}
+}
+
+bool is_supported(int color_type, int bit_depth)
+{
+	switch(color_type)
+	{
+	case gray:			return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16;
+	case palette:		return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8;
+	case rgb:
+	case gray_alpha:
+	case rgb_alpha:		return bit_depth == 8 || bit_depth == 16;
+	default:			return false;
+	}
+}
+
+uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+	int p  = static_cast<int>(a) + b - c;
+	int pa = std::abs(p - a);
+	int pb = std::abs(p - b);
+	int pc = std::abs(p - c);
+
+	if(pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+}
+
+struct png_row_reader::implementation : boost::noncopyable
+{
+	const std::wstring					filename_;
+	boost::filesystem::ifstream			file_;
+	const boost::uintmax_t				file_size_;
+	std::streamoff						first_chunk_;
+
+	int									width_;
+	int									height_;
+	int									bit_depth_;
+	int									color_type_;
+	int									pixel_bytes_;
+	size_t								stride_;
+
+	std::array<bgra_pixel, 256>			palette_;
+	bool								has_color_key_;
+	std::array<uint16_t, 3>				color_key_;
+
+	z_stream							zstream_;
+	std::vector<uint8_t>				input_;
+	uint32_t							idat_left_;
+	bool								idat_done_;
+
+	std::vector<uint8_t>				row_;
+	std::vector<uint8_t>				previous_row_;
+	int									next_row_;
+
+	implementation(const std::wstring& filename)
+		: filename_(filename)
+		, file_(boost::filesystem::path(filename), std::ios::binary)
+		, file_size_(file_ ? boost::filesystem::file_size(boost::filesystem::path(filename)) : 0)
+		, has_color_key_(false)
+		, input_(64 * 1024)
+		, idat_left_(0)
+		, idat_done_(false)
+		, next_row_(0)
+	{
+		if(!file_)
+			BOOST_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(narrow(filename)));
+
+		std::array<uint8_t, 8> signature;
+		if(!read(signature.data(), signature.size()) || signature != PNG_SIGNATURE)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Not a PNG file.") << boost::errinfo_file_name(narrow(filename)));
+
+		read_header();
+
+		std::fill(palette_.begin(), palette_.end(), bgra_pixel(0, 0, 0, 255));
+		std::fill(color_key_.begin(), color_key_.end(), 0);
+		read_until_image_data();
+
+		std::memset(&zstream_, 0, sizeof(zstream_));
+		if(inflateInit(&zstream_) != Z_OK)
+			BOOST_THROW_EXCEPTION(invalid_operation() << msg_info("inflateInit failed."));
+
+		row_.resize(stride_ + 1);
+		previous_row_.resize(stride_ + 1);
+	}
+
+	~implementation()
+	{
+		inflateEnd(&zstream_);
+	}
+
+	bool read(uint8_t* data, size_t size)
+	{
+		file_.read(reinterpret_cast<char*>(data), size);
+		return file_.gcount() == static_cast<std::streamsize>(size);
+	}
+
+	void read_chunk_header(uint32_t& length, uint32_t& type)
+	{
+		std::array<uint8_t, 8> header;
+		if(!read(header.data(), header.size()))
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Truncated PNG file.") << boost::errinfo_file_name(narrow(filename_)));
+
+		length	= read_be32(header.data());
+		type	= read_be32(header.data() + 4);
+
+		if(length > MAX_CHUNK_LENGTH)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid PNG chunk length.") << boost::errinfo_file_name(narrow(filename_)));
+
+		// The chunk data and its CRC have to fit in what is left of the file.
+		auto position = static_cast<boost::uintmax_t>(file_.tellg());
+		if(position > file_size_ || static_cast<boost::uintmax_t>(length) + 4 > file_size_ - position)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Truncated PNG file.") << boost::errinfo_file_name(narrow(filename_)));
+	}
+
+	void read_header()
+	{
+		uint32_t length, type;
+		read_chunk_header(length, type);
+
+		std::array<uint8_t, 13> ihdr;
+		if(type != 0x49484452 || length != ihdr.size() || !read(ihdr.data(), ihdr.size())) // IHDR
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Invalid PNG header.") << boost::errinfo_file_name(narrow(filename_)));
+		file_.seekg(4, std::ios::cur); // CRC
+
+		width_		= static_cast<int>(read_be32(ihdr.data()));
+		height_		= static_cast<int>(read_be32(ihdr.data() + 4));
+		bit_depth_	= ihdr[8];
+		color_type_	= ihdr[9];
+
+		if(width_ <= 0 || height_ <= 0 || !is_supported(color_type_, bit_depth_) || ihdr[10] != 0 || ihdr[11] != 0)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported PNG format.") << boost::errinfo_file_name(narrow(filename_)));
+
+		if(ihdr[12] != 0)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Interlaced PNG files cannot be read row by row.") << boost::errinfo_file_name(narrow(filename_)));
+
+		auto bits_per_pixel = channel_count(color_type_) * bit_depth_;
+		pixel_bytes_		= std::max(1, bits_per_pixel / 8);
+		stride_				= (static_cast<size_t>(width_) * bits_per_pixel + 7) / 8;
+		first_chunk_		= file_.tellg();
+	}
+
+	// Reads the ancillary chunks up to the first IDAT.
+	void read_until_image_data()
+	{
+		while(true)
+		{
+			uint32_t length, type;
+			read_chunk_header(length, type);
+
+			if(type == 0x49444154) // IDAT
+			{
+				idat_left_ = length;
+				return;
+			}
+			
+			std::vector<uint8_t> data(length);
+			if(length > 0 && !read(data.data(), length))
+				BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Truncated PNG file.") << boost::errinfo_file_name(narrow(filename_)));
+			file_.seekg(4, std::ios::cur); // CRC
+
+			if(type == 0x504C5445) // PLTE
+			{
+				for(size_t n = 0; n < std::min<size_t>(length / 3, 256); ++n)
+					palette_[n] = bgra_pixel(data[n*3+2], data[n*3+1], data[n*3+0], 255);
+			}
+			else if(type == 0x74524E53) // tRNS
+			{
+				if(color_type_ == palette)
+				{
+					for(size_t n = 0; n < std::min<size_t>(length, 256); ++n)
+						palette_[n].a() = data[n];
+				}
+				else if(color_type_ == gray && length >= 2)
+				{
+					has_color_key_	= true;
+					color_key_[0]	= static_cast<uint16_t>((data[0] << 8) | data[1]);
+				}
+				else if(color_type_ == rgb && length >= 6)
+				{
+					has_color_key_	= true;
+					for(int n = 0; n < 3; ++n)
+						color_key_[n] = static_cast<uint16_t>((data[n*2] << 8) | data[n*2+1]);
+				}
+			}
+			else if(type == 0x49454E44) // IEND
+				BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("PNG file without image data.") << boost::errinfo_file_name(narrow(filename_)));
+		}
+	}
+
+	// Moves the next piece of compressed image data into the inflate input.
+	void refill()
+	{
+		while(idat_left_ == 0 && !idat_done_)
+		{
+			file_.seekg(4, std::ios::cur); // CRC of the previous IDAT
+
+			uint32_t length, type;
+			read_chunk_header(length, type);
+
+			if(type == 0x49444154) // IDAT
+				idat_left_ = length;
+			else
+				idat_done_ = true;
+		}
+
+		if(idat_done_)
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("PNG image data ended early.") << boost::errinfo_file_name(narrow(filename_)));
+
+		auto size = std::min<size_t>(idat_left_, input_.size());
+		if(!read(input_.data(), size))
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Truncated PNG file.") << boost::errinfo_file_name(narrow(filename_)));
+
+		idat_left_			-= static_cast<uint32_t>(size);
+		zstream_.next_in	= input_.data();
+		zstream_.avail_in	= static_cast<uInt>(size);
+	}
+
+	void inflate_row()
+	{
+		zstream_.next_out	= row_.data();
+		zstream_.avail_out	= static_cast<uInt>(row_.size());
+
+		while(zstream_.avail_out > 0)
+		{
+			if(zstream_.avail_in == 0)
+				refill();
+
+			auto result = inflate(&zstream_, Z_NO_FLUSH);
+
+			if(result == Z_STREAM_END && zstream_.avail_out > 0)
+				BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("PNG image data ended early.") << boost::errinfo_file_name(narrow(filename_)));
+			if(result != Z_OK && result != Z_STREAM_END)
+				BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Corrupt PNG image data.") << boost::errinfo_file_name(narrow(filename_)));
+		}
+	}
+
+	void unfilter_row()
+	{
+		auto cur  = row_.data() + 1;
+		auto prev = previous_row_.data() + 1;
+		auto bpp  = static_cast<size_t>(pixel_bytes_);
+
+		switch(row_[0])
+		{
+		case 0: 
+			break;
+		case 1: 
+			for(size_t n = bpp; n < stride_; ++n)
+				cur[n] = static_cast<uint8_t>(cur[n] + cur[n - bpp]);
+			break;
+		case 2: 
+			for(size_t n = 0; n < stride_; ++n)
+				cur[n] = static_cast<uint8_t>(cur[n] + prev[n]);
+			break;
+		case 3: 
+			for(size_t n = 0; n < stride_; ++n)
+				cur[n] = static_cast<uint8_t>(cur[n] + ((n >= bpp ? cur[n - bpp] : 0) + prev[n]) / 2);
+			break;
+		case 4: 
+			for(size_t n = 0; n < stride_; ++n)
+				cur[n] = static_cast<uint8_t>(cur[n] + paeth(n >= bpp ? cur[n - bpp] : 0, prev[n], n >= bpp ? prev[n - bpp] : 0));
+			break;
+		default:
+			BOOST_THROW_EXCEPTION(invalid_argument() << msg_info("Corrupt PNG filter type.") << boost::errinfo_file_name(narrow(filename_)));
+		}
+	}
+
+	// Sample n of the row at the native bit depth.
+	uint16_t sample(size_t n) const
+	{
+		auto data = row_.data() + 1;
+
+		switch(bit_depth_)
+		{
+		case 16:	return static_cast<uint16_t>((data[n*2] << 8) | data[n*2+1]);
+		case 8:		return data[n];
+		default:
+			{
+				auto per_byte = 8 / bit_depth_;
+				auto shift	  = 8 - bit_depth_ * (static_cast<int>(n % per_byte) + 1);
+				return static_cast<uint16_t>((data[n / per_byte] >> shift) & ((1 << bit_depth_) - 1));
+			}
+		}
+	}
+
+	uint8_t to_8bit(uint16_t value) const
+	{
+		switch(bit_depth_)
+		{
+		case 16:	return static_cast<uint8_t>(value >> 8);
+		case 8:		return static_cast<uint8_t>(value);
+		default:	return static_cast<uint8_t>(value * 255 / ((1 << bit_depth_) - 1));
+		}
+	}
+
+	void convert_row(bgra_pixel* dest) const
+	{
+		const size_t channels = channel_count(color_type_);
+
+		for(int x = 0; x < width_; ++x)
+		{
+			const size_t n = x * channels;
+
+			switch(color_type_)
+			{
+			case gray:
+				{
+					auto value = sample(n);
+					auto luma  = to_8bit(value);
+					dest[x] = bgra_pixel(luma, luma, luma, has_color_key_ && value == color_key_[0] ? 0 : 255);
+					break;
+				}
+			case rgb:
+				{
+					auto r = sample(n), g = sample(n + 1), b = sample(n + 2);
+					auto keyed = has_color_key_ && r == color_key_[0] && g == color_key_[1] && b == color_key_[2];
+					dest[x] = bgra_pixel(to_8bit(b), to_8bit(g), to_8bit(r), keyed ? 0 : 255);
+					break;
+				}
+			case palette:
+				dest[x] = palette_[sample(n)];
+				break;
+			case gray_alpha:
+				{
+					auto luma = to_8bit(sample(n));
+					dest[x] = bgra_pixel(luma, luma, luma, to_8bit(sample(n + 1)));
+					break;
+				}
+			case rgb_alpha:
+				dest[x] = bgra_pixel(to_8bit(sample(n + 2)), to_8bit(sample(n + 1)), to_8bit(sample(n)), to_8bit(sample(n + 3)));
+				break;
+			}
+		}
+	}
+
+	void decode_row()
+	{
+		inflate_row();
+		unfilter_row();
+		++next_row_;
+	}
+
+	int read_rows(uint8_t* dest, int linesize, int count)
+	{
+		count = std::max(0, std::min(count, height_ - next_row_));
+
+		for(int n = 0; n < count; ++n)
+		{
+			decode_row();
+
+			auto row = reinterpret_cast<bgra_pixel*>(dest + n * linesize);
+			convert_row(row);
+
+			image_view<bgra_pixel> view(row, width_, 1);
+			premultiply(view);
+
+			row_.swap(previous_row_);
+		}
+
+		return count;
+	}
+
+	void skip_rows(int count)
+	{
+		count = std::max(0, std::min(count, height_ - next_row_));
+
+		for(int n = 0; n < count; ++n)
+		{
+			decode_row();
+			row_.swap(previous_row_);
+		}
+	}
+
+	void rewind()
+	{
+		file_.clear();
+		file_.seekg(first_chunk_);
+
+		idat_left_	= 0;
+		idat_done_	= false;
+		next_row_	= 0;
+		read_until_image_data();
+
+		inflateReset(&zstream_);
+		zstream_.avail_in = 0;
+		std::fill(previous_row_.begin(), previous_row_.end(), 0);
+	}
+};
+
+png_row_reader::png_row_reader(const std::wstring& filename) : impl_(new implementation(filename)){}
+png_row_reader::~png_row_reader(){}
+int png_row_reader::width() const{return impl_->width_;}
+int png_row_reader::height() const{return impl_->height_;}
+int png_row_reader::next_row() const{return impl_->next_row_;}
+int png_row_reader::read_rows(uint8_t* dest, int linesize, int count){return impl_->read_rows(dest, linesize, count);}
+void png_row_reader::skip_rows(int count){impl_->skip_rows(count);}
+void png_row_reader::rewind(){impl_->rewind();}
+
+bool png_row_reader::can_read(const std::wstring& filename)
+{
+	try
+	{
+		png_row_reader reader(filename);
+		return true;
+	}
+	catch(...)
+	{
+		return false;
+	}
+}
+
+}}
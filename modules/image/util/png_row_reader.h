@@ -0,0 +1,89 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Helge Norberg, helge.norberg@svt.se
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { namespace image {
+
+/**
+ * Decodes a non-interlaced PNG file row by row, top to bottom, without ever
+ * holding more than two rows of the image in memory.
+ * <p>
+ * Rows are delivered as premultiplied 8bit BGRA, the same as load_image()
+ * produces for PNG files. 16bit samples are truncated to 8bit.
+ */
+class png_row_reader : boost::noncopyable
+{
+public:
+	/**
+	 * Opens the file and reads its header.
+	 *
+	 * @param filename The PNG file. Interlaced files are not supported.
+	 */
+	explicit png_row_reader(const std::wstring& filename);
+	~png_row_reader();
+
+	/**
+	 * @return whether the file is a PNG file that can be read row by row.
+	 */
+	static bool can_read(const std::wstring& filename);
+
+	int width() const;
+	int height() const;
+
+	/**
+	 * @return The index of the row the next call to read_rows() starts at.
+	 */
+	int next_row() const;
+
+	/**
+	 * Decodes the following rows of the image.
+	 *
+	 * @param dest     Where to store the first row.
+	 * @param linesize The distance in bytes between two rows in dest.
+	 * @param count    The number of rows to decode, limited to the rows left.
+	 *
+	 * @return The number of rows decoded.
+	 */
+	int read_rows(uint8_t* dest, int linesize, int count);
+
+	/**
+	 * Skips rows, decoding them without delivering them.
+	 */
+	void skip_rows(int count);
+
+	/**
+	 * Restarts decoding at the first row.
+	 */
+	void rewind();
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
@@ -31,7 +31,18 @@
 
 #include <boost/algorithm/string.hpp>
 
-namespace caspar { namespace protocol { namespace amcp {
+namespace caspar { 
+	
+namespace ffmpeg {
+
+	class clip_cache;
+	class context_pools;
+
+}
+
+namespace protocol { namespace amcp {
+
+	class data_store;
 
 	enum AMCPCommandScheduling
 	{
@@ -77,6 +88,15 @@ namespace caspar { namespace protocol { namespace amcp {
 		void SetMediaInfoRepo(const safe_ptr<core::media_info_repository>& media_info_repo) {media_info_repo_ = media_info_repo;}
 		std::shared_ptr<core::media_info_repository> GetMediaInfoRepo() { return media_info_repo_; }
 
+		void SetDataStore(const safe_ptr<data_store>& store) {data_store_ = store;}
+		std::shared_ptr<data_store> GetDataStore() { return data_store_; }
+
+		void SetClipCache(const safe_ptr<ffmpeg::clip_cache>& clip_cache) {clip_cache_ = clip_cache;}
+		std::shared_ptr<ffmpeg::clip_cache> GetClipCache() { return clip_cache_; }
+
+		void SetContextPools(const safe_ptr<ffmpeg::context_pools>& context_pools) {context_pools_ = context_pools;}
+		std::shared_ptr<ffmpeg::context_pools> GetContextPools() { return context_pools_; }
+
 		void SetShutdownServerNow(const std::function<void (bool)>& shutdown_server_now) {shutdown_server_now_ = shutdown_server_now;}
 		const std::function<void (bool)>& GetShutdownServerNow() { return shutdown_server_now_; }
 
@@ -99,6 +119,14 @@ namespace caspar { namespace protocol { namespace amcp {
 		virtual std::wstring print() const = 0;
 
 		void SetScheduling(AMCPCommandScheduling s){scheduling_ = s;}
+
+		// Target frame given by the /AT= switch, see AMCPCommandQueue. Empty to execute right away.
+		void SetScheduledAt(const std::wstring& at){scheduledAt_ = at;}
+		const std::wstring& GetScheduledAt() const{return scheduledAt_;}
+
+		// Scheduled commands execute on the stage thread during the tick. Only commands
+		// that neither create producers or consumers nor wait on the stage may be scheduled.
+		virtual bool IsSchedulable() const{return false;}
 		void SetReplyString(const std::wstring& str){replyString_ = str;}
 
 	protected:
@@ -113,8 +141,12 @@ namespace caspar { namespace protocol { namespace amcp {
 		std::vector<safe_ptr<core::video_channel>> channels_;
 		std::shared_ptr<core::thumbnail_generator> thumb_gen_;
 		std::shared_ptr<core::media_info_repository> media_info_repo_;
+		std::shared_ptr<data_store> data_store_;
+		std::shared_ptr<ffmpeg::clip_cache> clip_cache_;
+		std::shared_ptr<ffmpeg::context_pools> context_pools_;
 		std::function<void (bool)> shutdown_server_now_;
 		AMCPCommandScheduling scheduling_;
+		std::wstring scheduledAt_;
 		std::wstring replyString_;
 	};
 
@@ -22,6 +22,9 @@
 #include "..\stdafx.h"
 
 #include "AMCPCommandQueue.h"
+#include "scheduled_frame.h"
+
+#include <core/producer/stage.h>
 
 #include <boost/property_tree/ptree.hpp>
 
@@ -45,6 +48,32 @@ std::map<std::wstring, AMCPCommandQueue*>& get_instances()
 	return queues;
 }
 
+bool execute_command(const AMCPCommandPtr& command, const std::wstring& queue_name)
+{
+	auto print = command->print();
+	bool result = false;
+
+	try
+	{
+		result = command->Execute();
+
+		if(result) 
+			CASPAR_LOG(debug) << "Executed command: " << print;
+		else 
+			CASPAR_LOG(warning) << "Failed to execute command: " << print << L" on " << queue_name;
+	}
+	catch(...)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+		CASPAR_LOG(error) << "Failed to execute command:" << print << L" on " << queue_name;
+		command->SetReplyString(L"500 FAILED\r\n");
+	}
+				
+	command->SendReply();
+
+	return result;
+}
+
 }
 	
 AMCPCommandQueue::AMCPCommandQueue(const std::wstring& name)
@@ -87,32 +116,21 @@ void AMCPCommandQueue::AddCommand(AMCPCommandPtr pCurrentCommand)
 	{
 		try
 		{
-			try
+			if(!pCurrentCommand->GetScheduledAt().empty())
 			{
-				auto print = pCurrentCommand->print();
-				auto params = pCurrentCommand->GetParameters().get_original_string();
-
-				{
-					tbb::spin_mutex::scoped_lock lock(running_command_mutex_);
-					running_command_ = true;
-					running_command_name_ = print;
-					running_command_params_ = std::move(params);
-					running_command_since_.restart();
-				}
-
-				if(pCurrentCommand->Execute()) 
-					CASPAR_LOG(debug) << "Executed command: " << print;
-				else 
-					CASPAR_LOG(warning) << "Failed to execute command: " << print << L" on " << widen(executor_.name());
+				ScheduleCommand(pCurrentCommand);
+				return;
 			}
-			catch(...)
+
 			{
-				CASPAR_LOG_CURRENT_EXCEPTION();
-				CASPAR_LOG(error) << "Failed to execute command:" << pCurrentCommand->print() << L" on " << widen(executor_.name());
-				pCurrentCommand->SetReplyString(L"500 FAILED\r\n");
+				tbb::spin_mutex::scoped_lock lock(running_command_mutex_);
+				running_command_ = true;
+				running_command_name_ = pCurrentCommand->print();
+				running_command_params_ = pCurrentCommand->GetParameters().get_original_string();
+				running_command_since_.restart();
 			}
-				
-			pCurrentCommand->SendReply();
+
+			execute_command(pCurrentCommand, widen(executor_.name()));
 			
 			CASPAR_LOG(trace) << "Ready for a new command";
 
@@ -126,6 +144,35 @@ void AMCPCommandQueue::AddCommand(AMCPCommandPtr pCurrentCommand)
 	});
 }
 
+void AMCPCommandQueue::ScheduleCommand(const AMCPCommandPtr& pCommand)
+{
+	try
+	{
+		if(!pCommand->IsSchedulable())
+			BOOST_THROW_EXCEPTION(invalid_argument() << arg_name_info("/AT") << msg_info(narrow(pCommand->print()) + " can not be scheduled, it would block the tick."));
+
+		auto channel	= pCommand->GetChannel();
+		auto stage		= channel->stage();
+		auto frame		= get_scheduled_frame(pCommand->GetScheduledAt(), channel->get_video_format_desc(), stage->frame_number());
+		auto queue_name	= widen(executor_.name());
+
+		// The command runs on the stage thread at the start of the tick and replies from there.
+		stage->schedule(frame, [=]
+		{
+			execute_command(pCommand, queue_name);
+		});
+
+		CASPAR_LOG(debug) << "Scheduled command: " << pCommand->print() << L" for frame " << frame;
+	}
+	catch(...)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+		CASPAR_LOG(error) << "Failed to schedule command:" << pCommand->print() << L" on " << widen(executor_.name());
+		pCommand->SetReplyString(L"403 ERROR\r\n");
+		pCommand->SendReply();
+	}
+}
+
 boost::property_tree::wptree AMCPCommandQueue::info() const
 {
 	boost::property_tree::wptree info;
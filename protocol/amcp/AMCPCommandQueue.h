@@ -48,6 +48,8 @@ public:
 
 	static boost::property_tree::wptree info_all_queues();
 private:
+	void ScheduleCommand(const AMCPCommandPtr& pCommand);
+
 	executor				executor_;
 	mutable tbb::spin_mutex	running_command_mutex_;
 	bool					running_command_;
@@ -27,6 +27,7 @@
 
 #include "AMCPCommandsImpl.h"
 #include "AMCPProtocolStrategy.h"
+#include "data_store.h"
 
 #include <common/env.h>
 
@@ -43,7 +44,9 @@
 #include <core/video_format.h>
 #include <core/producer/transition/transition_producer.h>
 #include <core/producer/channel/channel_producer.h>
+#include <core/producer/channel/multiview_producer.h>
 #include <core/producer/layer/layer_producer.h>
+#include <core/producer/prefetch/prefetch_producer.h>
 #include <core/producer/frame/frame_transform.h>
 #include <core/producer/stage.h>
 #include <core/producer/layer.h>
@@ -62,6 +65,8 @@
 #include <modules/flash/producer/flash_producer.h>
 #include <modules/flash/producer/cg_producer.h>
 #include <modules/ffmpeg/producer/util/util.h>
+#include <modules/ffmpeg/producer/cache/clip_cache.h>
+#include <modules/ffmpeg/producer/util/context_pool.h>
 #include <modules/image/image.h>
 #include <modules/ogl/ogl.h>
 
@@ -347,7 +352,6 @@ bool DiagnosticsCommand::DoExecute()
 
 bool ChannelGridCommand::DoExecute()
 {
-	int index = 1;
 	auto self = GetChannels().back();
 	
 	core::parameters params;
@@ -358,39 +362,16 @@ bool ChannelGridCommand::DoExecute()
 
 	self->output()->add(screen);
 
+	std::vector<safe_ptr<core::video_channel>> sources;
 	BOOST_FOREACH(auto channel, GetChannels())
 	{
 		if(channel != self)
-		{
-			auto producer = create_channel_producer(self->mixer()->get_frame_factory(index), channel);		
-			self->stage()->load(index, producer, false);
-			self->stage()->play(index);
-			index++;
-		}
+			sources.push_back(channel);
 	}
 
-	int n = GetChannels().size()-1;
-	double delta = 1.0/static_cast<double>(n);
-	for(int x = 0; x < n; ++x)
-	{
-		for(int y = 0; y < n; ++y)
-		{
-			int index = x+y*n+1;
-			auto transform = [=](frame_transform transform) -> frame_transform
-			{		
-				transform.fill_translation[0]	= x*delta;
-				transform.fill_translation[1]	= y*delta;
-				transform.fill_scale[0]			= delta;
-				transform.fill_scale[1]			= delta;
-				transform.clip_translation[0]	= x*delta;
-				transform.clip_translation[1]	= y*delta;
-				transform.clip_scale[0]			= delta;
-				transform.clip_scale[1]			= delta;			
-				return transform;
-			};
-			self->stage()->apply_transform(index, transform);
-		}
-	}
+	auto producer = create_multiview_producer(self->mixer()->get_frame_factory(1), sources);
+	self->stage()->load(1, producer, false);
+	self->stage()->play(1);
 
 	return true;
 }
@@ -1129,6 +1110,19 @@ bool RouteCommand::DoExecute()
 	}
 }
 
+// PREFETCH [n] lets the producer render up to n frames ahead on its own thread. The
+// channel tick waits at most half a frame for it and repeats the last frame otherwise.
+safe_ptr<core::frame_producer> create_prefetch_if_requested(const safe_ptr<core::frame_producer>& producer, const core::parameters& params, const core::video_format_desc& format_desc)
+{
+	if(producer == frame_producer::empty() || !params.has(L"PREFETCH"))
+		return producer;
+
+	auto capacity		 = params.get(L"PREFETCH", 3);
+	auto max_wait_millis = static_cast<int>(500.0 / format_desc.fps);
+
+	return create_prefetch_producer(producer, format_desc, std::max(1, capacity), max_wait_millis);
+}
+
 bool LoadCommand::DoExecute()
 {	
 	//Perform loading of the clip
@@ -1144,6 +1138,7 @@ bool LoadCommand::DoExecute()
 		{
 			pFP = create_producer(GetChannel()->mixer()->get_frame_factory(GetLayerIndex()), _parameters);
 		}
+		pFP = create_prefetch_if_requested(pFP, _parameters, GetChannel()->get_video_format_desc());
 		GetChannel()->stage()->load(GetLayerIndex(), pFP, true);
 	
 		SetReplyString(TEXT("202 LOAD OK\r\n"));
@@ -1263,6 +1258,8 @@ bool LoadbgCommand::DoExecute()
 
 		bool auto_play = std::find(_parameters.begin(), _parameters.end(), L"AUTO") != _parameters.end();
 
+		pFP = create_prefetch_if_requested(pFP, _parameters, GetChannel()->get_video_format_desc());
+
 		auto pFP2 = create_transition_producer(GetChannel()->get_video_format_desc().field_mode, pFP, transitionInfo);
 		GetChannel()->stage()->load(GetLayerIndex(), pFP2, false, auto_play ? transitionInfo.duration : -1); // TODO: LOOP
 	
@@ -1497,12 +1494,8 @@ bool CGCommand::DoExecuteAdd() {
 			pDataString = dataString.c_str();
 		else 
 		{
-			//The data is not an XML-string, it must be a filename
-			std::wstring filename = env::data_folder();
-			filename.append(dataString);
-			filename.append(TEXT(".ftd"));
-
-			dataFromFile = read_file(boost::filesystem::path(filename));
+			//The data is not an XML-string, it must be the name of a stored dataset
+			GetDataStore()->retrieve(dataString, dataFromFile);
 			pDataString = dataFromFile.c_str();
 		}
 	}
@@ -1717,12 +1710,10 @@ bool CGCommand::DoExecuteUpdate()
 		std::wstring dataString = _parameters.at_original(2);
 		if(dataString.at(0) != TEXT('<'))
 		{
-			//The data is not an XML-string, it must be a filename
-			std::wstring filename = env::data_folder();
-			filename.append(dataString);
-			filename.append(TEXT(".ftd"));
-
-			dataString = read_file(boost::filesystem::path(filename));
+			//The data is not an XML-string, it must be the name of a stored dataset
+			std::wstring name = dataString;
+			dataString.clear();
+			GetDataStore()->retrieve(name, dataString);
 		}		
 
 		int layer = _ttoi(_parameters.at(1).c_str());
@@ -1861,26 +1852,7 @@ bool DataCommand::DoExecuteStore()
 		return false;
 	}
 
-	std::wstring filename = env::data_folder();
-	filename.append(_parameters[1]);
-	filename.append(TEXT(".ftd"));
-
-	auto data_path = boost::filesystem::path(filename).parent_path();
-	
-	if(!boost::filesystem::exists(data_path))
-		boost::filesystem::create_directories(data_path);
-
-	std::wofstream datafile(filename.c_str());
-
-	if(!datafile) 
-	{
-		SetReplyString(TEXT("501 DATA STORE FAILED\r\n"));
-		return false;
-	}
-
-	datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
-	datafile << _parameters.at_original(2) << std::flush;
-	datafile.close();
+	GetDataStore()->store(_parameters[1], _parameters.at_original(2));
 
 	std::wstring replyString = TEXT("202 DATA STORE OK\r\n");
 	SetReplyString(replyString);
@@ -1895,13 +1867,9 @@ bool DataCommand::DoExecuteRetrieve()
 		return false;
 	}
 
-	std::wstring filename = env::data_folder();
-	filename.append(_parameters[1]);
-	filename.append(TEXT(".ftd"));
-
-	std::wstring file_contents = read_file(boost::filesystem::path(filename));
+	std::wstring file_contents;
 
-	if (file_contents.empty()) 
+	if (!GetDataStore()->retrieve(_parameters[1], file_contents) || file_contents.empty()) 
 	{
 		SetReplyString(TEXT("404 DATA RETRIEVE ERROR\r\n"));
 		return false;
@@ -1937,18 +1905,17 @@ bool DataCommand::DoExecuteRemove()
 		return false;
 	}
 
-	std::wstring filename = env::data_folder();
-	filename.append(_parameters[1]);
-	filename.append(TEXT(".ftd"));
-
-	if (!boost::filesystem::exists(filename)) 
+	try
 	{
-		SetReplyString(TEXT("404 DATA REMOVE ERROR\r\n"));
-		return false;
+		if (!GetDataStore()->remove(_parameters[1])) 
+		{
+			SetReplyString(TEXT("404 DATA REMOVE ERROR\r\n"));
+			return false;
+		}
 	}
-
-	if (!boost::filesystem::remove(filename))
+	catch(...)
 	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
 		SetReplyString(TEXT("403 DATA REMOVE ERROR\r\n"));
 		return false;
 	}
@@ -1963,22 +1930,8 @@ bool DataCommand::DoExecuteList()
 	std::wstringstream replyString;
 	replyString << TEXT("200 DATA LIST OK\r\n");
 
-	for (boost::filesystem::recursive_directory_iterator itr(env::data_folder()), end; itr != end; ++itr)
-	{			
-		if(boost::filesystem::is_regular_file(itr->path()))
-		{
-			if(!boost::iequals(itr->path().extension().wstring(), L".ftd"))
-				continue;
-			
-			auto relativePath = boost::filesystem::path(itr->path().wstring().substr(env::data_folder().size()-1, itr->path().wstring().size()));
-			
-			auto str = relativePath.replace_extension(TEXT("")).native();
-			if(str[0] == '\\' || str[0] == '/')
-				str = std::wstring(str.begin() + 1, str.end());
-
-			replyString << str << TEXT("\r\n"); 	
-		}
-	}
+	BOOST_FOREACH(auto& name, GetDataStore()->list())
+		replyString << name << TEXT("\r\n"); 	
 	
 	replyString << TEXT("\r\n");
 
@@ -2104,6 +2057,119 @@ bool ThumbnailCommand::DoExecuteGenerateAll()
 	}
 }
 
+bool CacheCommand::DoExecute()
+{
+	std::wstring command = _parameters[0];
+
+	if (command == TEXT("ADD"))
+		return DoExecuteAdd();
+	else if (command == TEXT("REMOVE"))
+		return DoExecuteRemove();
+	else if (command == TEXT("PIN"))
+		return DoExecutePin(true);
+	else if (command == TEXT("UNPIN"))
+		return DoExecutePin(false);
+	else if (command == TEXT("CLEAR"))
+		return DoExecuteClear();
+	else if (command == TEXT("INFO") || command == TEXT("LIST"))
+		return DoExecuteInfo();
+
+	SetReplyString(TEXT("403 CACHE ERROR\r\n"));
+	return false;
+}
+
+bool CacheCommand::DoExecuteAdd()
+{
+	if(_parameters.size() < 2 || GetChannels().empty()) 
+	{
+		SetReplyString(TEXT("402 CACHE ADD ERROR\r\n"));
+		return false;
+	}
+
+	try
+	{
+		// Frames are cached converted for the first channel and serve every channel of its format.
+		GetClipCache()->add(_parameters.at_original(1), GetChannels().front()->mixer()->get_frame_factory(0), _parameters.has(L"PIN"));
+
+		SetReplyString(TEXT("202 CACHE ADD OK\r\n"));
+		return true;
+	}
+	catch(file_not_found&)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+		SetReplyString(TEXT("404 CACHE ADD ERROR\r\n"));
+		return false;
+	}
+	catch(...)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+		SetReplyString(TEXT("501 CACHE ADD FAILED\r\n"));
+		return false;
+	}
+}
+
+bool CacheCommand::DoExecuteRemove()
+{
+	if(_parameters.size() < 2) 
+	{
+		SetReplyString(TEXT("402 CACHE REMOVE ERROR\r\n"));
+		return false;
+	}
+
+	if(!GetClipCache()->remove(_parameters.at_original(1)))
+	{
+		SetReplyString(TEXT("404 CACHE REMOVE ERROR\r\n"));
+		return false;
+	}
+
+	SetReplyString(TEXT("202 CACHE REMOVE OK\r\n"));
+	return true;
+}
+
+bool CacheCommand::DoExecutePin(bool pinned)
+{
+	std::wstring command = pinned ? L"PIN" : L"UNPIN";
+
+	if(_parameters.size() < 2) 
+	{
+		SetReplyString(L"402 CACHE " + command + L" ERROR\r\n");
+		return false;
+	}
+
+	if(!GetClipCache()->pin(_parameters.at_original(1), pinned))
+	{
+		SetReplyString(L"404 CACHE " + command + L" ERROR\r\n");
+		return false;
+	}
+
+	SetReplyString(L"202 CACHE " + command + L" OK\r\n");
+	return true;
+}
+
+bool CacheCommand::DoExecuteClear()
+{
+	GetClipCache()->clear();
+
+	SetReplyString(TEXT("202 CACHE CLEAR OK\r\n"));
+	return true;
+}
+
+bool CacheCommand::DoExecuteInfo()
+{
+	std::wstringstream replyString;
+	replyString << L"201 CACHE INFO OK\r\n";
+
+	boost::property_tree::wptree info;
+	info.add_child(L"clip-cache", GetClipCache()->info());
+
+	boost::property_tree::xml_writer_settings<std::wstring> w(' ', 3);
+	boost::property_tree::write_xml(replyString, info, w);
+
+	replyString << L"\r\n";
+	SetReplyString(replyString.str());
+	return true;
+}
+
 bool CinfOneCommand::DoExecute()
 {
 	std::wstringstream replyString;
@@ -2219,13 +2285,35 @@ bool InfoCommand::DoExecute()
 			boost::property_tree::wptree info = AMCPCommandQueue::info_all_queues();
 			boost::property_tree::write_xml(replyString, info, w);
 		}
+		else if(_parameters.size() >= 2 && _parameters[0] == L"THREADS" && _parameters[1] == L"PROFILE")
+		{
+			replyString << L"201 INFO THREADS OK\r\n";
+
+			boost::property_tree::wptree info = get_thread_profile_info();
+			boost::property_tree::write_xml(replyString, info, w);
+		}
 		else if(_parameters.size() >= 1 && _parameters[0] == L"THREADS")
 		{
 			replyString << L"200 INFO THREADS OK\r\n";
 
+			// id, name, cpu load, queue depth, average wait, average and max execution time (ms) 
+			// over the last profiler window.
 			BOOST_FOREACH(auto& thread, get_thread_infos())
 			{
-				replyString << thread->native_id << L"\t" << widen(thread->name) << L"\r\n";
+				replyString << thread->native_id << L"\t" << widen(thread->name);
+
+				auto window = thread->last_window();
+				replyString << L"\t" << static_cast<int>(window.cpu_load * 100.0) << L"%";
+
+				if(window.samples > 0)
+				{
+					replyString << L"\t" << window.queue_depth 
+								<< L"\t" << window.average_wait_time * 1000.0
+								<< L"\t" << window.average_execution_time * 1000.0
+								<< L"\t" << window.max_execution_time * 1000.0;
+				}
+
+				replyString << L"\r\n";
 			}
 
 			replyString << L"\r\n";
@@ -2255,6 +2343,8 @@ bool InfoCommand::DoExecute()
 			info.add(L"system.caspar.ffmpeg.avfilter",			caspar::ffmpeg::get_avfilter_version());
 			info.add(L"system.caspar.ffmpeg.avutil",			caspar::ffmpeg::get_avutil_version());
 			info.add(L"system.caspar.ffmpeg.swscale",			caspar::ffmpeg::get_swscale_version());
+			info.add_child(L"system.caspar.ffmpeg.context-pools",	GetContextPools()->info());
+			info.add_child(L"system.caspar.ffmpeg.clip-cache",		GetClipCache()->info());
 									
 			boost::property_tree::write_xml(replyString, info, w);
 		}
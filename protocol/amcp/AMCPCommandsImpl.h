@@ -25,6 +25,8 @@
 
 #include "AMCPCommand.h"
 
+#include <boost/filesystem/path.hpp>
+
 namespace caspar {
 
 namespace core {
@@ -36,6 +38,7 @@ namespace protocol {
 
 std::wstring ListMedia();
 std::wstring ListTemplates();
+std::wstring read_file(const boost::filesystem::path& file);
 
 namespace amcp {
 	
@@ -60,6 +63,7 @@ class CallCommand : public AMCPCommandBase<true, AddToQueue, 1>
 class MixerCommand : public AMCPCommandBase<true, AddToQueue, 1>
 {
 	std::wstring print() const { return L"MixerCommand";}
+	bool IsSchedulable() const { return true;}
 	core::frame_transform get_current_transform();
 	template<typename Func>
 	bool reply_value(const Func& extractor)
@@ -121,30 +125,35 @@ class LoadbgCommand : public AMCPCommandBase<true, AddToQueue, 1>
 class PlayCommand: public AMCPCommandBase<true, AddToQueue, 0>
 {
 	std::wstring print() const { return L"PlayCommand";}
+	bool IsSchedulable() const { return GetParameters().empty();} // PLAY with a clip loads it first.
 	bool DoExecute();
 };
 
 class PauseCommand: public AMCPCommandBase<true, AddToQueue, 0>
 {
 	std::wstring print() const { return L"PauseCommand";}
+	bool IsSchedulable() const { return true;}
 	bool DoExecute();
 };
 
 class ResumeCommand: public AMCPCommandBase<true, AddToQueue, 0>
 {
 	std::wstring print() const { return L"ResumeCommand";}
+	bool IsSchedulable() const { return true;}
 	bool DoExecute();
 };
 
 class StopCommand : public AMCPCommandBase<true, AddToQueue, 0>
 {
 	std::wstring print() const { return L"StopCommand";}
+	bool IsSchedulable() const { return true;}
 	bool DoExecute();
 };
 
 class ClearCommand : public AMCPCommandBase<true, AddToQueue, 0>
 {
 	std::wstring print() const { return L"ClearCommand";}
+	bool IsSchedulable() const { return true;}
 	bool DoExecute();
 };
 
@@ -197,6 +206,17 @@ class ThumbnailCommand : public AMCPCommandBase<false, AddToQueue, 1>
 	bool DoExecuteGenerateAll();
 };
 
+class CacheCommand : public AMCPCommandBase<false, AddToQueue, 1>
+{
+	std::wstring print() const { return L"CacheCommand";}
+	bool DoExecute();
+	bool DoExecuteAdd();
+	bool DoExecuteRemove();
+	bool DoExecutePin(bool pinned);
+	bool DoExecuteClear();
+	bool DoExecuteInfo();
+};
+
 class ClsCommand : public AMCPCommandBase<false, AddToQueue, 0>
 {
 	std::wstring print() const { return L"ClsCommand";}
@@ -58,11 +58,17 @@ AMCPProtocolStrategy::AMCPProtocolStrategy(
 		const std::vector<safe_ptr<core::video_channel>>& channels,
 		const std::shared_ptr<core::thumbnail_generator>& thumb_gen,
 		const safe_ptr<core::media_info_repository>& media_info_repo,
+		const safe_ptr<data_store>& data_store,
+		const safe_ptr<ffmpeg::clip_cache>& clip_cache,
+		const safe_ptr<ffmpeg::context_pools>& context_pools,
 		const safe_ptr<core::ogl_device>& ogl_device,
 		const std::function<void (bool)>& shutdown_server_now)
 	: channels_(channels)
 	, thumb_gen_(thumb_gen)
 	, media_info_repo_(media_info_repo)
+	, data_store_(data_store)
+	, clip_cache_(clip_cache)
+	, context_pools_(context_pools)
 	, ogl_(ogl_device)
 	, shutdown_server_now_(shutdown_server_now)
 {
@@ -214,6 +220,9 @@ AMCPCommandPtr AMCPProtocolStrategy::InterpretCommandString(const std::wstring&
 				pCommand->SetChannels(channels_);
 				pCommand->SetThumbGenerator(thumb_gen_);
 				pCommand->SetMediaInfoRepo(media_info_repo_);
+				pCommand->SetDataStore(data_store_);
+				pCommand->SetClipCache(clip_cache_);
+				pCommand->SetContextPools(context_pools_);
 				pCommand->SetOglDevice(ogl_);
 				pCommand->SetShutdownServerNow(shutdown_server_now_);
 				//Set scheduling
@@ -222,8 +231,14 @@ AMCPCommandPtr AMCPProtocolStrategy::InterpretCommandString(const std::wstring&
 
 					if(commandSwitch == TEXT("/APP"))
 						pCommand->SetScheduling(AddToQueue);
+					else if(boost::starts_with(commandSwitch, TEXT("/AT=")))
+						pCommand->SetScheduledAt(commandSwitch.substr(4));
 				}
 
+				// Scheduling is against the frames of a channel.
+				if(!pCommand->GetScheduledAt().empty() && !pCommand->NeedChannel())
+					goto ParseFinnished;
+
 				if(pCommand->NeedChannel())
 					state = GetChannel;
 				else
@@ -355,6 +370,7 @@ AMCPCommandPtr AMCPProtocolStrategy::CommandFactory(const std::wstring& str)
 	else if(s == TEXT("SET"))			return std::make_shared<SetCommand>();
 	else if(s == TEXT("GL"))			return std::make_shared<GlCommand>();
 	else if(s == TEXT("THUMBNAIL"))		return std::make_shared<ThumbnailCommand>();
+	else if(s == TEXT("CACHE"))			return std::make_shared<CacheCommand>();
 	//else if(s == TEXT("MONITOR"))
 	//{
 	//	result = AMCPCommandPtr(new MonitorCommand());
@@ -28,6 +28,7 @@
 
 #include "AMCPCommand.h"
 #include "AMCPCommandQueue.h"
+#include "data_store.h"
 
 #include <boost/noncopyable.hpp>
 #include <boost/thread/future.hpp>
@@ -54,6 +55,9 @@ public:
 			const std::vector<safe_ptr<core::video_channel>>& channels,
 			const std::shared_ptr<core::thumbnail_generator>& thumb_gen,
 			const safe_ptr<core::media_info_repository>& media_info_repo,
+			const safe_ptr<data_store>& data_store,
+			const safe_ptr<ffmpeg::clip_cache>& clip_cache,
+			const safe_ptr<ffmpeg::context_pools>& context_pools,
 			const safe_ptr<core::ogl_device>& ogl_device,
 			const std::function<void (bool)>& shutdown_server_now);
 	virtual ~AMCPProtocolStrategy();
@@ -77,6 +81,9 @@ private:
 	std::vector<safe_ptr<core::video_channel>> channels_;
 	std::shared_ptr<core::thumbnail_generator> thumb_gen_;
 	safe_ptr<core::media_info_repository> media_info_repo_;
+	safe_ptr<data_store> data_store_;
+	safe_ptr<ffmpeg::clip_cache> clip_cache_;
+	safe_ptr<ffmpeg::context_pools> context_pools_;
 	safe_ptr<core::ogl_device> ogl_;
 	std::function<void (bool)> shutdown_server_now_;
 	std::vector<AMCPCommandQueuePtr> commandQueues_;
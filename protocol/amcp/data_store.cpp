@@ -0,0 +1,501 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../StdAfx.h"
+
+#include "data_store.h"
+
+#include <common/env.h>
+#include <common/log/log.h>
+#include <common/exception/exceptions.h>
+#include <common/utility/string.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/exception/errinfo_api_function.hpp>
+#include <boost/exception/errinfo_errno.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+const wchar_t* const	JOURNAL_NAME		= L"datastore.journal";
+const size_t			COMPACTION_RECORDS	= 256;
+const long				COMPACTION_INTERVAL	= 10; // seconds
+
+// The name as DATA LIST reports it, with the separators of a path from the data folder.
+std::wstring display_name(const std::wstring& name)
+{
+	auto result = boost::replace_all_copy(name, L"/", L"\\");
+	boost::trim_left_if(result, boost::is_any_of(L"\\"));
+	return result;
+}
+
+std::wstring normalize(const std::wstring& name)
+{
+	return boost::to_upper_copy(display_name(name));
+}
+
+void write_all(HANDLE file, const std::string& data, const boost::filesystem::path& path)
+{
+	DWORD written = 0;
+	if(!data.empty() && (!WriteFile(file, data.data(), static_cast<DWORD>(data.size()), &written, nullptr) || written != data.size()))
+		BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to write " + narrow(path.wstring())) << boost::errinfo_api_function("WriteFile") << boost::errinfo_errno(GetLastError()));
+}
+
+void flush(HANDLE file, const boost::filesystem::path& path)
+{
+	if(!FlushFileBuffers(file))
+		BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to flush " + narrow(path.wstring())) << boost::errinfo_api_function("FlushFileBuffers") << boost::errinfo_errno(GetLastError()));
+}
+
+std::shared_ptr<void> open_file(const boost::filesystem::path& path, DWORD access, DWORD disposition)
+{
+	auto file = CreateFileW(path.wstring().c_str(), access, FILE_SHARE_READ, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to open " + narrow(path.wstring())) << boost::errinfo_api_function("CreateFileW") << boost::errinfo_errno(GetLastError()));
+
+	return std::shared_ptr<void>(file, CloseHandle);
+}
+
+}
+
+struct data_store::implementation : boost::noncopyable
+{
+	struct record
+	{
+		bool			removed;
+		std::wstring	name;
+		std::wstring	data;
+	};
+
+	typedef std::shared_ptr<const std::wstring> value_t; // Empty until read from disk.
+
+	struct entry
+	{
+		std::wstring	name; // As listed, keeps the case of the file on disk.
+		value_t			value;
+	};
+
+	const file_reader					reader_;
+
+	boost::mutex						mutex_;
+	boost::condition_variable			cond_;
+	bool								loaded_;
+	bool								running_;
+	boost::filesystem::path				folder_;
+	std::map<std::wstring, entry>		index_; // By normalized name.
+	std::set<std::wstring>				removed_; // Until compacted, a pending write may still bring the file back.
+	std::vector<record>					pending_;
+
+	// Only touched by the persistence thread.
+	std::shared_ptr<void>				journal_;
+	size_t								journal_records_;
+	std::set<std::wstring>				dirty_;
+	boost::posix_time::ptime			first_dirty_;
+
+	boost::thread						thread_;
+
+	implementation(const file_reader& reader)
+		: reader_(reader)
+		, loaded_(false)
+		, running_(false)
+		, journal_records_(0)
+	{
+	}
+
+	~implementation()
+	{
+		shutdown();
+	}
+
+	void shutdown()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			running_ = false;
+		}
+		cond_.notify_all();
+
+		// The thread compacts the journal into the .ftd files before it exits.
+		if(thread_.joinable())
+			thread_.join();
+	}
+
+	boost::filesystem::path get_path(const std::wstring& name) const
+	{
+		return folder_ / (name + L".ftd");
+	}
+
+	// Called with mutex_ held.
+	void ensure_loaded()
+	{
+		if(loaded_)
+			return;
+
+		folder_ = env::data_folder();
+
+		try
+		{
+			replay_journal();
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+
+		if(boost::filesystem::exists(folder_))
+		{
+			for(boost::filesystem::recursive_directory_iterator it(folder_), end; it != end; ++it)
+			{
+				if(!boost::filesystem::is_regular_file(it->path()) || !boost::iequals(it->path().extension().wstring(), L".ftd"))
+					continue;
+
+				auto relative	= it->path().wstring().substr(folder_.wstring().size());
+				auto name		= display_name(boost::filesystem::path(relative).replace_extension(L"").native());
+				index_[normalize(name)].name = name;
+			}
+		}
+
+		CASPAR_LOG(info) << L"[data_store] Indexed " << index_.size() << L" datasets.";
+
+		loaded_  = true;
+		running_ = true;
+		thread_  = boost::thread([this]{run();});
+	}
+
+	void store(const std::wstring& name, const std::wstring& data)
+	{
+		auto key = normalize(name);
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			ensure_loaded();
+
+			auto& e = index_[key];
+			if(e.name.empty())
+				e.name = display_name(name);
+			e.value = std::make_shared<std::wstring>(data);
+			removed_.erase(key);
+
+			if(!running_)
+				CASPAR_LOG(warning) << L"[data_store] Stored " << e.name << L" after shutdown. It will not be persisted.";
+
+			record r = {false, e.name, data};
+			pending_.push_back(r);
+		}
+		cond_.notify_all();
+	}
+
+	bool retrieve(const std::wstring& name, std::wstring& data)
+	{
+		auto key = normalize(name);
+
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		ensure_loaded();
+
+		auto it = index_.find(key);
+		if(it != index_.end() && it->second.value)
+		{
+			data = *it->second.value;
+			return true;
+		}
+
+		if(removed_.find(key) != removed_.end())
+			return false;
+
+		// Not read yet, or a file which has been added to the folder since it was indexed.
+		const bool indexed	= it != index_.end();
+		const auto path		= get_path(indexed ? it->second.name : display_name(name));
+
+		lock.unlock();
+		auto contents = reader_(path);
+		lock.lock();
+
+		it = index_.find(key);
+		if(it == index_.end())
+		{
+			// Removed while reading, or simply not there.
+			if(indexed || contents.empty() || removed_.find(key) != removed_.end())
+				return false;
+
+			it = index_.insert(std::make_pair(key, entry())).first;
+			it->second.name = display_name(name);
+		}
+
+		if(!it->second.value)
+			it->second.value = std::make_shared<std::wstring>(std::move(contents));
+
+		data = *it->second.value;
+		return true;
+	}
+
+	bool remove(const std::wstring& name)
+	{
+		auto key = normalize(name);
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			ensure_loaded();
+
+			auto it = index_.find(key);
+			if(it == index_.end() && removed_.find(key) != removed_.end())
+				return false;
+
+			auto display = it != index_.end() ? it->second.name : display_name(name);
+			auto path	 = get_path(display);
+
+			if(it == index_.end() && !boost::filesystem::exists(path))
+				return false;
+
+			// Deleted right away so that a failure can be reported, throws if the file is in use.
+			boost::filesystem::remove(path);
+
+			if(it != index_.end())
+				index_.erase(it);
+			removed_.insert(key);
+
+			// Still journaled, so that a store of the same dataset pending in the journal is not replayed.
+			record r = {true, display, std::wstring()};
+			pending_.push_back(r);
+		}
+		cond_.notify_all();
+
+		return true;
+	}
+
+	std::vector<std::wstring> list()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		ensure_loaded();
+
+		std::vector<std::wstring> result;
+		BOOST_FOREACH(auto& e, index_)
+			result.push_back(e.second.name);
+		return result;
+	}
+
+	// Persistence thread
+
+	void run()
+	{
+		try
+		{
+			open_journal(OPEN_ALWAYS);
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+			CASPAR_LOG(error) << L"[data_store] Failed to open journal. Changes will only be persisted on compaction.";
+		}
+
+		while(true)
+		{
+			std::vector<record> records;
+			bool running;
+			{
+				boost::unique_lock<boost::mutex> lock(mutex_);
+				if(running_ && pending_.empty())
+					cond_.timed_wait(lock, boost::posix_time::seconds(1));
+
+				records.swap(pending_);
+				running = running_;
+			}
+
+			try
+			{
+				append(records);
+
+				if(!dirty_.empty() && (!running || journal_records_ >= COMPACTION_RECORDS || 
+					boost::posix_time::second_clock::universal_time() - first_dirty_ >= boost::posix_time::seconds(COMPACTION_INTERVAL)))
+					compact();
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+
+			if(!running && records.empty())
+				break;
+		}
+	}
+
+	void open_journal(DWORD disposition)
+	{
+		journal_.reset();
+		journal_ = open_file(folder_ / JOURNAL_NAME, FILE_APPEND_DATA, disposition);
+	}
+
+	void append(const std::vector<record>& records)
+	{
+		if(records.empty())
+			return;
+
+		if(dirty_.empty())
+			first_dirty_ = boost::posix_time::second_clock::universal_time();
+
+		std::ostringstream stream;
+		BOOST_FOREACH(auto& r, records)
+		{
+			auto name = narrow(r.name);
+			auto data = narrow(r.data);
+
+			// Lengths make torn records at the end of the journal detectable.
+			stream << (r.removed ? 'R' : 'S') << ' ' << name.size() << ' ' << data.size() << '\n' << name << data << '\n';
+
+			dirty_.insert(normalize(r.name));
+			++journal_records_;
+		}
+
+		if(journal_)
+		{
+			// The change has been acknowledged, so it has to reach the disk and not only the cache.
+			auto path = folder_ / JOURNAL_NAME;
+			write_all(journal_.get(), stream.str(), path);
+			flush(journal_.get(), path);
+		}
+	}
+
+	void compact()
+	{
+		BOOST_FOREACH(auto& key, dirty_)
+		{
+			std::wstring name = key;
+			value_t value;
+			bool removed;
+			{
+				boost::lock_guard<boost::mutex> lock(mutex_);
+				auto it = index_.find(key);
+				removed = it == index_.end();
+				if(!removed)
+				{
+					name  = it->second.name;
+					value = it->second.value;
+				}
+			}
+
+			if(removed)
+			{
+				boost::filesystem::remove(get_path(key));
+
+				boost::lock_guard<boost::mutex> lock(mutex_);
+				if(index_.find(key) == index_.end())
+					removed_.erase(key);
+			}
+			else if(value)
+				write_file(get_path(name), *value);
+		}
+
+		dirty_.clear();
+		journal_records_ = 0;
+
+		// Everything in the journal is now in the .ftd files.
+		open_journal(CREATE_ALWAYS);
+	}
+
+	static void write_file(const boost::filesystem::path& path, const std::wstring& data)
+	{
+		static const char BOM[] = {'\xef', '\xbb', '\xbf'};
+
+		boost::filesystem::create_directories(path.parent_path());
+
+		auto temp_path = boost::filesystem::path(path.wstring() + L".tmp");
+		{
+			auto file = open_file(temp_path, GENERIC_WRITE, CREATE_ALWAYS);
+			write_all(file.get(), std::string(BOM, sizeof(BOM)) + narrow(data), temp_path);
+			flush(file.get(), temp_path);
+		}
+
+		// Atomic replace, a crash leaves either the old or the new dataset.
+		if(!MoveFileExW(temp_path.wstring().c_str(), path.wstring().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+			BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Failed to replace " + narrow(path.wstring())) << boost::errinfo_errno(GetLastError()));
+	}
+
+	// Called with mutex_ held, before the persistence thread is started.
+	void replay_journal()
+	{
+		auto path = folder_ / JOURNAL_NAME;
+		if(!boost::filesystem::exists(path) || boost::filesystem::file_size(path) == 0)
+			return;
+
+		std::string contents;
+		{
+			boost::filesystem::ifstream file(path, std::ios::binary);
+			contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+
+		std::map<std::wstring, std::pair<std::wstring, std::shared_ptr<std::wstring>>> changes; // Name and data, null for removed.
+
+		size_t pos = 0;
+		while(pos < contents.size())
+		{
+			auto eol = contents.find('\n', pos);
+			if(eol == std::string::npos)
+				break;
+
+			std::istringstream header(contents.substr(pos, eol - pos));
+			char type = 0;
+			size_t name_size = 0, data_size = 0;
+			if(!(header >> type >> name_size >> data_size) || (type != 'S' && type != 'R'))
+				break;
+
+			auto begin = eol + 1;
+			if(begin + name_size + data_size >= contents.size() || contents[begin + name_size + data_size] != '\n')
+				break; // Torn record written during a crash.
+
+			auto name = widen(contents.substr(begin, name_size));
+			auto data = type == 'S' ? std::make_shared<std::wstring>(widen(contents.substr(begin + name_size, data_size))) : nullptr;
+			changes[normalize(name)] = std::make_pair(name, data);
+
+			pos = begin + name_size + data_size + 1;
+		}
+
+		BOOST_FOREACH(auto& change, changes)
+		{
+			if(change.second.second)
+				write_file(get_path(change.second.first), *change.second.second);
+			else
+				boost::filesystem::remove(get_path(change.second.first));
+		}
+
+		boost::filesystem::remove(path);
+
+		CASPAR_LOG(info) << L"[data_store] Recovered " << changes.size() << L" datasets from journal.";
+	}
+};
+
+data_store::data_store(const file_reader& reader) : impl_(new implementation(reader)){}
+data_store::~data_store(){}
+void data_store::store(const std::wstring& name, const std::wstring& data){impl_->store(name, data);}
+bool data_store::retrieve(const std::wstring& name, std::wstring& data){return impl_->retrieve(name, data);}
+bool data_store::remove(const std::wstring& name){return impl_->remove(name);}
+std::vector<std::wstring> data_store::list(){return impl_->list();}
+void data_store::shutdown(){impl_->shutdown();}
+
+}}}
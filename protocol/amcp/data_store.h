@@ -0,0 +1,61 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// In-memory store for the DATA commands. The .ftd files in the data folder are
+// indexed on first use and read lazily. Changes are answered from memory and
+// persisted in the background: first appended to a journal, which is later
+// compacted into the .ftd files. A journal left behind by a crash is replayed
+// into the .ftd files before the store is used. Owned by the server, which
+// shuts it down explicitly.
+class data_store : boost::noncopyable
+{
+public:
+	typedef std::function<std::wstring(const boost::filesystem::path&)> file_reader;
+
+	explicit data_store(const file_reader& reader);
+	~data_store();
+
+	void store(const std::wstring& name, const std::wstring& data);
+	bool retrieve(const std::wstring& name, std::wstring& data);
+	bool remove(const std::wstring& name); // False if not found, throws if the file could not be deleted.
+	std::vector<std::wstring> list();
+
+	// Persists all changes into the .ftd files and stops the background thread.
+	void shutdown();
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}}
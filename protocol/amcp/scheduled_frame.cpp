@@ -0,0 +1,71 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "../StdAfx.h"
+
+#include "scheduled_frame.h"
+
+#include <core/video_format.h>
+
+#include <common/exception/exceptions.h>
+#include <common/utility/string.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+int64_t get_scheduled_frame(const std::wstring& at, const core::video_format_desc& format_desc, int64_t next_frame)
+{
+	try
+	{
+		if(boost::starts_with(at, L"+"))
+			return next_frame + boost::lexical_cast<int64_t>(at.substr(1));
+
+		std::vector<std::wstring> fields;
+		boost::split(fields, at, boost::is_any_of(L":"));
+
+		if(fields.size() == 1)
+			return boost::lexical_cast<int64_t>(at);
+
+		if(fields.size() == 4)
+		{
+			auto timecode_fps = static_cast<int64_t>(std::floor(format_desc.fps + 0.5));
+			auto hours		  = boost::lexical_cast<int64_t>(fields[0]);
+			auto minutes	  = boost::lexical_cast<int64_t>(fields[1]);
+			auto seconds	  = boost::lexical_cast<int64_t>(fields[2]);
+			auto frames		  = boost::lexical_cast<int64_t>(fields[3]);
+
+			if(hours >= 0 && minutes >= 0 && minutes < 60 && seconds >= 0 && seconds < 60 && frames >= 0 && frames < timecode_fps)
+				return ((hours * 60 + minutes) * 60 + seconds) * timecode_fps + frames;
+		}
+	}
+	catch(const boost::bad_lexical_cast&)
+	{
+	}
+
+	BOOST_THROW_EXCEPTION(invalid_argument() << arg_name_info("/AT") << arg_value_info(narrow(at)));
+}
+
+}}}
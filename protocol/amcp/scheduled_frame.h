@@ -0,0 +1,44 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace caspar { 
+	
+namespace core {
+
+	struct video_format_desc;
+
+}
+
+namespace protocol { namespace amcp {
+
+// Resolves the /AT= switch of a command to a channel frame number: an absolute
+// frame number, +<frames> relative to next_frame, or a time code hh:mm:ss:ff at
+// the nominal frame rate of format_desc. Frame numbers and time codes count from
+// the start of the channel or from its last video format change, see
+// core::stage::frame_number(). Throws invalid_argument when at is malformed.
+int64_t get_scheduled_frame(const std::wstring& at, const core::video_format_desc& format_desc, int64_t next_frame);
+
+}}}
@@ -265,7 +265,7 @@ int main(int argc, char* argv[])
 	boost::tribool restart = false;
 	tbb::task_scheduler_init init;
 	std::wstring config_file_name(L"casparcg.config");
-	
+
 	try 
 	{
 		// Configure environment properties from configuration.
@@ -27,6 +27,7 @@
 #include <common/env.h>
 #include <common/exception/exceptions.h>
 #include <common/utility/string.h>
+#include <common/concurrency/thread_info.h>
 #include <common/filesystem/polling_filesystem_monitor.h>
 
 #include <core/mixer/gpu/ogl_device.h>
@@ -35,10 +36,13 @@
 #include <core/video_channel.h>
 #include <core/producer/stage.h>
 #include <core/consumer/output.h>
+#include <core/consumer/frame_consumer.h>
 #include <core/thumbnail_generator.h>
 #include <core/producer/media_info/media_info.h>
 #include <core/producer/media_info/media_info_repository.h>
 #include <core/producer/media_info/in_memory_media_info_repository.h>
+#include <core/producer/replay/replay_buffer.h>
+#include <core/producer/replay/replay_producer.h>
 
 #include <modules/bluefish/bluefish.h>
 #include <modules/decklink/decklink.h>
@@ -57,8 +61,12 @@
 #include <modules/ogl/consumer/ogl_consumer.h>
 #include <modules/ffmpeg/consumer/ffmpeg_consumer.h>
 #include <modules/ffmpeg/consumer/streaming_consumer.h>
+#include <modules/ffmpeg/producer/cache/clip_cache.h>
+#include <modules/ffmpeg/producer/util/context_pool.h>
 
+#include <protocol/amcp/AMCPCommandsImpl.h>
 #include <protocol/amcp/AMCPProtocolStrategy.h>
+#include <protocol/amcp/data_store.h>
 #include <protocol/cii/CIIProtocolStrategy.h>
 #include <protocol/CLK/CLKProtocolStrategy.h>
 #include <protocol/util/AsyncEventServer.h>
@@ -118,6 +126,13 @@ struct server::implementation : boost::noncopyable
 	boost::thread								initial_media_info_thread_;
 	tbb::atomic<bool>							running_;
 	std::shared_ptr<thumbnail_generator>		thumbnail_generator_;
+	safe_ptr<amcp::data_store>					data_store_;
+	safe_ptr<ffmpeg::clip_cache>				clip_cache_;
+	safe_ptr<ffmpeg::context_pools>				context_pools_;
+	safe_ptr<core::replay_registry>				replay_registry_;
+	boost::asio::deadline_timer					profiler_timer_;
+	int											profiler_window_millis_;
+	bool										profiler_osc_;
 
 	implementation(const std::function<void (bool)>& shutdown_server_now)
 		: io_service_(create_running_io_service())
@@ -125,11 +140,24 @@ struct server::implementation : boost::noncopyable
 		, ogl_(ogl_device::create())
 		, osc_client_(io_service_)
 		, media_info_repo_(create_in_memory_media_info_repository())
+		, data_store_(make_safe<amcp::data_store>(&protocol::read_file))
+		, clip_cache_(make_safe<ffmpeg::clip_cache>())
+		, context_pools_(make_safe<ffmpeg::context_pools>())
+		, replay_registry_(make_safe<core::replay_registry>())
+		, profiler_timer_(*io_service_)
+		, profiler_window_millis_(0)
+		, profiler_osc_(false)
 	{
 		running_ = true;
+		setup_profiler(env::properties());
 		setup_audio(env::properties());
+
+		auto replay_registry = replay_registry_;
+		core::register_consumer_factory([=](const core::parameters& params){return core::create_replay_consumer(params, replay_registry);});
+		core::register_producer_factory([=](const safe_ptr<core::frame_factory>& frame_factory, const core::parameters& params){return core::create_replay_producer(frame_factory, params, replay_registry);});
+		CASPAR_LOG(info) << L"Initialized replay.";
 		
-		ffmpeg::init(media_info_repo_);
+		ffmpeg::init(media_info_repo_, clip_cache_, context_pools_);
 		CASPAR_LOG(info) << L"Initialized ffmpeg module.";
 							  
 		bluefish::init();	  
@@ -164,6 +192,8 @@ struct server::implementation : boost::noncopyable
 		setup_osc(env::properties());
 		CASPAR_LOG(info) << L"Initialized osc.";
 
+		schedule_profiler_report();
+
 		start_initial_media_info_scan();
 		CASPAR_LOG(info) << L"Started initial media information retrieval.";
 	}
@@ -172,13 +202,18 @@ struct server::implementation : boost::noncopyable
 	{
 		diagnostics::show_graphs(false);
 		running_ = false;
+		profiler_timer_.cancel();
 		initial_media_info_thread_.join();
 		thumbnail_generator_.reset();
 		primary_amcp_server_.reset();
 		async_servers_.clear();
+		data_store_->shutdown();
 		destroy_producers_synchronously();
 		channels_.clear();
 
+		// Cached frames belong to the ogl device.
+		clip_cache_->clear();
+		context_pools_->clear();
 		ffmpeg::uninit();
 	}
 
@@ -354,6 +389,54 @@ struct server::implementation : boost::noncopyable
 					});
 	}
 
+	void setup_profiler(const boost::property_tree::wptree& pt)
+	{
+		set_task_sample_rate(pt.get(L"configuration.profiler.sample-rate", 16u));
+		profiler_window_millis_ = pt.get(L"configuration.profiler.window-millis", 1000);
+		profiler_osc_			= pt.get(L"configuration.profiler.osc", true);
+	}
+
+	void schedule_profiler_report()
+	{
+		if(profiler_window_millis_ <= 0)
+			return;
+
+		// The one place which closes the thread windows. INFO THREADS and OSC only read them.
+		profiler_timer_.expires_from_now(boost::posix_time::milliseconds(profiler_window_millis_));
+		profiler_timer_.async_wait([this](const boost::system::error_code& ec)
+		{
+			if(ec || !running_)
+				return;
+
+			sample_thread_infos();
+
+			if(profiler_osc_)
+				publish_thread_profiles();
+
+			schedule_profiler_report();
+		});
+	}
+
+	void publish_thread_profiles()
+	{
+		BOOST_FOREACH(auto& thread, get_thread_infos())
+		{
+			auto window	= thread->last_window();
+			auto path	= "/profiler/thread/" + boost::lexical_cast<std::string>(thread->native_id);
+
+			*monitor_subject_	<< core::monitor::message(path + "/name")		% thread->name
+								<< core::monitor::message(path + "/cpu_load")	% window.cpu_load;
+
+			if(window.samples == 0)
+				continue;
+
+			*monitor_subject_	<< core::monitor::message(path + "/queue_depth")		% static_cast<int64_t>(window.queue_depth)
+								<< core::monitor::message(path + "/wait_time")			% window.average_wait_time
+								<< core::monitor::message(path + "/execution_time")		% window.average_execution_time
+								<< core::monitor::message(path + "/max_execution_time")	% window.max_execution_time;
+		}
+	}
+
 	void setup_thumbnail_generation(const boost::property_tree::wptree& pt)
 	{
 		if (!pt.get(L"configuration.thumbnails.generate-thumbnails", true))
@@ -387,6 +470,9 @@ struct server::implementation : boost::noncopyable
 					channels_,
 					thumbnail_generator_,
 					media_info_repo_,
+					data_store_,
+					clip_cache_,
+					context_pools_,
 					ogl_,
 					shutdown_server_now_);
 		else if(boost::iequals(name, L"CII"))
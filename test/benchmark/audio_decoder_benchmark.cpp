@@ -0,0 +1,286 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavformat/avformat.h>
+	#include <libswresample/swresample.h>
+}
+
+#include <modules/ffmpeg/ffmpeg_error.h>
+#include <modules/ffmpeg/producer/audio/audio_decoder.h>
+#include <modules/ffmpeg/producer/util/util.h>
+
+#include <common/exception/exceptions.h>
+
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/video_format.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+template<typename T>
+void write_le(std::ofstream& file, T value)
+{
+	file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// 16 bit WAVE_FORMAT_EXTENSIBLE with a channel mask so that ffmpeg reports a
+// channel layout for more than 8 channels. Every channel carries its own tone.
+void write_test_file(const boost::filesystem::path& path, size_t num_channels, size_t sample_rate, size_t seconds)
+{
+	const uint32_t block_align	= static_cast<uint32_t>(num_channels * sizeof(int16_t));
+	const uint32_t data_size	= static_cast<uint32_t>(sample_rate * seconds * block_align);
+
+	std::ofstream file(path.string().c_str(), std::ios::binary);
+	if(!file)
+		BOOST_THROW_EXCEPTION(io_error() << msg_info("Could not create " + path.string()));
+
+	file.write("RIFF", 4);
+	write_le<uint32_t>(file, 4 + (8 + 40) + (8 + data_size));
+	file.write("WAVE", 4);
+
+	file.write("fmt ", 4);
+	write_le<uint32_t>(file, 40);
+	write_le<uint16_t>(file, 0xFFFE);
+	write_le<uint16_t>(file, static_cast<uint16_t>(num_channels));
+	write_le<uint32_t>(file, static_cast<uint32_t>(sample_rate));
+	write_le<uint32_t>(file, static_cast<uint32_t>(sample_rate) * block_align);
+	write_le<uint16_t>(file, static_cast<uint16_t>(block_align));
+	write_le<uint16_t>(file, 16);
+	write_le<uint16_t>(file, 22);
+	write_le<uint16_t>(file, 16);
+	write_le<uint32_t>(file, static_cast<uint32_t>((1ULL << num_channels) - 1));
+	static const uint8_t pcm_guid[] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+	file.write(reinterpret_cast<const char*>(pcm_guid), sizeof(pcm_guid));
+
+	file.write("data", 4);
+	write_le<uint32_t>(file, data_size);
+
+	std::vector<int16_t> samples(sample_rate * num_channels);
+	for(size_t n = 0; n < sample_rate; ++n)
+	{
+		for(size_t c = 0; c < num_channels; ++c)
+			samples[n * num_channels + c] = static_cast<int16_t>(8192.0 * std::sin(2.0 * 3.14159265358979323846 * 100.0 * (c + 1) * n / sample_rate));
+	}
+
+	for(size_t s = 0; s < seconds; ++s)
+		file.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(int16_t));
+}
+
+// The decoder before buffer pooling, kept here as the baseline: a frame is
+// allocated for every packet and the converted samples are copied out of a
+// fixed buffer into a new audio_buffer.
+class allocating_decoder
+{
+	safe_ptr<AVCodecContext>										codec_context_;
+	std::shared_ptr<SwrContext>										swr_;
+	std::vector<int32_t, tbb::cache_aligned_allocator<int32_t>>	buffer_;
+	uint64_t														allocations_;
+public:
+	allocating_decoder(AVFormatContext& context, const core::video_format_desc& format_desc)
+		: codec_context_(open_codec(context))
+		, swr_(swr_alloc_set_opts(nullptr,
+								av_get_default_channel_layout(codec_context_->channels), AV_SAMPLE_FMT_S32, format_desc.audio_sample_rate,
+								av_get_default_channel_layout(codec_context_->channels), codec_context_->sample_fmt, codec_context_->sample_rate,
+								0, nullptr), [](SwrContext* p){swr_free(&p);})
+		, buffer_(480000*2)
+		, allocations_(0)
+	{
+		if(!swr_)
+			BOOST_THROW_EXCEPTION(bad_alloc());
+
+		THROW_ON_ERROR2(swr_init(swr_.get()), "[audio_decoder_benchmark]");
+	}
+
+	size_t decode(AVPacket packet)
+	{
+		size_t samples = 0;
+
+		while(packet.size > 0)
+		{
+			auto decoded_frame = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* frame){av_frame_free(&frame);});
+			++allocations_;
+
+			int got_frame = 0;
+			auto len = THROW_ON_ERROR2(avcodec_decode_audio4(codec_context_.get(), decoded_frame.get(), &got_frame, &packet), "[audio_decoder_benchmark]");
+			if(len == 0)
+				break;
+
+			packet.data += len;
+			packet.size -= len;
+
+			if(!got_frame)
+				continue;
+
+			const uint8_t **in = const_cast<const uint8_t**>(decoded_frame->extended_data);			
+			uint8_t* out[]	   = { reinterpret_cast<uint8_t*>(buffer_.data()) };
+
+			const auto channel_samples = swr_convert(swr_.get(), out, static_cast<int>(buffer_.size()) / codec_context_->channels, in, decoded_frame->nb_samples);
+
+			auto audio = std::make_shared<core::audio_buffer>(buffer_.begin(), buffer_.begin() + channel_samples * decoded_frame->channels);
+			++allocations_;
+
+			samples += audio->size();
+		}
+
+		return samples;
+	}
+
+	uint64_t allocations() const
+	{
+		return allocations_;
+	}
+private:
+	static safe_ptr<AVCodecContext> open_codec(AVFormatContext& context)
+	{
+		int index = -1;
+		return ffmpeg::open_codec(context, AVMEDIA_TYPE_AUDIO, index);
+	}
+};
+
+boost::property_tree::wptree decode(const std::string& filename, const core::video_format_desc& format_desc, bool pooled, double media_seconds)
+{
+	AVFormatContext* weak_context = nullptr;
+	THROW_ON_ERROR2(avformat_open_input(&weak_context, filename.c_str(), nullptr, nullptr), "[audio_decoder_benchmark]");
+	auto context = safe_ptr<AVFormatContext>(weak_context, [](AVFormatContext* context)
+	{
+		avformat_close_input(&context);
+	});
+	THROW_ON_ERROR2(avformat_find_stream_info(context.get(), nullptr), "[audio_decoder_benchmark]");
+
+	std::vector<std::shared_ptr<AVPacket>> packets;
+	for(;;)
+	{
+		auto packet = ffmpeg::create_packet();
+		if(av_read_frame(context.get(), packet.get()) < 0)
+			break;
+		av_dup_packet(packet.get());
+		packets.push_back(packet);
+	}
+
+	boost::property_tree::wptree info;
+	size_t	 samples		= 0;
+	uint64_t allocations	= 0;
+	double	 seconds		= 0.0;
+
+	if(pooled)
+	{
+		ffmpeg::audio_decoder decoder(context, format_desc, L"");
+
+		boost::timer timer;
+
+		BOOST_FOREACH(auto& packet, packets)
+		{
+			decoder.push(packet);
+			for(auto audio = decoder.poll(); audio; audio = decoder.poll())
+				samples += audio->size();
+		}
+
+		seconds = timer.elapsed();
+
+		auto stats = decoder.info();
+		allocations = stats.get<uint64_t>(L"allocations");
+		info.add(L"reuses",	stats.get<uint64_t>(L"reuses"));
+		info.add(L"slabs",	stats.get<size_t>(L"slabs"));
+	}
+	else
+	{
+		allocating_decoder decoder(*context, format_desc);
+
+		boost::timer timer;
+
+		BOOST_FOREACH(auto& packet, packets)
+			samples += decoder.decode(*packet);
+
+		seconds = timer.elapsed();
+
+		allocations = decoder.allocations();
+	}
+
+	info.add(L"packets",				packets.size());
+	info.add(L"samples",				samples);
+	info.add(L"decode-seconds",			seconds);
+	info.add(L"micros-per-packet",		packets.empty() ? 0.0 : seconds * 1000000.0 / static_cast<double>(packets.size()));
+	info.add(L"realtime-factor",		seconds > 0.0 ? media_seconds / seconds : 0.0);
+	info.add(L"allocations",			allocations);
+	info.add(L"allocations-per-second",	static_cast<double>(allocations) / media_seconds);
+	return info;
+}
+
+}
+
+boost::property_tree::wptree audio_decoder()
+{
+	const size_t num_channels	= 16;
+	const size_t seconds		= 60;
+
+	av_register_all();
+
+	const auto format_desc	= core::video_format_desc::get(core::video_format::x1080p5994);
+	const auto path			= boost::filesystem::temp_directory_path() / "casparcg-audio-decoder-benchmark.wav";
+
+	write_test_file(path, num_channels, format_desc.audio_sample_rate, seconds);
+
+	boost::property_tree::wptree info;
+	info.add(L"channels",	num_channels);
+	info.add(L"seconds",	seconds);
+	info.add(L"format",		L"pcm_s16le");
+
+	try
+	{
+		auto legacy = decode(path.string(), format_desc, false, static_cast<double>(seconds));
+		auto pooled = decode(path.string(), format_desc, true, static_cast<double>(seconds));
+
+		auto legacy_seconds = legacy.get<double>(L"decode-seconds");
+		auto pooled_seconds = pooled.get<double>(L"decode-seconds");
+
+		info.add_child(L"legacy",	legacy);
+		info.add_child(L"pooled",	pooled);
+		info.add(L"speedup",		pooled_seconds > 0.0 ? legacy_seconds / pooled_seconds : 0.0);
+	}
+	catch(...)
+	{
+		boost::filesystem::remove(path);
+		throw;
+	}
+
+	boost::filesystem::remove(path);
+
+	return info;
+}
+
+}}
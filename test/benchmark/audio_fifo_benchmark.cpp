@@ -0,0 +1,107 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <modules/ffmpeg/producer/muxer/audio_fifo.h>
+
+#include <core/video_format.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/range/algorithm.hpp>
+#include <boost/range/algorithm_ext/push_back.hpp>
+#include <boost/timer.hpp>
+
+#include <queue>
+
+namespace caspar { namespace benchmark {
+
+boost::property_tree::wptree audio_fifo()
+{
+	const size_t num_channels	= 16;
+	const size_t frames			= 60000;
+
+	auto cadence		= core::video_format_desc::get(core::video_format::x1080p5994).audio_cadence;
+	auto packet_size	= 1024 * num_channels;
+
+	core::audio_buffer packet(packet_size);
+	for(size_t n = 0; n < packet.size(); ++n)
+		packet[n] = static_cast<int32_t>(n);
+
+	// Previous frame_muxer implementation.
+	double legacy_seconds;
+	{
+		std::queue<core::audio_buffer> streams;
+		streams.push(core::audio_buffer());
+		auto legacy_cadence = cadence;
+
+		boost::timer timer;
+		for(size_t n = 0; n < frames; ++n)
+		{
+			auto count = legacy_cadence.front() * num_channels;
+			while(streams.front().size() < count)
+				boost::range::push_back(streams.back(), packet);
+
+			auto begin	= streams.front().begin();
+			auto end	= begin + count;
+			core::audio_buffer samples(begin, end);
+			streams.front().erase(begin, end);
+
+			boost::range::rotate(legacy_cadence, std::begin(legacy_cadence)+1);
+		}
+		legacy_seconds = timer.elapsed();
+	}
+
+	double fifo_seconds;
+	size_t fifo_capacity;
+	{
+		ffmpeg::audio_fifo fifo(num_channels, 8 * cadence.front() * num_channels);
+		core::audio_buffer samples;
+		auto fifo_cadence = cadence;
+
+		boost::timer timer;
+		for(size_t n = 0; n < frames; ++n)
+		{
+			auto count = fifo_cadence.front() * num_channels;
+			while(fifo.size() < count)
+				fifo.push(packet.data(), packet.size());
+
+			fifo.read(count, samples);
+
+			boost::range::rotate(fifo_cadence, std::begin(fifo_cadence)+1);
+		}
+		fifo_seconds	= timer.elapsed();
+		fifo_capacity	= fifo.capacity();
+	}
+
+	boost::property_tree::wptree info;
+	info.add(L"channels",				num_channels);
+	info.add(L"format",					L"1080p5994");
+	info.add(L"frames",					frames);
+	info.add(L"packet-samples",			1024);
+	info.add(L"legacy.micros-per-frame",	legacy_seconds * 1000000.0 / static_cast<double>(frames));
+	info.add(L"fifo.micros-per-frame",		fifo_seconds * 1000000.0 / static_cast<double>(frames));
+	info.add(L"fifo.capacity",				fifo_capacity);
+	info.add(L"speedup",					fifo_seconds > 0.0 ? legacy_seconds / fifo_seconds : 0.0);
+	return info;
+}
+
+}}
@@ -0,0 +1,321 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#if defined(_MSC_VER)
+#pragma warning (push)
+#pragma warning (disable : 4244)
+#endif
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavformat/avformat.h>
+	#include <libavcodec/avcodec.h>
+	#include <libavfilter/avfilter.h>
+	#include <libavfilter/avfiltergraph.h>
+	#include <libavfilter/buffersink.h>
+	#include <libavfilter/buffersrc.h>
+	#include <libavutil/channel_layout.h>
+	#include <libavutil/opt.h>
+}
+#if defined(_MSC_VER)
+#pragma warning (pop)
+#endif
+
+#include <modules/ffmpeg/ffmpeg_error.h>
+#include <modules/ffmpeg/producer/audio/audio_decoder.h>
+#include <modules/ffmpeg/producer/util/util.h>
+
+#include <common/exception/exceptions.h>
+
+#include <core/video_format.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+safe_ptr<AVFormatContext> open_file(const std::string& filename)
+{
+	AVFormatContext* weak_context = nullptr;
+	THROW_ON_ERROR2(avformat_open_input(&weak_context, filename.c_str(), nullptr, nullptr), "[audio_merge_benchmark]");
+	auto context = safe_ptr<AVFormatContext>(weak_context, [](AVFormatContext* context)
+	{
+		avformat_close_input(&context);
+	});
+	THROW_ON_ERROR2(avformat_find_stream_info(context.get(), nullptr), "[audio_merge_benchmark]");
+	return context;
+}
+
+std::vector<safe_ptr<AVPacket>> read_packets(AVFormatContext& context)
+{
+	std::vector<safe_ptr<AVPacket>> packets;
+	for(;;)
+	{
+		auto packet = ffmpeg::create_packet();
+		if(av_read_frame(&context, packet.get()) < 0)
+			break;
+		av_dup_packet(packet.get());
+		packets.push_back(packet);
+	}
+	return packets;
+}
+
+// One mono 16 bit PCM track per channel, each carrying its own tone.
+void write_test_file(const std::string& filename, size_t nb_tracks, int sample_rate, size_t seconds)
+{
+	AVFormatContext* weak_context = nullptr;
+	THROW_ON_ERROR2(avformat_alloc_output_context2(&weak_context, nullptr, "mov", filename.c_str()), "[audio_merge_benchmark]");
+	std::shared_ptr<AVFormatContext> context(weak_context, [](AVFormatContext* context)
+	{
+		if(context->pb)
+			avio_close(context->pb);
+		avformat_free_context(context);
+	});
+
+	for(size_t n = 0; n < nb_tracks; ++n)
+	{
+		auto stream = avformat_new_stream(context.get(), nullptr);
+		if(!stream)
+			BOOST_THROW_EXCEPTION(bad_alloc());
+
+		stream->id						= static_cast<int>(n);
+		stream->time_base.num			= 1;
+		stream->time_base.den			= sample_rate;
+		stream->codec->codec_type		= AVMEDIA_TYPE_AUDIO;
+		stream->codec->codec_id			= AV_CODEC_ID_PCM_S16LE;
+		stream->codec->sample_fmt		= AV_SAMPLE_FMT_S16;
+		stream->codec->sample_rate		= sample_rate;
+		stream->codec->channels			= 1;
+		stream->codec->channel_layout	= AV_CH_LAYOUT_MONO;
+		stream->codec->block_align		= 2;
+		stream->codec->bit_rate			= sample_rate * 16;
+		stream->codec->time_base		= stream->time_base;
+	}
+
+	THROW_ON_ERROR2(avio_open(&context->pb, filename.c_str(), AVIO_FLAG_WRITE), "[audio_merge_benchmark]");
+	THROW_ON_ERROR2(avformat_write_header(context.get(), nullptr), "[audio_merge_benchmark]");
+
+	const int packet_samples = 1920;
+	std::vector<int16_t> samples(packet_samples);
+
+	for(int64_t pts = 0; pts < static_cast<int64_t>(seconds) * sample_rate; pts += packet_samples)
+	{
+		for(size_t n = 0; n < nb_tracks; ++n)
+		{
+			for(int s = 0; s < packet_samples; ++s)
+				samples[s] = static_cast<int16_t>(8192.0 * std::sin(2.0 * 3.14159265358979323846 * 100.0 * (n + 1) * static_cast<double>(pts + s) / sample_rate));
+
+			AVPacket packet;
+			av_init_packet(&packet);
+			packet.data			= reinterpret_cast<uint8_t*>(samples.data());
+			packet.size			= packet_samples * sizeof(int16_t);
+			packet.stream_index	= static_cast<int>(n);
+			packet.pts			= pts;
+			packet.dts			= pts;
+			packet.duration		= packet_samples;
+			packet.flags	   |= AV_PKT_FLAG_KEY;
+
+			THROW_ON_ERROR2(av_write_frame(context.get(), &packet), "[audio_merge_benchmark]");
+		}
+	}
+
+	THROW_ON_ERROR2(av_write_trailer(context.get()), "[audio_merge_benchmark]");
+}
+
+boost::property_tree::wptree decode_merged(const std::string& filename, const core::video_format_desc& format_desc, double media_seconds)
+{
+	auto context = open_file(filename);
+	auto packets = read_packets(*context);
+
+	ffmpeg::audio_decoder decoder(context, format_desc, L"", L"ALL");
+
+	boost::timer timer;
+
+	size_t samples = 0;
+	BOOST_FOREACH(auto& packet, packets)
+	{
+		decoder.push(packet);
+		for(auto audio = decoder.poll(); audio; audio = decoder.poll())
+			samples += audio->size();
+	}
+
+	auto seconds = timer.elapsed();
+
+	boost::property_tree::wptree info;
+	info.add(L"channels",			decoder.channel_layout().num_channels);
+	info.add(L"samples",			samples);
+	info.add(L"decode-seconds",		seconds);
+	info.add(L"realtime-factor",	seconds > 0.0 ? media_seconds / seconds : 0.0);
+	return info;
+}
+
+// Per-track decoders feeding abuffer -> amerge -> aformat(s32) -> abuffersink,
+// the filter graph a user would otherwise set up for the same result.
+boost::property_tree::wptree decode_amerge(const std::string& filename, double media_seconds)
+{
+	auto context = open_file(filename);
+	auto packets = read_packets(*context);
+
+	std::vector<std::shared_ptr<AVCodecContext>> decoders;
+	for(unsigned int n = 0; n < context->nb_streams; ++n)
+	{
+		auto codec		= context->streams[n]->codec;
+		auto decoder	= avcodec_find_decoder(codec->codec_id);
+		if(!decoder)
+			BOOST_THROW_EXCEPTION(ffmpeg::averror_decoder_not_found());
+		THROW_ON_ERROR2(avcodec_open2(codec, decoder, nullptr), "[audio_merge_benchmark]");
+		decoders.push_back(std::shared_ptr<AVCodecContext>(codec, avcodec_close));
+	}
+
+	std::shared_ptr<AVFilterGraph> graph(avfilter_graph_alloc(), [](AVFilterGraph* graph)
+	{
+		avfilter_graph_free(&graph);
+	});
+
+	AVFilterContext* merge = nullptr;
+	AVFilterContext* format = nullptr;
+	AVFilterContext* sink = nullptr;
+	std::vector<AVFilterContext*> sources;
+
+	auto inputs = boost::lexical_cast<std::string>(decoders.size());
+	THROW_ON_ERROR2(avfilter_graph_create_filter(&merge, avfilter_get_by_name("amerge"), "amerge", ("inputs=" + inputs).c_str(), nullptr, graph.get()), "[audio_merge_benchmark]");
+	THROW_ON_ERROR2(avfilter_graph_create_filter(&format, avfilter_get_by_name("aformat"), "aformat", "sample_fmts=s32", nullptr, graph.get()), "[audio_merge_benchmark]");
+	THROW_ON_ERROR2(avfilter_graph_create_filter(&sink, avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr, graph.get()), "[audio_merge_benchmark]");
+
+	for(size_t n = 0; n < decoders.size(); ++n)
+	{
+		auto& codec = *decoders[n];
+		auto args = "time_base=1/" + boost::lexical_cast<std::string>(codec.sample_rate) +
+					":sample_rate=" + boost::lexical_cast<std::string>(codec.sample_rate) +
+					":sample_fmt=" + av_get_sample_fmt_name(codec.sample_fmt) +
+					":channel_layout=0x" + (boost::format("%x") % (codec.channel_layout ? codec.channel_layout : av_get_default_channel_layout(codec.channels))).str();
+
+		AVFilterContext* source = nullptr;
+		THROW_ON_ERROR2(avfilter_graph_create_filter(&source, avfilter_get_by_name("abuffer"), ("in" + boost::lexical_cast<std::string>(n)).c_str(), args.c_str(), nullptr, graph.get()), "[audio_merge_benchmark]");
+		THROW_ON_ERROR2(avfilter_link(source, 0, merge, static_cast<unsigned int>(n)), "[audio_merge_benchmark]");
+		sources.push_back(source);
+	}
+
+	THROW_ON_ERROR2(avfilter_link(merge, 0, format, 0), "[audio_merge_benchmark]");
+	THROW_ON_ERROR2(avfilter_link(format, 0, sink, 0), "[audio_merge_benchmark]");
+	THROW_ON_ERROR2(avfilter_graph_config(graph.get(), nullptr), "[audio_merge_benchmark]");
+
+	std::shared_ptr<AVFrame> frame(av_frame_alloc(), [](AVFrame* frame)
+	{
+		av_frame_free(&frame);
+	});
+
+	boost::timer timer;
+
+	size_t samples = 0;
+	BOOST_FOREACH(auto& packet, packets)
+	{
+		AVPacket pkt = *packet;
+		while(pkt.size > 0)
+		{
+			int got_frame = 0;
+			auto len = THROW_ON_ERROR2(avcodec_decode_audio4(decoders[pkt.stream_index].get(), frame.get(), &got_frame, &pkt), "[audio_merge_benchmark]");
+			if(len == 0)
+				break;
+
+			pkt.data += len;
+			pkt.size -= len;
+
+			if(!got_frame)
+				continue;
+
+			THROW_ON_ERROR2(av_buffersrc_add_frame(sources[pkt.stream_index], frame.get()), "[audio_merge_benchmark]");
+
+			while(av_buffersink_get_frame(sink, frame.get()) >= 0)
+			{
+				samples += frame->nb_samples * av_frame_get_channels(frame.get());
+				av_frame_unref(frame.get());
+			}
+		}
+	}
+
+	auto seconds = timer.elapsed();
+
+	boost::property_tree::wptree info;
+	info.add(L"samples",			samples);
+	info.add(L"decode-seconds",		seconds);
+	info.add(L"realtime-factor",	seconds > 0.0 ? media_seconds / seconds : 0.0);
+	return info;
+}
+
+}
+
+boost::property_tree::wptree audio_merge()
+{
+	const size_t nb_tracks	= 16;
+	const size_t seconds	= 60;
+
+	avcodec_register_all();
+	avfilter_register_all();
+	av_register_all();
+
+	const auto format_desc	= core::video_format_desc::get(core::video_format::x1080p5994);
+	const auto path			= boost::filesystem::temp_directory_path() / "casparcg-audio-merge-benchmark.mov";
+
+	write_test_file(path.string(), nb_tracks, format_desc.audio_sample_rate, seconds);
+
+	boost::property_tree::wptree info;
+	info.add(L"tracks",		nb_tracks);
+	info.add(L"seconds",	seconds);
+	info.add(L"format",		L"mov pcm_s16le mono tracks");
+
+	try
+	{
+		auto decoder	= decode_merged(path.string(), format_desc, static_cast<double>(seconds));
+		auto amerge		= decode_amerge(path.string(), static_cast<double>(seconds));
+
+		auto decoder_seconds	= decoder.get<double>(L"decode-seconds");
+		auto amerge_seconds		= amerge.get<double>(L"decode-seconds");
+
+		info.add_child(L"audio-decoder",	decoder);
+		info.add_child(L"amerge",			amerge);
+		info.add(L"speedup",				decoder_seconds > 0.0 ? amerge_seconds / decoder_seconds : 0.0);
+	}
+	catch(...)
+	{
+		boost::filesystem::remove(path);
+		throw;
+	}
+
+	boost::filesystem::remove(path);
+
+	return info;
+}
+
+}}
@@ -0,0 +1,75 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <core/mixer/audio/loudness_meter.h>
+
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+boost::property_tree::wptree audio_meter()
+{
+	const size_t	num_channels	= 16;
+	const size_t	seconds			= 60;
+	const int		sample_rate		= 48000;
+	const size_t	frame_size		= 800;
+
+	std::vector<int32_t> samples(frame_size * num_channels * 60);
+	uint32_t seed = 1;
+	BOOST_FOREACH(auto& sample, samples)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		sample = static_cast<int32_t>(seed) >> 2;
+	}
+
+	core::loudness_meter meter(std::vector<double>(num_channels, 1.0), sample_rate);
+	std::vector<float> sample_peaks, true_peaks;
+
+	const size_t nb_frames = seconds * sample_rate / frame_size;
+
+	boost::timer timer;
+
+	for(size_t n = 0; n < nb_frames; ++n)
+	{
+		meter.process(samples.data() + (n % 60) * frame_size * num_channels, frame_size);
+		meter.take_peaks(sample_peaks, true_peaks);
+	}
+
+	const auto elapsed = timer.elapsed();
+
+	boost::property_tree::wptree info;
+	info.add(L"channels",			num_channels);
+	info.add(L"sample-rate",		sample_rate);
+	info.add(L"frames",				nb_frames);
+	info.add(L"seconds",			elapsed);
+	info.add(L"micros-per-frame",	elapsed * 1000000.0 / static_cast<double>(nb_frames));
+	info.add(L"realtime-factor",	elapsed > 0.0 ? static_cast<double>(seconds) / elapsed : 0.0);
+	return info;
+}
+
+}}
@@ -0,0 +1,88 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavutil/samplefmt.h>
+}
+
+#include <modules/ffmpeg/producer/audio/audio_resampler.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <cmath>
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+boost::property_tree::wptree run_resampler(int output_channels, int input_channels, int output_rate, int input_rate, AVSampleFormat output_format, double seconds)
+{
+	const int chunk = 1920;
+
+	std::vector<int32_t> input(chunk * input_channels);
+	for(size_t n = 0; n < input.size(); ++n)
+		input[n] = static_cast<int32_t>(std::sin(static_cast<double>(n) * 0.01) * 1000000000.0);
+
+	ffmpeg::audio_resampler resampler(output_channels, input_channels, output_rate, input_rate, output_format, AV_SAMPLE_FMT_S32);
+
+	const uint8_t* planes[] = { reinterpret_cast<const uint8_t*>(input.data()) };
+	const int chunks = static_cast<int>(seconds * input_rate / chunk);
+
+	size_t output_bytes = 0;
+	boost::timer timer;
+	for(int n = 0; n < chunks; ++n)
+		output_bytes += resampler.resample(planes, chunk).size();
+	double elapsed = timer.elapsed();
+
+	boost::property_tree::wptree result;
+	result.add(L"input-channels", input_channels);
+	result.add(L"output-channels", output_channels);
+	result.add(L"input-sample-rate", input_rate);
+	result.add(L"output-sample-rate", output_rate);
+	result.add(L"output-format", output_format == AV_SAMPLE_FMT_FLT ? L"flt" : L"s16");
+	result.add(L"audio-seconds", seconds);
+	result.add(L"output-bytes", output_bytes);
+	result.add(L"elapsed-seconds", elapsed);
+	result.add(L"realtime-factor", elapsed > 0.0 ? seconds / elapsed : 0.0);
+	return result;
+}
+
+}
+
+boost::property_tree::wptree audio_resampler()
+{
+	boost::property_tree::wptree result;
+	result.add_child(L"cases.case", run_resampler(2,	2,	48000, 48000, AV_SAMPLE_FMT_S16, 60.0));
+	result.add_child(L"cases.case", run_resampler(2,	2,	48000, 44100, AV_SAMPLE_FMT_FLT, 60.0));
+	result.add_child(L"cases.case", run_resampler(2,	2,	44100, 48000, AV_SAMPLE_FMT_S16, 60.0));
+	result.add_child(L"cases.case", run_resampler(2,	6,	48000, 48000, AV_SAMPLE_FMT_FLT, 60.0));
+	result.add_child(L"cases.case", run_resampler(16,	16,	44100, 48000, AV_SAMPLE_FMT_FLT, 60.0));
+	return result;
+}
+
+}}
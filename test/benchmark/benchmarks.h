@@ -0,0 +1,114 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#pragma once
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+// Benchmarks run by the benchmark executable, "benchmark <name>" (see
+// main.cpp). They live outside of the server modules and only use their
+// public interfaces. Every harness returns its results as a property tree
+// which main.cpp writes as JSON.
+
+namespace caspar { namespace benchmark {
+
+// Runs headless channels over a matrix of formats, channel counts, layer
+// counts and synthetic producers (color, pattern, clip). Frames end in a
+// null consumer with a synchronization clock of its own, so the pipeline
+// runs as fast as it can. Every case reports frames per second, produce,
+// mix, consume and frame interval percentiles, gl buffer allocations and
+// process memory.
+//
+// The matrix is read from the <benchmark> element of casparcg.config, for
+// example:
+//
+// <formats><format>1080i5000</format><format>720p5000</format></formats>
+// <channels><count>1</count><count>2</count></channels>
+// <layers><count>1</count><count>8</count></layers>
+// <producers><producer>color</producer><producer>clip</producer></producers>
+// <frames>300</frames>
+// <warmup-frames>50</warmup-frames>
+// <clip-frames>25</clip-frames>
+// <timeout-seconds>60</timeout-seconds>
+//
+// Missing elements use the defaults above, with 1080p5000 added to the
+// formats and pattern to the producers.
+boost::property_tree::wptree pipeline();
+
+// Packs a 1080 line noise image into every core::packed_format and reports
+// milliseconds per frame and input throughput for the dispatched kernels.
+boost::property_tree::wptree pixel_packing();
+
+// Runs a minute of audio through ffmpeg::audio_resampler for common rate,
+// format and channel conversions and reports the realtime factor of each.
+boost::property_tree::wptree audio_resampler();
+
+// Measures the executor round trip at task sample rates 0, 16 and 1 and the
+// cost of closing the profiler windows with up to 128 extra threads.
+boost::property_tree::wptree thread_profiler();
+
+// Measures fast_memcpy, fast_memshfl and fast_memclr in GB/s against the CRT
+// for frame sizes up to 2160p, on 1, 2, 4 and the default number of threads.
+boost::property_tree::wptree memory_kernels();
+
+// Pushes 1024 sample packets of 16 channels and pops frames at the 1080p5994
+// cadence through ffmpeg::audio_fifo and through the previous vector based
+// queue, reporting the time per frame of both.
+boost::property_tree::wptree audio_fifo();
+
+// Decodes a synthetic 16 channel 48kHz PCM file through the pooled
+// ffmpeg::audio_decoder and through a copy of its former per-packet
+// allocating path, and reports decode time and allocations per second of
+// decoded audio.
+boost::property_tree::wptree audio_decoder();
+
+// Writes a MOV file with 16 mono PCM tracks and decodes it into one
+// interleaved layout, once through ffmpeg::audio_decoder (parallel per-track
+// decode and merge_channels) and once through ffmpeg's amerge filter.
+boost::property_tree::wptree audio_merge();
+
+// Meters 16 channels of 48kHz noise through core::loudness_meter as fast as
+// possible and reports the realtime factor.
+boost::property_tree::wptree audio_meter();
+
+// Records 500 generated 1080p50 frames through the ffmpeg consumer with
+// ProRes, DNxHD and MJPEG, once on one encoder context and once on one per
+// core, and reports the frame rates and the speedup.
+boost::property_tree::wptree ffmpeg_encode();
+
+// Records generated 1080p50 ProRes frames in two second segments at the
+// channel rate for 20 seconds to a disk that stalls for 500 ms every 2 s,
+// once through the smallest write ring and once through the default one,
+// and reports dropped frames and encode loop latency.
+boost::property_tree::wptree ffmpeg_record();
+
+// Culls a six layer program stack of videos, a picture in picture and
+// graphics with one tile off screen 100000 times and reports the items
+// dropped and the microseconds per pass.
+boost::property_tree::wptree image_culling();
+
+// Ingests a synthetic 1080 line capture 500 times as UYVY through sws_scale,
+// the way the decklink producer did before, and through
+// decklink::ingest_video as UYVY and v210. Reports the microseconds per frame
+// of each and the pixels that differ from the sws_scale output.
+boost::property_tree::wptree decklink_ingest();
+
+}}
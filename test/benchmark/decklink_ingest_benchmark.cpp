@@ -0,0 +1,180 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#if defined(_MSC_VER)
+#pragma warning (push)
+#pragma warning (disable : 4244)
+#endif
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavutil/avutil.h>
+	#include <libswscale/swscale.h>
+}
+#if defined(_MSC_VER)
+#pragma warning (pop)
+#endif
+
+#include <modules/decklink/producer/decklink_ingest.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+uint8_t to_8bit(uint32_t value)
+{
+	return static_cast<uint8_t>(std::min<uint32_t>((value + 2) >> 2, 255));
+}
+
+}
+
+boost::property_tree::wptree decklink_ingest()
+{
+	const int width		= 1920;
+	const int height	= 1080;
+	const int nb_frames	= 500;
+
+	// Synthetic captures of the same 10 bit picture, packed as UYVY and as v210.
+
+	const int uyvy_row_bytes = width * 2;
+	const int v210_row_bytes = ((width + 47) / 48) * 128;
+
+	std::vector<uint8_t> uyvy(uyvy_row_bytes * height);
+	std::vector<uint8_t> v210(v210_row_bytes * height, 0);
+
+	auto component = [](int x, int y, int plane) -> uint32_t
+	{
+		return static_cast<uint32_t>(64 + (x * 7 + y * 13 + plane * 101) % 877);
+	};
+
+	for (int y = 0; y < height; ++y)
+	{
+		auto row_uyvy = uyvy.data() + y * uyvy_row_bytes;
+		auto row_v210 = reinterpret_cast<uint32_t*>(v210.data() + y * v210_row_bytes);
+
+		std::vector<uint32_t> sequence;
+		for (int x = 0; x < width; x += 2)
+		{
+			sequence.push_back(component(x/2, y, 1));
+			sequence.push_back(component(x, y, 0));
+			sequence.push_back(component(x/2, y, 2));
+			sequence.push_back(component(x+1, y, 0));
+		}
+		sequence.resize(((sequence.size() + 11) / 12) * 12, 0);
+
+		for (int n = 0; n < width * 2; ++n)
+			row_uyvy[n] = to_8bit(sequence[n]);
+
+		for (size_t n = 0; n < sequence.size(); n += 3)
+			row_v210[n/3] = sequence[n] | (sequence[n+1] << 10) | (sequence[n+2] << 20);
+	}
+
+	auto measure = [&](const std::function<void()>& func) -> double
+	{
+		boost::timer timer;
+		for (int n = 0; n < nb_frames; ++n)
+			func();
+		return timer.elapsed() * 1000000.0 / static_cast<double>(nb_frames);
+	};
+
+	// Before: UYVY converted to planar Y'CbCr by sws_scale.
+
+	auto planar_desc = decklink::get_ingest_pixel_format_desc(decklink::capture_format::v210, width, height);
+	std::vector<uint8_t> sws_y(planar_desc.planes[0].size), sws_cb(planar_desc.planes[1].size), sws_cr(planar_desc.planes[2].size);
+
+	std::shared_ptr<SwsContext> sws_context(sws_getContext(width, height, PIX_FMT_UYVY422, width, height, PIX_FMT_YUV422P, SWS_BILINEAR, nullptr, nullptr, nullptr), sws_freeContext);
+
+	const uint8_t*	sws_src[4]			= {uyvy.data(), nullptr, nullptr, nullptr};
+	int				sws_src_linesize[4]	= {uyvy_row_bytes, 0, 0, 0};
+	uint8_t*		sws_dst[4]			= {sws_y.data(), sws_cb.data(), sws_cr.data(), nullptr};
+	int				sws_dst_linesize[4]	= {static_cast<int>(planar_desc.planes[0].linesize), static_cast<int>(planar_desc.planes[1].linesize), static_cast<int>(planar_desc.planes[2].linesize), 0};
+
+	auto sws_micros = measure([&]
+	{
+		sws_scale(sws_context.get(), sws_src, sws_src_linesize, 0, height, sws_dst, sws_dst_linesize);
+	});
+
+	// After: UYVY copied as it is, v210 unpacked.
+
+	auto uyvy_desc = decklink::get_ingest_pixel_format_desc(decklink::capture_format::uyvy, width, height);
+	std::vector<uint8_t> uyvy_plane(uyvy_desc.planes[0].size);
+	uint8_t* uyvy_planes[] = {uyvy_plane.data()};
+
+	auto uyvy_micros = measure([&]
+	{
+		decklink::ingest_video(decklink::capture_format::uyvy, uyvy.data(), uyvy_row_bytes, uyvy_desc, uyvy_planes);
+	});
+
+	std::vector<uint8_t> v210_y(planar_desc.planes[0].size), v210_cb(planar_desc.planes[1].size), v210_cr(planar_desc.planes[2].size);
+	uint8_t* v210_planes[] = {v210_y.data(), v210_cb.data(), v210_cr.data()};
+
+	auto v210_micros = measure([&]
+	{
+		decklink::ingest_video(decklink::capture_format::v210, v210.data(), v210_row_bytes, planar_desc, v210_planes);
+	});
+
+	// The packed UYVY plane and the unpacked v210 planes must hold the samples sws_scale produced.
+
+	int uyvy_errors = 0;
+	int v210_errors = 0;
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			auto packed = uyvy_plane.data() + y * uyvy_desc.planes[0].linesize + (x / 2) * 4;
+			auto luma	= y * planar_desc.planes[0].linesize + x;
+			auto chroma	= y * planar_desc.planes[1].linesize + x / 2;
+
+			if (packed[x % 2 == 0 ? 1 : 3] != sws_y[luma] || packed[0] != sws_cb[chroma] || packed[2] != sws_cr[chroma])
+				++uyvy_errors;
+
+			if (v210_y[luma] != sws_y[luma] || v210_cb[chroma] != sws_cb[chroma] || v210_cr[chroma] != sws_cr[chroma])
+				++v210_errors;
+		}
+	}
+
+	boost::property_tree::wptree info;
+	info.add(L"width",							width);
+	info.add(L"height",							height);
+	info.add(L"frames",							nb_frames);
+	info.add(L"sws.micros-per-frame",			sws_micros);
+	info.add(L"uyvy.micros-per-frame",			uyvy_micros);
+	info.add(L"uyvy.mismatched-pixels",			uyvy_errors);
+	info.add(L"v210.micros-per-frame",			v210_micros);
+	info.add(L"v210.mismatched-pixels",			v210_errors);
+	info.add(L"passed",							uyvy_errors == 0 && v210_errors == 0);
+	return info;
+}
+
+}}
@@ -0,0 +1,374 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <modules/ffmpeg/consumer/async_file_writer.h>
+#include <modules/ffmpeg/consumer/ffmpeg_consumer.h>
+
+#include <common/log/log.h>
+#include <common/utility/pacing_clock.h>
+#include <common/utility/string.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/mixer/audio/audio_util.h>
+#include <core/mixer/read_frame.h>
+#include <core/video_format.h>
+
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/chrono.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread.hpp>
+#include <boost/timer.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#pragma warning (push)
+#pragma warning (disable : 4244)
+#endif
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavformat/avformat.h>
+}
+#if defined(_MSC_VER)
+#pragma warning (pop)
+#endif
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+// A disk that stops for stall_for every stall_every, in front of the files
+// the writer would normally write.
+class stalling_sink : public ffmpeg::file_sink
+{
+	const safe_ptr<ffmpeg::file_sink>			sink_;
+	const boost::chrono::milliseconds			stall_every_;
+	const boost::chrono::milliseconds			stall_for_;
+	boost::chrono::steady_clock::time_point		next_stall_;
+public:
+	stalling_sink(int stall_every_ms, int stall_for_ms)
+		: sink_(ffmpeg::create_file_sink())
+		, stall_every_(stall_every_ms)
+		, stall_for_(stall_for_ms)
+		, next_stall_(boost::chrono::steady_clock::now() + stall_every_)
+	{
+	}
+
+	virtual bool open(const std::wstring& filename, bool unbuffered) override
+	{
+		return sink_->open(filename, unbuffered);
+	}
+
+	virtual bool write(const uint8_t* data, size_t size) override
+	{
+		if(boost::chrono::steady_clock::now() >= next_stall_)
+		{
+			boost::this_thread::sleep_for(stall_for_);
+			next_stall_ = boost::chrono::steady_clock::now() + stall_every_;
+		}
+
+		return sink_->write(data, size);
+	}
+
+	virtual bool truncate(uint64_t size) override
+	{
+		return sink_->truncate(size);
+	}
+
+	virtual bool flush() override
+	{
+		return sink_->flush();
+	}
+
+	virtual void close() override
+	{
+		sink_->close();
+	}
+};
+
+// A channel frame that never touches the gpu, for encoding without a channel.
+class generated_frame : public core::read_frame
+{
+	std::vector<uint8_t>	image_;
+	core::audio_buffer		audio_;
+	int						num_channels_;
+public:
+	generated_frame(const core::video_format_desc& format_desc, int num_channels, uint32_t seed)
+		: image_(format_desc.size)
+		, audio_(format_desc.audio_cadence.front() * num_channels, 0)
+		, num_channels_(num_channels)
+	{
+		// Gradients with noise on top, so the encoders have detail to spend bits on.
+		for(size_t y = 0; y < format_desc.height; ++y)
+		{
+			auto line = image_.data() + y * format_desc.width * 4;
+			for(size_t x = 0; x < format_desc.width; ++x)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const auto noise = static_cast<uint8_t>(seed >> 27);
+
+				line[x*4 + 0] = static_cast<uint8_t>((x + noise) & 0xFF);
+				line[x*4 + 1] = static_cast<uint8_t>((y + noise) & 0xFF);
+				line[x*4 + 2] = static_cast<uint8_t>(((x ^ y) + noise) & 0xFF);
+				line[x*4 + 3] = 255;
+			}
+		}
+	}
+
+	virtual const boost::iterator_range<const uint8_t*> image_data() override
+	{
+		return boost::iterator_range<const uint8_t*>(image_.data(), image_.data() + image_.size());
+	}
+
+	virtual const boost::iterator_range<const int32_t*> audio_data() override
+	{
+		return boost::iterator_range<const int32_t*>(audio_.data(), audio_.data() + audio_.size());
+	}
+
+	virtual size_t image_size() const override
+	{
+		return image_.size();
+	}
+
+	virtual int num_channels() const override
+	{
+		return num_channels_;
+	}
+
+	virtual int64_t get_age_millis() const override
+	{
+		return 0;
+	}
+};
+
+std::vector<safe_ptr<core::read_frame>> generate_frames(const core::video_format_desc& format_desc)
+{
+	std::vector<safe_ptr<core::read_frame>> frames;
+	for(uint32_t n = 0; n < 8; ++n)
+		frames.push_back(make_safe<generated_frame>(format_desc, 2, n + 1));
+	return frames;
+}
+
+// Waits until the consumer has room, the consumer drops frames sent to a full queue.
+void wait_for_room(const core::frame_consumer& consumer)
+{
+	while(true)
+	{
+		auto recording = consumer.info().get_child(L"recording");
+		if(recording.get<size_t>(L"encode-queue") < recording.get<size_t>(L"encode-queue-capacity"))
+			return;
+
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+}
+
+boost::property_tree::wptree encode(const std::vector<safe_ptr<core::read_frame>>& frames, const core::video_format_desc& format_desc, const std::string& vcodec, size_t encoders, size_t nb_frames)
+{
+	const auto path = boost::filesystem::temp_directory_path() / ("casparcg-encode-benchmark-" + vcodec + ".mov");
+
+	std::vector<ffmpeg::option> options;
+	options.push_back(ffmpeg::option("vcodec", vcodec));
+	options.push_back(ffmpeg::option("acodec", "pcm_s16le"));
+	options.push_back(ffmpeg::option("encoders", boost::lexical_cast<std::string>(encoders)));
+
+	boost::property_tree::wptree info;
+	info.add(L"requested-encoders", encoders);
+
+	try
+	{
+		std::shared_ptr<core::frame_consumer> consumer = ffmpeg::create_consumer(path.wstring(), options);
+		consumer->initialize(format_desc, core::channel_layout::stereo(), 0);
+		info.add(L"encoders", consumer->info().get<size_t>(L"recording.encoders"));
+
+		boost::timer timer;
+
+		for(size_t n = 0; n < nb_frames; ++n)
+		{
+			wait_for_room(*consumer);
+			consumer->send(frames[n % frames.size()]);
+		}
+
+		consumer.reset(); // Drains the encoders and writes the trailer.
+
+		const auto seconds = timer.elapsed();
+
+		info.add(L"frames",				nb_frames);
+		info.add(L"seconds",			seconds);
+		info.add(L"fps",				seconds > 0.0 ? static_cast<double>(nb_frames) / seconds : 0.0);
+		info.add(L"realtime-factor",	seconds > 0.0 ? static_cast<double>(nb_frames) / format_desc.fps / seconds : 0.0);
+		info.add(L"file-size",			boost::filesystem::file_size(path));
+	}
+	catch(...)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+		info.add(L"error", widen(boost::current_exception_diagnostic_information()));
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::remove(path, ec);
+
+	return info;
+}
+
+// Feeds frames at the channel rate, like a channel would, and reads back the
+// frames the consumer could not take.
+boost::property_tree::wptree record(const std::vector<safe_ptr<core::read_frame>>& frames, const core::video_format_desc& format_desc, const ffmpeg::async_file_writer::configuration& writer_config, size_t seconds)
+{
+	const auto directory	= boost::filesystem::temp_directory_path() / "casparcg-record-benchmark";
+	const auto path			= directory / "record.mov";
+
+	boost::system::error_code ec;
+	boost::filesystem::remove_all(directory, ec);
+	boost::filesystem::create_directories(directory);
+
+	std::vector<ffmpeg::option> options;
+	options.push_back(ffmpeg::option("vcodec", "prores"));
+	options.push_back(ffmpeg::option("acodec", "pcm_s16le"));
+	options.push_back(ffmpeg::option("segment_time", "2"));
+
+	boost::property_tree::wptree info;
+	info.add(L"write-buffers",		writer_config.buffer_count);
+	info.add(L"write-buffer-size",	writer_config.buffer_size);
+
+	try
+	{
+		std::shared_ptr<core::frame_consumer> consumer = ffmpeg::create_consumer(path.wstring(), options, writer_config);
+		consumer->initialize(format_desc, core::channel_layout::stereo(), 0);
+
+		frame_pacer pacer(make_safe<pacing_clock>(format_desc.time_scale, format_desc.duration));
+
+		const auto nb_frames = static_cast<size_t>(seconds * format_desc.fps);
+
+		for(size_t n = 0; n < nb_frames; ++n)
+		{
+			pacer.tick();
+			consumer->send(frames[n % frames.size()]);
+		}
+
+		auto recording = consumer->info().get_child(L"recording");
+
+		info.add(L"frames",			nb_frames);
+		info.add(L"dropped-frames",	recording.get<uint64_t>(L"dropped-frames"));
+		info.add_child(L"recording", recording);
+
+		consumer.reset();
+
+		size_t segments = 0;
+		uint64_t bytes = 0;
+		for(boost::filesystem::directory_iterator it(directory), end; it != end; ++it)
+		{
+			++segments;
+			bytes += boost::filesystem::file_size(it->path());
+		}
+
+		info.add(L"segments",		segments);
+		info.add(L"segment-bytes",	bytes);
+	}
+	catch(...)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+		info.add(L"error", widen(boost::current_exception_diagnostic_information()));
+	}
+
+	boost::filesystem::remove_all(directory, ec);
+
+	return info;
+}
+
+}
+
+boost::property_tree::wptree ffmpeg_encode()
+{
+	const size_t nb_frames = 500;
+
+	av_register_all();
+
+	const auto format_desc	= core::video_format_desc::get(core::video_format::x1080p5000);
+	const auto frames		= generate_frames(format_desc);
+
+	boost::property_tree::wptree info;
+	info.add(L"format",	format_desc.name);
+	info.add(L"frames",	nb_frames);
+	info.add(L"cores",	boost::thread::hardware_concurrency());
+
+	const char* codecs[] = {"prores", "dnxhd", "mjpeg"};
+	BOOST_FOREACH(auto vcodec, codecs)
+	{
+		auto sequential = encode(frames, format_desc, vcodec, 1, nb_frames);
+		auto parallel	= encode(frames, format_desc, vcodec, 0, nb_frames);
+
+		auto sequential_fps = sequential.get(L"fps", 0.0);
+		auto parallel_fps	= parallel.get(L"fps", 0.0);
+
+		boost::property_tree::wptree codec;
+		codec.add(L"vcodec",			widen(std::string(vcodec)));
+		codec.add_child(L"sequential",	sequential);
+		codec.add_child(L"parallel",	parallel);
+		codec.add(L"speedup",			sequential_fps > 0.0 ? parallel_fps / sequential_fps : 0.0);
+		info.add_child(L"codec",		codec);
+	}
+
+	return info;
+}
+
+boost::property_tree::wptree ffmpeg_record()
+{
+	const size_t seconds = 20;
+
+	av_register_all();
+
+	const auto format_desc	= core::video_format_desc::get(core::video_format::x1080p5000);
+	const auto frames		= generate_frames(format_desc);
+
+	const int stall_every_ms	= 2000;
+	const int stall_for_ms		= 500;
+
+	// The smallest ring the writer takes holds the encoder up for most of
+	// every stall, about what writing on the encoding thread did.
+	ffmpeg::async_file_writer::configuration minimal_config;
+	minimal_config.buffer_count	= 2;
+	minimal_config.sink			= std::make_shared<stalling_sink>(stall_every_ms, stall_for_ms);
+
+	ffmpeg::async_file_writer::configuration writer_config;
+	writer_config.sink			= std::make_shared<stalling_sink>(stall_every_ms, stall_for_ms);
+
+	boost::property_tree::wptree info;
+	info.add(L"format",					format_desc.name);
+	info.add(L"seconds",				seconds);
+	info.add(L"stall-every-ms",			stall_every_ms);
+	info.add(L"stall-for-ms",			stall_for_ms);
+	info.add_child(L"minimal-ring",		record(frames, format_desc, minimal_config, seconds));
+	info.add_child(L"asynchronous",		record(frames, format_desc, writer_config, seconds));
+	return info;
+}
+
+}}
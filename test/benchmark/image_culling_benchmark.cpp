@@ -0,0 +1,99 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <core/mixer/image/image_culling.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+struct synthetic_item
+{
+	core::pixel_format_desc	pix_desc;
+	core::frame_transform	transform;
+};
+
+typedef std::pair<core::blend_mode, std::vector<synthetic_item>> synthetic_layer;
+
+synthetic_item create_item(core::pixel_format::type pix_fmt)
+{
+	synthetic_item item;
+	item.pix_desc.pix_fmt = pix_fmt;
+	item.pix_desc.planes.push_back(core::pixel_format_desc::plane(1920, 1080, pix_fmt == core::pixel_format::bgra ? 4 : 1));
+	return item;
+}
+
+synthetic_layer create_layer(const synthetic_item& item)
+{
+	return synthetic_layer(core::blend_mode::normal, std::vector<synthetic_item>(1, item));
+}
+
+}
+
+boost::property_tree::wptree image_culling()
+{
+	auto video		= create_item(core::pixel_format::ycbcr);
+	auto graphics	= create_item(core::pixel_format::bgra);
+
+	// A typical program stack: background, full screen video, a picture in
+	// picture, a lower third, a scroller with one tile off screen and a bug.
+
+	std::vector<synthetic_layer> program(1, create_layer(video));
+	program.push_back(create_layer(video));
+	program.push_back(create_layer(video));
+	program.back().second[0].transform.fill_scale[0] = 0.3;
+	program.back().second[0].transform.fill_scale[1] = 0.3;
+	program.push_back(create_layer(graphics));
+	program.push_back(create_layer(graphics));
+	program.back().second.push_back(graphics);
+	program.back().second.back().transform.fill_translation[0] = 1.5;
+	program.push_back(create_layer(graphics));
+
+	const int nb_passes = 100000;
+	core::culling_stats stats;
+
+	boost::timer timer;
+
+	for (int n = 0; n < nb_passes; ++n)
+	{
+		auto layers = program;
+		stats = core::cull_layers(layers, 16.0 / 9.0);
+	}
+
+	auto seconds = timer.elapsed();
+
+	boost::property_tree::wptree info;
+	info.add(L"program.items",				stats.items);
+	info.add(L"program.invisible",			stats.invisible);
+	info.add(L"program.occluded",			stats.occluded);
+	info.add(L"program.micros-per-pass",	seconds * 1000000.0 / static_cast<double>(nb_passes));
+
+	return info;
+}
+
+}}
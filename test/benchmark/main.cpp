@@ -0,0 +1,140 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+// The benchmark runner, a separate executable so that none of the harnesses
+// ship in the server:
+//
+// benchmark <name> [result.json]
+//
+// runs one benchmark and writes its result as JSON to result.json, or to 
+// stdout. Benchmarks reading casparcg.config look for it in the working 
+// directory. Without arguments the names are listed.
+
+#include "benchmarks.h"
+
+#include <common/env.h>
+#include <common/exception/exceptions.h>
+#include <common/log/log.h>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/range/algorithm/find_if.hpp>
+
+#include <tbb/task_scheduler_init.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+
+using namespace caspar;
+
+struct benchmark_mode
+{
+	const char*							name;
+	bool								configured;	// Reads casparcg.config.
+	boost::property_tree::wptree		(*run)();
+};
+
+const benchmark_mode MODES[] = 
+{
+	// Runs the <benchmark> matrix of casparcg.config headless.
+	{"pipeline",			true,	benchmark::pipeline},
+	// Measures core::pack for every packed format at 1080p.
+	{"pixel-packing",		false,	benchmark::pixel_packing},
+	// Measures the audio resampler of the ffmpeg producer.
+	{"audio-resampler",		false,	benchmark::audio_resampler},
+	// Measures the cost of task profiling and of sampling the thread windows.
+	{"thread-profiler",		false,	benchmark::thread_profiler},
+	// Measures the memory kernels.
+	{"memory",				false,	benchmark::memory_kernels},
+	// Measures the loudness and true peak meter at 16 channels.
+	{"audio-meter",			false,	benchmark::audio_meter},
+	// Measures culling of a synthetic program stack.
+	{"culling",				false,	benchmark::image_culling},
+	// Ingests synthetic 1080 line UYVY and v210 captures and compares them with sws_scale.
+	{"decklink-ingest",		false,	benchmark::decklink_ingest},
+	// Measures the frame_muxer audio fifo at 16 channels 1080p5994.
+	{"audio-fifo",			false,	benchmark::audio_fifo},
+	// Decodes a synthetic 16 channel file with and without buffer pooling.
+	{"audio-decode",		true,	benchmark::audio_decoder},
+	// Decodes a synthetic 16 track file through audio_decoder and through amerge.
+	{"audio-merge",			true,	benchmark::audio_merge},
+	// Records generated 1080p50 frames with intra only codecs in sequence and in parallel.
+	{"encode",				true,	benchmark::ffmpeg_encode},
+	// Records segments at the channel rate on a stalling disk, with the smallest and the default write ring.
+	{"record",				true,	benchmark::ffmpeg_record},
+};
+
+}
+
+int main(int argc, char* argv[])
+{
+	tbb::task_scheduler_init init;
+
+	if (argc < 2)
+	{
+		std::cout << "benchmark <name> [result.json]" << std::endl;
+		for (size_t n = 0; n < sizeof(MODES)/sizeof(MODES[0]); ++n)
+			std::cout << "  " << MODES[n].name << std::endl;
+		return 1;
+	}
+
+	const std::string arg = argv[1];
+
+	auto mode = boost::find_if(MODES, [&](const benchmark_mode& mode)
+	{
+		return arg == mode.name;
+	});
+
+	if (mode == boost::end(MODES))
+	{
+		std::cerr << "Unknown benchmark " << arg << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		if (mode->configured)
+		{
+			env::configure(L"casparcg.config");
+			log::set_log_level(env::properties().get(L"configuration.log-level", L"debug"));
+		}
+
+		auto result = mode->run();
+
+		if (argc >= 3)
+		{
+			std::wofstream file(argv[2]);
+			boost::property_tree::write_json(file, result);
+		}
+		else
+			boost::property_tree::write_json(std::wcout, result);
+	}
+	catch(...)
+	{
+		CASPAR_LOG_CURRENT_EXCEPTION();
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <common/memory/memory_kernels.h>
+#include <common/memory/memclr.h>
+#include <common/memory/memcpy.h>
+#include <common/memory/memshfl.h>
+
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/task_scheduler_init.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+// Returns GB/s.
+double measure(size_t size, double seconds, const std::function<void()>& func)
+{
+	func(); // Warm up, faults in the pages.
+
+	int iterations = 0;
+	boost::timer timer;
+
+	do
+	{
+		func();
+		++iterations;
+	}
+	while(timer.elapsed() < seconds || iterations < 3);
+
+	return static_cast<double>(size) * iterations / timer.elapsed() / 1.0e9;
+}
+
+}
+
+boost::property_tree::wptree memory_kernels()
+{
+	typedef std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> buffer;
+
+	const double seconds_per_case = 0.25;
+
+	std::vector<size_t> sizes;
+	sizes.push_back(64*1024);
+	sizes.push_back(720*576*4);
+	sizes.push_back(1280*720*4);
+	sizes.push_back(1920*1080*4);
+	sizes.push_back(3840*2160*4);
+
+	// 0 is the default tbb pool.
+	std::vector<int> thread_counts;
+	thread_counts.push_back(1);
+	thread_counts.push_back(2);
+	thread_counts.push_back(4);
+	thread_counts.push_back(0);
+	
+	boost::property_tree::wptree info;
+	info.add(L"simd-level",					get_memory_kernels_simd_level());
+	info.add(L"default-threads",			tbb::task_scheduler_init::default_num_threads());
+	info.add(L"parallel-threshold",			static_cast<size_t>(memory_kernel_thresholds::parallel_threshold));
+	info.add(L"min-parallel-chunk",			static_cast<size_t>(memory_kernel_thresholds::min_parallel_chunk));
+	info.add(L"non-temporal-threshold",		static_cast<size_t>(memory_kernel_thresholds::non_temporal_threshold));
+
+	BOOST_FOREACH(auto size, sizes)
+	{
+		buffer source(size + 64);
+		buffer dest(size + 64);
+
+		for(size_t n = 0; n < source.size(); ++n)
+			source[n] = static_cast<uint8_t>(n * 31);
+
+		boost::property_tree::wptree crt;
+		crt.add(L"size",		size);
+		crt.add(L"threads",		1);
+		crt.add(L"memcpy",		measure(size, seconds_per_case, [&]{memcpy(dest.data(), source.data(), size);}));
+		crt.add(L"memset",		measure(size, seconds_per_case, [&]{memset(dest.data(), 0, size);}));
+		info.add_child(L"crt.case", crt);
+
+		BOOST_FOREACH(auto threads, thread_counts)
+		{
+			boost::property_tree::wptree result;
+			result.add(L"size",					size);
+			result.add(L"threads",				threads);
+			result.add(L"memcpy",				measure(size, seconds_per_case, [&]{detail::fast_memcpy(dest.data(), source.data(), size, threads);}));
+			result.add(L"memcpy-unaligned",		measure(size, seconds_per_case, [&]{detail::fast_memcpy(dest.data() + 3, source.data() + 1, size, threads);}));
+			result.add(L"memshfl",				measure(size, seconds_per_case, [&]{detail::fast_memshfl(dest.data(), source.data(), size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303, threads);}));
+			result.add(L"memclr",				measure(size, seconds_per_case, [&]{detail::fast_memclr(dest.data(), size, threads);}));
+			info.add_child(L"kernels.case", result);
+		}
+	}
+
+	return info;
+}
+
+}}
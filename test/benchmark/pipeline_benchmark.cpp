@@ -0,0 +1,661 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <core/video_channel.h>
+#include <core/video_format.h>
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/mixer/mixer.h>
+#include <core/mixer/read_frame.h>
+#include <core/mixer/write_frame.h>
+#include <core/mixer/audio/audio_util.h>
+#include <core/mixer/gpu/ogl_device.h>
+#include <core/monitor/monitor.h>
+#include <core/parameters/parameters.h>
+#include <core/producer/stage.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/color/color_producer.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_factory.h>
+#include <core/producer/frame/pixel_format.h>
+
+#include <common/env.h>
+#include <common/concurrency/future_util.h>
+#include <common/log/log.h>
+#include <common/memory/memcpy.h>
+#include <common/os/windows/system_info.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/assign.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/parallel_for.h>
+
+#include <windows.h>
+#include <psapi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#pragma comment(lib, "psapi.lib")
+
+namespace caspar { namespace benchmark {
+
+using namespace core;
+
+namespace {
+
+double now()
+{
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+// Receives the arrival of every frame from the null consumers and the
+// produce/mix/consume times the channels publish over their monitor output.
+class benchmark_run : public monitor::sink
+{
+	mutable boost::mutex		mutex_;
+	boost::condition_variable	cond_;
+	std::vector<int64_t>		frame_counts_;
+	std::vector<int64_t>		start_counts_;
+	std::vector<int64_t>		stop_counts_;
+	std::vector<double>			last_arrivals_;
+	bool						recording_;
+
+	std::vector<double>			produce_times_;
+	std::vector<double>			mix_times_;
+	std::vector<double>			consume_times_;
+	std::vector<double>			intervals_;
+public:
+	explicit benchmark_run(size_t channels)
+		: frame_counts_(channels, 0)
+		, start_counts_(channels, 0)
+		, stop_counts_(channels, 0)
+		, last_arrivals_(channels, 0.0)
+		, recording_(false)
+	{
+	}
+
+	void frame_arrived(size_t channel)
+	{
+		auto arrival = now();
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		if(recording_ && last_arrivals_[channel] > 0.0)
+			intervals_.push_back(arrival - last_arrivals_[channel]);
+
+		last_arrivals_[channel] = arrival;
+		++frame_counts_[channel];
+
+		cond_.notify_all();
+	}
+
+	virtual void propagate(const monitor::message& msg) override
+	{
+		std::vector<double>* samples = nullptr;
+
+		if(boost::ends_with(msg.path(), "/stage/produce_time"))
+			samples = &produce_times_;
+		else if(boost::ends_with(msg.path(), "/mixer/mix_time"))
+			samples = &mix_times_;
+		else if(boost::ends_with(msg.path(), "/output/consume_time"))
+			samples = &consume_times_;
+		else
+			return;
+
+		if(msg.data().empty())
+			return;
+
+		auto value = boost::get<double>(&msg.data().front());
+		if(!value)
+			return;
+
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		if(recording_)
+			samples->push_back(*value);
+	}
+
+	// Waits until every channel has received at least count frames.
+	bool wait_for_frames(int64_t count, double timeout_seconds)
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+
+		auto deadline = boost::get_system_time() + boost::posix_time::milliseconds(static_cast<int64_t>(timeout_seconds * 1000.0));
+
+		while(*std::min_element(frame_counts_.begin(), frame_counts_.end()) < count)
+		{
+			if(!cond_.timed_wait(lock, deadline))
+				return false;
+		}
+
+		return true;
+	}
+
+	void start_recording()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		recording_		= true;
+		start_counts_	= frame_counts_;
+	}
+
+	void stop_recording()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		recording_		= false;
+		stop_counts_	= frame_counts_;
+	}
+
+	int64_t recorded_frames(size_t channel) const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return stop_counts_[channel] - start_counts_[channel];
+	}
+
+	boost::property_tree::wptree latency_info() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+
+		boost::property_tree::wptree info;
+		info.add_child(L"produce",	percentiles(produce_times_));
+		info.add_child(L"mix",		percentiles(mix_times_));
+		info.add_child(L"consume",	percentiles(consume_times_));
+		info.add_child(L"interval", percentiles(intervals_));
+		return info;
+	}
+
+private:
+	// In milliseconds, nearest rank.
+	static boost::property_tree::wptree percentiles(std::vector<double> samples)
+	{
+		boost::property_tree::wptree info;
+		info.add(L"count", samples.size());
+
+		if(samples.empty())
+			return info;
+
+		std::sort(samples.begin(), samples.end());
+
+		auto at = [&](double p) -> double
+		{
+			auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+			return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)] * 1000.0;
+		};
+
+		info.add(L"mean",	std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size()) * 1000.0);
+		info.add(L"p50",	at(0.50));
+		info.add(L"p90",	at(0.90));
+		info.add(L"p99",	at(0.99));
+		info.add(L"max",	samples.back() * 1000.0);
+
+		return info;
+	}
+};
+
+// Waits for the read back of every frame and returns immediately, having a
+// synchronization clock of its own means the output never paces the channel.
+class null_consumer : public frame_consumer
+{
+	const safe_ptr<benchmark_run>	run_;
+	const size_t					channel_;
+public:
+	null_consumer(const safe_ptr<benchmark_run>& run, size_t channel)
+		: run_(run)
+		, channel_(channel)
+	{
+	}
+
+	// frame_consumer
+
+	virtual boost::unique_future<bool> send(const safe_ptr<read_frame>& frame) override
+	{
+		frame->image_data();
+		run_->frame_arrived(channel_);
+
+		return wrap_as_future(true);
+	}
+
+	virtual void initialize(const video_format_desc&, const channel_layout&, int) override
+	{
+	}
+
+	virtual int64_t presentation_frame_age_millis() const override
+	{
+		return 0;
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"null[" + boost::lexical_cast<std::wstring>(channel_ + 1) + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::property_tree::wptree info;
+		info.add(L"type", L"null-consumer");
+		return info;
+	}
+
+	virtual bool has_synchronization_clock() const override
+	{
+		return true;
+	}
+
+	virtual int buffer_depth() const override
+	{
+		return 1;
+	}
+
+	virtual int index() const override
+	{
+		return 100000;
+	}
+};
+
+pixel_format_desc bgra_desc(const video_format_desc& format_desc)
+{
+	pixel_format_desc desc;
+	desc.pix_fmt = pixel_format::bgra;
+	desc.planes.push_back(pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
+	return desc;
+}
+
+// Renders a moving pattern into a new frame every tick.
+class pattern_producer : public frame_producer
+{
+	monitor::subject				monitor_subject_;
+	const safe_ptr<frame_factory>	frame_factory_;
+	const video_format_desc			format_desc_;
+	uint32_t						frame_number_;
+	safe_ptr<basic_frame>			last_frame_;
+public:
+	pattern_producer(const safe_ptr<frame_factory>& frame_factory, uint32_t offset)
+		: frame_factory_(frame_factory)
+		, format_desc_(frame_factory->get_video_format_desc())
+		, frame_number_(offset)
+		, last_frame_(basic_frame::empty())
+	{
+	}
+
+	// frame_producer
+
+	virtual safe_ptr<basic_frame> receive(int) override
+	{
+		auto frame	= frame_factory_->create_frame(this, bgra_desc(format_desc_));
+		auto data	= reinterpret_cast<uint32_t*>(frame->image_data().begin());
+		auto width	= static_cast<int>(format_desc_.width);
+		auto offset	= frame_number_++;
+
+		tbb::parallel_for(0, static_cast<int>(format_desc_.height), 1, [&](int y)
+		{
+			auto row = data + y * width;
+			for(int x = 0; x < width; ++x)
+				row[x] = 0xFF000000 | (((x + offset) & 0xFF) << 16) | (((y + offset) & 0xFF) << 8) | ((x ^ y) & 0xFF);
+		});
+
+		frame->commit();
+
+		last_frame_ = frame;
+		return frame;
+	}
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return disable_audio(last_frame_);
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"pattern[]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::property_tree::wptree info;
+		info.add(L"type", L"pattern-producer");
+		return info;
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return monitor_subject_;
+	}
+};
+
+typedef std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> clip_frame;
+
+// Decoded frames of an in-memory clip, shared by all layers and channels of a case.
+std::shared_ptr<std::vector<clip_frame>> create_clip(const video_format_desc& format_desc, size_t count)
+{
+	auto clip = std::make_shared<std::vector<clip_frame>>();
+
+	for(size_t n = 0; n < count; ++n)
+	{
+		clip_frame frame(format_desc.size);
+		auto data = reinterpret_cast<uint32_t*>(frame.data());
+		auto shade = static_cast<uint32_t>(n * 255 / std::max<size_t>(1, count - 1));
+
+		for(size_t i = 0; i < format_desc.size / 4; ++i)
+			data[i] = 0xFF000000 | (shade << 16) | ((i & 0xFF) << 8) | ((i >> 8) & 0xFF);
+
+		clip->push_back(std::move(frame));
+	}
+
+	return clip;
+}
+
+// Loops an in-memory clip, uploading a copy of the next frame every tick
+// like a producer which decodes ahead would.
+class clip_producer : public frame_producer
+{
+	monitor::subject								monitor_subject_;
+	const safe_ptr<frame_factory>					frame_factory_;
+	const video_format_desc							format_desc_;
+	const std::shared_ptr<std::vector<clip_frame>>	clip_;
+	size_t											position_;
+	safe_ptr<basic_frame>							last_frame_;
+public:
+	clip_producer(const safe_ptr<frame_factory>& frame_factory, const std::shared_ptr<std::vector<clip_frame>>& clip, size_t offset)
+		: frame_factory_(frame_factory)
+		, format_desc_(frame_factory->get_video_format_desc())
+		, clip_(clip)
+		, position_(offset % clip->size())
+		, last_frame_(basic_frame::empty())
+	{
+	}
+
+	// frame_producer
+
+	virtual safe_ptr<basic_frame> receive(int) override
+	{
+		auto& source = clip_->at(position_);
+		position_ = (position_ + 1) % clip_->size();
+
+		auto frame = frame_factory_->create_frame(this, bgra_desc(format_desc_));
+		fast_memcpy(frame->image_data().begin(), source.data(), std::min(source.size(), frame->image_data().size()));
+		frame->commit();
+
+		last_frame_ = frame;
+		return frame;
+	}
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return disable_audio(last_frame_);
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"clip[" + boost::lexical_cast<std::wstring>(clip_->size()) + L"]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::property_tree::wptree info;
+		info.add(L"type", L"clip-producer");
+		info.add(L"frames", clip_->size());
+		return info;
+	}
+
+	virtual uint32_t nb_frames() const override
+	{
+		return static_cast<uint32_t>(clip_->size());
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return monitor_subject_;
+	}
+};
+
+struct benchmark_settings
+{
+	int64_t frames;
+	int64_t warmup_frames;
+	size_t	clip_frames;
+	double	timeout_seconds;
+};
+
+struct benchmark_case
+{
+	video_format_desc	format_desc;
+	size_t				channels;
+	size_t				layers;
+	std::wstring		producer;
+};
+
+template<typename T>
+std::vector<T> get_list(const boost::property_tree::wptree& config, const std::wstring& path, const std::wstring& item, const std::vector<T>& default_value)
+{
+	std::vector<T> result;
+
+	auto list = config.get_child_optional(path);
+	if(list)
+	{
+		BOOST_FOREACH(auto& elem, *list)
+		{
+			if(elem.first == item)
+				result.push_back(elem.second.get_value<T>());
+		}
+	}
+
+	return result.empty() ? default_value : result;
+}
+
+boost::property_tree::wptree memory_info()
+{
+	PROCESS_MEMORY_COUNTERS_EX counters = {};
+	counters.cb = sizeof(counters);
+	GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters));
+
+	boost::property_tree::wptree info;
+	info.add(L"working-set", counters.WorkingSetSize);
+	info.add(L"peak-working-set", counters.PeakWorkingSetSize);
+	info.add(L"private-bytes", counters.PrivateUsage);
+	return info;
+}
+
+boost::property_tree::wptree gl_info(const boost::property_tree::wptree& before, const boost::property_tree::wptree& after)
+{
+	boost::property_tree::wptree info;
+	info.add(L"allocations", after.get(L"gl.summary.pools.allocations", static_cast<int64_t>(0)) - before.get(L"gl.summary.pools.allocations", static_cast<int64_t>(0)));
+	info.add(L"reuses", after.get(L"gl.summary.pools.reuses", static_cast<int64_t>(0)) - before.get(L"gl.summary.pools.reuses", static_cast<int64_t>(0)));
+	info.add(L"device-buffers", after.get(L"gl.summary.all_device_buffers.total_count", static_cast<int64_t>(0)));
+	info.add(L"device-size", after.get(L"gl.summary.all_device_buffers.total_size", static_cast<int64_t>(0)));
+	info.add(L"host-read-size", after.get(L"gl.summary.all_host_buffers.total_read_size", static_cast<int64_t>(0)));
+	info.add(L"host-write-size", after.get(L"gl.summary.all_host_buffers.total_write_size", static_cast<int64_t>(0)));
+	return info;
+}
+
+safe_ptr<frame_producer> create_benchmark_producer(
+		const benchmark_case& benchmark,
+		const safe_ptr<frame_factory>& frame_factory,
+		const std::shared_ptr<std::vector<clip_frame>>& clip,
+		size_t layer)
+{
+	if(benchmark.producer == L"pattern")
+		return make_safe<pattern_producer>(frame_factory, static_cast<uint32_t>(layer * 7));
+	else if(benchmark.producer == L"clip")
+		return make_safe<clip_producer>(frame_factory, clip, layer);
+
+	std::vector<std::wstring> params;
+	params.push_back(L"#FF336699");
+	return create_color_producer(frame_factory, parameters(params));
+}
+
+boost::property_tree::wptree run_case(const safe_ptr<ogl_device>& ogl, const benchmark_case& benchmark, const benchmark_settings& settings)
+{
+	boost::property_tree::wptree info;
+	info.add(L"format",		benchmark.format_desc.name);
+	info.add(L"channels",	benchmark.channels);
+	info.add(L"layers",		benchmark.layers);
+	info.add(L"producer",	benchmark.producer);
+
+	CASPAR_LOG(info) << L"[benchmark] " << benchmark.format_desc.name << L" channels:" << benchmark.channels << L" layers:" << benchmark.layers << L" producer:" << benchmark.producer;
+
+	auto run		= make_safe<benchmark_run>(benchmark.channels);
+	auto gl_before	= ogl->info();
+
+	std::shared_ptr<std::vector<clip_frame>> clip;
+	if(benchmark.producer == L"clip")
+		clip = create_clip(benchmark.format_desc, std::max<size_t>(1, settings.clip_frames));
+
+	std::vector<safe_ptr<video_channel>> channels;
+	for(size_t n = 0; n < benchmark.channels; ++n)
+	{
+		auto channel = make_safe<video_channel>(static_cast<int>(n + 1), benchmark.format_desc, ogl, default_channel_layout_repository().get_by_name(L"STEREO"));
+		channel->monitor_output().attach_parent(run);
+		channel->output()->add(make_safe<null_consumer>(run, n));
+
+		for(size_t layer = 0; layer < benchmark.layers; ++layer)
+		{
+			auto index = static_cast<int>(layer + 1);
+			channel->stage()->load(index, create_benchmark_producer(benchmark, channel->mixer()->get_frame_factory(index), clip, layer));
+			channel->stage()->play(index);
+		}
+
+		channels.push_back(channel);
+	}
+
+	bool completed = run->wait_for_frames(settings.warmup_frames, settings.timeout_seconds);
+
+	run->start_recording();
+	auto start = now();
+
+	completed = completed && run->wait_for_frames(settings.warmup_frames + settings.frames, settings.timeout_seconds);
+
+	run->stop_recording();
+	auto elapsed = now() - start;
+
+	int64_t total_frames = 0;
+	for(size_t n = 0; n < benchmark.channels; ++n)
+		total_frames += run->recorded_frames(n);
+
+	info.add(L"completed",			completed);
+	info.add(L"frames",				total_frames);
+	info.add(L"elapsed-seconds",	elapsed);
+	info.add(L"fps",				elapsed > 0.0 ? static_cast<double>(total_frames) / static_cast<double>(benchmark.channels) / elapsed : 0.0);
+	info.add(L"aggregate-fps",		elapsed > 0.0 ? static_cast<double>(total_frames) / elapsed : 0.0);
+	info.add(L"realtime-factor",	elapsed > 0.0 ? static_cast<double>(total_frames) / static_cast<double>(benchmark.channels) / elapsed / benchmark.format_desc.fps : 0.0);
+	info.add_child(L"latency",		run->latency_info());
+	info.add_child(L"memory",		memory_info());
+	info.add_child(L"gl",			gl_info(gl_before, ogl->info()));
+
+	if(!completed)
+		CASPAR_LOG(warning) << L"[benchmark] Timed out after " << settings.timeout_seconds << L" seconds.";
+
+	channels.clear();
+	clip.reset();
+	ogl->gc().wait();
+
+	return info;
+}
+
+boost::property_tree::wptree run_pipeline(const safe_ptr<ogl_device>& ogl, const boost::property_tree::wptree& config)
+{
+	using namespace boost::assign;
+
+	auto formats	= get_list<std::wstring>(config, L"formats", L"format", list_of<std::wstring>(L"720p5000")(L"1080i5000")(L"1080p5000"));
+	auto channels	= get_list<size_t>(config, L"channels", L"count", list_of<size_t>(1)(2));
+	auto layers		= get_list<size_t>(config, L"layers", L"count", list_of<size_t>(1)(8));
+	auto producers	= get_list<std::wstring>(config, L"producers", L"producer", list_of<std::wstring>(L"color")(L"pattern")(L"clip"));
+
+	benchmark_settings settings;
+	settings.frames				= std::max<int64_t>(1, config.get(L"frames", 300));
+	settings.warmup_frames		= std::max<int64_t>(0, config.get(L"warmup-frames", 50));
+	settings.clip_frames		= config.get(L"clip-frames", 25);
+	settings.timeout_seconds	= config.get(L"timeout-seconds", 60.0);
+
+	boost::property_tree::wptree result;
+	result.add(L"gl-version",			ogl->version());
+	result.add(L"cpu",					get_cpu_features_info());
+	result.add(L"frames",				settings.frames);
+	result.add(L"warmup-frames",		settings.warmup_frames);
+	result.add(L"clip-frames",			settings.clip_frames);
+
+	BOOST_FOREACH(auto& format, formats)
+	{
+		auto format_desc = video_format_desc::get(format);
+		if(format_desc.format == video_format::invalid)
+		{
+			CASPAR_LOG(warning) << L"[benchmark] Skipping invalid format " << format;
+			continue;
+		}
+
+		BOOST_FOREACH(auto channel_count, channels)
+		{
+			BOOST_FOREACH(auto layer_count, layers)
+			{
+				BOOST_FOREACH(auto producer, producers)
+				{
+					boost::to_lower(producer);
+					if(producer != L"color" && producer != L"pattern" && producer != L"clip")
+					{
+						CASPAR_LOG(warning) << L"[benchmark] Skipping unknown producer " << producer;
+						continue;
+					}
+
+					benchmark_case benchmark;
+					benchmark.format_desc	= format_desc;
+					benchmark.channels		= std::max<size_t>(1, channel_count);
+					benchmark.layers		= layer_count;
+					benchmark.producer		= producer;
+
+					try
+					{
+						result.add_child(L"cases.case", run_case(ogl, benchmark, settings));
+					}
+					catch(...)
+					{
+						CASPAR_LOG_CURRENT_EXCEPTION();
+					}
+				}
+			}
+		}
+	}
+
+	return result;
+}
+
+}
+
+boost::property_tree::wptree pipeline()
+{
+	auto config = env::properties().get_child_optional(L"configuration.benchmark");
+
+	return run_pipeline(ogl_device::create(), config ? *config : boost::property_tree::wptree());
+}
+
+}}
@@ -0,0 +1,85 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <core/consumer/pixel_packing.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/timer.hpp>
+
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+boost::property_tree::wptree pixel_packing()
+{
+	using namespace core;
+
+	const int width		= 1920;
+	const int height	= 1080;
+	const int frames	= 200;
+
+	std::vector<uint8_t> bgra(width*height*4);
+	uint32_t seed = 1;
+	for(size_t n = 0; n < bgra.size(); ++n)
+	{
+		seed = seed*1664525 + 1013904223;
+		bgra[n] = static_cast<uint8_t>(seed >> 24);
+	}
+
+	boost::property_tree::wptree result;
+	result.add(L"simd", get_pixel_packing_simd_level());
+	result.add(L"width", width);
+	result.add(L"height", height);
+	result.add(L"frames", frames);
+
+	for(int n = 0; n < packed_format::count; ++n)
+	{
+		auto format = static_cast<packed_format::type>(n);
+
+		std::vector<uint8_t> data(packed_size(format, width, height));
+		std::vector<packed_plane> planes;
+		auto ptr = data.data();
+		for(int plane = 0; plane < packed_plane_count(format); ++plane)
+		{
+			planes.push_back(packed_plane(ptr, packed_linesize(format, width, plane)));
+			ptr += planes.back().linesize*packed_plane_height(format, height, plane);
+		}
+
+		pack(format, bgra.data(), width, height, planes.data());
+
+		boost::timer timer;
+		for(int frame = 0; frame < frames; ++frame)
+			pack(format, bgra.data(), width, height, planes.data());
+		double elapsed = timer.elapsed();
+
+		boost::property_tree::wptree entry;
+		entry.add(L"format", packed_format::print(format));
+		entry.add(L"ms-per-frame", elapsed*1000.0/frames);
+		entry.add(L"input-mb-per-second", elapsed > 0.0 ? bgra.size()*static_cast<double>(frames)/elapsed/1000000.0 : 0.0);
+		result.add_child(L"formats.format", entry);
+	}
+
+	return result;
+}
+
+}}
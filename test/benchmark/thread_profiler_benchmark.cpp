@@ -0,0 +1,116 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include "benchmarks.h"
+
+#include <common/concurrency/executor.h>
+#include <common/concurrency/thread_info.h>
+
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <vector>
+
+namespace caspar { namespace benchmark {
+
+namespace {
+
+const int TASKS		= 200000;
+const int SAMPLES	= 100;
+
+// Nanoseconds per no-op task for an executor round trip at the given sample rate.
+boost::property_tree::wptree run_executor(unsigned int sample_rate)
+{
+	set_task_sample_rate(sample_rate);
+
+	executor executor(L"thread_profiler_benchmark");
+	executor.invoke([]{}); // Starts the thread and creates its thread_info.
+
+	auto start = get_task_timestamp();
+	for(int n = 0; n < TASKS - 1; ++n)
+		executor.begin_invoke([]{});
+	executor.invoke([]{});
+	auto elapsed = task_timestamp_to_seconds(get_task_timestamp() - start);
+
+	boost::property_tree::wptree result;
+	result.add(L"sample-rate", sample_rate);
+	result.add(L"tasks", TASKS);
+	result.add(L"nanoseconds-per-task", elapsed * 1.0e9 / TASKS);
+	return result;
+}
+
+// Microseconds per sample_thread_infos call with the given number of extra threads alive.
+boost::property_tree::wptree run_sampler(int thread_count)
+{
+	boost::barrier ready(thread_count + 1);
+	boost::barrier done(thread_count + 1);
+
+	std::vector<std::shared_ptr<boost::thread>> threads;
+	for(int n = 0; n < thread_count; ++n)
+	{
+		threads.push_back(std::make_shared<boost::thread>([&]
+		{
+			get_thread_info().name = "thread_profiler_benchmark";
+			ready.wait();
+			done.wait();
+		}));
+	}
+	ready.wait();
+
+	auto total_threads = get_thread_infos().size();
+
+	auto start = get_task_timestamp();
+	for(int n = 0; n < SAMPLES; ++n)
+		sample_thread_infos();
+	auto elapsed = task_timestamp_to_seconds(get_task_timestamp() - start);
+
+	done.wait();
+	BOOST_FOREACH(auto& thread, threads)
+		thread->join();
+
+	boost::property_tree::wptree result;
+	result.add(L"threads", total_threads);
+	result.add(L"microseconds-per-sample", elapsed * 1.0e6 / SAMPLES);
+	result.add(L"microseconds-per-thread", total_threads > 0 ? elapsed * 1.0e6 / (SAMPLES * total_threads) : 0.0);
+	return result;
+}
+
+}
+
+boost::property_tree::wptree thread_profiler()
+{
+	auto sample_rate = get_task_sample_rate();
+
+	boost::property_tree::wptree result;
+	result.add_child(L"executor.case", run_executor(0));
+	result.add_child(L"executor.case", run_executor(16));
+	result.add_child(L"executor.case", run_executor(1));
+	result.add_child(L"sampler.case", run_sampler(0));
+	result.add_child(L"sampler.case", run_sampler(32));
+	result.add_child(L"sampler.case", run_sampler(128));
+
+	set_task_sample_rate(sample_rate);
+	return result;
+}
+
+}}
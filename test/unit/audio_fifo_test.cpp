@@ -0,0 +1,175 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <modules/ffmpeg/producer/muxer/audio_fifo.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using namespace caspar;
+using namespace caspar::ffmpeg;
+
+namespace {
+
+// Every sample holds its position in the stream, so any reordering or loss
+// shows up as a wrong value.
+void push_sequence(audio_fifo& fifo, int32_t first, size_t count)
+{
+	std::vector<int32_t> samples(count);
+	for(size_t n = 0; n < count; ++n)
+		samples[n] = first + static_cast<int32_t>(n);
+	fifo.push(samples.data(), count);
+}
+
+bool is_sequence(const audio_fifo::view& view, int32_t first)
+{
+	auto expected = first;
+	for(int part = 0; part < 2; ++part)
+	{
+		for(size_t n = 0; n < view.size[part]; ++n)
+		{
+			if(view.data[part][n] != expected++)
+				return false;
+		}
+	}
+	return true;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(audio_fifo_tests)
+
+BOOST_AUTO_TEST_CASE(a_wrapped_ring_is_read_in_two_ranges)
+{
+	audio_fifo fifo(2, 1024);
+	BOOST_REQUIRE_EQUAL(fifo.capacity(), 1024u);
+
+	push_sequence(fifo, 0, 800);
+	fifo.pop(600);
+	push_sequence(fifo, 800, 600);
+
+	BOOST_CHECK_EQUAL(fifo.capacity(), 1024u);
+	BOOST_REQUIRE_EQUAL(fifo.size(), 800u);
+
+	auto view = fifo.peek(800);
+	BOOST_CHECK_EQUAL(view.size[0], 424u);
+	BOOST_CHECK_EQUAL(view.size[1], 376u);
+	BOOST_CHECK(is_sequence(view, 600));
+
+	core::audio_buffer dest;
+	fifo.read(500, dest);
+	BOOST_REQUIRE_EQUAL(dest.size(), 500u);
+	for(size_t n = 0; n < dest.size(); ++n)
+		BOOST_REQUIRE_EQUAL(dest[n], 600 + static_cast<int32_t>(n));
+
+	BOOST_CHECK_EQUAL(fifo.size(), 300u);
+	BOOST_CHECK(is_sequence(fifo.peek(300), 1100));
+}
+
+BOOST_AUTO_TEST_CASE(growing_a_wrapped_ring_keeps_the_order)
+{
+	audio_fifo fifo(2, 1024);
+
+	// Moves the stream to position 3500, so the samples wrap both in the
+	// current ring and in the grown one.
+	for(int32_t n = 0; n < 3500; n += 500)
+	{
+		push_sequence(fifo, n, 500);
+		fifo.pop(500);
+	}
+
+	push_sequence(fifo, 3500, 900);		// Wraps at 4096.
+	push_sequence(fifo, 4400, 1200);	// Grows to fit 2100 samples.
+
+	BOOST_CHECK_EQUAL(fifo.capacity(), 4096u);
+	BOOST_REQUIRE_EQUAL(fifo.size(), 2100u);
+	BOOST_CHECK(is_sequence(fifo.peek(2100), 3500));
+
+	fifo.pop(2000);
+	push_sequence(fifo, 5600, 3000);
+	BOOST_CHECK_EQUAL(fifo.capacity(), 4096u);
+	BOOST_REQUIRE_EQUAL(fifo.size(), 3100u);
+	BOOST_CHECK(is_sequence(fifo.peek(3100), 5500));
+}
+
+BOOST_AUTO_TEST_CASE(flushes_split_the_stream_into_segments)
+{
+	audio_fifo fifo(2, 1024);
+
+	push_sequence(fifo, 0, 100);
+	fifo.push_flush();
+	push_sequence(fifo, 100, 50);
+	fifo.push_flush();
+	push_sequence(fifo, 150, 20);
+
+	BOOST_CHECK_EQUAL(fifo.segments(), 3u);
+	BOOST_CHECK_EQUAL(fifo.size(), 100u);
+	BOOST_CHECK_EQUAL(fifo.back_size(), 20u);
+
+	// A partial pop stays within the front segment.
+	fifo.pop(40);
+	BOOST_CHECK_EQUAL(fifo.size(), 60u);
+
+	core::audio_buffer dest;
+	fifo.read(20, dest);
+	BOOST_REQUIRE_EQUAL(dest.size(), 20u);
+	BOOST_CHECK_EQUAL(dest.front(), 40);
+	BOOST_CHECK_EQUAL(dest.back(), 59);
+
+	// Drops the rest of the front segment.
+	fifo.pop_segment();
+	BOOST_CHECK_EQUAL(fifo.segments(), 2u);
+	BOOST_REQUIRE_EQUAL(fifo.size(), 50u);
+	BOOST_CHECK(is_sequence(fifo.peek(50), 100));
+
+	fifo.pop_segment();
+	BOOST_CHECK_EQUAL(fifo.segments(), 1u);
+	BOOST_REQUIRE_EQUAL(fifo.size(), 20u);
+	BOOST_CHECK_EQUAL(fifo.back_size(), 20u);
+	BOOST_CHECK(is_sequence(fifo.peek(20), 150));
+
+	fifo.pop_segment();
+	BOOST_CHECK_EQUAL(fifo.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(silence_is_pushed_across_the_end_of_the_ring)
+{
+	audio_fifo fifo(2, 1024);
+
+	push_sequence(fifo, 0, 1000);
+	fifo.pop(1000);
+	fifo.push_silence(100);
+	push_sequence(fifo, 1, 10);
+
+	BOOST_CHECK_EQUAL(fifo.capacity(), 1024u);
+	auto view = fifo.peek(110);
+	BOOST_CHECK_EQUAL(view.size[0], 24u);
+
+	core::audio_buffer dest;
+	fifo.read(110, dest);
+	for(size_t n = 0; n < 100; ++n)
+		BOOST_REQUIRE_EQUAL(dest[n], 0);
+	for(size_t n = 0; n < 10; ++n)
+		BOOST_REQUIRE_EQUAL(dest[100 + n], 1 + static_cast<int32_t>(n));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <modules/ffmpeg/producer/audio/audio_merge.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using namespace caspar::ffmpeg;
+
+namespace {
+
+// Every source sample encodes its track, channel and position, so any
+// misplaced sample in the output is caught.
+int32_t sample_value(size_t track, size_t channel, size_t n)
+{
+	return static_cast<int32_t>((track << 24) | (channel << 20) | n);
+}
+
+// Merges tracks of the given channel counts, nb_samples long, through
+// merge_channels and checks the result against a straightforward copy.
+void check_merge(const std::vector<size_t>& channels, size_t nb_samples)
+{
+	std::vector<std::vector<int32_t>> tracks(channels.size());
+	std::vector<const int32_t*> inputs;
+
+	size_t stride = 0;
+	for(size_t t = 0; t < channels.size(); ++t)
+	{
+		for(size_t n = 0; n < nb_samples; ++n)
+		{
+			for(size_t c = 0; c < channels[t]; ++c)
+				tracks[t].push_back(sample_value(t, c, n));
+		}
+		inputs.push_back(tracks[t].data());
+		stride += channels[t];
+	}
+
+	std::vector<int32_t> expected;
+	for(size_t n = 0; n < nb_samples; ++n)
+	{
+		for(size_t t = 0; t < channels.size(); ++t)
+		{
+			for(size_t c = 0; c < channels[t]; ++c)
+				expected.push_back(sample_value(t, c, n));
+		}
+	}
+
+	// Guards after the output catch writes past nb_samples.
+	std::vector<int32_t> dest(nb_samples * stride + 16, -1);
+	merge_channels(inputs.data(), channels.data(), channels.size(), nb_samples, dest.data());
+
+	BOOST_CHECK_EQUAL_COLLECTIONS(dest.begin(), dest.begin() + nb_samples * stride, expected.begin(), expected.end());
+	for(size_t n = nb_samples * stride; n < dest.size(); ++n)
+		BOOST_REQUIRE_EQUAL(dest[n], -1);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(audio_merge_tests)
+
+BOOST_AUTO_TEST_CASE(sixteen_mono_tracks_are_interleaved)
+{
+	// 1003 samples span several blocks and leave a tail for the 8 and 4
+	// track kernels.
+	check_merge(std::vector<size_t>(16, 1), 1003);
+}
+
+BOOST_AUTO_TEST_CASE(short_runs_of_mono_tracks_are_interleaved)
+{
+	check_merge(std::vector<size_t>(4, 1), 1003);
+	check_merge(std::vector<size_t>(5, 1), 1003);
+	check_merge(std::vector<size_t>(7, 1), 1003);
+	check_merge(std::vector<size_t>(12, 1), 1003);
+}
+
+BOOST_AUTO_TEST_CASE(multichannel_tracks_are_merged_in_order)
+{
+	size_t layout[] = {2, 1, 1, 1, 1, 6, 1, 1, 1, 1, 1, 1, 1, 1, 2};
+	check_merge(std::vector<size_t>(layout, layout + sizeof(layout) / sizeof(layout[0])), 1003);
+
+	size_t stereo[] = {2, 2};
+	check_merge(std::vector<size_t>(stereo, stereo + 2), 300);
+}
+
+BOOST_AUTO_TEST_CASE(short_and_empty_inputs_are_merged)
+{
+	check_merge(std::vector<size_t>(16, 1), 1);
+	check_merge(std::vector<size_t>(8, 1), 7);
+	check_merge(std::vector<size_t>(8, 1), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
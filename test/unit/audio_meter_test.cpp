@@ -0,0 +1,213 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <core/mixer/audio/loudness_meter.h>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace caspar;
+
+namespace {
+
+const double PI				= 3.14159265358979323846;
+const double MIN_LOUDNESS	= -200.0;	// What loudness_meter reports without enough audio.
+const int	 SAMPLE_RATE	= 48000;
+
+// EBU Tech 3341 allows +-0.1 LU, as a percentage of the expected level.
+double lu_tolerance(double expected)
+{
+	return 100.0 * 0.1 / std::abs(expected);
+}
+
+double to_dbfs(double pfs)
+{
+	const auto MIN_PFS = 0.5 / static_cast<double>(std::numeric_limits<int32_t>::max());
+
+	return 20.0 * std::log10(std::max(MIN_PFS, pfs));
+}
+
+struct tone
+{
+	double	seconds;
+	double	dbfs;
+};
+
+// Stereo sine sequence at the given peak levels, EBU Tech 3341 cases 1-5 use
+// 1 kHz.
+std::vector<int32_t> make_sine_sequence(const std::vector<tone>& tones, double frequency, double phase)
+{
+	std::vector<int32_t> samples;
+
+	// 10 ms raised cosine fade in, an abrupt onset rings in the true peak interpolator.
+	const size_t fade = static_cast<size_t>(SAMPLE_RATE / 100);
+
+	size_t n = 0;
+	BOOST_FOREACH(auto& t, tones)
+	{
+		const double amplitude	= std::pow(10.0, t.dbfs / 20.0) * 2147483647.0;
+		const size_t count		= static_cast<size_t>(t.seconds * SAMPLE_RATE);
+
+		for(size_t i = 0; i < count; ++i, ++n)
+		{
+			const double gain	= n < fade ? 0.5 - 0.5 * std::cos(PI * n / fade) : 1.0;
+			const auto	 value	= static_cast<int32_t>(gain * amplitude * std::sin(2.0 * PI * frequency * n / SAMPLE_RATE + phase));
+			samples.push_back(value);
+			samples.push_back(value);
+		}
+	}
+
+	return samples;
+}
+
+// Meters the signal in 800 sample frames and keeps the highest readings.
+struct metered
+{
+	core::loudness_meter	meter;
+	double					momentary_max;
+	double					short_term_max;
+	double					true_peak;
+
+	metered(const std::vector<int32_t>& samples)
+		: meter(std::vector<double>(2, 1.0), SAMPLE_RATE)
+		, momentary_max(MIN_LOUDNESS)
+		, short_term_max(MIN_LOUDNESS)
+		, true_peak(0.0)
+	{
+		const size_t frame_size = 800 * 2;
+
+		std::vector<float> sample_peaks, true_peaks;
+
+		for(size_t offset = 0; offset < samples.size(); offset += frame_size)
+		{
+			auto count = std::min(frame_size, samples.size() - offset);
+			meter.process(samples.data() + offset, count / 2);
+			meter.take_peaks(sample_peaks, true_peaks);
+
+			momentary_max	= std::max(momentary_max, meter.momentary());
+			short_term_max	= std::max(short_term_max, meter.short_term());
+			true_peak		= std::max(true_peak, static_cast<double>(*std::max_element(true_peaks.begin(), true_peaks.end())));
+		}
+	}
+};
+
+template<size_t N>
+std::vector<tone> sequence(const tone (&tones)[N])
+{
+	return std::vector<tone>(tones, tones + N);
+}
+
+std::vector<tone> sequence(double seconds, double dbfs)
+{
+	tone t = {seconds, dbfs};
+	return std::vector<tone>(1, t);
+}
+
+// Sines of known amplitude whose samples (apart from the 0 degree case) miss
+// the crest, the true peak has to read the amplitude within the BS.1770-4
+// tolerance of +0.2 / -0.4 dB.
+void check_true_peak(double frequency, double phase)
+{
+	const double dbfs = -6.0;
+
+	metered result(make_sine_sequence(sequence(5.0, dbfs), frequency, phase));
+
+	const auto true_peak = to_dbfs(result.true_peak);
+	BOOST_CHECK_CLOSE(true_peak, dbfs, 100.0 * 0.4 / std::abs(dbfs));
+	BOOST_CHECK_LE(true_peak, dbfs + 0.2);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(audio_meter_tests)
+
+BOOST_AUTO_TEST_CASE(tech3341_case1_steady_minus_23)
+{
+	metered result(make_sine_sequence(sequence(20.0, -23.0), 1000.0, 0.0));
+
+	BOOST_CHECK_CLOSE(result.momentary_max,		-23.0, lu_tolerance(-23.0));
+	BOOST_CHECK_CLOSE(result.short_term_max,	-23.0, lu_tolerance(-23.0));
+	BOOST_CHECK_CLOSE(result.meter.integrated(),	-23.0, lu_tolerance(-23.0));
+}
+
+BOOST_AUTO_TEST_CASE(tech3341_case2_steady_minus_33)
+{
+	metered result(make_sine_sequence(sequence(20.0, -33.0), 1000.0, 0.0));
+
+	BOOST_CHECK_CLOSE(result.momentary_max,		-33.0, lu_tolerance(-33.0));
+	BOOST_CHECK_CLOSE(result.short_term_max,	-33.0, lu_tolerance(-33.0));
+	BOOST_CHECK_CLOSE(result.meter.integrated(),	-33.0, lu_tolerance(-33.0));
+}
+
+BOOST_AUTO_TEST_CASE(tech3341_case3_relative_gate)
+{
+	const tone tones[] = {{10.0, -36.0}, {60.0, -23.0}, {10.0, -36.0}};
+
+	metered result(make_sine_sequence(sequence(tones), 1000.0, 0.0));
+
+	BOOST_CHECK_CLOSE(result.meter.integrated(), -23.0, lu_tolerance(-23.0));
+}
+
+BOOST_AUTO_TEST_CASE(tech3341_case4_absolute_and_relative_gate)
+{
+	const tone tones[] = {{10.0, -72.0}, {10.0, -36.0}, {60.0, -23.0}, {10.0, -36.0}, {10.0, -72.0}};
+
+	metered result(make_sine_sequence(sequence(tones), 1000.0, 0.0));
+
+	BOOST_CHECK_CLOSE(result.meter.integrated(), -23.0, lu_tolerance(-23.0));
+}
+
+BOOST_AUTO_TEST_CASE(tech3341_case5_gating_blocks)
+{
+	const tone tones[] = {{20.0, -26.0}, {20.1, -20.0}, {20.0, -26.0}};
+
+	metered result(make_sine_sequence(sequence(tones), 1000.0, 0.0));
+
+	BOOST_CHECK_CLOSE(result.meter.integrated(), -23.0, lu_tolerance(-23.0));
+}
+
+BOOST_AUTO_TEST_CASE(true_peak_fs4_45_degrees)
+{
+	check_true_peak(12000.0, PI / 4.0);
+}
+
+BOOST_AUTO_TEST_CASE(true_peak_fs6_60_degrees)
+{
+	check_true_peak(8000.0, PI / 3.0);
+}
+
+BOOST_AUTO_TEST_CASE(true_peak_fs4_0_degrees)
+{
+	check_true_peak(12000.0, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(true_peak_997_hz)
+{
+	check_true_peak(997.0, 0.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,291 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavutil/samplefmt.h>
+}
+
+#include <modules/ffmpeg/producer/audio/audio_resampler.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <vector>
+
+using namespace caspar::ffmpeg;
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Feeds "seconds" of a sine (interleaved, identical in every channel given
+// a non zero gain) through the resampler in 1920 sample chunks and returns
+// the interleaved float output.
+std::vector<float> resample_sine(audio_resampler& resampler, int input_rate, double frequency, double seconds, const std::vector<float>& gains)
+{
+	const size_t channels	= gains.size();
+	const size_t total		= static_cast<size_t>(input_rate * seconds);
+	const size_t chunk		= 1920;
+
+	std::vector<float> output;
+	std::vector<int32_t> input(chunk * channels);
+
+	for(size_t offset = 0; offset < total; offset += chunk)
+	{
+		size_t count = std::min(chunk, total - offset);
+		for(size_t n = 0; n < count; ++n)
+		{
+			double value = 0.5 * std::sin(2.0 * PI * frequency * static_cast<double>(offset + n) / input_rate);
+			for(size_t c = 0; c < channels; ++c)
+				input[n * channels + c] = static_cast<int32_t>(value * gains[c] * 2147483647.0);
+		}
+
+		const uint8_t* planes[] = { reinterpret_cast<const uint8_t*>(input.data()) };
+		auto result = resampler.resample(planes, count);
+		auto begin	= reinterpret_cast<const float*>(result.begin());
+		auto end	= reinterpret_cast<const float*>(result.end());
+		output.insert(output.end(), begin, end);
+	}
+
+	return output;
+}
+
+// Largest deviation of one output channel from the ideal sine, skipping the
+// filter's start up transient.
+double max_error(const std::vector<float>& output, size_t channels, size_t channel, int output_rate, double frequency, double gain)
+{
+	double error = 0.0;
+	for(size_t n = 64; n < output.size() / channels; ++n)
+	{
+		double expected = 0.5 * gain * std::sin(2.0 * PI * frequency * static_cast<double>(n) / output_rate);
+		error = std::max(error, std::abs(expected - output[n * channels + channel]));
+	}
+	return error;
+}
+
+std::vector<float> gains(float g0, float g1)
+{
+	std::vector<float> result;
+	result.push_back(g0);
+	result.push_back(g1);
+	return result;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(audio_resampler_tests)
+
+BOOST_AUTO_TEST_CASE(equal_rates_pass_the_signal)
+{
+	audio_resampler resampler(2, 2, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	auto output = resample_sine(resampler, 48000, 1000.0, 1.0, gains(1.0f, 0.5f));
+
+	BOOST_CHECK_LT(max_error(output, 2, 0, 48000, 1000.0, 1.0), 1e-5);
+	BOOST_CHECK_LT(max_error(output, 2, 1, 48000, 1000.0, 0.5), 1e-5);
+}
+
+BOOST_AUTO_TEST_CASE(upsamples_44100_to_48000)
+{
+	audio_resampler resampler(2, 2, 48000, 44100, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	auto output = resample_sine(resampler, 44100, 997.0, 1.0, gains(1.0f, 1.0f));
+
+	BOOST_CHECK_LT(std::abs(static_cast<int>(output.size() / 2) - 48000), 32);
+	BOOST_CHECK_LT(max_error(output, 2, 0, 48000, 997.0, 1.0), 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(downsamples_48000_to_44100)
+{
+	audio_resampler resampler(2, 2, 44100, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	auto output = resample_sine(resampler, 48000, 997.0, 1.0, gains(1.0f, 1.0f));
+
+	BOOST_CHECK_LT(std::abs(static_cast<int>(output.size() / 2) - 44100), 32);
+	BOOST_CHECK_LT(max_error(output, 2, 1, 44100, 997.0, 1.0), 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(position_does_not_drift)
+{
+	// Ten minutes at 44.1 -> 48 kHz. A drifting read position would show up
+	// as a phase error at the end of the signal.
+	audio_resampler resampler(1, 1, 48000, 44100, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	std::vector<float> mono(1, 1.0f);
+	auto output = resample_sine(resampler, 44100, 1000.0, 600.0, mono);
+
+	BOOST_CHECK_LT(std::abs(static_cast<int>(output.size()) - 48000*600), 32);
+
+	std::vector<float> tail(output.end() - 48000, output.end());
+	double error = 0.0;
+	const size_t first = output.size() - tail.size();
+	for(size_t n = 0; n < tail.size(); ++n)
+	{
+		double expected = 0.5 * std::sin(2.0 * PI * 1000.0 * static_cast<double>(first + n) / 48000.0);
+		error = std::max(error, std::abs(expected - tail[n]));
+	}
+	BOOST_CHECK_LT(error, 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(converts_sample_formats)
+{
+	audio_resampler resampler(1, 1, 48000, 48000, AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S32);
+
+	std::vector<int32_t> input(4096, 0x40000000);
+	const uint8_t* planes[] = { reinterpret_cast<const uint8_t*>(input.data()) };
+	auto result = resampler.resample(planes, input.size());
+
+	auto begin	= reinterpret_cast<const int16_t*>(result.begin());
+	auto end	= reinterpret_cast<const int16_t*>(result.end());
+	BOOST_REQUIRE(end - begin > 64);
+	BOOST_CHECK_EQUAL(*(end - 1), 0x4000);
+}
+
+BOOST_AUTO_TEST_CASE(downmixes_5_1_to_stereo)
+{
+	// FL FR FC LFE SL SR
+	const float layout[][6] = 
+	{
+		{0, 0, 1, 0, 0, 0},	// Centre goes to both sides.
+		{0, 0, 0, 1, 0, 0},	// LFE is dropped.
+		{0, 0, 0, 0, 1, 0},	// Left surround goes left.
+		{0, 0, 0, 0, 0, 1}	// Right surround goes right.
+	};
+
+	double level[4][2];
+	for(int n = 0; n < 4; ++n)
+	{
+		audio_resampler resampler(2, 6, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+		auto output = resample_sine(resampler, 48000, 1000.0, 0.1, std::vector<float>(layout[n], layout[n] + 6));
+		for(int c = 0; c < 2; ++c)
+		{
+			level[n][c] = 0.0;
+			for(size_t s = c; s < output.size(); s += 2)
+				level[n][c] = std::max<double>(level[n][c], std::abs(output[s]));
+		}
+	}
+
+	BOOST_CHECK_GT(level[0][0], 0.1);
+	BOOST_CHECK_CLOSE(level[0][0], level[0][1], 0.1);
+	BOOST_CHECK_LT(level[1][0] + level[1][1], 1e-5);
+	BOOST_CHECK_GT(level[2][0], 0.1);
+	BOOST_CHECK_LT(level[2][1], 1e-5);
+	BOOST_CHECK_LT(level[3][0], 1e-5);
+	BOOST_CHECK_GT(level[3][1], 0.1);
+}
+
+BOOST_AUTO_TEST_CASE(downmix_does_not_clip)
+{
+	std::vector<float> all(6, 1.0f);
+	audio_resampler resampler(2, 6, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	auto output = resample_sine(resampler, 48000, 1000.0, 0.1, all);
+
+	double peak = 0.0;
+	for(size_t n = 0; n < output.size(); ++n)
+		peak = std::max<double>(peak, std::abs(output[n]));
+	BOOST_CHECK_LE(peak, 0.5 + 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(mono_feeds_every_channel)
+{
+	std::vector<float> mono(1, 1.0f);
+	audio_resampler resampler(2, 1, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	auto output = resample_sine(resampler, 48000, 1000.0, 0.1, mono);
+
+	BOOST_CHECK_LT(max_error(output, 2, 0, 48000, 1000.0, 1.0), 1e-5);
+	BOOST_CHECK_LT(max_error(output, 2, 1, 48000, 1000.0, 1.0), 1e-5);
+}
+
+BOOST_AUTO_TEST_CASE(ratio_is_fixed_without_drift_compensation)
+{
+	audio_resampler resampler(1, 1, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	resampler.set_ratio_adjustment(1.004);
+	resampler.follow_buffer_level(48000, 0);
+
+	BOOST_CHECK_EQUAL(resampler.ratio_adjustment(), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(ratio_adjustment_is_clamped)
+{
+	audio_resampler resampler(1, 1, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	resampler.enable_drift_compensation(true);
+
+	resampler.set_ratio_adjustment(1.1);
+	BOOST_CHECK_CLOSE(resampler.ratio_adjustment(), 1.005, 1e-9);
+	resampler.set_ratio_adjustment(0.9);
+	BOOST_CHECK_CLOSE(resampler.ratio_adjustment(), 0.995, 1e-9);
+
+	resampler.enable_drift_compensation(false);
+	BOOST_CHECK_EQUAL(resampler.ratio_adjustment(), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(adjusted_ratio_scales_the_output)
+{
+	// Consuming the input 0.2% faster plays it 0.2% shorter and higher.
+	audio_resampler resampler(1, 1, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	resampler.enable_drift_compensation(true);
+	resampler.set_ratio_adjustment(1.002);
+
+	std::vector<float> mono(1, 1.0f);
+	auto output = resample_sine(resampler, 48000, 1000.0, 10.0, mono);
+
+	BOOST_CHECK_LT(std::abs(static_cast<double>(output.size()) - 480000.0 / 1.002), 32.0);
+	BOOST_CHECK_LT(max_error(output, 1, 0, 48000, 1000.0 * 1.002, 1.0), 1e-3);
+}
+
+BOOST_AUTO_TEST_CASE(follows_a_drifting_clock)
+{
+	// The input clock runs 100 ppm fast against a channel playing 1920
+	// samples per frame. Without compensation ten minutes would buffer 2880
+	// extra samples, following the level keeps it near the target.
+	audio_resampler resampler(1, 1, 48000, 48000, AV_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_S32);
+	resampler.enable_drift_compensation(true);
+
+	const int64_t	target		= 4800;
+	const size_t	frames		= 25 * 600;
+	const double	drift		= 1.0001;
+
+	std::vector<int32_t> input(2048, 0);
+	int64_t	level	= target;
+	int64_t	worst	= 0;
+	double	source	= 0.0;
+	int64_t	fed		= 0;
+
+	for(size_t frame = 0; frame < frames; ++frame)
+	{
+		source += 1920.0 * drift;
+		const auto count = static_cast<int64_t>(source) - fed;
+		fed += count;
+
+		const uint8_t* planes[] = { reinterpret_cast<const uint8_t*>(input.data()) };
+		auto result = resampler.resample(planes, static_cast<size_t>(count));
+
+		level += static_cast<int64_t>(result.size() / sizeof(float)) - 1920;
+		resampler.follow_buffer_level(level, target);
+
+		if(frame > frames / 2)
+			worst = std::max(worst, std::abs(level - target));
+	}
+
+	BOOST_CHECK_LT(worst, 480);
+	BOOST_CHECK_CLOSE(resampler.ratio_adjustment(), drift, 0.002);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,232 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavcodec/avcodec.h>
+}
+
+#include <modules/ffmpeg/producer/util/context_pool.h>
+#include <modules/ffmpeg/producer/util/util.h>
+#include <modules/ffmpeg/producer/filter/filter.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstring>
+
+using namespace caspar::ffmpeg;
+
+namespace {
+
+std::shared_ptr<void> make_context(int value)
+{
+	return std::make_shared<int>(value);
+}
+
+int value_of(const std::shared_ptr<int>& context)
+{
+	return context ? *context : -1;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(context_pool_tests)
+
+BOOST_AUTO_TEST_CASE(returns_given_context_once)
+{
+	context_pool pool(L"test", 4, 60);
+
+	pool.give("a", make_context(1));
+
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("b")), -1);
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), 1);
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), -1);
+
+	auto info = pool.info();
+	BOOST_CHECK_EQUAL(info.get<int>(L"hits"), 1);
+	BOOST_CHECK_EQUAL(info.get<int>(L"misses"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(keeps_contexts_of_the_same_key)
+{
+	context_pool pool(L"test", 4, 60);
+
+	pool.give("a", make_context(1));
+	pool.give("a", make_context(2));
+
+	// Most recently returned first.
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), 2);
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), 1);
+}
+
+BOOST_AUTO_TEST_CASE(evicts_least_recently_returned)
+{
+	context_pool pool(L"test", 2, 60);
+
+	pool.give("a", make_context(1));
+	pool.give("b", make_context(2));
+	pool.give("c", make_context(3));
+
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), -1);
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("b")), 2);
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("c")), 3);
+	BOOST_CHECK_EQUAL(pool.info().get<int>(L"evictions"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(releases_evicted_contexts)
+{
+	context_pool pool(L"test", 1, 60);
+
+	std::weak_ptr<void> first;
+	{
+		auto context = make_context(1);
+		first = context;
+		pool.give("a", context);
+	}
+	pool.give("b", make_context(2));
+
+	BOOST_CHECK(first.expired());
+}
+
+BOOST_AUTO_TEST_CASE(zero_size_disables)
+{
+	context_pool pool(L"test", 0, 60);
+
+	pool.give("a", make_context(1));
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), -1);
+	BOOST_CHECK_EQUAL(pool.info().get<int>(L"size"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(expires_idle_contexts)
+{
+	context_pool pool(L"test", 4, 0);
+
+	pool.give("a", make_context(1));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), -1);
+	BOOST_CHECK_EQUAL(pool.info().get<int>(L"expirations"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(expires_every_key)
+{
+	context_pool pool(L"test", 4, 0);
+
+	pool.give("a", make_context(1));
+	pool.give("b", make_context(2));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	pool.expire();
+
+	BOOST_CHECK_EQUAL(pool.info().get<int>(L"size"), 0);
+	BOOST_CHECK_EQUAL(pool.info().get<int>(L"expirations"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(pools_expire_on_a_timer)
+{
+	context_pools pools(4, 0);
+
+	std::weak_ptr<void> context;
+	{
+		auto codec = make_context(1);
+		context = codec;
+		pools.codec().give("a", codec);
+		pools.filter().give("b", make_context(2));
+	}
+
+	// Nothing takes or gives, only the timer can release them.
+	for(int n = 0; n < 50 && !context.expired(); ++n)
+		boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+	BOOST_CHECK(context.expired());
+	BOOST_CHECK_EQUAL(pools.filter().info().get<int>(L"size"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(pools_are_separate)
+{
+	context_pools pools(4, 60);
+
+	pools.codec().give("a", make_context(1));
+
+	BOOST_CHECK_EQUAL(value_of(pools.filter().try_take<int>("a")), -1);
+	BOOST_CHECK_EQUAL(value_of(pools.codec().try_take<int>("a")), 1);
+	BOOST_CHECK_EQUAL(pools.info().count(L"pool"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(clear_releases_everything)
+{
+	context_pool pool(L"test", 4, 60);
+
+	pool.give("a", make_context(1));
+	pool.give("b", make_context(2));
+	pool.clear();
+
+	BOOST_CHECK_EQUAL(pool.info().get<int>(L"size"), 0);
+	BOOST_CHECK_EQUAL(value_of(pool.try_take<int>("a")), -1);
+}
+
+BOOST_AUTO_TEST_CASE(codec_key_covers_block_parameters)
+{
+	AVCodecContext codec;
+	std::memset(&codec, 0, sizeof(codec));
+	codec.codec_type	= AVMEDIA_TYPE_AUDIO;
+	codec.codec_id		= AV_CODEC_ID_ADPCM_MS;
+	codec.sample_rate	= 48000;
+	codec.channels		= 2;
+
+	const auto key = get_codec_key(codec);
+
+	AVCodecContext other = codec;
+	other.block_align = 2048;
+	BOOST_CHECK(get_codec_key(other) != key);
+
+	other = codec;
+	other.bits_per_coded_sample = 4;
+	BOOST_CHECK(get_codec_key(other) != key);
+
+	other = codec;
+	other.bit_rate = 128000;
+	BOOST_CHECK(get_codec_key(other) != key);
+
+	other = codec;
+	BOOST_CHECK(get_codec_key(other) == key);
+}
+
+BOOST_AUTO_TEST_CASE(pools_only_stateless_filter_graphs)
+{
+	BOOST_CHECK(filter::is_poolable(""));
+	BOOST_CHECK(filter::is_poolable("null"));
+	BOOST_CHECK(filter::is_poolable("scale=1280:720,setsar=1"));
+	BOOST_CHECK(filter::is_poolable("[in]hflip[a];[a]vflip[out]"));
+	BOOST_CHECK(filter::is_poolable("SCALE@s=640:360"));
+
+	BOOST_CHECK(!filter::is_poolable("yadif=1:-1"));
+	BOOST_CHECK(!filter::is_poolable("scale=1280:720,fade=in:0:25"));
+	BOOST_CHECK(!filter::is_poolable("setpts=PTS-STARTPTS"));
+	BOOST_CHECK(!filter::is_poolable("pullup"));
+	BOOST_CHECK(!filter::is_poolable("crop=w=100:x=n"));
+	BOOST_CHECK(!filter::is_poolable("[in]scale=640:360[a];[a]fps=25[out]"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,227 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <modules/decklink/producer/decklink_ingest.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <vector>
+
+using namespace caspar;
+using namespace caspar::decklink;
+
+namespace {
+
+int v210_row_bytes(int width)
+{
+	return ((width + 47) / 48) * 128;
+}
+
+// Packs 10 bit planar 4:2:2 samples into v210 rows, six pixels per four words.
+std::vector<uint8_t> pack_v210(const std::vector<uint32_t>& y, const std::vector<uint32_t>& cb, const std::vector<uint32_t>& cr, int width, int height)
+{
+	const int row_bytes		= v210_row_bytes(width);
+	const int chroma_width	= (width + 1) / 2;
+
+	std::vector<uint8_t> bytes(row_bytes * height, 0);
+
+	for (int row = 0; row < height; ++row)
+	{
+		std::vector<uint32_t> sequence;
+		for (int x = 0; x < width; x += 2)
+		{
+			sequence.push_back(cb[row * chroma_width + x/2]);
+			sequence.push_back(y[row * width + x]);
+			sequence.push_back(cr[row * chroma_width + x/2]);
+			sequence.push_back(x + 1 < width ? y[row * width + x + 1] : 0);
+		}
+		sequence.resize(((sequence.size() + 11) / 12) * 12, 0);
+
+		auto words = reinterpret_cast<uint32_t*>(bytes.data() + row * row_bytes);
+		for (size_t n = 0; n < sequence.size(); n += 3)
+			words[n/3] = sequence[n] | (sequence[n+1] << 10) | (sequence[n+2] << 20);
+	}
+
+	return bytes;
+}
+
+std::vector<uint32_t> ramp(size_t count, uint32_t offset)
+{
+	std::vector<uint32_t> samples;
+	for (size_t n = 0; n < count; ++n)
+		samples.push_back(((offset + static_cast<uint32_t>(n) * 9) % 256) * 4);
+	return samples;
+}
+
+void check_v210(int width, int height)
+{
+	const int chroma_width = (width + 1) / 2;
+
+	auto y	= ramp(width * height, 16);
+	auto cb	= ramp(chroma_width * height, 100);
+	auto cr	= ramp(chroma_width * height, 200);
+
+	auto bytes	= pack_v210(y, cb, cr, width, height);
+	auto desc	= get_ingest_pixel_format_desc(capture_format::v210, width, height);
+
+	std::vector<uint8_t> y_plane(desc.planes[0].size), cb_plane(desc.planes[1].size), cr_plane(desc.planes[2].size);
+	uint8_t* planes[] = {y_plane.data(), cb_plane.data(), cr_plane.data()};
+
+	ingest_video(capture_format::v210, bytes.data(), v210_row_bytes(width), desc, planes);
+
+	for (int n = 0; n < width * height; ++n)
+		BOOST_CHECK_EQUAL(y_plane[n], y[n] / 4);
+
+	for (int n = 0; n < chroma_width * height; ++n)
+	{
+		BOOST_CHECK_EQUAL(cb_plane[n], cb[n] / 4);
+		BOOST_CHECK_EQUAL(cr_plane[n], cr[n] / 4);
+	}
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(decklink_ingest_tests)
+
+BOOST_AUTO_TEST_CASE(uyvy_is_ingested_as_one_packed_plane)
+{
+	auto desc = get_ingest_pixel_format_desc(capture_format::uyvy, 1920, 1080);
+
+	BOOST_CHECK_EQUAL(desc.pix_fmt, core::pixel_format::uyvy);
+	BOOST_REQUIRE_EQUAL(desc.planes.size(), 1u);
+	BOOST_CHECK_EQUAL(desc.planes[0].width, 960u);
+	BOOST_CHECK_EQUAL(desc.planes[0].height, 1080u);
+	BOOST_CHECK_EQUAL(desc.planes[0].channels, 4u);
+	BOOST_CHECK_EQUAL(desc.planes[0].linesize, 1920u * 2);
+
+	auto odd = get_ingest_pixel_format_desc(capture_format::uyvy, 1281, 720);
+	BOOST_CHECK_EQUAL(odd.planes[0].width, 641u);
+}
+
+BOOST_AUTO_TEST_CASE(v210_is_ingested_as_planar_ycbcr_422)
+{
+	auto desc = get_ingest_pixel_format_desc(capture_format::v210, 1920, 1080);
+
+	BOOST_CHECK_EQUAL(desc.pix_fmt, core::pixel_format::ycbcr);
+	BOOST_REQUIRE_EQUAL(desc.planes.size(), 3u);
+	BOOST_CHECK_EQUAL(desc.planes[0].width, 1920u);
+	BOOST_CHECK_EQUAL(desc.planes[1].width, 960u);
+	BOOST_CHECK_EQUAL(desc.planes[2].width, 960u);
+
+	for (size_t n = 0; n < desc.planes.size(); ++n)
+	{
+		BOOST_CHECK_EQUAL(desc.planes[n].height, 1080u);
+		BOOST_CHECK_EQUAL(desc.planes[n].channels, 1u);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(uyvy_is_copied_unchanged)
+{
+	const int width		= 6;
+	const int height	= 3;
+
+	auto desc = get_ingest_pixel_format_desc(capture_format::uyvy, width, height);
+
+	std::vector<uint8_t> bytes(width * 2 * height);
+	for (size_t n = 0; n < bytes.size(); ++n)
+		bytes[n] = static_cast<uint8_t>(n * 7);
+
+	std::vector<uint8_t> plane(desc.planes[0].size, 0);
+	uint8_t* planes[] = {plane.data()};
+
+	ingest_video(capture_format::uyvy, bytes.data(), width * 2, desc, planes);
+
+	BOOST_CHECK(plane == bytes);
+}
+
+BOOST_AUTO_TEST_CASE(uyvy_line_padding_is_dropped)
+{
+	const int width		= 6;
+	const int height	= 3;
+	const int row_bytes	= 16;
+
+	auto desc = get_ingest_pixel_format_desc(capture_format::uyvy, width, height);
+
+	std::vector<uint8_t> bytes(row_bytes * height, 0xff);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width * 2; ++x)
+			bytes[y * row_bytes + x] = static_cast<uint8_t>(y * 16 + x);
+	}
+
+	std::vector<uint8_t> plane(desc.planes[0].size, 0);
+	uint8_t* planes[] = {plane.data()};
+
+	ingest_video(capture_format::uyvy, bytes.data(), row_bytes, desc, planes);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width * 2; ++x)
+			BOOST_CHECK_EQUAL(plane[y * width * 2 + x], y * 16 + x);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(v210_is_unpacked)
+{
+	check_v210(12, 2);
+	check_v210(1920, 4);
+}
+
+BOOST_AUTO_TEST_CASE(v210_partial_groups_are_unpacked)
+{
+	// 1280 and 8 pixels end in a group of two pixels, 4 in a group of four.
+	check_v210(8, 2);
+	check_v210(4, 1);
+	check_v210(1280, 2);
+}
+
+BOOST_AUTO_TEST_CASE(v210_samples_are_rounded_to_8_bits)
+{
+	std::vector<uint32_t> y(6), cb(3), cr(3);
+	y[0] = 0;		y[1] = 1;		y[2] = 2;
+	y[3] = 513;		y[4] = 1021;	y[5] = 1023;
+	cb[0] = 64;		cb[1] = 65;		cb[2] = 66;
+	cr[0] = 940;	cr[1] = 941;	cr[2] = 942;
+
+	auto bytes	= pack_v210(y, cb, cr, 6, 1);
+	auto desc	= get_ingest_pixel_format_desc(capture_format::v210, 6, 1);
+
+	std::vector<uint8_t> y_plane(6), cb_plane(3), cr_plane(3);
+	uint8_t* planes[] = {y_plane.data(), cb_plane.data(), cr_plane.data()};
+
+	ingest_video(capture_format::v210, bytes.data(), v210_row_bytes(6), desc, planes);
+
+	BOOST_CHECK_EQUAL(y_plane[0], 0);
+	BOOST_CHECK_EQUAL(y_plane[1], 0);
+	BOOST_CHECK_EQUAL(y_plane[2], 1);
+	BOOST_CHECK_EQUAL(y_plane[3], 128);
+	BOOST_CHECK_EQUAL(y_plane[4], 255);
+	BOOST_CHECK_EQUAL(y_plane[5], 255);
+	BOOST_CHECK_EQUAL(cb_plane[0], 16);
+	BOOST_CHECK_EQUAL(cb_plane[1], 16);
+	BOOST_CHECK_EQUAL(cb_plane[2], 17);
+	BOOST_CHECK_EQUAL(cr_plane[0], 235);
+	BOOST_CHECK_EQUAL(cr_plane[1], 235);
+	BOOST_CHECK_EQUAL(cr_plane[2], 236);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
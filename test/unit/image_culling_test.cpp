@@ -0,0 +1,291 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <core/mixer/image/image_culling.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+using namespace caspar::core;
+
+namespace {
+
+struct synthetic_item
+{
+	pixel_format_desc	pix_desc;
+	frame_transform		transform;
+};
+
+typedef std::pair<blend_mode, std::vector<synthetic_item>> synthetic_layer;
+
+const double ASPECT_RATIO = 16.0 / 9.0;
+
+synthetic_item create_item(pixel_format::type pix_fmt)
+{
+	synthetic_item item;
+	item.pix_desc.pix_fmt = pix_fmt;
+	item.pix_desc.planes.push_back(pixel_format_desc::plane(1920, 1080, pix_fmt == pixel_format::bgra ? 4 : 1));
+	return item;
+}
+
+synthetic_layer create_layer(const synthetic_item& item, blend_mode mode = blend_mode::normal)
+{
+	return synthetic_layer(mode, std::vector<synthetic_item>(1, item));
+}
+
+const synthetic_item VIDEO		= create_item(pixel_format::ycbcr);
+const synthetic_item GRAPHICS	= create_item(pixel_format::bgra);
+
+}
+
+BOOST_AUTO_TEST_SUITE(image_culling_tests)
+
+BOOST_AUTO_TEST_CASE(full_screen_video_is_an_opaque_fill)
+{
+	BOOST_CHECK(is_opaque_fill(VIDEO.pix_desc, VIDEO.transform));
+	BOOST_CHECK(!is_opaque_fill(GRAPHICS.pix_desc, GRAPHICS.transform));
+
+	auto zoomed = VIDEO;
+	zoomed.transform.fill_translation[0] = -0.5;
+	zoomed.transform.fill_scale[0] = 2.0;
+	zoomed.transform.fill_scale[1] = 2.0;
+	BOOST_CHECK(is_opaque_fill(zoomed.pix_desc, zoomed.transform));
+}
+
+BOOST_AUTO_TEST_CASE(partial_fills_are_not_opaque)
+{
+	auto scaled = VIDEO;
+	scaled.transform.fill_scale[0] = 0.5;
+	BOOST_CHECK(!is_opaque_fill(scaled.pix_desc, scaled.transform));
+
+	auto clipped = VIDEO;
+	clipped.transform.clip_scale[1] = 0.5;
+	BOOST_CHECK(!is_opaque_fill(clipped.pix_desc, clipped.transform));
+
+	auto faded = VIDEO;
+	faded.transform.opacity = 0.99;
+	BOOST_CHECK(!is_opaque_fill(faded.pix_desc, faded.transform));
+
+	auto field = VIDEO;
+	field.transform.field_mode = field_mode::upper;
+	BOOST_CHECK(!is_opaque_fill(field.pix_desc, field.transform));
+
+	auto rotated = VIDEO;
+	rotated.transform.angle = 0.1;
+	BOOST_CHECK(!is_opaque_fill(rotated.pix_desc, rotated.transform));
+
+	auto key = VIDEO;
+	key.transform.is_key = true;
+	BOOST_CHECK(!is_opaque_fill(key.pix_desc, key.transform));
+
+	BOOST_CHECK(!is_opaque_fill(pixel_format_desc(), VIDEO.transform));
+}
+
+BOOST_AUTO_TEST_CASE(transparent_and_off_screen_items_are_invisible)
+{
+	BOOST_CHECK(!is_invisible(GRAPHICS.transform, ASPECT_RATIO));
+
+	auto transparent = GRAPHICS;
+	transparent.transform.opacity = 0.0;
+	BOOST_CHECK(is_invisible(transparent.transform, ASPECT_RATIO));
+
+	auto left = GRAPHICS;
+	left.transform.fill_translation[0] = -1.5;
+	BOOST_CHECK(is_invisible(left.transform, ASPECT_RATIO));
+
+	auto below = GRAPHICS;
+	below.transform.fill_translation[1] = 1.0001;
+	BOOST_CHECK(is_invisible(below.transform, ASPECT_RATIO));
+
+	auto partly = GRAPHICS;
+	partly.transform.fill_translation[0] = 0.75;
+	BOOST_CHECK(!is_invisible(partly.transform, ASPECT_RATIO));
+
+	auto no_field = GRAPHICS;
+	no_field.transform.field_mode = field_mode::empty;
+	BOOST_CHECK(is_invisible(no_field.transform, ASPECT_RATIO));
+
+	// A key decides what the items above it show, even when it draws nothing itself.
+	auto key = transparent;
+	key.transform.is_key = true;
+	BOOST_CHECK(!is_invisible(key.transform, ASPECT_RATIO));
+}
+
+BOOST_AUTO_TEST_CASE(an_opaque_fill_occludes_the_layers_below)
+{
+	std::vector<synthetic_layer> layers(8, create_layer(GRAPHICS));
+	layers.push_back(create_layer(VIDEO));
+	layers.push_back(create_layer(GRAPHICS));
+
+	auto stats = cull_layers(layers, ASPECT_RATIO);
+
+	BOOST_CHECK_EQUAL(stats.items, 10u);
+	BOOST_CHECK_EQUAL(stats.occluded, 8u);
+	BOOST_CHECK_EQUAL(stats.invisible, 0u);
+	BOOST_CHECK_EQUAL(layers.size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(a_fill_above_a_key_occludes_nothing)
+{
+	auto key = GRAPHICS;
+	key.transform.is_key = true;
+
+	std::vector<synthetic_layer> layers(4, create_layer(GRAPHICS));
+	layers.push_back(create_layer(key));
+	layers.push_back(create_layer(VIDEO));
+
+	auto stats = cull_layers(layers, ASPECT_RATIO);
+
+	BOOST_CHECK_EQUAL(stats.occluded, 0u);
+	BOOST_CHECK_EQUAL(stats.invisible, 0u);
+	BOOST_CHECK_EQUAL(layers.size(), 6u);
+}
+
+BOOST_AUTO_TEST_CASE(a_fill_occludes_the_items_below_it_in_its_layer)
+{
+	auto mix = VIDEO;
+	mix.transform.is_mix = true;
+
+	std::vector<synthetic_layer> layers(4, create_layer(GRAPHICS));
+	layers.push_back(create_layer(mix));
+	layers.back().second.push_back(VIDEO);
+	layers.back().second.push_back(GRAPHICS);
+
+	auto stats = cull_layers(layers, ASPECT_RATIO);
+
+	BOOST_CHECK_EQUAL(stats.occluded, 5u);
+	BOOST_REQUIRE_EQUAL(layers.size(), 1u);
+	BOOST_CHECK_EQUAL(layers[0].second.size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(partial_fills_and_blended_layers_occlude_nothing)
+{
+	auto scaled = VIDEO;
+	scaled.transform.fill_scale[0] = 0.5;
+
+	auto clipped = VIDEO;
+	clipped.transform.clip_scale[1] = 0.5;
+
+	auto faded = VIDEO;
+	faded.transform.opacity = 0.99;
+
+	auto field = VIDEO;
+	field.transform.field_mode = field_mode::upper;
+
+	auto rotated = VIDEO;
+	rotated.transform.angle = 0.1;
+
+	std::vector<synthetic_layer> layers(1, create_layer(GRAPHICS));
+	layers.push_back(create_layer(scaled));
+	layers.push_back(create_layer(clipped));
+	layers.push_back(create_layer(faded));
+	layers.push_back(create_layer(field));
+	layers.push_back(create_layer(rotated));
+	layers.push_back(create_layer(GRAPHICS));
+	layers.push_back(create_layer(VIDEO, blend_mode::multiply));
+
+	auto stats = cull_layers(layers, ASPECT_RATIO);
+
+	BOOST_CHECK_EQUAL(stats.occluded, 0u);
+	BOOST_CHECK_EQUAL(stats.invisible, 0u);
+	BOOST_CHECK_EQUAL(layers.size(), 8u);
+}
+
+BOOST_AUTO_TEST_CASE(a_zoomed_fill_occludes_the_layers_below)
+{
+	auto zoomed = VIDEO;
+	zoomed.transform.fill_translation[0] = -0.5;
+	zoomed.transform.fill_scale[0] = 2.0;
+	zoomed.transform.fill_scale[1] = 2.0;
+
+	std::vector<synthetic_layer> layers(2, create_layer(GRAPHICS));
+	layers.push_back(create_layer(zoomed));
+
+	auto stats = cull_layers(layers, ASPECT_RATIO);
+
+	BOOST_CHECK_EQUAL(stats.occluded, 2u);
+	BOOST_CHECK_EQUAL(layers.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(invisible_items_and_emptied_layers_are_dropped)
+{
+	auto transparent = GRAPHICS;
+	transparent.transform.opacity = 0.0;
+
+	auto left = GRAPHICS;
+	left.transform.fill_translation[0] = -1.5;
+
+	auto below = GRAPHICS;
+	below.transform.fill_translation[1] = 1.0001;
+
+	auto partly = GRAPHICS;
+	partly.transform.fill_translation[0] = 0.75;
+
+	auto no_field = GRAPHICS;
+	no_field.transform.field_mode = field_mode::empty;
+
+	std::vector<synthetic_layer> layers(1, create_layer(transparent));
+	layers.push_back(create_layer(left));
+	layers.back().second.push_back(below);
+	layers.back().second.push_back(partly);
+	layers.push_back(create_layer(no_field));
+
+	auto stats = cull_layers(layers, ASPECT_RATIO);
+
+	BOOST_CHECK_EQUAL(stats.invisible, 4u);
+	BOOST_REQUIRE_EQUAL(layers.size(), 1u);
+	BOOST_CHECK_EQUAL(layers[0].second.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(layers_above_a_key_and_mix_layers_are_kept)
+{
+	auto key = GRAPHICS;
+	key.transform.is_key = true;
+
+	auto transparent = GRAPHICS;
+	transparent.transform.opacity = 0.0;
+
+	auto mix = GRAPHICS;
+	mix.transform.is_mix = true;
+
+	// The key layer and the emptied layer above it are kept, the mix layer is
+	// kept and the last transparent item is dropped.
+	std::vector<synthetic_layer> layers(1, create_layer(key));
+	layers.back().second.push_back(transparent);
+	layers.push_back(create_layer(transparent));
+	layers.push_back(create_layer(mix));
+	layers.back().second.push_back(transparent);
+	layers.push_back(create_layer(GRAPHICS));
+	layers.back().second.push_back(transparent);
+
+	auto stats = cull_layers(layers, ASPECT_RATIO);
+
+	BOOST_CHECK_EQUAL(stats.invisible, 1u);
+	BOOST_CHECK_EQUAL(stats.occluded, 0u);
+	BOOST_REQUIRE_EQUAL(layers.size(), 4u);
+	BOOST_CHECK_EQUAL(layers[0].second.size(), 2u);
+	BOOST_CHECK_EQUAL(layers[1].second.size(), 1u);
+	BOOST_CHECK_EQUAL(layers[2].second.size(), 2u);
+	BOOST_CHECK_EQUAL(layers[3].second.size(), 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,279 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <common/exception/exceptions.h>
+#include <common/memory/memclr.h>
+#include <common/memory/memcpy.h>
+#include <common/memory/memory_kernels.h>
+#include <common/memory/memshfl.h>
+#include <common/utility/string.h>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace caspar;
+
+namespace {
+
+typedef std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> buffer;
+
+const size_t GUARD = 64;
+
+// Deterministic noise, offset 0 is 64 byte aligned.
+buffer make_buffer(size_t size, uint32_t seed)
+{
+	buffer result(size + 2*GUARD);
+	for(size_t n = 0; n < result.size(); ++n)
+	{
+		seed = seed*1664525 + 1013904223;
+		result[n] = static_cast<uint8_t>(seed >> 24);
+	}
+	return result;
+}
+
+// The bytes of _mm_set_epi32(m1, m2, m3, m4).
+void make_mask(int m1, int m2, int m3, int m4, uint8_t* mask)
+{
+	const int words[] = {m4, m3, m2, m1};
+	for(int n = 0; n < 16; ++n)
+		mask[n] = static_cast<uint8_t>(words[n / 4] >> ((n % 4) * 8));
+}
+
+void reference_shuffle(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask)
+{
+	for(size_t block = 0; block < count; block += 16)
+	{
+		uint8_t in[16] = {0};
+		memcpy(in, source + block, std::min<size_t>(16, count - block));
+		for(size_t n = 0; n < 16 && block + n < count; ++n)
+			dest[block + n] = (mask[n] & 0x80) ? 0 : in[mask[n] & 0x0F];
+	}
+}
+
+// Lengths around every block and unroll size of the kernels.
+std::vector<size_t> small_counts()
+{
+	const size_t counts[] = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 255, 256, 257, 1000, 4096 + 13};
+	return std::vector<size_t>(counts, counts + sizeof(counts)/sizeof(counts[0]));
+}
+
+// Around the parallel and non-temporal thresholds.
+std::vector<size_t> large_counts()
+{
+	std::vector<size_t> counts;
+	counts.push_back(memory_kernel_thresholds::non_temporal_threshold - 1);
+	counts.push_back(memory_kernel_thresholds::non_temporal_threshold + 17);
+	counts.push_back(memory_kernel_thresholds::parallel_threshold + 13);
+	counts.push_back(3*memory_kernel_thresholds::parallel_threshold + 77);
+	return counts;
+}
+
+std::vector<size_t> offsets()
+{
+	const size_t offsets[] = {0, 1, 3, 15, 16, 31, 33, 63};
+	return std::vector<size_t>(offsets, offsets + sizeof(offsets)/sizeof(offsets[0]));
+}
+
+std::vector<int> thread_counts()
+{
+	const int threads[] = {1, 2, 3, 4, 0}; // 0 is the default tbb pool.
+	return std::vector<int>(threads, threads + sizeof(threads)/sizeof(threads[0]));
+}
+
+struct masks
+{
+	uint8_t rgba_to_bgra[16];
+	uint8_t zeroing[16];
+
+	masks()
+	{
+		make_mask(0x0F0C0D0E, 0x0B08090A, 0x07040506, 0x03000102, rgba_to_bgra);
+		make_mask(0x800F800E, 0x0D80800C, 0x80808080, 0x00010203, zeroing);
+	}
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(memory_kernels_tests)
+
+BOOST_AUTO_TEST_CASE(every_simd_level_matches_the_c_kernels)
+{
+	auto levels = detail::get_memory_kernel_levels();
+	BOOST_REQUIRE(!levels.empty());
+	BOOST_REQUIRE(levels.front().stream_copy && levels.front().stream_clear && levels.front().shuffle);
+
+	auto& c = levels.front();
+	masks m;
+
+	BOOST_FOREACH(auto& level, levels)
+	{
+		BOOST_TEST_MESSAGE(narrow(level.name));
+
+		BOOST_FOREACH(auto count, small_counts())
+		BOOST_FOREACH(auto dest_offset, offsets())
+		BOOST_FOREACH(auto source_offset, offsets())
+		{
+			auto source		= make_buffer(count, 1);
+			auto expected	= make_buffer(count, 2);
+			auto actual		= expected;
+
+			if(level.stream_copy)
+			{
+				c.stream_copy(expected.data() + GUARD + dest_offset, source.data() + GUARD + source_offset, count);
+				level.stream_copy(actual.data() + GUARD + dest_offset, source.data() + GUARD + source_offset, count);
+				BOOST_REQUIRE_MESSAGE(expected == actual, narrow(level.name) << " copy " << count << " bytes at " << dest_offset << "/" << source_offset);
+
+				c.stream_clear(expected.data() + GUARD + dest_offset, count);
+				level.stream_clear(actual.data() + GUARD + dest_offset, count);
+				BOOST_REQUIRE_MESSAGE(expected == actual, narrow(level.name) << " clear " << count << " bytes at " << dest_offset);
+			}
+
+			if(level.shuffle)
+			{
+				for(int stream = 0; stream < 2; ++stream)
+				{
+					c.shuffle(expected.data() + GUARD + dest_offset, source.data() + GUARD + source_offset, count, m.zeroing, stream != 0);
+					level.shuffle(actual.data() + GUARD + dest_offset, source.data() + GUARD + source_offset, count, m.zeroing, stream != 0);
+					BOOST_REQUIRE_MESSAGE(expected == actual, narrow(level.name) << " shuffle " << count << " bytes at " << dest_offset << "/" << source_offset);
+				}
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(the_c_shuffle_matches_pshufb)
+{
+	masks m;
+	auto levels = detail::get_memory_kernel_levels();
+
+	BOOST_FOREACH(auto count, small_counts())
+	{
+		auto source		= make_buffer(count, 3);
+		auto expected	= make_buffer(count, 4);
+		auto actual		= expected;
+
+		reference_shuffle(expected.data() + GUARD, source.data() + GUARD, count, m.rgba_to_bgra);
+		levels.front().shuffle(actual.data() + GUARD, source.data() + GUARD, count, m.rgba_to_bgra, false);
+		BOOST_REQUIRE_MESSAGE(expected == actual, "shuffle " << count << " bytes");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(copies_match_memcpy)
+{
+	std::vector<size_t> counts = small_counts();
+	BOOST_FOREACH(auto count, large_counts())
+		counts.push_back(count);
+
+	BOOST_FOREACH(auto count, counts)
+	BOOST_FOREACH(auto threads, thread_counts())
+	BOOST_FOREACH(auto offset, offsets())
+	{
+		auto source		= make_buffer(count, 5);
+		auto expected	= make_buffer(count, 6);
+		auto actual		= expected;
+
+		// Both unaligned by a different amount, and the source ahead of the destination.
+		memcpy(expected.data() + GUARD + offset, source.data() + GUARD + (offset + 5) % GUARD, count);
+		detail::fast_memcpy(actual.data() + GUARD + offset, source.data() + GUARD + (offset + 5) % GUARD, count, threads);
+		BOOST_REQUIRE_MESSAGE(expected == actual, "copy " << count << " bytes at " << offset << " on " << threads << " threads");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(shuffles_match_pshufb)
+{
+	masks m;
+
+	std::vector<size_t> counts = small_counts();
+	BOOST_FOREACH(auto count, large_counts())
+		counts.push_back(count);
+
+	BOOST_FOREACH(auto count, counts)
+	BOOST_FOREACH(auto threads, thread_counts())
+	BOOST_FOREACH(auto offset, offsets())
+	{
+		auto source		= make_buffer(count, 7);
+		auto expected	= make_buffer(count, 8);
+		auto actual		= expected;
+
+		reference_shuffle(expected.data() + GUARD + offset, source.data() + GUARD + (offset + 7) % GUARD, count, m.rgba_to_bgra);
+		detail::fast_memshfl(actual.data() + GUARD + offset, source.data() + GUARD + (offset + 7) % GUARD, count, 0x0F0C0D0E, 0x0B08090A, 0x07040506, 0x03000102, threads);
+		BOOST_REQUIRE_MESSAGE(expected == actual, "shuffle " << count << " bytes at " << offset << " on " << threads << " threads");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(clears_match_memset)
+{
+	std::vector<size_t> counts = small_counts();
+	BOOST_FOREACH(auto count, large_counts())
+		counts.push_back(count);
+
+	BOOST_FOREACH(auto count, counts)
+	BOOST_FOREACH(auto threads, thread_counts())
+	BOOST_FOREACH(auto offset, offsets())
+	{
+		auto expected	= make_buffer(count, 9);
+		auto actual		= expected;
+
+		memset(expected.data() + GUARD + offset, 0, count);
+		detail::fast_memclr(actual.data() + GUARD + offset, count, threads);
+		BOOST_REQUIRE_MESSAGE(expected == actual, "clear " << count << " bytes at " << offset << " on " << threads << " threads");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(a_shuffle_can_run_in_place)
+{
+	masks m;
+
+	BOOST_FOREACH(auto count, large_counts())
+	BOOST_FOREACH(auto threads, thread_counts())
+	{
+		auto expected	= make_buffer(count, 10);
+		auto actual		= expected;
+
+		reference_shuffle(expected.data() + GUARD + 3, actual.data() + GUARD + 3, count, m.rgba_to_bgra);
+		detail::fast_memshfl(actual.data() + GUARD + 3, actual.data() + GUARD + 3, count, 0x0F0C0D0E, 0x0B08090A, 0x07040506, 0x03000102, threads);
+		BOOST_REQUIRE_MESSAGE(expected == actual, "shuffle " << count << " bytes in place on " << threads << " threads");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(overlapping_buffers_are_rejected)
+{
+	auto data = make_buffer(4096, 11);
+	auto copy = data;
+
+	BOOST_CHECK_THROW(detail::fast_memcpy(data.data() + GUARD + 1, data.data() + GUARD, 1024, 1), invalid_argument);
+	BOOST_CHECK_THROW(detail::fast_memcpy(data.data() + GUARD, data.data() + GUARD + 1023, 1024, 1), invalid_argument);
+	BOOST_CHECK_THROW(detail::fast_memshfl(data.data() + GUARD + 16, data.data() + GUARD, 1024, 0x0F0C0D0E, 0x0B08090A, 0x07040506, 0x03000102, 1), invalid_argument);
+	BOOST_CHECK(data == copy);
+
+	// Adjacent buffers do not overlap.
+	BOOST_CHECK_NO_THROW(detail::fast_memcpy(data.data() + GUARD + 1024, data.data() + GUARD, 1024, 1));
+	BOOST_CHECK_NO_THROW(detail::fast_memcpy(data.data() + GUARD, data.data() + GUARD + 1024, 1024, 1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
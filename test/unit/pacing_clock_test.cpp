@@ -0,0 +1,100 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <common/utility/pacing_clock.h>
+
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace caspar;
+
+namespace {
+
+struct rate
+{
+	int time_scale;
+	int duration;
+};
+
+const rate RATES[] = {{24000, 1001}, {24, 1}, {25, 1}, {30000, 1001}, {50, 1}, {60000, 1001}, {60, 1}};
+
+const int64_t SIMULATED_SECONDS = 10 * 60;
+
+}
+
+BOOST_AUTO_TEST_SUITE(pacing_clock_tests)
+
+BOOST_AUTO_TEST_CASE(deadlines_do_not_drift_over_ten_minutes)
+{
+	BOOST_FOREACH(auto& r, RATES)
+	{
+		pacing_clock clock(r.time_scale, r.duration);
+		const auto frequency = clock.frequency();
+		const auto frames	 = SIMULATED_SECONDS * r.time_scale / r.duration;
+		
+		int64_t errors = 0;
+		int64_t elapsed = 0;
+		for(int64_t frame = 0; frame < frames; ++frame)
+		{
+			// Accumulate the intervals the pacer waits, so any rounding would add up.
+			auto next = clock.deadline(frame + 1);
+			elapsed  += next - clock.deadline(frame);
+
+			if(next != (frame + 1) * r.duration * frequency / r.time_scale)
+				++errors;
+			if(clock.frame_at(next) != frame + 1 || clock.frame_at(next - 1) != frame)
+				++errors;
+		}
+
+		BOOST_CHECK_EQUAL(errors, 0);
+		BOOST_CHECK_EQUAL(elapsed, frames * r.duration * frequency / r.time_scale);
+
+		// Every time_scale frames take exactly duration seconds.
+		auto periods = frames / r.time_scale;
+		BOOST_CHECK_EQUAL(clock.deadline(periods * r.time_scale), periods * r.duration * frequency);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(channels_of_the_same_rate_share_a_clock)
+{
+	auto a = get_master_pacing_clock(60000, 1001);
+	auto b = get_master_pacing_clock(60000, 1001);
+	auto c = get_master_pacing_clock(50, 1);
+
+	BOOST_CHECK(a == b);
+	BOOST_CHECK(a != c);
+}
+
+BOOST_AUTO_TEST_CASE(pacer_never_returns_before_the_deadline)
+{
+	frame_pacer pacer(get_master_pacing_clock(100, 1));
+
+	for(int n = 0; n < 10; ++n)
+	{
+		pacer.tick();
+		BOOST_CHECK(pacer.last_jitter() >= 0.0);
+	}
+
+	BOOST_CHECK_EQUAL(pacer.info().get<int>(L"ticks"), 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
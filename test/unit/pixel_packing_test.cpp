@@ -0,0 +1,435 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <core/consumer/pixel_packing.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace caspar::core;
+
+namespace {
+
+struct image
+{
+	int						width;
+	int						height;
+	std::vector<uint8_t>	bgra;
+
+	// Deterministic noise, so that every SIMD lane and row tail sees different values.
+	image(int width, int height, uint32_t seed = 1)
+		: width(width)
+		, height(height)
+		, bgra(width*height*4)
+	{
+		for(size_t n = 0; n < bgra.size(); ++n)
+		{
+			seed = seed*1664525 + 1013904223;
+			bgra[n] = static_cast<uint8_t>(seed >> 24);
+		}
+	}
+};
+
+struct packed
+{
+	packed_format::type			format;
+	std::vector<uint8_t>		data;
+	std::vector<packed_plane>	planes;
+
+	packed(packed_format::type format, const image& src)
+		: format(format)
+		, data(packed_size(format, src.width, src.height))
+	{
+		auto ptr = data.data();
+		for(int plane = 0; plane < packed_plane_count(format); ++plane)
+		{
+			planes.push_back(packed_plane(ptr, packed_linesize(format, src.width, plane)));
+			ptr += planes.back().linesize*packed_plane_height(format, src.height, plane);
+		}
+		pack(format, src.bgra.data(), src.width, src.height, planes.data());
+	}
+
+	// One field of src.
+	packed(packed_format::type format, const image& src, field_mode::type field)
+		: format(format)
+		, data(packed_size(format, src.width, field_height(src.height, field)))
+	{
+		auto ptr = data.data();
+		for(int plane = 0; plane < packed_plane_count(format); ++plane)
+		{
+			planes.push_back(packed_plane(ptr, packed_linesize(format, src.width, plane)));
+			ptr += planes.back().linesize*packed_plane_height(format, field_height(src.height, field), plane);
+		}
+		pack_field(format, field, src.bgra.data(), src.width, src.height, planes.data());
+	}
+
+	uint8_t at(int plane, int x, int y) const
+	{
+		return planes[plane].data[y*planes[plane].linesize + x];
+	}
+};
+
+// Studio range Y'CbCr in 8 bits computed in double precision. Chroma is
+// taken from the average of the horizontal pixel pair, as in pack.
+struct reference
+{
+	double kr;
+	double kb;
+
+	explicit reference(int height)
+		: kr(height >= 720 ? 0.2126 : 0.299)
+		, kb(height >= 720 ? 0.0722 : 0.114)
+	{
+	}
+
+	double y(const uint8_t* p) const
+	{
+		return 16.0 + 219.0/255.0*(kb*p[0] + (1.0-kr-kb)*p[1] + kr*p[2]);
+	}
+
+	double cb(const uint8_t* p0, const uint8_t* p1) const
+	{
+		double b = (p0[0] + p1[0])*0.5, g = (p0[1] + p1[1])*0.5, r = (p0[2] + p1[2])*0.5;
+		double y = kb*b + (1.0-kr-kb)*g + kr*r;
+		return 128.0 + 224.0/255.0*(b - y)/(2.0*(1.0-kb));
+	}
+
+	double cr(const uint8_t* p0, const uint8_t* p1) const
+	{
+		double b = (p0[0] + p1[0])*0.5, g = (p0[1] + p1[1])*0.5, r = (p0[2] + p1[2])*0.5;
+		double y = kb*b + (1.0-kr-kb)*g + kr*r;
+		return 128.0 + 224.0/255.0*(r - y)/(2.0*(1.0-kr));
+	}
+};
+
+bool within_one(double expected, int actual)
+{
+	return std::abs(expected - actual) <= 1.0;
+}
+
+void check_yuv422p(const image& src)
+{
+	packed out(packed_format::yuv422p, src);
+	reference ref(src.height);
+
+	int errors = 0;
+	for(int y = 0; y < src.height; ++y)
+	{
+		auto row = src.bgra.data() + y*src.width*4;
+		for(int x = 0; x < src.width; ++x)
+			errors += within_one(ref.y(row + x*4), out.at(0, x, y)) ? 0 : 1;
+
+		for(int x = 0; x < (src.width+1)/2; ++x)
+		{
+			auto p0 = row + x*8;
+			auto p1 = row + std::min(x*2+1, src.width-1)*4;
+			errors += within_one(ref.cb(p0, p1), out.at(1, x, y)) ? 0 : 1;
+			errors += within_one(ref.cr(p0, p1), out.at(2, x, y)) ? 0 : 1;
+		}
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(pixel_packing)
+
+BOOST_AUTO_TEST_CASE(plane_layout)
+{
+	BOOST_CHECK_EQUAL(packed_linesize(packed_format::bgra, 1920, 0), 1920*4);
+	BOOST_CHECK_EQUAL(packed_linesize(packed_format::uyvy, 1919, 0), 960*4);
+	BOOST_CHECK_EQUAL(packed_linesize(packed_format::v210, 1920, 0), 5120);
+	BOOST_CHECK_EQUAL(packed_linesize(packed_format::v210, 1280, 0), 3456);
+	BOOST_CHECK_EQUAL(packed_linesize(packed_format::yuv420p, 1919, 1), 960);
+	BOOST_CHECK_EQUAL(packed_plane_height(packed_format::yuv420p, 1081, 2), 541);
+	BOOST_CHECK_EQUAL(packed_size(packed_format::yuv420p, 1920, 1080), 1920*1080*3/2);
+	BOOST_CHECK_EQUAL(packed_size(packed_format::key_luma, 720, 576), 720*576);
+}
+
+BOOST_AUTO_TEST_CASE(format_names)
+{
+	for(int n = 0; n < packed_format::count; ++n)
+	{
+		auto format = static_cast<packed_format::type>(n);
+		BOOST_CHECK_EQUAL(packed_format::from_string(packed_format::print(format)), format);
+	}
+	BOOST_CHECK_THROW(packed_format::from_string(L"rgb565"), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(bgra_copies)
+{
+	image src(1917, 31);
+	packed out(packed_format::bgra, src);
+	BOOST_CHECK(out.data == src.bgra);
+}
+
+BOOST_AUTO_TEST_CASE(key_formats)
+{
+	image src(1917, 31);
+	packed luma(packed_format::key_luma, src);
+	packed bgra(packed_format::key_bgra, src);
+
+	int errors = 0;
+	for(int y = 0; y < src.height; ++y)
+	{
+		for(int x = 0; x < src.width; ++x)
+		{
+			auto alpha = src.bgra[(y*src.width + x)*4 + 3];
+			errors += luma.at(0, x, y) != alpha ? 1 : 0;
+			for(int c = 0; c < 4; ++c)
+				errors += bgra.at(0, x*4+c, y) != alpha ? 1 : 0;
+		}
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE(premultiply_rounds_exactly)
+{
+	image src(1917, 31);
+	packed out(packed_format::premultiplied_bgra, src);
+
+	int errors = 0;
+	for(size_t n = 0; n < src.bgra.size(); n += 4)
+	{
+		int a = src.bgra[n+3];
+		for(int c = 0; c < 3; ++c)
+		{
+			int expected = static_cast<int>(std::floor(src.bgra[n+c]*a/255.0 + 0.5));
+			errors += out.data[n+c] != expected ? 1 : 0;
+		}
+		errors += out.data[n+3] != a ? 1 : 0;
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE(straight_alpha_inverts_premultiply)
+{
+	image src(1917, 31);
+	packed premultiplied(packed_format::premultiplied_bgra, src);
+
+	image tmp(src.width, src.height);
+	tmp.bgra = premultiplied.data;
+	packed straight(packed_format::straight_bgra, tmp);
+
+	// Premultiplication loses 8 - log2(a) bits, so only compare well covered pixels.
+	int errors = 0;
+	for(size_t n = 0; n < src.bgra.size(); n += 4)
+	{
+		int a = src.bgra[n+3];
+		if(a < 64)
+			continue;
+		for(int c = 0; c < 3; ++c)
+			errors += std::abs(straight.data[n+c] - src.bgra[n+c]) > 255/a + 1 ? 1 : 0;
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE(yuv422p_bt709_hd)
+{
+	check_yuv422p(image(1920, 720));
+}
+
+BOOST_AUTO_TEST_CASE(yuv422p_bt601_sd)
+{
+	check_yuv422p(image(720, 576));
+}
+
+BOOST_AUTO_TEST_CASE(yuv422p_odd_width)
+{
+	check_yuv422p(image(1917, 17));
+}
+
+BOOST_AUTO_TEST_CASE(yuv_extremes)
+{
+	image src(64, 4);
+	for(size_t n = 0; n < src.bgra.size(); n += 4)
+	{
+		uint8_t value = (n/4) % 2 == 0 ? 0 : 255;
+		src.bgra[n+0] = src.bgra[n+1] = src.bgra[n+2] = src.bgra[n+3] = value;
+	}
+
+	packed out(packed_format::yuv422p, src);
+	BOOST_CHECK_EQUAL(out.at(0, 0, 0), 16);
+	BOOST_CHECK_EQUAL(out.at(0, 1, 0), 235);
+	BOOST_CHECK_EQUAL(out.at(1, 0, 0), 128);
+	BOOST_CHECK_EQUAL(out.at(2, 0, 0), 128);
+}
+
+BOOST_AUTO_TEST_CASE(uyvy_matches_planar)
+{
+	image src(1917, 17);
+	packed uyvy(packed_format::uyvy, src);
+	packed planar(packed_format::yuv422p, src);
+
+	int errors = 0;
+	for(int y = 0; y < src.height; ++y)
+	{
+		for(int x = 0; x < (src.width+1)/2; ++x)
+		{
+			errors += uyvy.at(0, x*4+0, y) != planar.at(1, x, y) ? 1 : 0;
+			errors += uyvy.at(0, x*4+1, y) != planar.at(0, x*2, y) ? 1 : 0;
+			errors += uyvy.at(0, x*4+2, y) != planar.at(2, x, y) ? 1 : 0;
+			errors += uyvy.at(0, x*4+3, y) != planar.at(0, std::min(x*2+1, src.width-1), y) ? 1 : 0;
+		}
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE(v210_matches_planar)
+{
+	image src(1280, 9);
+	packed v210(packed_format::v210, src);
+	packed planar(packed_format::yuv422p, src);
+
+	int errors = 0;
+	for(int y = 0; y < src.height; ++y)
+	{
+		auto words = reinterpret_cast<const uint32_t*>(v210.planes[0].data + y*v210.planes[0].linesize);
+		for(int x = 0; x < src.width; x += 6, words += 4)
+		{
+			// Cb Y Cr | Y Cb Y | Cr Y Cb | Y Cr Y
+			const int samples[12] = 
+			{
+				words[0] & 0x3FF, (words[0] >> 10) & 0x3FF, (words[0] >> 20) & 0x3FF,
+				words[1] & 0x3FF, (words[1] >> 10) & 0x3FF, (words[1] >> 20) & 0x3FF,
+				words[2] & 0x3FF, (words[2] >> 10) & 0x3FF, (words[2] >> 20) & 0x3FF,
+				words[3] & 0x3FF, (words[3] >> 10) & 0x3FF, (words[3] >> 20) & 0x3FF
+			};
+			const int y_index[6]	= {1, 3, 5, 7, 9, 11};
+			const int cb_index[3]	= {0, 4, 8};
+			const int cr_index[3]	= {2, 6, 10};
+
+			// The last group of a row is padded past the image width.
+			for(int n = 0; n < 6 && x+n < src.width; ++n)
+				errors += std::min(255, (samples[y_index[n]] + 2) >> 2) != planar.at(0, x+n, y) ? 1 : 0;
+			for(int n = 0; n < 3 && x/2+n < (src.width+1)/2; ++n)
+			{
+				errors += std::min(255, (samples[cb_index[n]] + 2) >> 2) != planar.at(1, x/2+n, y) ? 1 : 0;
+				errors += std::min(255, (samples[cr_index[n]] + 2) >> 2) != planar.at(2, x/2+n, y) ? 1 : 0;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE(yuv420p_averages_row_pairs)
+{
+	image src(1917, 17);
+	packed out(packed_format::yuv420p, src);
+	packed planar(packed_format::yuv422p, src);
+
+	int errors = 0;
+	for(int y = 0; y < src.height; ++y)
+	{
+		for(int x = 0; x < src.width; ++x)
+			errors += out.at(0, x, y) != planar.at(0, x, y) ? 1 : 0;
+	}
+	for(int y = 0; y < (src.height+1)/2; ++y)
+	{
+		int y1 = std::min(y*2+1, src.height-1);
+		for(int x = 0; x < (src.width+1)/2; ++x)
+		{
+			errors += std::abs(out.at(1, x, y) - (planar.at(1, x, y*2) + planar.at(1, x, y1) + 1)/2) > 1 ? 1 : 0;
+			errors += std::abs(out.at(2, x, y) - (planar.at(2, x, y*2) + planar.at(2, x, y1) + 1)/2) > 1 ? 1 : 0;
+		}
+	}
+	BOOST_CHECK_EQUAL(errors, 0);
+}
+
+BOOST_AUTO_TEST_CASE(field_heights)
+{
+	BOOST_CHECK_EQUAL(field_height(1080, field_mode::upper), 540);
+	BOOST_CHECK_EQUAL(field_height(1080, field_mode::lower), 540);
+	BOOST_CHECK_EQUAL(field_height(1081, field_mode::upper), 541);
+	BOOST_CHECK_EQUAL(field_height(1081, field_mode::lower), 540);
+}
+
+BOOST_AUTO_TEST_CASE(split_fields_separates_rows)
+{
+	image src(17, 7);
+	const int linesize = src.width*4;
+
+	std::vector<uint8_t> upper(linesize*field_height(src.height, field_mode::upper));
+	std::vector<uint8_t> lower(linesize*field_height(src.height, field_mode::lower));
+	split_fields(src.bgra.data(), linesize, src.height, upper.data(), lower.data());
+
+	for(int y = 0; y < src.height; ++y)
+	{
+		auto field = y % 2 == 0 ? upper.data() : lower.data();
+		BOOST_CHECK(std::equal(src.bgra.begin() + y*linesize, src.bgra.begin() + (y+1)*linesize, field + (y/2)*linesize));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(packed_fields_match_the_packed_frame)
+{
+	// 720 lines, so the fields must still use the BT.709 matrix of the frame.
+	image src(1917, 720);
+
+	for(int n = 0; n < packed_format::count; ++n)
+	{
+		auto format = static_cast<packed_format::type>(n);
+		if(format == packed_format::yuv420p) // Averages chroma over rows of different fields.
+			continue;
+
+		packed frame(format, src);
+		packed upper(format, src, field_mode::upper);
+		packed lower(format, src, field_mode::lower);
+
+		int errors = 0;
+		for(int plane = 0; plane < packed_plane_count(format); ++plane)
+		{
+			const int linesize = frame.planes[plane].linesize;
+			for(int y = 0; y < src.height; ++y)
+			{
+				auto field_row	= (y % 2 == 0 ? upper : lower).planes[plane].data + (y/2)*linesize;
+				auto frame_row	= frame.planes[plane].data + y*linesize;
+				errors += std::equal(frame_row, frame_row + linesize, field_row) ? 0 : 1;
+			}
+		}
+		BOOST_CHECK_MESSAGE(errors == 0, "format " << n << ": " << errors << " rows differ");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(yuv420p_fields_average_their_own_rows)
+{
+	image src(64, 9);
+	packed upper(packed_format::yuv420p, src, field_mode::upper);
+
+	image upper_rows(src.width, field_height(src.height, field_mode::upper));
+	for(int y = 0; y < upper_rows.height; ++y)
+		std::copy(src.bgra.begin() + y*2*src.width*4, src.bgra.begin() + (y*2+1)*src.width*4, upper_rows.bgra.begin() + y*src.width*4);
+
+	packed expected(packed_format::yuv420p, upper_rows);
+	BOOST_CHECK(upper.data == expected.data);
+}
+
+BOOST_AUTO_TEST_CASE(pack_field_needs_a_field)
+{
+	image src(16, 4);
+	packed out(packed_format::bgra, src);
+	BOOST_CHECK_THROW(pack_field(packed_format::bgra, field_mode::progressive, src.bgra.data(), src.width, src.height, out.planes.data()), std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,432 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Helge Norberg, helge.norberg@svt.se
+*/
+
+#include <modules/image/util/png_row_reader.h>
+#include <modules/image/util/image_loader.h>
+
+#include <common/exception/exceptions.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace caspar;
+using namespace caspar::image;
+
+namespace {
+
+enum png_color_type
+{
+	gray		= 0,
+	rgb			= 2,
+	palette		= 3,
+	gray_alpha	= 4,
+	rgb_alpha	= 6
+};
+
+struct png_description
+{
+	int						width;
+	int						height;
+	int						bit_depth;
+	int						color_type;
+	bool					interlaced;
+	std::vector<uint8_t>	palette;
+	std::vector<uint8_t>	transparency;
+
+	png_description(int width, int height, int bit_depth, int color_type)
+		: width(width)
+		, height(height)
+		, bit_depth(bit_depth)
+		, color_type(color_type)
+		, interlaced(false)
+	{
+	}
+};
+
+int channel_count(int color_type)
+{
+	switch(color_type)
+	{
+	case rgb:			return 3;
+	case gray_alpha:	return 2;
+	case rgb_alpha:		return 4;
+	default:			return 1;
+	}
+}
+
+// A pattern that differs between neighbouring pixels, rows and channels so
+// that every filter type has something to predict.
+uint16_t test_sample(int x, int y, int channel, int bit_depth)
+{
+	return static_cast<uint16_t>(((x * 37 + y * 91 + channel * 53 + x * y) * 2731) & ((1 << bit_depth) - 1));
+}
+
+void append_be32(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back(static_cast<uint8_t>(value >> 24));
+	out.push_back(static_cast<uint8_t>(value >> 16));
+	out.push_back(static_cast<uint8_t>(value >> 8));
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+void append_chunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, size_t size)
+{
+	append_be32(png, static_cast<uint32_t>(size));
+	auto start = png.size();
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data, data + size);
+	append_be32(png, crc32(0, png.data() + start, static_cast<uInt>(png.size() - start)));
+}
+
+void append_chunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data)
+{
+	append_chunk(png, type, data.empty() ? nullptr : data.data(), data.size());
+}
+
+// Packs the samples of the pixels x = first_x, first_x + step_x, ... of row y.
+std::vector<uint8_t> pack_row(const png_description& desc, int y, int first_x, int step_x)
+{
+	const int channels = channel_count(desc.color_type);
+
+	std::vector<uint8_t> row;
+	int bits = 0;
+	for(int x = first_x; x < desc.width; x += step_x)
+	{
+		for(int c = 0; c < channels; ++c)
+		{
+			auto value = test_sample(x, y, c, desc.bit_depth);
+			if(desc.bit_depth == 16)
+			{
+				row.push_back(static_cast<uint8_t>(value >> 8));
+				row.push_back(static_cast<uint8_t>(value));
+			}
+			else
+			{
+				if(bits % 8 == 0)
+					row.push_back(0);
+				row.back() |= static_cast<uint8_t>(value << (8 - desc.bit_depth - bits % 8));
+				bits += desc.bit_depth;
+			}
+		}
+	}
+	return row;
+}
+
+uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+	int p  = static_cast<int>(a) + b - c;
+	int pa = std::abs(p - a);
+	int pb = std::abs(p - b);
+	int pc = std::abs(p - c);
+
+	if(pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+// Appends the row with a filter byte, cycling through all five filter types.
+void filter_row(const std::vector<uint8_t>& row, const std::vector<uint8_t>& previous, size_t bpp, int type, std::vector<uint8_t>& out)
+{
+	out.push_back(static_cast<uint8_t>(type));
+	for(size_t n = 0; n < row.size(); ++n)
+	{
+		uint8_t a = n >= bpp ? row[n - bpp] : 0;
+		uint8_t b = previous.empty() ? 0 : previous[n];
+		uint8_t c = n >= bpp && !previous.empty() ? previous[n - bpp] : 0;
+
+		uint8_t prediction = 0;
+		switch(type)
+		{
+		case 1: prediction = a;									break;
+		case 2: prediction = b;									break;
+		case 3: prediction = static_cast<uint8_t>((a + b) / 2);	break;
+		case 4: prediction = paeth(a, b, c);					break;
+		}
+		out.push_back(static_cast<uint8_t>(row[n] - prediction));
+	}
+}
+
+std::vector<uint8_t> encode_png(const png_description& desc)
+{
+	static const int ADAM7[7][4] = // first x, first y, step x, step y
+	{
+		{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}
+	};
+	static const int PROGRESSIVE[1][4] = {{0, 0, 1, 1}};
+
+	const size_t bpp = std::max(1, channel_count(desc.color_type) * desc.bit_depth / 8);
+
+	const int (*passes)[4]	= PROGRESSIVE;
+	int nb_passes			= 1;
+	if(desc.interlaced)
+	{
+		passes		= ADAM7;
+		nb_passes	= 7;
+	}
+
+	std::vector<uint8_t> raw;
+	int type = 0;
+	for(int pass = 0; pass < nb_passes; ++pass)
+	{
+		std::vector<uint8_t> previous;
+		for(int y = passes[pass][1]; y < desc.height; y += passes[pass][3])
+		{
+			if(passes[pass][0] >= desc.width)
+				break;
+			auto row = pack_row(desc, y, passes[pass][0], passes[pass][2]);
+			filter_row(row, previous, bpp, type++ % 5, raw);
+			previous = row;
+		}
+	}
+
+	std::vector<uint8_t> compressed(compressBound(static_cast<uLong>(raw.size())));
+	auto compressed_size = static_cast<uLongf>(compressed.size());
+	BOOST_REQUIRE(compress2(compressed.data(), &compressed_size, raw.data(), static_cast<uLong>(raw.size()), 9) == Z_OK);
+	compressed.resize(compressed_size);
+
+	static const uint8_t SIGNATURE[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	std::vector<uint8_t> png(SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+
+	std::vector<uint8_t> ihdr;
+	append_be32(ihdr, desc.width);
+	append_be32(ihdr, desc.height);
+	ihdr.push_back(static_cast<uint8_t>(desc.bit_depth));
+	ihdr.push_back(static_cast<uint8_t>(desc.color_type));
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(desc.interlaced ? 1 : 0);
+	append_chunk(png, "IHDR", ihdr);
+
+	if(!desc.palette.empty())
+		append_chunk(png, "PLTE", desc.palette);
+	if(!desc.transparency.empty())
+		append_chunk(png, "tRNS", desc.transparency);
+
+	// Small IDAT chunks so that decoding has to continue across chunks.
+	for(size_t offset = 0; offset < compressed.size(); offset += 100)
+		append_chunk(png, "IDAT", compressed.data() + offset, std::min<size_t>(100, compressed.size() - offset));
+
+	append_chunk(png, "IEND", nullptr, 0);
+	return png;
+}
+
+std::vector<uint8_t> full_palette(int bit_depth)
+{
+	std::vector<uint8_t> palette;
+	for(int n = 0; n < (1 << bit_depth); ++n)
+	{
+		palette.push_back(static_cast<uint8_t>(n * 73));
+		palette.push_back(static_cast<uint8_t>(255 - n * 11));
+		palette.push_back(static_cast<uint8_t>(n * 5 + 3));
+	}
+	return palette;
+}
+
+class temp_png : boost::noncopyable
+{
+	const boost::filesystem::path path_;
+public:
+	explicit temp_png(const std::vector<uint8_t>& data)
+		: path_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("casparcg-png-%%%%-%%%%-%%%%.png"))
+	{
+		boost::filesystem::ofstream file(path_, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	}
+
+	~temp_png()
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove(path_, ec);
+	}
+
+	std::wstring filename() const
+	{
+		return path_.wstring();
+	}
+};
+
+std::vector<uint8_t> read_all_rows(const std::wstring& filename)
+{
+	png_row_reader reader(filename);
+	std::vector<uint8_t> image(reader.width() * reader.height() * 4);
+	BOOST_CHECK_EQUAL(reader.read_rows(image.data(), reader.width() * 4, reader.height()), reader.height());
+	return image;
+}
+
+// load_image() returns bottom-up rows, the reader delivers top-down rows.
+std::vector<uint8_t> load_top_down(const std::wstring& filename)
+{
+	auto bitmap = load_image(filename);
+	const int width		= FreeImage_GetWidth(bitmap.get());
+	const int height	= FreeImage_GetHeight(bitmap.get());
+
+	std::vector<uint8_t> image(width * height * 4);
+	for(int y = 0; y < height; ++y)
+	{
+		auto row = FreeImage_GetScanLine(bitmap.get(), height - 1 - y);
+		std::copy(row, row + width * 4, image.begin() + y * width * 4);
+	}
+	return image;
+}
+
+void check_matches_load_image(const png_description& desc)
+{
+	temp_png file(encode_png(desc));
+
+	BOOST_REQUIRE(png_row_reader::can_read(file.filename()));
+
+	auto expected	= load_top_down(file.filename());
+	auto actual		= read_all_rows(file.filename());
+
+	BOOST_REQUIRE_EQUAL(actual.size(), static_cast<size_t>(desc.width * desc.height * 4));
+	BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(png_row_reader_tests)
+
+BOOST_AUTO_TEST_CASE(an_8bit_palette_file_with_transparency_matches_load_image)
+{
+	png_description desc(37, 23, 8, palette);
+	desc.palette = full_palette(8);
+	for(int n = 0; n < 200; ++n)
+		desc.transparency.push_back(static_cast<uint8_t>(n * 7));
+
+	check_matches_load_image(desc);
+}
+
+BOOST_AUTO_TEST_CASE(a_packed_palette_file_matches_load_image)
+{
+	png_description desc(37, 23, 2, palette);
+	desc.palette = full_palette(2);
+
+	check_matches_load_image(desc);
+}
+
+BOOST_AUTO_TEST_CASE(a_16bit_rgba_file_matches_load_image)
+{
+	check_matches_load_image(png_description(37, 23, 16, rgb_alpha));
+}
+
+BOOST_AUTO_TEST_CASE(a_16bit_rgb_file_matches_load_image)
+{
+	check_matches_load_image(png_description(37, 23, 16, rgb));
+}
+
+BOOST_AUTO_TEST_CASE(skipped_and_rewound_rows_match_load_image)
+{
+	png_description desc(16, 40, 8, rgb_alpha);
+	temp_png file(encode_png(desc));
+
+	auto expected = load_top_down(file.filename());
+	const size_t linesize = desc.width * 4;
+
+	png_row_reader reader(file.filename());
+	reader.skip_rows(25);
+	BOOST_CHECK_EQUAL(reader.next_row(), 25);
+
+	std::vector<uint8_t> rows(linesize * 10);
+	BOOST_REQUIRE_EQUAL(reader.read_rows(rows.data(), static_cast<int>(linesize), 10), 10);
+	BOOST_CHECK(std::equal(rows.begin(), rows.end(), expected.begin() + 25 * linesize));
+
+	// Only the 5 remaining rows are delivered.
+	BOOST_CHECK_EQUAL(reader.read_rows(rows.data(), static_cast<int>(linesize), 10), 5);
+	BOOST_CHECK_EQUAL(reader.read_rows(rows.data(), static_cast<int>(linesize), 10), 0);
+
+	reader.rewind();
+	BOOST_CHECK_EQUAL(reader.next_row(), 0);
+	BOOST_REQUIRE_EQUAL(reader.read_rows(rows.data(), static_cast<int>(linesize), 10), 10);
+	BOOST_CHECK(std::equal(rows.begin(), rows.end(), expected.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(an_interlaced_file_is_left_to_load_image)
+{
+	png_description desc(37, 23, 8, rgb_alpha);
+	desc.interlaced = true;
+	temp_png file(encode_png(desc));
+
+	BOOST_CHECK(!png_row_reader::can_read(file.filename()));
+	BOOST_CHECK_THROW(png_row_reader reader(file.filename()), invalid_argument);
+
+	// The producer falls back to load_image(), which has to see the same image.
+	desc.interlaced = false;
+	temp_png progressive(encode_png(desc));
+
+	auto interlaced_image	= load_top_down(file.filename());
+	auto progressive_image	= load_top_down(progressive.filename());
+	BOOST_CHECK(interlaced_image == progressive_image);
+	BOOST_CHECK(read_all_rows(progressive.filename()) == interlaced_image);
+}
+
+BOOST_AUTO_TEST_CASE(a_truncated_file_throws)
+{
+	png_description desc(37, 23, 8, rgb_alpha);
+	auto png = encode_png(desc);
+
+	// Every cut that loses image data, from inside the signature to the CRC
+	// of the last IDAT chunk. Only IEND may be missing.
+	for(size_t size = 0; size < png.size() - 12; size += 7)
+	{
+		temp_png file(std::vector<uint8_t>(png.begin(), png.begin() + size));
+		BOOST_CHECK_THROW(read_all_rows(file.filename()), invalid_argument);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(an_oversize_chunk_length_throws)
+{
+	png_description desc(8, 8, 8, rgb);
+	auto png = encode_png(desc);
+
+	const uint32_t LENGTHS[] = 
+	{
+		0xFFFFFFF0,	// Above the 2^31-1 limit of the PNG specification.
+		0x7FFFFFFF,	// At the limit, but larger than the file.
+		static_cast<uint32_t>(png.size())
+	};
+
+	BOOST_FOREACH(auto length, LENGTHS)
+	{
+		// An ancillary chunk between IHDR and the image data.
+		std::vector<uint8_t> chunk;
+		append_be32(chunk, length);
+		chunk.insert(chunk.end(), "tEXt", "tEXt" + 4);
+		chunk.resize(chunk.size() + 16, 'x');
+
+		auto broken = png;
+		broken.insert(broken.begin() + 8 + 25, chunk.begin(), chunk.end());
+
+		temp_png file(broken);
+		BOOST_CHECK(!png_row_reader::can_read(file.filename()));
+		BOOST_CHECK_THROW(png_row_reader reader(file.filename()), invalid_argument);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,255 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <core/monitor/monitor.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/prefetch/prefetch_producer.h>
+#include <core/video_format.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+// Shared between a gated_producer and the test, it outlives the producer.
+struct producer_gate
+{
+	boost::mutex				mutex;
+	boost::condition_variable	cond;
+	bool						open;
+	int							receives;
+	bool						destroyed;
+
+	producer_gate()
+		: open(true)
+		, receives(0)
+		, destroyed(false)
+	{
+	}
+
+	void set_open(bool value)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		open = value;
+		cond.notify_all();
+	}
+
+	int get_receives()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		return receives;
+	}
+
+	bool is_destroyed()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		return destroyed;
+	}
+
+	bool wait_for_receives(int count)
+	{
+		boost::unique_lock<boost::mutex> lock(mutex);
+		return cond.timed_wait(lock, boost::posix_time::seconds(5), [&]{return receives >= count;});
+	}
+
+	bool wait_for_destruction()
+	{
+		boost::unique_lock<boost::mutex> lock(mutex);
+		return cond.timed_wait(lock, boost::posix_time::seconds(5), [&]{return destroyed;});
+	}
+};
+
+// Decorates the empty producer, counting its receives and holding them while 
+// the gate is closed.
+class gated_producer : public frame_producer
+{
+	monitor::subject			monitor_subject_;
+	safe_ptr<frame_producer>	producer_;
+	std::shared_ptr<producer_gate>		gate_;
+public:
+	explicit gated_producer(const std::shared_ptr<producer_gate>& gate)
+		: producer_(frame_producer::empty())
+		, gate_(gate)
+	{
+	}
+
+	~gated_producer()
+	{
+		boost::lock_guard<boost::mutex> lock(gate_->mutex);
+		gate_->destroyed = true;
+		gate_->cond.notify_all();
+	}
+
+	virtual safe_ptr<basic_frame> receive(int hints) override
+	{
+		{
+			boost::unique_lock<boost::mutex> lock(gate_->mutex);
+			++gate_->receives;
+			gate_->cond.notify_all();
+			while(!gate_->open)
+				gate_->cond.wait(lock);
+		}
+		return make_safe<basic_frame>(producer_->receive(hints));
+	}
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return producer_->last_frame();
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"gated[]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::property_tree::wptree info;
+		info.add(L"type", L"gated-producer");
+		return info;
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return monitor_subject_;
+	}
+};
+
+struct prefetched
+{
+	std::shared_ptr<producer_gate> gate;
+
+	prefetched()
+		: gate(std::make_shared<producer_gate>())
+	{
+	}
+
+	safe_ptr<frame_producer> create(size_t capacity, int max_wait_millis)
+	{
+		return create_prefetch_producer(make_safe<gated_producer>(gate), video_format_desc::get(video_format::x1080i5000), capacity, max_wait_millis);
+	}
+
+	static bool wait_for_buffered(const safe_ptr<frame_producer>& producer, size_t count)
+	{
+		for(int n = 0; n < 500; ++n)
+		{
+			if(producer->info().get<size_t>(L"prefetch.buffered") >= count)
+				return true;
+			boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+		}
+		return false;
+	}
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(prefetch_producer_tests)
+
+BOOST_FIXTURE_TEST_CASE(renders_ahead_up_to_its_capacity, prefetched)
+{
+	auto producer = create(3, 20);
+
+	BOOST_REQUIRE(wait_for_buffered(producer, 3));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	BOOST_CHECK_EQUAL(gate->get_receives(), 3);
+	BOOST_CHECK_EQUAL(producer->info().get<size_t>(L"prefetch.buffered"), 3u);
+
+	// Each frame taken is replaced by one more.
+	producer->receive(frame_producer::NO_HINT);
+	BOOST_REQUIRE(gate->wait_for_receives(4));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	BOOST_CHECK_EQUAL(gate->get_receives(), 4);
+}
+
+BOOST_FIXTURE_TEST_CASE(a_capacity_of_zero_renders_one_frame_ahead, prefetched)
+{
+	auto producer = create(0, 20);
+
+	BOOST_REQUIRE(gate->wait_for_receives(1));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	BOOST_CHECK_EQUAL(gate->get_receives(), 1);
+	BOOST_CHECK_EQUAL(producer->info().get<size_t>(L"prefetch.capacity"), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(an_underrun_repeats_the_last_frame, prefetched)
+{
+	auto producer = create(2, 10);
+	BOOST_REQUIRE(wait_for_buffered(producer, 2));
+	gate->set_open(false);
+
+	// The two buffered frames, the next is held at the gate.
+	BOOST_CHECK(producer->receive(frame_producer::NO_HINT) != basic_frame::late());
+	BOOST_CHECK(producer->receive(frame_producer::NO_HINT) != basic_frame::late());
+	BOOST_CHECK(producer->receive(frame_producer::NO_HINT) == basic_frame::late());
+	BOOST_CHECK(producer->receive(frame_producer::NO_HINT) == basic_frame::late());
+	BOOST_CHECK_EQUAL(producer->info().get<int64_t>(L"prefetch.repeats"), 2);
+	BOOST_CHECK(producer->last_frame() != basic_frame::late());
+
+	gate->set_open(true);
+
+	auto frame = basic_frame::late();
+	for(int n = 0; n < 100 && frame == basic_frame::late(); ++n)
+		frame = producer->receive(frame_producer::NO_HINT);
+
+	BOOST_CHECK(frame != basic_frame::late());
+}
+
+BOOST_FIXTURE_TEST_CASE(the_first_receive_waits_for_a_frame, prefetched)
+{
+	gate->set_open(false);
+	auto producer = create(2, 10);
+	BOOST_REQUIRE(gate->wait_for_receives(1));
+
+	boost::thread opener([&]
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+		gate->set_open(true);
+	});
+
+	BOOST_CHECK(producer->receive(frame_producer::NO_HINT) != basic_frame::late());
+	opener.join();
+}
+
+BOOST_FIXTURE_TEST_CASE(teardown_waits_for_the_frame_in_flight, prefetched)
+{
+	gate->set_open(false);
+	{
+		auto producer = create(4, 10);
+		BOOST_REQUIRE(gate->wait_for_receives(1));
+	}
+
+	// The receive held at the gate keeps the decorated producer alive.
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	BOOST_CHECK(!gate->is_destroyed());
+
+	gate->set_open(true);
+
+	// Nothing is rendered ahead once the teardown has started.
+	BOOST_REQUIRE(gate->wait_for_destruction());
+	BOOST_CHECK_EQUAL(gate->get_receives(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,336 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <core/consumer/frame_consumer.h>
+#include <core/mixer/audio/audio_util.h>
+#include <core/mixer/read_frame.h>
+#include <core/mixer/write_frame.h>
+#include <core/parameters/parameters.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_factory.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/replay/replay_buffer.h>
+#include <core/producer/replay/replay_producer.h>
+#include <core/video_format.h>
+
+#include <common/exception/exceptions.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+// What a channel playing a color producer sends its consumers: a solid
+// premultiplied BGRA frame, numbered by the channel's stage.
+class color_frame : public read_frame
+{
+	std::vector<uint8_t>	image_;
+	audio_buffer			audio_;
+	int64_t					frame_number_;
+public:
+	color_frame(const video_format_desc& format_desc, uint32_t bgra, int64_t frame_number)
+		: image_(format_desc.size)
+		, audio_(format_desc.audio_cadence.front() * 2, static_cast<int32_t>(frame_number))
+		, frame_number_(frame_number)
+	{
+		for(size_t n = 0; n < image_.size(); n += 4)
+		{
+			image_[n + 0] = static_cast<uint8_t>(bgra >> 0);
+			image_[n + 1] = static_cast<uint8_t>(bgra >> 8);
+			image_[n + 2] = static_cast<uint8_t>(bgra >> 16);
+			image_[n + 3] = static_cast<uint8_t>(bgra >> 24);
+		}
+	}
+
+	virtual const boost::iterator_range<const uint8_t*> image_data() override
+	{
+		return boost::iterator_range<const uint8_t*>(image_.data(), image_.data() + image_.size());
+	}
+
+	virtual const boost::iterator_range<const int32_t*> audio_data() override
+	{
+		return boost::iterator_range<const int32_t*>(audio_.data(), audio_.data() + audio_.size());
+	}
+
+	virtual size_t image_size() const override
+	{
+		return image_.size();
+	}
+
+	virtual int num_channels() const override
+	{
+		return 2;
+	}
+
+	virtual int64_t get_age_millis() const override
+	{
+		return 0;
+	}
+
+	virtual int64_t frame_number() const override
+	{
+		return frame_number_;
+	}
+
+	virtual const core::multichannel_view<const int32_t, boost::iterator_range<const int32_t*>::const_iterator> multichannel_view() const override
+	{
+		return make_multichannel_view<const int32_t>(audio_.data(), audio_.data() + audio_.size(), channel_layout::stereo());
+	}
+};
+
+// Frame memory needs a gpu, the producer paths under test never write to it.
+struct no_image_frame_factory : public frame_factory
+{
+	video_format_desc format_desc;
+
+	explicit no_image_frame_factory(const video_format_desc& format_desc)
+		: format_desc(format_desc)
+	{
+	}
+
+	virtual safe_ptr<write_frame> create_frame(const void* tag, const pixel_format_desc&, const channel_layout& audio_channel_layout) override
+	{
+		return make_safe<write_frame>(tag, audio_channel_layout);
+	}
+
+	virtual video_format_desc get_video_format_desc() const override
+	{
+		return format_desc;
+	}
+};
+
+core::parameters make_params(const std::wstring& line)
+{
+	std::vector<std::wstring> tokens;
+	std::wstring token;
+	for(size_t n = 0; n <= line.size(); ++n)
+	{
+		if(n == line.size() || line[n] == L' ')
+		{
+			if(!token.empty())
+				tokens.push_back(token);
+			token.clear();
+		}
+		else
+			token += line[n];
+	}
+	return core::parameters(tokens);
+}
+
+const uint32_t RED		= 0xFFFF0000;
+const uint32_t BLUE		= 0xFF0000FF;
+
+struct replay_fixture
+{
+	const video_format_desc	format_desc;
+	const size_t			frame_bytes;
+
+	replay_fixture()
+		: format_desc(video_format_desc::get(video_format::pal))
+		, frame_bytes(format_desc.size + 8 * 1920 * sizeof(int32_t))
+	{
+	}
+
+	safe_ptr<read_frame> frame(int64_t number, uint32_t bgra = RED) const
+	{
+		return make_safe<color_frame>(format_desc, bgra, number);
+	}
+
+	// BGRA keeps the pixels as they were sent.
+	safe_ptr<replay_buffer> create_buffer(size_t frames) const
+	{
+		return make_safe<replay_buffer>(format_desc, 1, replay_format::bgra, frames * frame_bytes);
+	}
+};
+
+uint32_t first_pixel(const replay_frame& frame)
+{
+	return frame.image_data[0] | (frame.image_data[1] << 8) | (frame.image_data[2] << 16) | (static_cast<uint32_t>(frame.image_data[3]) << 24);
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(replay_tests, replay_fixture)
+
+BOOST_AUTO_TEST_CASE(frames_are_kept_by_channel_frame_number)
+{
+	auto buffer = create_buffer(8);
+
+	for(int64_t n = 100; n < 105; ++n)
+		buffer->push(frame(n, n == 102 ? BLUE : RED));
+
+	BOOST_CHECK_EQUAL(buffer->first_frame(), 100);
+	BOOST_CHECK_EQUAL(buffer->last_frame(), 104);
+
+	auto stored = buffer->get(102);
+	BOOST_REQUIRE(stored);
+	BOOST_CHECK_EQUAL(stored->number, 102);
+	BOOST_CHECK_EQUAL(first_pixel(*stored), BLUE);
+	BOOST_CHECK_EQUAL(stored->audio_data.front(), 102);
+
+	BOOST_CHECK(!buffer->get(99));
+	BOOST_CHECK(!buffer->get(105));
+}
+
+BOOST_AUTO_TEST_CASE(skipped_frame_numbers_are_not_held)
+{
+	auto buffer = create_buffer(8);
+
+	buffer->push(frame(10));
+	buffer->push(frame(12));
+
+	BOOST_CHECK(buffer->get(10));
+	BOOST_CHECK(!buffer->get(11));
+	BOOST_CHECK(buffer->get(12));
+}
+
+BOOST_AUTO_TEST_CASE(the_oldest_frames_are_overwritten)
+{
+	auto buffer = create_buffer(4);
+	BOOST_REQUIRE_EQUAL(buffer->capacity(), 4u);
+
+	for(int64_t n = 0; n < 6; ++n)
+		buffer->push(frame(n));
+
+	BOOST_CHECK_EQUAL(buffer->first_frame(), 2);
+	BOOST_CHECK_EQUAL(buffer->last_frame(), 5);
+	BOOST_CHECK(!buffer->get(1));
+	BOOST_CHECK(buffer->get(2));
+}
+
+BOOST_AUTO_TEST_CASE(a_held_frame_is_not_recycled)
+{
+	auto buffer = create_buffer(2);
+
+	buffer->push(frame(0, BLUE));
+	auto held = buffer->get(0);
+
+	buffer->push(frame(1));
+	buffer->push(frame(2));	// Evicts frame 0.
+
+	BOOST_CHECK(!buffer->get(0));
+	BOOST_CHECK_EQUAL(held->number, 0);
+	BOOST_CHECK_EQUAL(first_pixel(*held), BLUE);
+}
+
+BOOST_AUTO_TEST_CASE(restarted_frame_numbers_drop_the_old_frames)
+{
+	auto buffer = create_buffer(8);
+
+	buffer->push(frame(50));
+	buffer->push(frame(51));
+	buffer->push(frame(0));
+
+	BOOST_CHECK_EQUAL(buffer->first_frame(), 0);
+	BOOST_CHECK_EQUAL(buffer->last_frame(), 0);
+	BOOST_CHECK(!buffer->get(50));
+	BOOST_CHECK(buffer->get(0));
+}
+
+BOOST_AUTO_TEST_CASE(empty_frames_are_not_stored)
+{
+	auto buffer = create_buffer(8);
+
+	buffer->push(make_safe<read_frame>());
+
+	BOOST_CHECK_EQUAL(buffer->first_frame(), -1);
+	BOOST_CHECK_EQUAL(buffer->last_frame(), -1);
+}
+
+BOOST_AUTO_TEST_CASE(consumers_register_their_buffer_while_they_record)
+{
+	auto registry = make_safe<replay_registry>();
+
+	{
+		auto consumer = create_replay_consumer(make_params(L"REPLAY BUDGET 16 FORMAT BGRA"), registry);
+		consumer->initialize(format_desc, channel_layout::stereo(), 3);
+
+		auto buffer = registry->find(3);
+		BOOST_REQUIRE(buffer);
+		BOOST_CHECK(!registry->find(1));
+
+		for(int64_t n = 20; n < 23; ++n)
+			BOOST_CHECK(consumer->send(frame(n)).get());
+
+		BOOST_CHECK_EQUAL(buffer->first_frame(), 20);
+		BOOST_CHECK_EQUAL(buffer->last_frame(), 22);
+		BOOST_CHECK_EQUAL(consumer->info().get<int64_t>(L"buffer.last-frame"), 22);
+	}
+
+	BOOST_CHECK(!registry->find(3));
+}
+
+BOOST_AUTO_TEST_CASE(registries_are_separate)
+{
+	auto registry	= make_safe<replay_registry>();
+	auto other		= make_safe<replay_registry>();
+
+	auto consumer = create_replay_consumer(make_params(L"REPLAY BUDGET 16"), registry);
+	consumer->initialize(format_desc, channel_layout::stereo(), 1);
+
+	BOOST_CHECK(registry->find(1));
+	BOOST_CHECK(!other->find(1));
+}
+
+BOOST_AUTO_TEST_CASE(other_commands_are_not_replay)
+{
+	auto registry	= make_safe<replay_registry>();
+	auto factory	= make_safe<no_image_frame_factory>(format_desc);
+
+	BOOST_CHECK(create_replay_consumer(make_params(L"SCREEN"), registry) == frame_consumer::empty());
+	BOOST_CHECK(create_replay_producer(factory, make_params(L"AMB"), registry) == frame_producer::empty());
+}
+
+BOOST_AUTO_TEST_CASE(producers_need_a_recording_channel)
+{
+	auto registry	= make_safe<replay_registry>();
+	auto factory	= make_safe<no_image_frame_factory>(format_desc);
+
+	BOOST_CHECK_THROW(create_replay_producer(factory, make_params(L"REPLAY 2"), registry), file_not_found);
+}
+
+BOOST_AUTO_TEST_CASE(producers_wait_for_the_first_frame_and_seek_by_frame_number)
+{
+	auto registry	= make_safe<replay_registry>();
+	auto factory	= make_safe<no_image_frame_factory>(format_desc);
+
+	auto consumer = create_replay_consumer(make_params(L"REPLAY BUDGET 16 FORMAT BGRA"), registry);
+	consumer->initialize(format_desc, channel_layout::stereo(), 2);
+
+	auto producer = create_replay_producer(factory, make_params(L"REPLAY 2"), registry);
+	BOOST_CHECK(producer->receive(frame_producer::NO_HINT) == basic_frame::late());
+
+	for(int64_t n = 1000; n < 1003; ++n)
+		consumer->send(frame(n)).get();
+
+	BOOST_CHECK(producer->call(L"FRAME 1001").get() == L"1001");
+	BOOST_CHECK_EQUAL(producer->info().get<int64_t>(L"first-frame"), 1000);
+	BOOST_CHECK_EQUAL(producer->info().get<int64_t>(L"last-frame"), 1002);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <protocol/amcp/scheduled_frame.h>
+
+#include <core/video_format.h>
+
+#include <common/exception/exceptions.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace caspar;
+using namespace caspar::protocol::amcp;
+
+namespace {
+
+const core::video_format_desc& format(core::video_format::type format)
+{
+	return core::video_format_desc::get(format);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(scheduled_frame_tests)
+
+BOOST_AUTO_TEST_CASE(frame_numbers_are_absolute)
+{
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"0",		format(core::video_format::x1080i5000), 100), 0);
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"4711",	format(core::video_format::x1080i5000), 100), 4711);
+}
+
+BOOST_AUTO_TEST_CASE(plus_is_relative_to_the_next_frame)
+{
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"+0",	format(core::video_format::x1080i5000), 100), 100);
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"+50",	format(core::video_format::x1080i5000), 100), 150);
+}
+
+BOOST_AUTO_TEST_CASE(time_codes_count_nominal_frames)
+{
+	// 1080i5000 ticks 25 frames a second.
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"00:00:01:00", format(core::video_format::x1080i5000), 0), 25);
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"01:02:03:04", format(core::video_format::x1080i5000), 0), ((1 * 60 + 2) * 60 + 3) * 25 + 4);
+
+	// Non drop frame, 59.94 counts 60 frames a second.
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"00:01:00:00", format(core::video_format::x1080p5994), 0), 60 * 60);
+	BOOST_CHECK_EQUAL(get_scheduled_frame(L"00:00:00:59", format(core::video_format::x1080p5994), 0), 59);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_values_throw)
+{
+	auto& format_desc = format(core::video_format::x1080i5000);
+
+	BOOST_CHECK_THROW(get_scheduled_frame(L"",				format_desc, 0), invalid_argument);
+	BOOST_CHECK_THROW(get_scheduled_frame(L"next",			format_desc, 0), invalid_argument);
+	BOOST_CHECK_THROW(get_scheduled_frame(L"+",				format_desc, 0), invalid_argument);
+	BOOST_CHECK_THROW(get_scheduled_frame(L"00:01:00",		format_desc, 0), invalid_argument);
+	BOOST_CHECK_THROW(get_scheduled_frame(L"00:60:00:00",	format_desc, 0), invalid_argument);
+	BOOST_CHECK_THROW(get_scheduled_frame(L"00:00:60:00",	format_desc, 0), invalid_argument);
+	BOOST_CHECK_THROW(get_scheduled_frame(L"00:00:00:25",	format_desc, 0), invalid_argument);
+	BOOST_CHECK_THROW(get_scheduled_frame(L"-1:00:00:00",	format_desc, 0), invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,361 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*
+* Author: Robert Nagy, ronag89@gmail.com
+*/
+
+#include <core/monitor/monitor.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/stage.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <tbb/atomic.h>
+
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+// Holds the ticket of every produced frame, so the next tick only starts
+// when the test releases it.
+class manual_ticker : public stage::target_t
+{
+	boost::mutex					mutex_;
+	boost::condition_variable		cond_;
+	int64_t							frames_;
+	std::shared_ptr<void>			ticket_;
+public:
+	manual_ticker()
+		: frames_(0)
+	{
+	}
+
+	virtual void send(const std::pair<stage_frames, std::shared_ptr<void>>& frames) override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		ticket_ = frames.second;
+		++frames_;
+		cond_.notify_all();
+	}
+
+	void wait_for(int64_t frames)
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		while(frames_ < frames)
+			cond_.wait(lock);
+	}
+
+	// Releases the held ticket and waits for the stage to produce the next frame.
+	void tick()
+	{
+		std::shared_ptr<void> ticket;
+		int64_t frames;
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			ticket.swap(ticket_);
+			frames = frames_;
+		}
+		ticket.reset();
+		wait_for(frames + 1);
+	}
+};
+
+// Records the stage frame in which it is first received.
+class probe_producer : public frame_producer
+{
+	monitor::subject		monitor_subject_;
+	const stage&			stage_;
+	tbb::atomic<int64_t>	first_frame_;
+public:
+	explicit probe_producer(const stage& stage)
+		: stage_(stage)
+	{
+		first_frame_ = -1;
+	}
+
+	virtual safe_ptr<basic_frame> receive(int) override
+	{
+		if(first_frame_ < 0)
+			first_frame_ = stage_.frame_number();
+		return make_safe<basic_frame>();
+	}
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return basic_frame::empty();
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"probe[]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::property_tree::wptree info;
+		info.add(L"type", L"probe-producer");
+		return info;
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return monitor_subject_;
+	}
+
+	int64_t first_frame() const
+	{
+		return first_frame_;
+	}
+};
+
+// Counts the frames it produces and how often its info is built.
+class info_producer : public frame_producer
+{
+	monitor::subject	monitor_subject_;
+	const bool			throws_;
+	tbb::atomic<int>	frames_;
+	mutable tbb::atomic<int> infos_;
+public:
+	explicit info_producer(bool throws = false)
+		: throws_(throws)
+	{
+		frames_ = 0;
+		infos_	= 0;
+	}
+
+	virtual safe_ptr<basic_frame> receive(int) override
+	{
+		++frames_;
+		return make_safe<basic_frame>();
+	}
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return basic_frame::empty();
+	}
+
+	virtual std::wstring print() const override
+	{
+		return L"info[]";
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		++infos_;
+		if(throws_)
+			throw std::runtime_error("info");
+
+		boost::property_tree::wptree info;
+		info.add(L"type", L"info-producer");
+		return info;
+	}
+
+	virtual monitor::subject& monitor_output() override
+	{
+		return monitor_subject_;
+	}
+
+	int frames() const
+	{
+		return frames_;
+	}
+
+	int infos() const
+	{
+		return infos_;
+	}
+};
+
+// A stage that has produced its first frame and waits for the next tick.
+struct ticked_stage
+{
+	safe_ptr<manual_ticker>	ticker;
+	safe_ptr<core::stage>	stage;
+
+	ticked_stage()
+		: ticker(make_safe<manual_ticker>())
+		, stage(make_safe<core::stage>(make_safe<diagnostics::graph>(), ticker, video_format_desc::get(video_format::x1080i5000), 1))
+	{
+		stage->spawn_token();
+		ticker->wait_for(1);
+	}
+
+	void tick(int frames = 1)
+	{
+		for(int n = 0; n < frames; ++n)
+			ticker->tick();
+	}
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(stage_schedule_tests)
+
+BOOST_FIXTURE_TEST_CASE(tasks_run_in_the_tick_of_their_frame, ticked_stage)
+{
+	auto& s	   = *stage;
+	auto next  = s.frame_number();
+
+	std::vector<int64_t> ran;
+	for(int64_t offset = 3; offset >= 0; --offset)
+		s.schedule(next + offset, [&ran, &s]{ ran.push_back(s.frame_number()); });
+
+	tick(5);
+
+	BOOST_REQUIRE_EQUAL(ran.size(), 4u);
+	for(int64_t n = 0; n < 4; ++n)
+		BOOST_CHECK_EQUAL(ran[n], next + n);
+}
+
+BOOST_FIXTURE_TEST_CASE(stage_calls_of_a_task_apply_to_its_frame, ticked_stage)
+{
+	auto& s		  = *stage;
+	auto target	  = s.frame_number() + 2;
+	auto producer = make_safe<probe_producer>(s);
+
+	s.schedule(target, [&s, producer]
+	{
+		s.load(10, producer);
+		s.play(10);
+	});
+
+	tick(4);
+
+	BOOST_CHECK_EQUAL(producer->first_frame(), target);
+}
+
+BOOST_FIXTURE_TEST_CASE(tasks_for_past_frames_run_on_the_next_tick, ticked_stage)
+{
+	tick(3);
+
+	auto& s	  = *stage;
+	auto next = s.frame_number();
+
+	int64_t ran = -1;
+	s.schedule(next - 2, [&ran, &s]{ ran = s.frame_number(); });
+
+	tick();
+
+	BOOST_CHECK_EQUAL(ran, next);
+}
+
+BOOST_FIXTURE_TEST_CASE(tasks_for_the_same_frame_run_in_scheduling_order, ticked_stage)
+{
+	auto& s	  = *stage;
+	auto next = s.frame_number();
+
+	std::vector<int> ran;
+	for(int n = 0; n < 8; ++n)
+		s.schedule(next + 1, [&ran, n]{ ran.push_back(n); });
+
+	tick(2);
+
+	BOOST_REQUIRE_EQUAL(ran.size(), 8u);
+	for(int n = 0; n < 8; ++n)
+		BOOST_CHECK_EQUAL(ran[n], n);
+}
+
+BOOST_FIXTURE_TEST_CASE(a_failing_task_does_not_stop_the_tick, ticked_stage)
+{
+	auto& s	  = *stage;
+	auto next = s.frame_number();
+
+	bool ran = false;
+	s.schedule(next, []{ throw std::runtime_error("scheduled task"); });
+	s.schedule(next, [&ran]{ ran = true; });
+
+	tick(2);
+
+	BOOST_CHECK(ran);
+	BOOST_CHECK_EQUAL(s.frame_number(), next + 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(a_format_change_restarts_the_frame_numbers, ticked_stage)
+{
+	tick(10);
+
+	auto& s = *stage;
+
+	// The same format keeps counting.
+	s.set_video_format_desc(video_format_desc::get(video_format::x1080i5000));
+	tick();
+	BOOST_CHECK_EQUAL(s.frame_number(), 12);
+
+	int64_t ran = -1;
+	s.schedule(s.frame_number() + 100, [&ran, &s]{ ran = s.frame_number(); });
+
+	s.set_video_format_desc(video_format_desc::get(video_format::x720p5000));
+	tick();
+
+	// The pending task ran in the first frame of the new format.
+	BOOST_CHECK_EQUAL(ran, 0);
+	BOOST_CHECK_EQUAL(s.frame_number(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(a_failing_layer_info_does_not_clear_the_layers, ticked_stage)
+{
+	auto& s		  = *stage;
+	auto producer = make_safe<info_producer>(true);
+
+	s.load(10, producer);
+	s.play(10);
+	tick();
+
+	for(int n = 0; n < 5; ++n)
+	{
+		s.info().get();
+		tick();
+	}
+
+	BOOST_CHECK_GT(producer->infos(), 0);
+	BOOST_CHECK_EQUAL(producer->frames(), 6);
+}
+
+BOOST_FIXTURE_TEST_CASE(layer_info_is_only_built_when_read, ticked_stage)
+{
+	auto& s		  = *stage;
+	auto producer = make_safe<info_producer>();
+
+	s.load(10, producer);
+	s.play(10);
+	tick(10);
+
+	BOOST_CHECK_EQUAL(producer->infos(), 0);
+	
+	// A stale snapshot is brought up to date before it is returned.
+	auto info = s.info().get();
+	BOOST_CHECK_EQUAL(info.get<int64_t>(L"frame-number"), s.frame_number());
+	BOOST_CHECK_EQUAL(info.get<std::wstring>(L"layers.layer.foreground.producer.type"), L"info-producer");
+
+	auto infos = producer->infos();
+	tick(10);
+	BOOST_CHECK_EQUAL(producer->infos(), infos + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()